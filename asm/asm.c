@@ -5,8 +5,18 @@
 #include <stdlib.h>
 #include <ctype.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
 #define MAX_LABEL 50
-#define MAX_LINE 500
+#define MAX_TOKENS 8
 #define CMD_MEM_LINES_SIZE 4096
 
 #define HEX_INSTRUCTION_LENGTH 12
@@ -15,6 +25,47 @@
 #define REG_LENGTH 1
 #define IMM_LENGTH 3
 
+#define IMM_MIN (-2048) //immediates are 12-bit signed
+#define IMM_MAX 2047
+
+/*Opcodes and registers the pseudo-instructions expand to*/
+#define OP_ADD 0
+#define OP_SUB 1
+#define OP_MAC 2
+#define OP_AND 3
+#define OP_OR 4
+#define OP_XOR 5
+#define OP_SLL 6
+#define OP_SRA 7
+#define OP_SRL 8
+#define OP_BEQ 9
+#define OP_BLE 13
+#define OP_BGE 14
+#define OP_JAL 15
+#define OP_LW 16
+#define OP_SW 17
+#define OP_OUT 20
+#define OP_VSETVL 22 //first opcode of the vector extension
+#define REG_ZERO 0
+#define REG_IMM1 1
+#define REG_IMM2 2
+#define REG_SP 14
+#define REG_RA 15
+
+/*Pseudo-instructions share the opcode table, above the 8-bit opcode range*/
+#define PSEUDO_FIRST 0x100
+enum { PSEUDO_LI = PSEUDO_FIRST, PSEUDO_MOV, PSEUDO_INC, PSEUDO_B, PSEUDO_CALL, PSEUDO_RET, PSEUDO_PUSH, PSEUDO_POP, PSEUDO_PIXEL };
+
+#define MONITOR_ADDR_IOR 20
+#define MONITOR_DATA_IOR 21
+#define MONITOR_CMD_IOR 22
+
+#define OPT_REMOVED -1 //opcode of a command the optimizer dropped
+#define SUM_TERMS 6
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define TABLE_MIN_CAPACITY 64
+
 
 typedef struct Command{
     int opcode;
@@ -24,642 +75,2338 @@ typedef struct Command{
     int rm;
     int immediate1;
     int immediate2;
-    int is_pseudo;
+    int is_pseudo; //part of the expansion of a pseudo-instruction
+    const char* label[2]; //label operand of each immediate (points into the source), NULL for numbers
+    int label_len[2];
+    int line; //source line, for error messages
 }Command;
 
-typedef struct Label{
-    char name[MAX_LABEL+1]; //we add +1 for the null terminator
-    int adress;
-    struct Label* next;
-}Label_Node;
+/*A slice of the source text, tokens are never copied*/
+typedef struct Token{
+    const char* text;
+    int len;
+}Token;
+
+/*One entry of an open-addressing hash table. Labels, opcodes and registers all use it*/
+typedef struct Symbol{
+    const char* name; //NULL marks an empty slot
+    int len;
+    unsigned int hash;
+    int value; //label address, opcode or register number
+    int defined; //0 for a label that was referenced but not defined yet
+    int fixups; //first pending fixup of an undefined label, -1 if none
+}Symbol;
+
+typedef struct Symbol_Table{
+    Symbol* slots;
+    int capacity; //always a power of two
+    int count;
+}Symbol_Table;
+
+/*Bump allocator for everything whose lifetime is the whole run*/
+typedef struct Arena_Block{
+    struct Arena_Block* next;
+    size_t used;
+    size_t size;
+    char* data;
+}Arena_Block;
+
+typedef struct Arena{
+    Arena_Block* head;
+}Arena;
+
+/*A .word directive*/
+typedef struct Data_Word{
+    int address;
+    int value;
+}Data_Word;
+
+/*An immediate field already written to the output that waits for its label*/
+typedef struct Fixup{
+    size_t offset; //position of the 3 hex digits in the instruction buffer
+    int line; //source line of the reference, for error messages
+    int next; //next fixup of the same label, -1 at the end of the chain
+}Fixup;
+
+/*Everything collected from the source before encoding*/
+typedef struct Program{
+    Arena arena;
+    Command* commands;
+    int command_count;
+    int command_capacity;
+    Data_Word* data;
+    int data_count;
+    int data_capacity;
+    Symbol_Table labels;
+    int address; //address of the next command
+    int single_pass; //encode every line as soon as it is parsed
+    char* imem; //single-pass instruction buffer
+    size_t imem_size;
+    size_t imem_capacity;
+    Fixup* fixups;
+    int fixup_count;
+    int fixup_capacity;
+    int quiet; //a chunk of a parallel run: errors are reported by the sequential rerun
+    Token* exports; //.global names, kept for object files
+    int export_count;
+    int export_capacity;
+}Program;
+
+/*An add or sub seen as signed register terms plus a constant*/
+typedef struct Sum{
+    int regs[SUM_TERMS];
+    int signs[SUM_TERMS];
+    int count;
+    int constant;
+}Sum;
+
+/*What the optimizer changed*/
+typedef struct Opt_Stats{
+    int before;
+    int after;
+    int dead; //commands removed: no effect, or a result overwritten before it is read
+    int merged; //pairs of adds merged into one three-source add
+    int folded; //pairs of constant operations folded into one load
+    int threaded; //branches retargeted past a jump
+}Opt_Stats;
+
+/*A slice of the source assembled by one thread*/
+typedef struct Chunk{
+    Program program;
+    const char* source;
+    size_t size;
+    int base; //address of the first command of the chunk
+    Symbol_Table* labels; //labels of the whole source, for the second pass
+    char* imem; //shared instruction buffer
+    int ok;
+}Chunk;
+
+typedef void (*Chunk_Function)(Chunk* chunk);
+
+/*Start arguments of one worker thread*/
+typedef struct Worker{
+    Chunk_Function function;
+    Chunk* chunk;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+}Worker;
+
+
+static const char* opcode_names[] = { "add", "sub", "mac", "and", "or", "xor", "sll", "sra", "srl", "beq", "bne", "blt", "bgt",
+    "ble", "bge", "jal", "lw", "sw", "reti", "in", "out", "halt", "vsetvl", "vlw", "vsw", "vadd", "vsub", "vmac", "vsplat", "vredsum" };
+/*Operand kinds of the vector opcodes, rd rs rt rm: S = scalar register, V = vector register*/
+static const char* vector_operands[] = { "SSSS", "VSSS", "VSSS", "VVVV", "VVVV", "VVVV", "VSSS", "SVSS" };
+static const char* register_names[] = { "$zero", "$imm1", "$imm2", "$v0", "$a0", "$a1", "$a2", "$t0", "$t1", "$t2", "$s0", "$s1",
+    "$s2", "$gp", "$sp", "$ra" };
+static const char* vector_register_names[] = { "$vr0", "$vr1", "$vr2", "$vr3", "$vr4", "$vr5", "$vr6", "$vr7" };
+static const char* pseudo_names[] = { "li", "mov", "inc", "b", "call", "ret", "push", "pop", "pixel" };
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static Symbol_Table opcode_table;
+static Symbol_Table register_table;
+static Symbol_Table vector_register_table;
+
+
+/*Allocate size bytes from the arena, aborting if the system is out of memory*/
+void* arena_alloc(Arena* arena, size_t size)
+{
+    size = (size + 15) & ~(size_t)15; //keep every allocation 16-byte aligned
+    Arena_Block* block = arena->head;
+    if (block == NULL || block->used + size > block->size)
+    {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (Arena_Block*)malloc(sizeof(Arena_Block));
+        if (block == NULL || (block->data = (char*)malloc(block_size)) == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->head;
+        arena->head = block;
+    }
+    void* result = block->data + block->used;
+    block->used += size;
+    return result;
+}
 
 
-/*Add label to the chain*/
-Label_Node* add_label(char* name, int address){
-    Label_Node* L = (Label_Node*)malloc(sizeof(Label_Node));
-    memset(L->name, '\0', (MAX_LABEL+1)*sizeof(char)); //initialize the name argument to null chars for easy handling
-    strcpy(L->name, name);
-    L->name[strlen(L->name)-1] = '\0'; //removing the ':' char at the end
-    L->adress = address;
-    L->next = NULL;
-    return L;
+/*Release every block of the arena*/
+void arena_free(Arena* arena)
+{
+    while (arena->head != NULL)
+    {
+        Arena_Block* next = arena->head->next;
+        free(arena->head->data);
+        free(arena->head);
+        arena->head = next;
+    }
 }
 
 
-/*Search label node in the chain*/
-Label_Node* find_label(Label_Node* head, char* name){
-    Label_Node* found_label = head;
-    while (found_label != NULL)
+/*FNV-1a hash of a name*/
+unsigned int hash_name(const char* name, int len)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++)
     {
-        if (strcmp(found_label->name, name)==0)
-        {
-            return found_label;
-        }
-        found_label = found_label->next;
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
     }
-    
+    return hash;
 }
 
 
-/*Recieves a string line and checks if it is a label*/
-int is_label(char* str)
+/*Create an empty table with room for at least expected entries*/
+void table_init(Symbol_Table* table, int expected)
 {
-    int len = strlen(str);
-
-    //Removing any trailing spaces after the ':' character
-	for (int i = 0; i < strlen(str); i++)
+    int capacity = TABLE_MIN_CAPACITY;
+    while (capacity < expected * 2)
     {
-        if (str[i-1] == ':') //if we found the end of the label name and are now after the ':' char
-        {
-            for (int j = i; j < strlen(str); j++)
-            {
-                if (str[j] != '\n')
-                {
-                    str[j] = '\0'; //remove everything after it
-                }
-            }  
-        }
+        capacity *= 2;
     }
-
-    len = strlen(str); //updating to the new length
-    if (len<=MAX_LABEL+1 && isalpha(str[0]) && str[len-1] == ':')
+    table->slots = (Symbol*)calloc(capacity, sizeof(Symbol));
+    if (table->slots == NULL)
     {
-        return 1;
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
     }
-    return 0;
+    table->capacity = capacity;
+    table->count = 0;
 }
 
 
-/*Remove comments from line*/
-void remove_comments(char* line) {
-	for (int i = 0; i < strlen(line); i++)
+/*Find the slot of a name: either the matching entry or the empty slot where it belongs*/
+Symbol* table_slot(Symbol_Table* table, const char* name, int len, unsigned int hash)
+{
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = hash & mask;
+    while (table->slots[i].name != NULL)
     {
-        if (line[i] == '#') //if we found the begginning of the comment
+        Symbol* slot = &table->slots[i];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->name, name, len) == 0)
         {
-            for (int j = i; j < strlen(line); j++)
-            {
-                line[j] = '\0'; //remove everything after it
-            }  
+            return slot;
         }
+        i = (i + 1) & mask; //linear probing
     }
+    return &table->slots[i];
 }
 
-/*Function to recieve a line and return a copy of it without spaces and tabs*/
-char* remove_spaces(char* line) {
-	char new_line[MAX_LINE] = { 0 };
-	char* new_line_p = new_line;
-    remove_comments(new_line_p);
-	char* head_new_line = new_line;
-	while (*line != '\0') //iterate until we reach the comment or the end of the line
-	{
-		if (((*line != ' ') && (*line != '\t'))) //if the current char isnt a space
+
+/*Double the capacity of the table*/
+void table_grow(Symbol_Table* table)
+{
+    Symbol* old_slots = table->slots;
+    int old_capacity = table->capacity;
+    table_init(table, old_capacity);
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i].name != NULL)
         {
-			*new_line_p = *line; //copy the char to the new line
-			new_line_p++; //advance the new line char pointer
-		}
-		line++;
-	}
-	*new_line_p = '\0'; //end the line with null terminator
-	return head_new_line;
+            *table_slot(table, old_slots[i].name, old_slots[i].len, old_slots[i].hash) = old_slots[i];
+            table->count++;
+        }
+    }
+    free(old_slots);
 }
 
 
-/*Function to reset an array*/
-void reset_array(char* str)
+/*Insert a name, returns 0 if it is already in the table*/
+int table_insert(Symbol_Table* table, const char* name, int len, int value)
 {
-    memset(str, '\0', strlen(str) * sizeof(char));
+    if ((table->count + 1) * 10 > table->capacity * 7) //keep the load factor under 70%
+    {
+        table_grow(table);
+    }
+    unsigned int hash = hash_name(name, len);
+    Symbol* slot = table_slot(table, name, len, hash);
+    if (slot->name != NULL)
+    {
+        return 0;
+    }
+    slot->name = name;
+    slot->len = len;
+    slot->hash = hash;
+    slot->value = value;
+    slot->defined = 1;
+    slot->fixups = -1;
+    table->count++;
+    return 1;
 }
 
 
-/*Function that recieves a SIMP string of a register and returns it's int value*/
-int find_opcode(char* op_str)
+/*Look up a name and add it as an undefined label if it is missing*/
+Symbol* table_find_or_add(Symbol_Table* table, const char* name, int len)
 {
-    int opcode;
-
-    if (strcmp(op_str, "add") == 0) opcode = 0;
-    else if (strcmp(op_str, "sub") == 0) opcode = 1;
-    else if (strcmp(op_str, "mac") == 0) opcode = 2;
-    else if (strcmp(op_str, "and") == 0) opcode = 3;
-    else if (strcmp(op_str, "or") == 0) opcode = 4;
-    else if (strcmp(op_str, "xor") == 0) opcode = 5;
-    else if (strcmp(op_str, "sll") == 0) opcode = 6;
-    else if (strcmp(op_str, "sra") == 0) opcode = 7;
-    else if (strcmp(op_str, "srl") == 0) opcode = 8;
-    else if (strcmp(op_str, "beq") == 0) opcode = 9;
-    else if (strcmp(op_str, "bne") == 0) opcode = 10;
-    else if (strcmp(op_str, "blt") == 0) opcode = 11;
-    else if (strcmp(op_str, "bgt") == 0) opcode = 12;
-    else if (strcmp(op_str, "ble") == 0) opcode = 13;
-    else if (strcmp(op_str, "bge") == 0) opcode = 14;
-    else if (strcmp(op_str, "jal") == 0) opcode = 15;
-    else if (strcmp(op_str, "lw") == 0) opcode = 16;
-    else if (strcmp(op_str, "sw") == 0) opcode = 17;
-    else if (strcmp(op_str, "reti") == 0) opcode = 18;
-    else if (strcmp(op_str, "in") == 0) opcode = 19;
-    else if (strcmp(op_str, "out") == 0) opcode = 20;
-    else if (strcmp(op_str, "halt") == 0) opcode = 21;
-    else opcode = -1; // If no match is found, return -1 (or some error value)
-
-    return opcode;
+    if ((table->count + 1) * 10 > table->capacity * 7)
+    {
+        table_grow(table);
+    }
+    unsigned int hash = hash_name(name, len);
+    Symbol* slot = table_slot(table, name, len, hash);
+    if (slot->name == NULL)
+    {
+        slot->name = name;
+        slot->len = len;
+        slot->hash = hash;
+        slot->value = -1;
+        slot->defined = 0;
+        slot->fixups = -1;
+        table->count++;
+    }
+    return slot;
 }
 
 
-/*Function that recieves a SIMP string of a register and returns it's int value*/
-int find_register(char* reg_str)
+/*Look up a name, returns NULL if it is not in the table*/
+Symbol* table_find(Symbol_Table* table, const char* name, int len)
 {
-    int reg;
-
-    if (strcmp(reg_str, "$zero") == 0) reg = 0;
-    else if (strcmp(reg_str, "$imm1") == 0) reg = 1;
-    else if (strcmp(reg_str, "$imm2") == 0) reg = 2;
-    else if (strcmp(reg_str, "$v0") == 0) reg = 3;
-    else if (strcmp(reg_str, "$a0") == 0) reg = 4;
-    else if (strcmp(reg_str, "$a1") == 0) reg = 5;
-    else if (strcmp(reg_str, "$a2") == 0) reg = 6;
-    else if (strcmp(reg_str, "$t0") == 0) reg = 7;
-    else if (strcmp(reg_str, "$t1") == 0) reg = 8;
-    else if (strcmp(reg_str, "$t2") == 0) reg = 9;
-    else if (strcmp(reg_str, "$s0") == 0) reg = 10;
-    else if (strcmp(reg_str, "$s1") == 0) reg = 11;
-    else if (strcmp(reg_str, "$s2") == 0) reg = 12;
-    else if (strcmp(reg_str, "$gp") == 0) reg = 13;
-    else if (strcmp(reg_str, "$sp") == 0) reg = 14;
-    else if (strcmp(reg_str, "$ra") == 0) reg = 15;
-    else reg = -1; // Return -1 or any error code if no match is found
-
-    return reg;
+    Symbol* slot = table_slot(table, name, len, hash_name(name, len));
+    return slot->name != NULL ? slot : NULL;
 }
 
 
-/*Function that recieves a SIMP string of the immediate field and tells if it's a decimal number, hexadecimal number, or a label*/
-int find_immediate_type(char* imm_str)
+/*Fill the opcode and register tables once*/
+void init_keyword_tables()
 {
-    int imm_type;
-
-    //checking if imm_str is in hexadecimal representation
-    if (imm_str[0] == '0' && imm_str[1] == 'x')
+    table_init(&opcode_table, sizeof(opcode_names) / sizeof(opcode_names[0]) + sizeof(pseudo_names) / sizeof(pseudo_names[0]));
+    for (int i = 0; i < (int)(sizeof(opcode_names) / sizeof(opcode_names[0])); i++)
     {
-        imm_type = 16;
+        table_insert(&opcode_table, opcode_names[i], (int)strlen(opcode_names[i]), i);
     }
-    else if ((imm_str[0]>=65 && imm_str[0]<=90) || (imm_str[0]>=97 && imm_str[0]<=122)) //if imm_str starts with a letter then it's a label
+    for (int i = 0; i < (int)(sizeof(pseudo_names) / sizeof(pseudo_names[0])); i++)
     {
-        imm_type = -1;
+        table_insert(&opcode_table, pseudo_names[i], (int)strlen(pseudo_names[i]), PSEUDO_FIRST + i);
     }
-    else
+    table_init(&register_table, sizeof(register_names) / sizeof(register_names[0]));
+    for (int i = 0; i < (int)(sizeof(register_names) / sizeof(register_names[0])); i++)
+    {
+        table_insert(&register_table, register_names[i], (int)strlen(register_names[i]), i);
+    }
+    table_init(&vector_register_table, sizeof(vector_register_names) / sizeof(vector_register_names[0]));
+    for (int i = 0; i < (int)(sizeof(vector_register_names) / sizeof(vector_register_names[0])); i++)
     {
-        imm_type = 10; //if the 2 other tests failed then it's in decimal representation
+        table_insert(&vector_register_table, vector_register_names[i], (int)strlen(vector_register_names[i]), i);
     }
+}
+
 
-    return imm_type;
+/*Function that recieves a SIMP opcode token and returns it's int value, -1 if unknown. Pseudo-instructions return PSEUDO_FIRST and up*/
+int find_opcode(Token* token)
+{
+    Symbol* symbol = table_find(&opcode_table, token->text, token->len);
+    return symbol != NULL ? symbol->value : -1;
 }
 
 
-/*Function that recieves a string of the immediate field and it's base representation(10, 16, or label) and returns it's int value*/
-int* string_to_int(char *str, int base, Label_Node* head) {
-    int result = 0;
-    int* res_ptr;
-    int digit_value;
-    int sign = 1;
-    
-    //Loop through each character of the string
-    int i = 0;
-    
-    //handling a label and returning it's address
-    if (base == -1)
+/*Function that recieves a SIMP register token and returns it's int value, -1 if unknown*/
+int find_register(Token* token)
+{
+    Symbol* symbol = table_find(&register_table, token->text, token->len);
+    return symbol != NULL ? symbol->value : -1;
+}
+
+
+/*Function that recieves a vector register token ($vr0-$vr7) and returns it's number, -1 if unknown*/
+int find_vector_register(Token* token)
+{
+    Symbol* symbol = table_find(&vector_register_table, token->text, token->len);
+    return symbol != NULL ? symbol->value : -1;
+}
+
+
+/*Split one line into tokens in a single pass, stopping at a comment. Returns the number of tokens*/
+int tokenize_line(const char* line, const char* end, Token tokens[MAX_TOKENS])
+{
+    int count = 0;
+    const char* p = line;
+    while (p < end && *p != '#')
     {
-        Label_Node* label = find_label(head, str);
-        if (label != NULL)
+        char c = *p;
+        if (c == ' ' || c == '\t' || c == ',' || c == '\r')
         {
-            return &label->adress;
+            p++;
+            continue;
         }
-        else
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != ',' && *p != '\r' && *p != '#')
+        {
+            p++;
+        }
+        if (count == MAX_TOKENS)
         {
-            return NULL;
+            return MAX_TOKENS + 1; //too many operands
         }
+        tokens[count].text = start;
+        tokens[count].len = (int)(p - start);
+        count++;
     }
-    
+    return count;
+}
+
+
+/*Checks if a token is a valid label name*/
+int is_label_name(const char* name, int len)
+{
+    return len > 0 && len <= MAX_LABEL && isalpha((unsigned char)name[0]);
+}
+
+
+/*Parse a decimal or "0x" hexadecimal number, returns 0 if the token is not a number*/
+int parse_number(Token* token, int* value)
+{
+    const char* p = token->text;
+    const char* end = token->text + token->len;
+    int sign = 1;
+    unsigned int result = 0;
+    int base = 10;
 
-    //if the string is hexadecimal then we will skip the "0x" initial two chars.
-    if (base == 16)
+    if (p < end && (*p == '-' || *p == '+'))
     {
-        i = 2;
+        sign = *p == '-' ? -1 : 1;
+        p++;
     }
-    
-    char current;
-    while (str[i] != '\0')
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
     {
-        current = str[i];
-
-        //check if negative decimal
-        if (i == 0 && current == '-')
-        {
-            sign = -1;
-            i++;
-            continue; //continue to next char
-        }
-        
-        //Convert the character to uppercase to handle both cases uniformly (relevant only if the base is hexadecimal)
-        current = toupper(current);
-
-        //Convert the character to its corresponding integer value
-        if (isdigit(current))
-        {
-            digit_value = current - '0';  // For '0' to '9'
-        }
-        else if (isalpha(current))
-        {
-            digit_value = current - 'A' + 10;  // For 'A' to 'F'
-        }
-        else
+        base = 16;
+        p += 2;
+    }
+    if (p == end)
+    {
+        return 0;
+    }
+    for (; p < end; p++)
+    {
+        int digit;
+        char c = (char)toupper((unsigned char)*p);
+        if (isdigit((unsigned char)c)) digit = c - '0';
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return 0;
+        if (digit >= base)
         {
-            //Invalid character for the given base
-            return NULL;
+            return 0;
         }
+        result = result * base + digit;
+    }
+    *value = (int)(result * sign);
+    return 1;
+}
 
-        //Check if the digit value is valid in the specified base
-        if (digit_value >= base) {
-            return NULL;  // Invalid digit for the base
-        }
 
-        //Accumulate the result, multiplying by the base for each digit
-        result = result*base + digit_value;
-        i++;
+/*Parse an immediate operand: a number, or a label that is resolved when encoding*/
+int parse_immediate(Token* token, Command* cmd, int index)
+{
+    if (isalpha((unsigned char)token->text[0])) //if the immediate starts with a letter then it's a label
+    {
+        cmd->label[index] = token->text;
+        cmd->label_len[index] = token->len;
+        return 1;
     }
-    result = result * sign;
-    res_ptr = &result;
-    return res_ptr;
+    return parse_number(token, index == 0 ? &cmd->immediate1 : &cmd->immediate2);
 }
 
 
-/*Recieve an int and create string of it's hex representation*/
-char* int_to_hex(int num) {
-    // Allocate memory for the string that will hold the hexadecimal value.
-    // We use 4 characters: 3 hexadecimal digits + null-terminator
-    char* hexStr = (char*)malloc(4 * sizeof(char));
-
-    if (hexStr == NULL) {
-        // Memory allocation failed
-        return NULL;
+/*Append an empty command to the program*/
+Command* new_command(Program* program, int line)
+{
+    if (program->command_count == program->command_capacity)
+    {
+        int capacity = program->command_capacity ? program->command_capacity * 2 : 1024;
+        Command* commands = (Command*)arena_alloc(&program->arena, capacity * sizeof(Command));
+        memcpy(commands, program->commands, program->command_count * sizeof(Command));
+        program->commands = commands;
+        program->command_capacity = capacity;
     }
+    Command* cmd = &program->commands[program->command_count++];
+    memset(cmd, 0, sizeof(Command));
+    cmd->line = line;
+    program->address++;
+    return cmd;
+}
 
-    // Convert integer to hexadecimal string
-    snprintf(hexStr, 4, "%X", num & 0xFFF);
 
-    return hexStr;
+/*Append a .word directive to the program*/
+void add_data_word(Program* program, int address, int value)
+{
+    if (program->data_count == program->data_capacity)
+    {
+        int capacity = program->data_capacity ? program->data_capacity * 2 : 256;
+        Data_Word* data = (Data_Word*)arena_alloc(&program->arena, capacity * sizeof(Data_Word));
+        memcpy(data, program->data, program->data_count * sizeof(Data_Word));
+        program->data = data;
+        program->data_capacity = capacity;
+    }
+    program->data[program->data_count].address = address;
+    program->data[program->data_count].value = value;
+    program->data_count++;
 }
 
 
-/*Concatenate the hex representation of an argument to the final hex command string*/
-void concat_hex_str(char* hexStr, int parameter, int parameter_bit_len)
+/*Append a .global name to the program*/
+void add_export(Program* program, Token* name)
 {
-    char* parameter_hex_str = int_to_hex(parameter); //get hex representation of the argument
-    int string_len = strlen(parameter_hex_str); //length of the hex representation
-    int hexStr_end = strlen(hexStr); //where we finished writing the previous argument
-    int i = hexStr_end;
-
-    while (i < hexStr_end + (parameter_bit_len - string_len))
+    if (program->export_count == program->export_capacity)
     {
-        hexStr[i] = '0'; //pad with zeros the unnecessary bits in the final hex string
-        i++;
+        int capacity = program->export_capacity ? program->export_capacity * 2 : 64;
+        Token* exports = (Token*)arena_alloc(&program->arena, capacity * sizeof(Token));
+        memcpy(exports, program->exports, program->export_count * sizeof(Token));
+        program->exports = exports;
+        program->export_capacity = capacity;
     }
-    
-    strcat(hexStr, parameter_hex_str);
-    free(parameter_hex_str);
+    program->exports[program->export_count++] = *name;
 }
 
 
-/*Recieve a command struct and return a hex string that represents the command*/
-char* cmd_to_hex_line(Command* cmd)
+/*Recieve the tokens of a command line in SIMP format and fill a command struct*/
+int buildCommand(Token* tokens, int count, Command* cmd)
 {
-    // Allocate memory for the string that will hold the hexadecimal value.
-    // We use 9 characters: "0x" + 8 hexadecimal digits + null-terminator
-    char* hexStr = (char*)malloc((HEX_INSTRUCTION_LENGTH+2)* sizeof(char));
-    memset(hexStr, '\0', (HEX_INSTRUCTION_LENGTH+2)* sizeof(char));
+    if (count != 7)
+    {
+        return 0;
+    }
 
-    if (hexStr == NULL) {
-        return NULL;
+    //discovering the opcode
+    cmd->opcode = find_opcode(&tokens[0]);
+    if (cmd->opcode == -1 || cmd->opcode >= PSEUDO_FIRST)
+    {
+        return 0;
     }
-    reset_array(hexStr);
-    
-    //opcode
-    concat_hex_str(hexStr, cmd->opcode, OP_LENGTH);
 
-    //rd
-    concat_hex_str(hexStr, cmd->rd, REG_LENGTH);
+    //discovering the registers, using an array to loop the operation 4 times. Vector opcodes mix in vector registers
+    int* reg_arr[4] = { &cmd->rd, &cmd->rs, &cmd->rt, &cmd->rm };
+    const char* kinds = cmd->opcode >= OP_VSETVL ? vector_operands[cmd->opcode - OP_VSETVL] : "SSSS";
+    for (int i = 0; i < 4; i++)
+    {
+        *reg_arr[i] = kinds[i] == 'V' ? find_vector_register(&tokens[1 + i]) : find_register(&tokens[1 + i]);
+        if (*reg_arr[i] == -1)
+        {
+            return 0;
+        }
+    }
 
-    //rs
-    concat_hex_str(hexStr, cmd->rs, REG_LENGTH);
+    //discovering the immediates
+    return parse_immediate(&tokens[5], cmd, 0) && parse_immediate(&tokens[6], cmd, 1);
+}
 
-    //rt
-    concat_hex_str(hexStr, cmd->rt, REG_LENGTH);
 
-    //rm
-    concat_hex_str(hexStr, cmd->rm, REG_LENGTH);
+/*Append a command built from its fields, as part of a pseudo-instruction*/
+Command* add_command(Program* program, int line, int opcode, int rd, int rs, int rt, int rm, int immediate1, int immediate2)
+{
+    Command* cmd = new_command(program, line);
+    cmd->opcode = opcode;
+    cmd->rd = rd;
+    cmd->rs = rs;
+    cmd->rt = rt;
+    cmd->rm = rm;
+    cmd->immediate1 = immediate1;
+    cmd->immediate2 = immediate2;
+    cmd->is_pseudo = 1;
+    return cmd;
+}
 
-    //immediates
-    concat_hex_str(hexStr, cmd->immediate1, IMM_LENGTH);
-    concat_hex_str(hexStr, cmd->immediate2, IMM_LENGTH);
 
-    return hexStr;
+/*Checks if a value fits a 12-bit signed immediate*/
+int fits_immediate(int value)
+{
+    return value >= IMM_MIN && value <= IMM_MAX;
 }
 
 
-/*Handling a pseudo instruction*/
-void** get_pseudo_instruction(char* raw_command_line)
+/*Find one command "op rd, $imm1, $imm2, $zero, a, b" that computes value: add, sll, mac or srl of the two
+  immediates. Returns 0 if there is none*/
+int load_in_one(int value, int* opcode, int* a, int* b)
 {
-    char* adjusted_line = raw_command_line;
-    remove_comments(adjusted_line); //removing the comments from the command
-
-    void** address_and_value = (void**)malloc(2*sizeof(void*));
-    if (!address_and_value)
-    {
-        printf("Memory allocation failed");
-        return NULL;
-    }
-    
-    address_and_value[0] = (int*)malloc(sizeof(int)); //address will be in index 0
-    if (!address_and_value[0])
-    {
-        free(address_and_value);
-        printf("Memory allocation failed");
-        return NULL;
-    }
+    unsigned int u = (unsigned int)value;
 
-    address_and_value[1] = (char*)malloc((HEX_DATA_LENGTH+2)* sizeof(char)); //value will be in index 0
-    if (!address_and_value[1])
+    //a + b, both 12-bit
+    if (value >= 2 * IMM_MIN && value <= 2 * IMM_MAX)
     {
-        free(address_and_value[0]);
-        free(address_and_value);
-        printf("Memory allocation failed");
-        return NULL;
+        *opcode = OP_ADD;
+        *a = value < 0 ? (value < IMM_MIN ? IMM_MIN : value) : (value > IMM_MAX ? IMM_MAX : value);
+        *b = value - *a;
+        return 1;
     }
-    memset(address_and_value[1],'\0',(HEX_DATA_LENGTH+1)* sizeof(char));
-    
-    int base;
 
-    char delim[] = " ,\t";
-    char* token = strtok(adjusted_line, delim); //The first token will be the ".word"
-
-    token = strtok(NULL, delim); //second token is address
-    base = find_immediate_type(token);
-    *(int*)address_and_value[0] = *string_to_int(token, base, NULL);
-    
-    token = strtok(NULL, delim); //third token is value
-    base = find_immediate_type(token);
-    if (base == 16) //if the value is already in hex representation
-    {
-        strcpy(address_and_value[1], token+2); //+2 to ignore the "0x"
-    }
-    else
+    //a << b, shifting out the trailing zeros
+    int zeros = 0;
+    while (zeros < 31 && ((u >> zeros) & 1) == 0)
     {
-        concat_hex_str(address_and_value[1], *string_to_int(token, base, NULL), HEX_DATA_LENGTH);
+        zeros++;
     }
-    if (*(int*)address_and_value[0] != 4095)
+    if (fits_immediate(value >> zeros))
     {
-        strcat((char*)address_and_value[1], "\n");
+        *opcode = OP_SLL;
+        *a = value >> zeros;
+        *b = zeros;
+        return 1;
     }
-    
-    token = strtok(NULL, delim); //fourth token is NULL
-
-    return address_and_value;
-}
-
 
-/*Initialize dmem_arr to zeros*/
-void dmem_initialize(char dmem_arr[][10]) {
-    for (int i = 0; i < CMD_MEM_LINES_SIZE; i++) {
-        strcpy(dmem_arr[i], "00000000");
-        if (i != CMD_MEM_LINES_SIZE - 1) {
-            strcat(dmem_arr[i], "\n");
+    //(unsigned)a >> b, masks like 0x7FFFFFFF from a negative a
+    for (int shift = 1; shift < 32; shift++)
+    {
+        int shifted = (int)(u << shift);
+        if ((unsigned int)shifted >> shift == u && fits_immediate(shifted))
+        {
+            *opcode = OP_SRL;
+            *a = shifted;
+            *b = shift;
+            return 1;
         }
     }
-}
-
-/*Function to print the entire 2D array to a file*/
-void print_2D_array_to_file(char array[][10], FILE* file, int last_line) {
-    if (array == NULL) {
-        printf("Array is NULL, nothing to print\n");
-        return;
-    }
 
-    //Loop through all lines and write to the file
-    for (int i = 0; i < last_line+1; i++) {
-		if (i != last_line)
-		{
-			fprintf(file, "%s", &array[i]);
-		}
-		else
-		{
-			int j = 0;
-			while (array[i][j] != '\n')
-			{
-				fprintf(file, "%c", array[i][j]);
-				j++;
-			}
-		}
+    //a * b, with a large enough for b to fit
+    long long magnitude = value < 0 ? -(long long)value : value;
+    for (int factor = magnitude / -IMM_MIN > 2 ? (int)(magnitude / -IMM_MIN) : 2; factor <= IMM_MAX; factor++)
+    {
+        if (value % factor == 0 && fits_immediate(value / factor))
+        {
+            *opcode = OP_MAC;
+            *a = factor;
+            *b = value / factor;
+            return 1;
+        }
     }
-
-    fclose(file);
+    return 0;
 }
 
 
-/*Recieve a string of a command line in SIMP format and all the labels, and return a command struct*/
-Command* buildCommand(char* raw_command_line, Label_Node* labels_head)
+/*li rd, value: load a 32-bit constant or a label in the fewest commands. A value of one command is
+  built from both immediates, two commands extend one of them by a shift or an add, and any other value
+  takes three: value >> 10 in two commands, then rd * 1024 + the low 10 bits*/
+void expand_load(Program* program, int line, int rd, int value)
 {
-    char* adjusted_line = raw_command_line;
-    remove_comments(adjusted_line); //removing the comments from the command
+    int opcode, a, b;
 
-    Command* cmd = (Command*)malloc(sizeof(Command)); //intialization
-
-    char delim[] = " ,\t";
-    char* token = strtok(adjusted_line, delim); //The first token will be the opcode connected to the first register without spaces
+    if (load_in_one(value, &opcode, &a, &b))
+    {
+        add_command(program, line, opcode, rd, REG_IMM1, REG_IMM2, REG_ZERO, a, b);
+        return;
+    }
 
-    //discovering the opcode
-    int opcode;
-    opcode = find_opcode(token);
-    if (opcode == -1)
+    //(one command value) << shift
+    int zeros = 0;
+    while (((unsigned int)value >> zeros & 1) == 0)
     {
-        return NULL;
+        zeros++;
     }
-    
-    //discovering the registers, using an array to loop the operation 4 times
-    int reg_arr[4] = {0};
-    for (int i = 0; i < sizeof(reg_arr)/4; i++)
+    if (zeros > 0 && load_in_one(value >> zeros, &opcode, &a, &b))
     {
-        token = strtok(NULL, delim);
-        reg_arr[i] = find_register(token);
-        if (reg_arr[i] == -1) {
-            return NULL;
-        }
+        add_command(program, line, opcode, rd, REG_IMM1, REG_IMM2, REG_ZERO, a, b);
+        add_command(program, line, OP_SLL, rd, rd, REG_IMM1, REG_ZERO, zeros, 0);
+        return;
     }
-    
-    //discovering the immediates, using an array to loop the operation 2 times
-    int imm_arr[2] = {0};
-    for (int i = 0; i < sizeof(imm_arr)/4; i++)
+
+    //(one command value) + c + d, the nearest multiple of a power of two
+    for (int shift = 1; shift < 32; shift++)
     {
-        token = strtok(NULL, delim); //Next token is immediate1
-        int* imm_ptr =  string_to_int(token, find_immediate_type(token), labels_head);
-        if (imm_ptr != NULL)
+        int base = (int)((unsigned int)((value >> shift) + ((value >> (shift - 1)) & 1)) << shift);
+        int rest = (int)((unsigned int)value - (unsigned int)base);
+        if (rest >= 2 * IMM_MIN && rest <= 2 * IMM_MAX && load_in_one(base, &opcode, &a, &b))
         {
-            imm_arr[i] = *imm_ptr;
+            int c = rest < 0 ? (rest < IMM_MIN ? IMM_MIN : rest) : (rest > IMM_MAX ? IMM_MAX : rest);
+            add_command(program, line, opcode, rd, REG_IMM1, REG_IMM2, REG_ZERO, a, b);
+            add_command(program, line, OP_ADD, rd, rd, REG_IMM1, REG_IMM2, c, rest - c);
+            return;
         }
-        else return NULL;
     }
 
+    //((high << 12) + middle) * 1024 + low
+    int upper = value >> 10;
+    int low = value & 0x3FF;
+    int high = (upper + 2048) >> 12;
+    int middle = upper - high * 4096;
+    add_command(program, line, OP_SLL, rd, REG_IMM1, REG_IMM2, REG_ZERO, high, 12);
+    add_command(program, line, OP_ADD, rd, rd, REG_IMM1, REG_ZERO, middle, 0);
+    add_command(program, line, OP_MAC, rd, rd, REG_IMM1, REG_IMM2, 1024, low);
+}
 
-    token = strtok(NULL, delim); //Next token is NULL
-    
-    //constructing the struct
-    cmd->opcode = opcode;
-    cmd->rd = reg_arr[0];
-    cmd->rs = reg_arr[1];
-    cmd->rt = reg_arr[2];
-    cmd->rm = reg_arr[3];
-    cmd->immediate1 = imm_arr[0];
-    cmd->immediate2 = imm_arr[1];
 
-    return cmd;
+/*A register the program can write: not $zero, $imm1 or $imm2*/
+int find_target_register(Token* token)
+{
+    int reg = find_register(token);
+    return reg > REG_IMM2 ? reg : -1;
 }
 
-int main(int argc, char* argv[]){
 
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <input.asm> <output.imemin> <output.dmemin>\n", argv[0]);
-        return 1;
+/*An operand that is either a register or an immediate. Immediates are placed in the immediate field
+  index of cmd and the matching $imm register is returned*/
+int pseudo_operand(Token* token, Command* cmd, int index)
+{
+    int reg = find_register(token);
+    if (reg != -1)
+    {
+        return reg;
+    }
+    if (!parse_immediate(token, cmd, index))
+    {
+        return -1;
     }
-    
+    return index == 0 ? REG_IMM1 : REG_IMM2;
+}
+
 
-    FILE* program_ptr = fopen(argv[1], "r");
-    FILE* imemin_ptr = fopen(argv[2], "w");
-    FILE* dmemin_ptr = fopen(argv[3], "w");
+/*Expand a pseudo-instruction into SIMP commands, operands are the tokens after the name. Returns 0 on a syntax error*/
+int expand_pseudo(Program* program, int pseudo, Token* operands, int count, int line)
+{
+    Command* cmd;
+    int rd, value;
 
-    if (program_ptr == NULL) {
-        printf("Error openning file program.asm");
+    switch (pseudo)
+    {
+    case PSEUDO_LI: //li rd, value
+        if (count != 2 || (rd = find_target_register(&operands[0])) == -1)
+        {
+            return 0;
+        }
+        if (isalpha((unsigned char)operands[1].text[0])) //a label, always one command so sizes never depend on labels
+        {
+            cmd = add_command(program, line, OP_ADD, rd, REG_IMM1, REG_ZERO, REG_ZERO, 0, 0);
+            return parse_immediate(&operands[1], cmd, 0);
+        }
+        if (!parse_number(&operands[1], &value))
+        {
+            return 0;
+        }
+        expand_load(program, line, rd, value);
         return 1;
-    }
-    if (imemin_ptr == NULL) {
-        printf("Error openning file imemin.txt");
+
+    case PSEUDO_MOV: //mov rd, rs
+    {
+        int rs;
+        if (count != 2 || (rd = find_target_register(&operands[0])) == -1 || (rs = find_register(&operands[1])) == -1)
+        {
+            return 0;
+        }
+        add_command(program, line, OP_ADD, rd, rs, REG_ZERO, REG_ZERO, 0, 0);
         return 1;
     }
-    if (dmemin_ptr == NULL) {
-        printf("Error openning file dmemin.txt");
+
+    case PSEUDO_INC: //inc rd [, value], value defaults to 1 and may be up to twice the 12-bit range
+        value = 1;
+        if ((count != 1 && count != 2) || (rd = find_target_register(&operands[0])) == -1
+            || (count == 2 && !parse_number(&operands[1], &value)) || value < 2 * IMM_MIN || value > 2 * IMM_MAX)
+        {
+            return 0;
+        }
+        if (fits_immediate(value))
+        {
+            add_command(program, line, OP_ADD, rd, rd, REG_IMM1, REG_ZERO, value, 0);
+        }
+        else
+        {
+            int a = value < 0 ? IMM_MIN : IMM_MAX;
+            add_command(program, line, OP_ADD, rd, rd, REG_IMM1, REG_IMM2, a, value - a);
+        }
         return 1;
+
+    case PSEUDO_B: //b target, a label, an address or a register
+    case PSEUDO_CALL: //call target, return address in $ra
+    {
+        if (count != 1)
+        {
+            return 0;
+        }
+        int opcode = pseudo == PSEUDO_B ? OP_BEQ : OP_JAL;
+        int link = pseudo == PSEUDO_B ? REG_ZERO : REG_RA;
+        cmd = add_command(program, line, opcode, link, REG_ZERO, REG_ZERO, REG_ZERO, 0, 0);
+        cmd->rm = pseudo_operand(&operands[0], cmd, 0);
+        return cmd->rm != -1;
     }
 
-    /*initialize dmemin to 4096 lines of 8 digits of 0*/
-    char dmem_arr[CMD_MEM_LINES_SIZE][10];
-    dmem_initialize(dmem_arr);
-    
-    char str_cmd[MAX_LINE] = {0};
-    int found_label = 0;
-    Label_Node* head = NULL;
-    Label_Node* last = NULL;
+    case PSEUDO_RET: //ret
+        if (count != 0)
+        {
+            return 0;
+        }
+        add_command(program, line, OP_BEQ, REG_ZERO, REG_ZERO, REG_ZERO, REG_RA, 0, 0);
+        return 1;
 
-    /*FIRST READING, FINDING ALL LABELS AND REMEMBERING THEIR ADDRESSES*/
-    int PC = 0;
-    int last_line = -1;
-    int scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-    do
+    case PSEUDO_PUSH: //push r1 [, r2 ...]: one $sp update for the whole list, r1 ends up at the lowest address
+    case PSEUDO_POP: //pop r1 [, r2 ...]: the same list as the matching push
     {
-        if (scan_element == 0)
+        int regs[MAX_TOKENS];
+        if (count == 0)
         {
-            fgetc(program_ptr); //flush the \n
-            scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-            continue;
+            return 0;
         }
-        
-        fgetc(program_ptr); //flush the \n
-        if (is_label(str_cmd))
+        for (int i = 0; i < count; i++)
         {
-            found_label = 1;
-            if (head == NULL) //if it is the first label
+            regs[i] = pseudo == PSEUDO_PUSH ? find_register(&operands[i]) : find_target_register(&operands[i]);
+            if (regs[i] == -1 || regs[i] == REG_SP)
             {
-                 head = add_label(str_cmd, PC);
-                 last = head;
+                return 0;
             }
-            else
+        }
+        if (pseudo == PSEUDO_PUSH)
+        {
+            add_command(program, line, OP_ADD, REG_SP, REG_SP, REG_IMM1, REG_ZERO, -count, 0);
+            for (int i = 0; i < count; i++)
             {
-                last->next = add_label(str_cmd, PC);
-                last = last->next;
+                add_command(program, line, OP_SW, REG_ZERO, REG_SP, REG_IMM1, regs[i], i, 0);
             }
         }
         else
         {
-            PC++;
-            if (!strstr(str_cmd, ".word"))
-            {
-                last_line++;
-            }
-            if (found_label == 1)
+            for (int i = 0; i < count; i++)
             {
-                found_label = 0;
+                add_command(program, line, OP_LW, regs[i], REG_SP, REG_IMM1, REG_ZERO, i, 0);
             }
+            add_command(program, line, OP_ADD, REG_SP, REG_SP, REG_IMM1, REG_ZERO, count, 0);
         }
-        scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-    } while (scan_element != EOF);
-
-    
+        return 1;
+    }
 
-    /*SECOND READING, ANALYZING SIMP COMMANDS*/
-    rewind(program_ptr);
-    Command* cmd;
-    PC = 0;
-	int data_last_line = 0; //The last relevant line in dmemin.txt. Will be used so we can ignore the remaining irrelevant lines after that.
-    scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-    char* line_no_space;
-    do
-    {
-        line_no_space = remove_spaces(str_cmd);
-        remove_comments(line_no_space);
-        if (scan_element == 0 || is_label(str_cmd) || strlen(line_no_space)==0)
-        {
-            fgetc(program_ptr); //flush the \n
-            scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-            continue;
+    case PSEUDO_PIXEL: //pixel address, color: each a register or an immediate
+    {
+        if (count != 2)
+        {
+            return 0;
         }
-        else
+        for (int i = 0; i < 2; i++)
         {
-            fgetc(program_ptr); //flush the \n
-            if (strstr(str_cmd, ".word"))
-            {
-                void** pseudo = get_pseudo_instruction(str_cmd);
-                strcpy(dmem_arr[*(int*)pseudo[0]], (char*)pseudo[1]);
-				if (data_last_line < *(int*)pseudo[0])
-				{
-					data_last_line = *(int*)pseudo[0]; //updating last relevant line in dmemin.
-				}
-                free(pseudo[0]);
-                free(pseudo[1]);
-                free(pseudo);
-            }
-            else
+            cmd = add_command(program, line, OP_OUT, REG_ZERO, REG_IMM1, REG_ZERO, REG_ZERO, i == 0 ? MONITOR_ADDR_IOR : MONITOR_DATA_IOR, 0);
+            cmd->rm = pseudo_operand(&operands[i], cmd, 1);
+            if (cmd->rm == -1)
             {
-                cmd = buildCommand(str_cmd, head);
-                if (cmd == NULL)
-                {
-                    printf("Error in assembly code\n");
-                    return 1;
-                }
-                else
-                {
-                    fprintf(imemin_ptr, cmd_to_hex_line(cmd));
-                    if (PC != last_line)
-                    {
-                        fprintf(imemin_ptr, "\n");
-                    }
-                    free(cmd);
-                }
+                return 0;
             }
-            PC++;
         }
-        scan_element = fscanf(program_ptr, "%[^\n]", str_cmd);
-    } while (scan_element != EOF);
+        add_command(program, line, OP_OUT, REG_ZERO, REG_IMM1, REG_ZERO, REG_IMM2, MONITOR_CMD_IOR, 1);
+        return 1;
+    }
+    }
+    return 0;
+}
+
+
+/*Write value as digits hex characters*/
+void put_hex(char* out, unsigned int value, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+    {
+        out[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+}
 
-    print_2D_array_to_file(dmem_arr, dmemin_ptr, data_last_line);
-    
-    fclose(program_ptr);
-    fclose(imemin_ptr);
-    fclose(dmemin_ptr);
 
+/*Define a label at the current address and patch the fields that were waiting for it*/
+int define_label(Program* program, const char* name, int len, int line_number)
+{
+    Symbol* label = table_find_or_add(&program->labels, name, len);
+    if (label->defined)
+    {
+        if (!program->quiet)
+        {
+            fprintf(stderr, "Error: Label %.*s defined twice (line %d)\n", len, name, line_number);
+        }
+        return 0;
+    }
+    label->defined = 1;
+    label->value = program->address;
+
+    //single-pass mode: backpatch the forward references in place
+    for (int i = label->fixups; i != -1; i = program->fixups[i].next)
+    {
+        put_hex(program->imem + program->fixups[i].offset, label->value & 0xFFF, IMM_LENGTH);
+    }
+    label->fixups = -1;
     return 1;
-}
\ No newline at end of file
+}
+
+
+/*Analyze one source line: a label, a .word directive and/or a command. Returns 0 on a syntax error*/
+int parse_line(Program* program, const char* line, const char* end, int line_number)
+{
+    Token tokens[MAX_TOKENS];
+    int count = tokenize_line(line, end, tokens);
+    Token* t = tokens;
+
+    if (count > MAX_TOKENS)
+    {
+        return 0;
+    }
+
+    //a label, optionally followed by a command on the same line
+    if (count > 0 && t[0].text[t[0].len - 1] == ':')
+    {
+        if (!is_label_name(t[0].text, t[0].len - 1))
+        {
+            return 0;
+        }
+        if (!define_label(program, t[0].text, t[0].len - 1, line_number))
+        {
+            return 0;
+        }
+        t++;
+        count--;
+    }
+
+    if (count == 0)
+    {
+        return 1;
+    }
+
+    //.global name [name ...]: labels other object files may use
+    if (t[0].len == 7 && memcmp(t[0].text, ".global", 7) == 0)
+    {
+        if (count < 2)
+        {
+            return 0;
+        }
+        for (int i = 1; i < count; i++)
+        {
+            if (!is_label_name(t[i].text, t[i].len))
+            {
+                return 0;
+            }
+            add_export(program, &t[i]);
+        }
+        return 1;
+    }
+
+    //.word address value
+    if (t[0].len == 5 && memcmp(t[0].text, ".word", 5) == 0)
+    {
+        int address, value;
+        if (count != 3 || !parse_number(&t[1], &address) || !parse_number(&t[2], &value)
+            || address < 0 || address >= CMD_MEM_LINES_SIZE)
+        {
+            return 0;
+        }
+        add_data_word(program, address, value);
+        return 1;
+    }
+
+    int opcode = find_opcode(&t[0]);
+    if (opcode >= PSEUDO_FIRST)
+    {
+        return expand_pseudo(program, opcode, t + 1, count - 1, line_number);
+    }
+    return buildCommand(t, count, new_command(program, line_number));
+}
+
+
+/*Recieve a command struct and write the 12 hex characters that represent it*/
+void cmd_to_hex_line(Command* cmd, char* out)
+{
+    put_hex(out, cmd->opcode, OP_LENGTH);
+    put_hex(out + 2, cmd->rd, REG_LENGTH);
+    put_hex(out + 3, cmd->rs, REG_LENGTH);
+    put_hex(out + 4, cmd->rt, REG_LENGTH);
+    put_hex(out + 5, cmd->rm, REG_LENGTH);
+    put_hex(out + 6, cmd->immediate1 & 0xFFF, IMM_LENGTH);
+    put_hex(out + 9, cmd->immediate2 & 0xFFF, IMM_LENGTH);
+}
+
+
+/*Make room for extra bytes in the single-pass instruction buffer*/
+void reserve_imem(Program* program, size_t extra)
+{
+    if (program->imem_size + extra <= program->imem_capacity)
+    {
+        return;
+    }
+    size_t capacity = program->imem_capacity ? program->imem_capacity * 2 : 64 * 1024;
+    while (capacity < program->imem_size + extra)
+    {
+        capacity *= 2;
+    }
+    program->imem = (char*)realloc(program->imem, capacity);
+    if (program->imem == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    program->imem_capacity = capacity;
+}
+
+
+/*Record that the immediate at offset waits for label*/
+void add_fixup(Program* program, Symbol* label, size_t offset, int line)
+{
+    if (program->fixup_count == program->fixup_capacity)
+    {
+        int capacity = program->fixup_capacity ? program->fixup_capacity * 2 : 1024;
+        Fixup* fixups = (Fixup*)arena_alloc(&program->arena, capacity * sizeof(Fixup));
+        memcpy(fixups, program->fixups, program->fixup_count * sizeof(Fixup));
+        program->fixups = fixups;
+        program->fixup_capacity = capacity;
+    }
+    Fixup* fixup = &program->fixups[program->fixup_count];
+    fixup->offset = offset;
+    fixup->line = line;
+    fixup->next = label->fixups; //push on the label's chain
+    label->fixups = program->fixup_count++;
+}
+
+
+/*Single-pass mode: encode the commands of the last line right away, leaving a fixup for every forward reference*/
+void emit_commands(Program* program)
+{
+    for (int c = 0; c < program->command_count; c++)
+    {
+        Command* cmd = &program->commands[c];
+        int* immediates[2] = { &cmd->immediate1, &cmd->immediate2 };
+
+        reserve_imem(program, HEX_INSTRUCTION_LENGTH + 1);
+        if (program->imem_size != 0)
+        {
+            program->imem[program->imem_size++] = '\n';
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (cmd->label[i] != NULL)
+            {
+                Symbol* label = table_find_or_add(&program->labels, cmd->label[i], cmd->label_len[i]);
+                if (label->defined)
+                {
+                    *immediates[i] = label->value;
+                }
+                else
+                {
+                    add_fixup(program, label, program->imem_size + 6 + i * IMM_LENGTH, cmd->line);
+                    *immediates[i] = 0;
+                }
+            }
+        }
+        cmd_to_hex_line(cmd, program->imem + program->imem_size);
+        program->imem_size += HEX_INSTRUCTION_LENGTH;
+    }
+    program->command_count = 0; //the commands are in the buffer now, reuse the slots
+}
+
+
+/*Single-pass mode: every label that still has fixups was never defined*/
+int check_fixups(Program* program)
+{
+    int ok = 1;
+    for (int i = 0; i < program->labels.capacity; i++)
+    {
+        Symbol* label = &program->labels.slots[i];
+        if (label->name != NULL && !label->defined)
+        {
+            fprintf(stderr, "Error: Unknown label %.*s (line %d)\n", label->len, label->name, program->fixups[label->fixups].line);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+
+/*FIRST PASS: read every line once, collecting labels, commands and data*/
+int parse_source(Program* program, const char* source, size_t size)
+{
+    const char* p = source;
+    const char* end = source + size;
+    int line_number = 1;
+
+    while (p < end)
+    {
+        const char* line_end = (const char*)memchr(p, '\n', end - p);
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+        if (!parse_line(program, p, line_end, line_number))
+        {
+            if (!program->quiet)
+            {
+                fprintf(stderr, "Error in assembly code (line %d)\n", line_number);
+            }
+            return 0;
+        }
+        if (program->single_pass)
+        {
+            emit_commands(program);
+        }
+        p = line_end + 1;
+        line_number++;
+    }
+    return 1;
+}
+
+
+/*PEEPHOLE OPTIMIZER: rewrites the parsed commands before the second pass*/
+
+/*Value of a 12-bit immediate field as the processor sees it, sign extended*/
+int immediate_value(int immediate)
+{
+    return (immediate & 0x800) ? (immediate & 0xFFF) - 0x1000 : (immediate & 0xFFF);
+}
+
+
+/*Value of source register reg of cmd when it is a constant: $zero or an immediate without a label*/
+int source_constant(Command* cmd, int reg, int* value)
+{
+    if (reg == REG_ZERO)
+    {
+        *value = 0;
+        return 1;
+    }
+    if (reg == REG_IMM1 || reg == REG_IMM2)
+    {
+        int index = reg - REG_IMM1;
+        if (cmd->label[index] != NULL)
+        {
+            return 0;
+        }
+        *value = immediate_value(index == 0 ? cmd->immediate1 : cmd->immediate2);
+        return 1;
+    }
+    return 0;
+}
+
+
+/*Checks if an opcode is one of the ALU commands, add to srl*/
+int is_arithmetic(int opcode)
+{
+    return opcode >= OP_ADD && opcode <= OP_SRL;
+}
+
+
+/*Checks if an opcode is a conditional branch, beq to bge*/
+int is_branch(int opcode)
+{
+    return opcode >= OP_BEQ && opcode < OP_JAL;
+}
+
+
+/*Checks if cmd jumps whatever the registers hold: beq, ble or bge of a register with itself*/
+int is_unconditional_jump(Command* cmd)
+{
+    return (cmd->opcode == OP_BEQ || cmd->opcode == OP_BLE || cmd->opcode == OP_BGE) && cmd->rs == cmd->rt;
+}
+
+
+/*Checks if cmd reads register reg*/
+int reads_register(Command* cmd, int reg)
+{
+    return cmd->rs == reg || cmd->rt == reg || cmd->rm == reg || (cmd->opcode == OP_SW && cmd->rd == reg);
+}
+
+
+/*Compute an ALU command whose sources are all constants, with a register value substituted for reg.
+  Returns 0 if a source is unknown or a shift is out of range*/
+int evaluate_command(Command* cmd, int reg, int reg_value, int* result)
+{
+    int values[3];
+    int sources[3] = { cmd->rs, cmd->rt, cmd->rm };
+    for (int i = 0; i < 3; i++)
+    {
+        if (sources[i] == reg && reg > REG_IMM2)
+        {
+            values[i] = reg_value;
+        }
+        else if (!source_constant(cmd, sources[i], &values[i]))
+        {
+            return 0;
+        }
+    }
+
+    unsigned int rs = (unsigned int)values[0], rt = (unsigned int)values[1], rm = (unsigned int)values[2];
+    if ((cmd->opcode == OP_SLL || cmd->opcode == OP_SRA || cmd->opcode == OP_SRL) && rt > 31)
+    {
+        return 0;
+    }
+    switch (cmd->opcode)
+    {
+    case OP_ADD: *result = (int)(rs + rt + rm); return 1;
+    case OP_SUB: *result = (int)(rs - rt - rm); return 1;
+    case OP_MAC: *result = (int)(rs * rt + rm); return 1;
+    case OP_AND: *result = (int)(rs & rt & rm); return 1;
+    case OP_OR: *result = (int)(rs | rt | rm); return 1;
+    case OP_XOR: *result = (int)(rs ^ rt ^ rm); return 1;
+    case OP_SLL: *result = (int)(rs << rt); return 1;
+    case OP_SRA: *result = values[0] >> rt; return 1;
+    case OP_SRL: *result = (int)(rs >> rt); return 1;
+    }
+    return 0;
+}
+
+
+/*Write an add or sub as a list of signed register terms plus a constant. Returns 0 for other commands or label operands*/
+int command_to_sum(Command* cmd, Sum* sum)
+{
+    if (cmd->opcode != OP_ADD && cmd->opcode != OP_SUB)
+    {
+        return 0;
+    }
+    int sources[3] = { cmd->rs, cmd->rt, cmd->rm };
+    sum->count = 0;
+    sum->constant = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int sign = (cmd->opcode == OP_SUB && i > 0) ? -1 : 1;
+        int value;
+        if (source_constant(cmd, sources[i], &value))
+        {
+            sum->constant = (int)((unsigned int)sum->constant + (unsigned int)(sign * value));
+        }
+        else if (sources[i] == REG_IMM1 || sources[i] == REG_IMM2)
+        {
+            return 0; //a label operand
+        }
+        else
+        {
+            sum->regs[sum->count] = sources[i];
+            sum->signs[sum->count] = sign;
+            sum->count++;
+        }
+    }
+    return 1;
+}
+
+
+/*Build a single add or sub "rd = sum" into cmd. Returns 0 if the sum needs more than three sources*/
+int sum_to_command(Sum* sum, int rd, Command* cmd)
+{
+    int positive[SUM_TERMS], negative[SUM_TERMS];
+    int positive_count = 0, negative_count = 0;
+    for (int i = 0; i < sum->count; i++)
+    {
+        if (sum->signs[i] > 0)
+        {
+            positive[positive_count++] = sum->regs[i];
+        }
+        else
+        {
+            negative[negative_count++] = sum->regs[i];
+        }
+    }
+
+    int sources[3] = { REG_ZERO, REG_ZERO, REG_ZERO };
+    int immediates[2] = { 0, 0 };
+    int used = 0;
+    int constant = sum->constant;
+    int opcode;
+
+    if (negative_count == 0)
+    {
+        opcode = OP_ADD;
+        for (int i = 0; i < positive_count; i++)
+        {
+            sources[used++] = positive[i];
+        }
+    }
+    else if (positive_count <= 1)
+    {
+        opcode = OP_SUB; //rs - rt - rm: the constant moves to the subtracted side
+        used = 1;
+        if (positive_count == 1)
+        {
+            sources[0] = positive[0];
+        }
+        for (int i = 0; i < negative_count; i++)
+        {
+            if (used == 3)
+            {
+                return 0;
+            }
+            sources[used++] = negative[i];
+        }
+        constant = -constant;
+    }
+    else
+    {
+        return 0;
+    }
+
+    //the constant takes one immediate, or both when it is outside the 12-bit range
+    int parts = constant == 0 ? 0 : fits_immediate(constant) ? 1 : (constant >= 2 * IMM_MIN && constant <= 2 * IMM_MAX) ? 2 : 3;
+    if (parts == 3 || used + parts > 3)
+    {
+        return 0;
+    }
+    if (parts == 2)
+    {
+        immediates[0] = constant < 0 ? IMM_MIN : IMM_MAX;
+        immediates[1] = constant - immediates[0];
+    }
+    else if (parts == 1)
+    {
+        immediates[0] = constant;
+    }
+    for (int i = 0; i < parts; i++)
+    {
+        sources[used++] = REG_IMM1 + i;
+    }
+
+    int line = cmd->line;
+    memset(cmd, 0, sizeof(Command));
+    cmd->opcode = opcode;
+    cmd->rd = rd;
+    cmd->rs = sources[0];
+    cmd->rt = sources[1];
+    cmd->rm = sources[2];
+    cmd->immediate1 = immediates[0];
+    cmd->immediate2 = immediates[1];
+    cmd->line = line;
+    return 1;
+}
+
+
+/*Checks if an ALU command leaves its destination unchanged, or writes $zero, $imm1 or $imm2
+  (the immediate registers are reloaded by the next command anyway)*/
+int is_dead_command(Command* cmd)
+{
+    if (!is_arithmetic(cmd->opcode) && cmd->opcode != OP_LW)
+    {
+        return 0;
+    }
+    if (cmd->rd <= REG_IMM2)
+    {
+        return 1;
+    }
+    if (cmd->opcode == OP_LW)
+    {
+        return 0;
+    }
+
+    Sum sum;
+    if (command_to_sum(cmd, &sum))
+    {
+        return sum.count == 1 && sum.regs[0] == cmd->rd && sum.signs[0] > 0 && sum.constant == 0;
+    }
+
+    //x | 0, x ^ 0, x & x & x, x << 0, x * 1 + 0
+    int sources[3] = { cmd->rs, cmd->rt, cmd->rm };
+    int values[3];
+    int is_constant[3];
+    for (int i = 0; i < 3; i++)
+    {
+        is_constant[i] = source_constant(cmd, sources[i], &values[i]);
+    }
+    switch (cmd->opcode)
+    {
+    case OP_OR:
+    case OP_XOR:
+    {
+        int rd_count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            if (sources[i] == cmd->rd)
+            {
+                rd_count++;
+            }
+            else if (!is_constant[i] || values[i] != 0)
+            {
+                return 0;
+            }
+        }
+        return rd_count == 1 || (rd_count == 3 && cmd->opcode == OP_OR);
+    }
+    case OP_AND:
+        for (int i = 0; i < 3; i++)
+        {
+            if (sources[i] != cmd->rd && !(is_constant[i] && values[i] == -1))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    case OP_SLL:
+    case OP_SRA:
+    case OP_SRL:
+        return sources[0] == cmd->rd && is_constant[1] && values[1] == 0;
+    case OP_MAC:
+        return ((sources[0] == cmd->rd && is_constant[1] && values[1] == 1) || (sources[1] == cmd->rd && is_constant[0] && values[0] == 1))
+            && is_constant[2] && values[2] == 0;
+    }
+    return 0;
+}
+
+
+/*Try to replace the pair first, second with one command in first. second is never a branch target*/
+int combine_pair(Command* first, Command* second, Opt_Stats* stats)
+{
+    int rd = first->rd;
+    if (!is_arithmetic(first->opcode) || !is_arithmetic(second->opcode) || second->rd != rd || rd <= REG_IMM2)
+    {
+        return 0;
+    }
+
+    //a constant followed by an operation on it: fold both into one load
+    int value, folded;
+    if (evaluate_command(first, -1, 0, &value) && evaluate_command(second, rd, value, &folded))
+    {
+        int opcode, a, b;
+        if (load_in_one(folded, &opcode, &a, &b))
+        {
+            int line = first->line;
+            memset(first, 0, sizeof(Command));
+            first->opcode = opcode;
+            first->rd = rd;
+            first->rs = REG_IMM1;
+            first->rt = REG_IMM2;
+            first->rm = REG_ZERO;
+            first->immediate1 = a;
+            first->immediate2 = b;
+            first->line = line;
+            stats->folded++;
+            return 1;
+        }
+    }
+
+    //rd = a + b followed by rd = rd + c: one three-source add
+    Sum outer, inner;
+    if (command_to_sum(first, &inner) && command_to_sum(second, &outer))
+    {
+        Sum merged = { { 0 }, { 0 }, 0, 0 };
+        int uses = 0, sign = 0;
+        for (int i = 0; i < outer.count; i++)
+        {
+            if (outer.regs[i] == rd)
+            {
+                uses++;
+                sign = outer.signs[i];
+            }
+            else
+            {
+                merged.regs[merged.count] = outer.regs[i];
+                merged.signs[merged.count++] = outer.signs[i];
+            }
+        }
+        if (uses != 1)
+        {
+            return 0;
+        }
+        for (int i = 0; i < inner.count; i++)
+        {
+            merged.regs[merged.count] = inner.regs[i];
+            merged.signs[merged.count++] = inner.signs[i] * sign;
+        }
+        merged.constant = (int)((unsigned int)outer.constant + (unsigned int)(sign * inner.constant));
+
+        Command combined = *first;
+        if (merged.count <= 3 && sum_to_command(&merged, rd, &combined))
+        {
+            *first = combined;
+            stats->merged++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*Follow a chain of unconditional jumps from the label target of a branch. Returns the command whose label is
+  the final target, or NULL if the branch is not retargeted*/
+Command* final_jump_target(Program* program, Command* cmd)
+{
+    Command* last = NULL;
+    Command* current = cmd;
+    for (int hops = 0; hops < 16; hops++) //bounded, a loop of jumps never ends
+    {
+        int slot = current->rm - REG_IMM1;
+        if (slot < 0 || slot > 1 || current->label[slot] == NULL)
+        {
+            break;
+        }
+        Symbol* label = table_find(&program->labels, current->label[slot], current->label_len[slot]);
+        if (label == NULL || label->value < 0 || label->value >= program->command_count)
+        {
+            break;
+        }
+        Command* target = &program->commands[label->value];
+        if (target == cmd || !is_unconditional_jump(target) || target->opcode == OPT_REMOVED)
+        {
+            break;
+        }
+        int target_slot = target->rm - REG_IMM1;
+        if (target_slot < 0 || target_slot > 1 || target->label[target_slot] == NULL)
+        {
+            break;
+        }
+        last = target;
+        current = target;
+    }
+    return last;
+}
+
+
+/*Drop the removed commands and move every label to the new address of its command*/
+void compact_commands(Program* program)
+{
+    int* new_address = (int*)malloc(((size_t)program->command_count + 1) * sizeof(int));
+    if (new_address == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    int kept = 0;
+    for (int i = 0; i < program->command_count; i++)
+    {
+        new_address[i] = kept;
+        if (program->commands[i].opcode != OPT_REMOVED)
+        {
+            program->commands[kept++] = program->commands[i];
+        }
+    }
+    new_address[program->command_count] = kept;
+
+    //a label of a removed command now names the next command, which is where execution would have gone
+    for (int i = 0; i < program->labels.capacity; i++)
+    {
+        Symbol* label = &program->labels.slots[i];
+        if (label->name != NULL && label->defined && label->value >= 0 && label->value <= program->command_count)
+        {
+            label->value = new_address[label->value];
+        }
+    }
+    free(new_address);
+    program->command_count = kept;
+    program->address = kept;
+}
+
+
+/*Checks for branches to a numeric address: removing commands would move their target*/
+int has_numeric_targets(Program* program)
+{
+    for (int i = 0; i < program->command_count; i++)
+    {
+        Command* cmd = &program->commands[i];
+        int slot = cmd->rm - REG_IMM1;
+        if ((is_branch(cmd->opcode) || cmd->opcode == OP_JAL) && slot >= 0 && slot <= 1 && cmd->label[slot] == NULL)
+        {
+            fprintf(stderr, "Warning: branch to a fixed address (line %d), the optimizer is skipped\n", cmd->line);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*OPTIMIZATION PASS: rewrite the parsed commands until nothing changes. Removes dead commands, merges adjacent
+  adds, folds constant chains and threads jumps to jumps; every label is moved with its command*/
+void optimize_program(Program* program, Opt_Stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->before = program->command_count;
+    if (has_numeric_targets(program))
+    {
+        stats->after = program->command_count;
+        return;
+    }
+
+    char* is_target = NULL;
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+
+        //commands that a label points to can be entered from elsewhere
+        free(is_target);
+        is_target = (char*)calloc((size_t)program->command_count + 1, 1);
+        if (is_target == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (int i = 0; i < program->labels.capacity; i++)
+        {
+            Symbol* label = &program->labels.slots[i];
+            if (label->name != NULL && label->defined && label->value >= 0 && label->value <= program->command_count)
+            {
+                is_target[label->value] = 1;
+            }
+        }
+
+        for (int i = 0; i < program->command_count; i++)
+        {
+            Command* cmd = &program->commands[i];
+            if (cmd->opcode == OPT_REMOVED)
+            {
+                continue;
+            }
+
+            if (is_dead_command(cmd))
+            {
+                cmd->opcode = OPT_REMOVED;
+                stats->dead++;
+                changed = 1;
+                continue;
+            }
+
+            //jumps to jumps go straight to the last target
+            if (is_branch(cmd->opcode) || cmd->opcode == OP_JAL)
+            {
+                Command* target = final_jump_target(program, cmd);
+                int slot = cmd->rm - REG_IMM1;
+                int target_slot = target != NULL ? target->rm - REG_IMM1 : 0;
+                if (target != NULL && (cmd->label_len[slot] != target->label_len[target_slot]
+                    || memcmp(cmd->label[slot], target->label[target_slot], cmd->label_len[slot]) != 0))
+                {
+                    cmd->label[slot] = target->label[target_slot];
+                    cmd->label_len[slot] = target->label_len[target_slot];
+                    stats->threaded++;
+                    changed = 1;
+                }
+            }
+
+            //a branch to the next command does nothing
+            if (is_branch(cmd->opcode) && cmd->rm >= REG_IMM1 && cmd->rm <= REG_IMM2 && cmd->label[cmd->rm - REG_IMM1] != NULL)
+            {
+                Symbol* label = table_find(&program->labels, cmd->label[cmd->rm - REG_IMM1], cmd->label_len[cmd->rm - REG_IMM1]);
+                if (label != NULL && label->value == i + 1)
+                {
+                    cmd->opcode = OPT_REMOVED;
+                    stats->dead++;
+                    changed = 1;
+                    continue;
+                }
+            }
+
+            if (i + 1 >= program->command_count)
+            {
+                continue;
+            }
+            Command* next = &program->commands[i + 1];
+
+            //a value that is overwritten right away without being read
+            if (is_arithmetic(cmd->opcode) && is_arithmetic(next->opcode) && next->rd == cmd->rd && !reads_register(next, cmd->rd))
+            {
+                cmd->opcode = OPT_REMOVED;
+                stats->dead++;
+                changed = 1;
+                continue;
+            }
+
+            //merging needs both commands to run together, nothing may jump to the second one
+            if (is_target[i + 1])
+            {
+                continue;
+            }
+
+            if (combine_pair(cmd, next, stats))
+            {
+                next->opcode = OPT_REMOVED;
+                changed = 1;
+                i++;
+            }
+        }
+        compact_commands(program);
+    }
+    free(is_target);
+    stats->after = program->command_count;
+}
+
+
+/*Replace label operands with their addresses*/
+int resolve_labels(Command* cmd, Symbol_Table* labels, int quiet)
+{
+    int* immediates[2] = { &cmd->immediate1, &cmd->immediate2 };
+    for (int i = 0; i < 2; i++)
+    {
+        if (cmd->label[i] != NULL)
+        {
+            Symbol* label = table_find(labels, cmd->label[i], cmd->label_len[i]);
+            if (label == NULL)
+            {
+                if (!quiet)
+                {
+                    fprintf(stderr, "Error: Unknown label %.*s (line %d)\n", cmd->label_len[i], cmd->label[i], cmd->line);
+                }
+                return 0;
+            }
+            *immediates[i] = label->value;
+        }
+    }
+    return 1;
+}
+
+
+/*Resolve and encode count commands whose first address is first_address. Line k of the output starts at k*13*/
+int encode_commands(Command* commands, int count, int first_address, Symbol_Table* labels, char* buffer, int quiet)
+{
+    char* out = buffer + (size_t)first_address * (HEX_INSTRUCTION_LENGTH + 1);
+    for (int i = 0; i < count; i++)
+    {
+        if (!resolve_labels(&commands[i], labels, quiet))
+        {
+            return 0;
+        }
+        cmd_to_hex_line(&commands[i], out);
+        out[HEX_INSTRUCTION_LENGTH] = '\n';
+        out += HEX_INSTRUCTION_LENGTH + 1;
+    }
+    return 1;
+}
+
+
+/*SECOND PASS: resolve labels and encode every command into one buffer, lines separated by '\n'*/
+char* encode_program(Program* program, size_t* size)
+{
+    char* buffer = (char*)arena_alloc(&program->arena, (size_t)program->command_count * (HEX_INSTRUCTION_LENGTH + 1) + 1);
+    if (!encode_commands(program->commands, program->command_count, 0, &program->labels, buffer, 0))
+    {
+        return NULL;
+    }
+    *size = program->command_count ? (size_t)program->command_count * (HEX_INSTRUCTION_LENGTH + 1) - 1 : 0; //no newline after the last line
+    return buffer;
+}
+
+
+/*Place the .word directives in a dmem image, returns the last relevant line of dmemin.txt*/
+int layout_data(Data_Word* data, int count, int dmem[CMD_MEM_LINES_SIZE])
+{
+    int data_last_line = 0; //the remaining lines are all zero and are not written
+    for (int i = 0; i < count; i++)
+    {
+        dmem[data[i].address] = data[i].value;
+        if (data_last_line < data[i].address)
+        {
+            data_last_line = data[i].address;
+        }
+    }
+    return data_last_line;
+}
+
+
+/*Encode dmem lines [first, last) into the buffer, line k starts at k*9*/
+void encode_data_lines(int dmem[CMD_MEM_LINES_SIZE], int first, int last, char* buffer)
+{
+    for (int i = first; i < last; i++)
+    {
+        char* out = buffer + (size_t)i * (HEX_DATA_LENGTH + 1);
+        put_hex(out, (unsigned int)dmem[i], HEX_DATA_LENGTH);
+        out[HEX_DATA_LENGTH] = '\n';
+    }
+}
+
+
+/*Lay out dmemin: every line up to the highest .word address, lines separated by '\n'*/
+char* encode_data(Program* program, size_t* size)
+{
+    static int dmem[CMD_MEM_LINES_SIZE];
+    memset(dmem, 0, sizeof(dmem));
+    int lines = layout_data(program->data, program->data_count, dmem) + 1;
+
+    char* buffer = (char*)arena_alloc(&program->arena, (size_t)lines * (HEX_DATA_LENGTH + 1));
+    encode_data_lines(dmem, 0, lines, buffer);
+    *size = (size_t)lines * (HEX_DATA_LENGTH + 1) - 1;
+    return buffer;
+}
+
+
+/*Count the lines of the source, an upper bound on the number of commands*/
+int count_lines(const char* source, size_t size)
+{
+    int lines = 1;
+    const char* p = source;
+    const char* end = source + size;
+    while ((p = (const char*)memchr(p, '\n', end - p)) != NULL)
+    {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+
+/*Read a whole file into the arena*/
+char* read_source(Arena* arena, const char* filename, size_t* size)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* source = (char*)arena_alloc(arena, length > 0 ? (size_t)length : 1);
+    *size = fread(source, 1, length > 0 ? (size_t)length : 0, file);
+    fclose(file);
+    return source;
+}
+
+
+/*Map the source file into memory read-only. Returns NULL if the file cannot be mapped*/
+const char* map_source(const char* filename, size_t* size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+    LARGE_INTEGER length;
+    const char* source = NULL;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+        {
+            source = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); //the view keeps the mapping alive
+        }
+        *size = (size_t)length.QuadPart;
+    }
+    CloseHandle(file);
+    return source;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat info;
+    const char* source = NULL;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED)
+        {
+            source = (const char*)view;
+            madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+        }
+        *size = (size_t)info.st_size;
+    }
+    close(fd); //the mapping stays valid after the descriptor is closed
+    return source;
+#endif
+}
+
+
+/*Release a mapping made by map_source*/
+void unmap_source(const char* source, size_t size)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(source);
+#else
+    munmap((void*)source, size);
+#endif
+}
+
+
+/*Write a buffer to a file with a single write*/
+int write_output(const char* filename, const char* buffer, size_t size)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        return 0;
+    }
+    fwrite(buffer, 1, size, file);
+    fclose(file);
+    return 1;
+}
+
+
+/*Orders labels by address, then by name*/
+int compare_labels(const void* a, const void* b)
+{
+    const Symbol* first = *(const Symbol* const*)a;
+    const Symbol* second = *(const Symbol* const*)b;
+    if (first->value != second->value)
+    {
+        return first->value < second->value ? -1 : 1;
+    }
+    int len = first->len < second->len ? first->len : second->len;
+    int order = strncmp(first->name, second->name, len);
+    return order != 0 ? order : first->len - second->len;
+}
+
+
+/*Write the symbol map for the simulator's -callgraph profiler: one "<address hex> <label>" line per label,
+  by address*/
+int write_symbol_map(Program* program, const char* filename)
+{
+    Symbol** sorted = (Symbol**)malloc(((size_t)program->labels.count + 1) * sizeof(Symbol*));
+    if (sorted == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    int count = 0;
+    for (int i = 0; i < program->labels.capacity; i++)
+    {
+        Symbol* label = &program->labels.slots[i];
+        if (label->name != NULL && label->defined)
+        {
+            sorted[count++] = label;
+        }
+    }
+    qsort(sorted, count, sizeof(Symbol*), compare_labels);
+
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        free(sorted);
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(file, "%03X %.*s\n", sorted[i]->value & 0xFFF, sorted[i]->len, sorted[i]->name);
+    }
+    fclose(file);
+    free(sorted);
+    return 1;
+}
+
+
+/*Number of processors, used when -threads 0 is given*/
+int cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+
+#ifdef _WIN32
+DWORD WINAPI worker_main(LPVOID argument)
+#else
+void* worker_main(void* argument)
+#endif
+{
+    Worker* worker = (Worker*)argument;
+    worker->function(worker->chunk);
+    return 0;
+}
+
+
+/*Run function on every chunk, one thread per chunk, and wait for all of them*/
+void run_chunks(Chunk* chunks, int count, Chunk_Function function)
+{
+    Worker* workers = (Worker*)calloc(count, sizeof(Worker));
+    if (workers == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (int i = 1; i < count; i++)
+    {
+        workers[i].function = function;
+        workers[i].chunk = &chunks[i];
+#ifdef _WIN32
+        workers[i].handle = CreateThread(NULL, 0, worker_main, &workers[i], 0, NULL);
+        if (workers[i].handle == NULL)
+#else
+        if (pthread_create(&workers[i].handle, NULL, worker_main, &workers[i]) != 0)
+#endif
+        {
+            workers[i].function = NULL; //could not start a thread: run the chunk here
+            function(&chunks[i]);
+        }
+    }
+    function(&chunks[0]); //the main thread takes the first chunk
+    for (int i = 1; i < count; i++)
+    {
+        if (workers[i].function != NULL)
+        {
+#ifdef _WIN32
+            WaitForSingleObject(workers[i].handle, INFINITE);
+            CloseHandle(workers[i].handle);
+#else
+            pthread_join(workers[i].handle, NULL);
+#endif
+        }
+    }
+    free(workers);
+}
+
+
+/*FIRST PASS of one chunk: labels get addresses relative to the start of the chunk*/
+void parse_chunk(Chunk* chunk)
+{
+    Program* program = &chunk->program;
+    int lines = count_lines(chunk->source, chunk->size);
+    program->quiet = 1;
+    program->commands = (Command*)arena_alloc(&program->arena, (size_t)lines * sizeof(Command));
+    program->command_capacity = lines;
+    table_init(&program->labels, lines);
+    chunk->ok = parse_source(program, chunk->source, chunk->size);
+}
+
+
+/*SECOND PASS of one chunk: encode straight into the chunk's lines of the shared buffer*/
+void encode_chunk(Chunk* chunk)
+{
+    chunk->ok = encode_commands(chunk->program.commands, chunk->program.command_count, chunk->base, chunk->labels, chunk->imem, 1);
+}
+
+
+/*Release the memory of the chunks*/
+void free_chunks(Chunk* chunks, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        free(chunks[i].program.labels.slots);
+        arena_free(&chunks[i].program.arena);
+    }
+    free(chunks);
+}
+
+
+/*Assemble the source with thread_count threads. The source is cut into chunks at line boundaries, every chunk is
+  parsed on its own, the chunk label tables are merged with the chunk base addresses, and then every chunk encodes its
+  commands into its own part of the output. Returns 0 on any error, the caller then reruns the sequential assembler
+  so the messages are the usual ones*/
+int assemble_parallel(Program* program, const char* source, size_t size, int thread_count, char** imem, size_t* imem_size)
+{
+    Chunk* chunks = (Chunk*)calloc(thread_count, sizeof(Chunk));
+    if (chunks == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    //cut the source into chunks of about the same size, each one ends after a '\n'
+    const char* start = source;
+    const char* end = source + size;
+    for (int i = 0; i < thread_count; i++)
+    {
+        const char* cut = source + size / thread_count * (i + 1);
+        if (i == thread_count - 1 || cut <= start)
+        {
+            cut = i == thread_count - 1 ? end : start;
+        }
+        else
+        {
+            const char* newline = (const char*)memchr(cut - 1, '\n', end - (cut - 1));
+            cut = newline != NULL ? newline + 1 : end;
+        }
+        chunks[i].source = start;
+        chunks[i].size = cut - start;
+        start = cut;
+    }
+
+    run_chunks(chunks, thread_count, parse_chunk);
+
+    //merge: chunk bases, the global label table and the .word directives in source order
+    int total = 0;
+    int labels = 0;
+    int data = 0;
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (!chunks[i].ok)
+        {
+            free_chunks(chunks, thread_count);
+            return 0;
+        }
+        chunks[i].base = total;
+        total += chunks[i].program.command_count;
+        labels += chunks[i].program.labels.count;
+        data += chunks[i].program.data_count;
+    }
+
+    table_init(&program->labels, labels);
+    program->data = (Data_Word*)arena_alloc(&program->arena, (data > 0 ? data : 1) * sizeof(Data_Word));
+    program->data_capacity = data;
+    for (int i = 0; i < thread_count; i++)
+    {
+        Symbol_Table* table = &chunks[i].program.labels;
+        for (int j = 0; j < table->capacity; j++)
+        {
+            Symbol* label = &table->slots[j];
+            if (label->name != NULL && !table_insert(&program->labels, label->name, label->len, label->value + chunks[i].base))
+            {
+                free_chunks(chunks, thread_count); //defined in two chunks
+                return 0;
+            }
+        }
+        memcpy(program->data + program->data_count, chunks[i].program.data, chunks[i].program.data_count * sizeof(Data_Word));
+        program->data_count += chunks[i].program.data_count;
+    }
+    program->address = total;
+
+    char* buffer = (char*)arena_alloc(&program->arena, (size_t)total * (HEX_INSTRUCTION_LENGTH + 1) + 1);
+    for (int i = 0; i < thread_count; i++)
+    {
+        chunks[i].labels = &program->labels;
+        chunks[i].imem = buffer;
+    }
+
+    run_chunks(chunks, thread_count, encode_chunk);
+
+    int ok = 1;
+    for (int i = 0; i < thread_count; i++)
+    {
+        ok = ok && chunks[i].ok;
+    }
+    free_chunks(chunks, thread_count);
+    if (!ok)
+    {
+        return 0;
+    }
+    *imem = buffer;
+    *imem_size = total ? (size_t)total * (HEX_INSTRUCTION_LENGTH + 1) - 1 : 0; //no newline after the last line
+    return 1;
+}
+
+
+/*Write a relocatable object file. Label immediates of the module hold the module-relative address and get a
+  relocation record, labels that are not defined in the module are imports and hold 0 until simp-ld links them.
+  The format is text, one record per line:
+    SIMPOBJ 1
+    CODE <n>                 n encoded commands, 12 hex digits each
+    DATA <n>                 n ".word" records: <address hex> <value hex>
+    EXPORT <n>               n ".global" labels: <name> <address>
+    RELOC <n>                n records: <command> <immediate 0|1> <symbol>, "." for a label of this module*/
+int write_object(Program* program, const char* filename)
+{
+    int relocation_count = 0;
+    for (int i = 0; i < program->command_count; i++)
+    {
+        relocation_count += (program->commands[i].label[0] != NULL) + (program->commands[i].label[1] != NULL);
+    }
+    for (int i = 0; i < program->export_count; i++)
+    {
+        Symbol* label = table_find(&program->labels, program->exports[i].text, program->exports[i].len);
+        if (label == NULL || !label->defined)
+        {
+            fprintf(stderr, "Error: Exported label %.*s is not defined\n", program->exports[i].len, program->exports[i].text);
+            return 0;
+        }
+    }
+
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        return 0;
+    }
+
+    char line[HEX_INSTRUCTION_LENGTH + 2];
+    line[HEX_INSTRUCTION_LENGTH] = '\n';
+    line[HEX_INSTRUCTION_LENGTH + 1] = '\0';
+    fprintf(file, "SIMPOBJ 1\nCODE %d\n", program->command_count);
+    for (int i = 0; i < program->command_count; i++)
+    {
+        Command* cmd = &program->commands[i];
+        int* immediates[2] = { &cmd->immediate1, &cmd->immediate2 };
+        for (int j = 0; j < 2; j++)
+        {
+            if (cmd->label[j] != NULL)
+            {
+                Symbol* label = table_find(&program->labels, cmd->label[j], cmd->label_len[j]);
+                *immediates[j] = (label != NULL && label->defined) ? label->value : 0;
+            }
+        }
+        cmd_to_hex_line(cmd, line);
+        fputs(line, file);
+    }
+
+    fprintf(file, "DATA %d\n", program->data_count);
+    for (int i = 0; i < program->data_count; i++)
+    {
+        fprintf(file, "%03X %08X\n", program->data[i].address, (unsigned int)program->data[i].value);
+    }
+
+    fprintf(file, "EXPORT %d\n", program->export_count);
+    for (int i = 0; i < program->export_count; i++)
+    {
+        Symbol* label = table_find(&program->labels, program->exports[i].text, program->exports[i].len);
+        fprintf(file, "%.*s %d\n", program->exports[i].len, program->exports[i].text, label->value);
+    }
+
+    fprintf(file, "RELOC %d\n", relocation_count);
+    for (int i = 0; i < program->command_count; i++)
+    {
+        Command* cmd = &program->commands[i];
+        for (int j = 0; j < 2; j++)
+        {
+            if (cmd->label[j] != NULL)
+            {
+                Symbol* label = table_find(&program->labels, cmd->label[j], cmd->label_len[j]);
+                if (label != NULL && label->defined)
+                {
+                    fprintf(file, "%d %d .\n", i, j);
+                }
+                else
+                {
+                    fprintf(file, "%d %d %.*s\n", i, j, cmd->label_len[j], cmd->label[j]);
+                }
+            }
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+
+/*Assemble one module of a larger program into a relocatable object for simp-ld*/
+int assemble_object(const char* input, const char* output, int optimize)
+{
+    Program program;
+    memset(&program, 0, sizeof(program));
+
+    size_t source_size = 0;
+    const char* source = read_source(&program.arena, input, &source_size);
+    if (source == NULL) {
+        printf("Error openning file %s", input);
+        return 1;
+    }
+    int lines = count_lines(source, source_size);
+    program.commands = (Command*)arena_alloc(&program.arena, (size_t)lines * sizeof(Command));
+    program.command_capacity = lines;
+    table_init(&program.labels, lines);
+
+    if (!parse_source(&program, source, source_size)) {
+        return 1;
+    }
+    if (optimize) {
+        Opt_Stats stats;
+        optimize_program(&program, &stats);
+    }
+    if (!write_object(&program, output)) {
+        return 1;
+    }
+    free(program.labels.slots);
+    arena_free(&program.arena);
+    return 0;
+}
+
+
+int main(int argc, char* argv[]){
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <input.asm> <output.imemin> <output.dmemin> [-O] [-single-pass | -threads N] [-map <file>]\n", argv[0]);
+        fprintf(stderr, "       %s -c <input.asm> <output.obj> [-O]\n", argv[0]);
+        return 1;
+    }
+
+    Program program;
+    memset(&program, 0, sizeof(program));
+    init_keyword_tables();
+
+    /*Relocatable object for simp-ld: one module of a program*/
+    if (strcmp(argv[1], "-c") == 0) {
+        if (argc > 5 || (argc == 5 && strcmp(argv[4], "-O") != 0)) {
+            fprintf(stderr, "Unknown option %s\n", argv[argc - 1]);
+            return 1;
+        }
+        return assemble_object(argv[2], argv[3], argc == 5);
+    }
+    int thread_count = 1;
+    int optimize = 0;
+    const char* map_filename = NULL;
+
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "-single-pass") == 0) {
+            program.single_pass = 1;
+        }
+        else if (strcmp(argv[i], "-O") == 0) {
+            optimize = 1;
+        }
+        else if (strcmp(argv[i], "-map") == 0 && i + 1 < argc) {
+            map_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count <= 0) {
+                thread_count = cpu_count();
+            }
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (program.single_pass && thread_count > 1) {
+        fprintf(stderr, "-single-pass and -threads cannot be combined\n");
+        return 1;
+    }
+    if (optimize && (program.single_pass || thread_count > 1)) {
+        fprintf(stderr, "-O needs the whole program: it cannot be combined with -single-pass or -threads\n");
+        return 1;
+    }
+
+    size_t source_size = 0;
+    size_t imem_size, dmem_size;
+    char* imem;
+    const char* mapped = NULL;
+    const char* source = NULL;
+
+    if (program.single_pass) {
+        /*One read of the mapped input: commands are encoded as they are parsed and forward references are backpatched*/
+        source = mapped = map_source(argv[1], &source_size);
+        if (mapped == NULL) {
+            source = read_source(&program.arena, argv[1], &source_size); //empty or unmappable file
+        }
+        if (source == NULL) {
+            printf("Error openning file program.asm");
+            return 1;
+        }
+        program.commands = (Command*)arena_alloc(&program.arena, 16 * sizeof(Command));
+        program.command_capacity = 16;
+        table_init(&program.labels, (int)(source_size / 128)); //grows as labels appear
+
+        if (!parse_source(&program, source, source_size) || !check_fixups(&program)) {
+            return 1;
+        }
+        imem = program.imem != NULL ? program.imem : "";
+        imem_size = program.imem_size;
+    }
+    else if (thread_count > 1 && (source = map_source(argv[1], &source_size)) != NULL
+        && assemble_parallel(&program, source, source_size, thread_count, &imem, &imem_size)) {
+        mapped = source; //labels and data point into the mapping until the output is written
+    }
+    else {
+        if (thread_count > 1 && source != NULL) {
+            unmap_source(source, source_size); //the parallel run failed, redo it sequentially for the error messages
+            free(program.labels.slots);
+            arena_free(&program.arena);
+            memset(&program, 0, sizeof(program));
+        }
+        source = read_source(&program.arena, argv[1], &source_size);
+        if (source == NULL) {
+            printf("Error openning file program.asm");
+            return 1;
+        }
+
+        /*Size the command array and the label table once, from the number of lines*/
+        int lines = count_lines(source, source_size);
+        program.commands = (Command*)arena_alloc(&program.arena, (size_t)lines * sizeof(Command));
+        program.command_capacity = lines;
+        table_init(&program.labels, lines);
+
+        if (!parse_source(&program, source, source_size)) {
+            return 1;
+        }
+        if (optimize) {
+            Opt_Stats stats;
+            optimize_program(&program, &stats);
+            printf("Optimizer: %d -> %d commands (%d removed, %d adds merged, %d constants folded, %d jumps threaded)\n",
+                stats.before, stats.after, stats.dead, stats.merged, stats.folded, stats.threaded);
+        }
+        imem = encode_program(&program, &imem_size);
+        if (imem == NULL) {
+            return 1;
+        }
+    }
+
+    if (program.address > CMD_MEM_LINES_SIZE) {
+        fprintf(stderr, "Warning: %d instructions do not fit in the %d-line instruction memory\n", program.address, CMD_MEM_LINES_SIZE);
+    }
+    char* dmem = encode_data(&program, &dmem_size);
+
+    if (!write_output(argv[2], imem, imem_size) || !write_output(argv[3], dmem, dmem_size)) {
+        return 1;
+    }
+    if (map_filename != NULL && !write_symbol_map(&program, map_filename)) {
+        return 1;
+    }
+
+    if (mapped != NULL) {
+        unmap_source(mapped, source_size);
+    }
+    free(program.imem);
+    free(program.labels.slots);
+    arena_free(&program.arena);
+    return 0;
+}
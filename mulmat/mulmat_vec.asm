@@ -0,0 +1,53 @@
+    vsetvl $t0,$imm1,$zero,$zero,4,0           # VL = 4, one matrix row
+    add $t0,$zero,$zero,$zero,0,0              # initialize 4i = 0
+LOOPI:
+    vsplat $vr0,$zero,$zero,$zero,0,0          # row accumulator = 0
+    add $t2,$zero,$zero,$zero,0,0              # initialize k=0
+MULTIPLY:
+    add $a1,$t0,$t2,$zero,0,0                  # $a1 = 4i+k
+    lw $a1,$a1,$imm1,$zero,256,0               # load mat1[i][k] from MEM[256+4i+k]
+    vsplat $vr1,$a1,$zero,$zero,0,0            # broadcast mat1[i][k]
+    mac $a2,$t2,$imm1,$imm2,4,272              # $a2 = 272+4k, row k of matrix 2
+    vlw $vr2,$a2,$zero,$zero,0,0               # load mat2[k][0..3]
+    vmac $vr0,$vr1,$vr2,$vr0,0,0               # row += mat1[i][k] * mat2[k][0..3]
+    add $t2,$t2,$imm1,$zero,1,0                # k = k+1
+    blt $zero,$t2,$imm1,$imm2,4,MULTIPLY       # if k<4 jump to MULTIPLY
+    vsw $vr0,$t0,$imm1,$zero,288,0             # mat3[i][0..3] = row
+    add $t0,$t0,$imm1,$zero,4,0                # 4i = 4i+4
+    blt $zero,$t0,$imm1,$imm2,16,LOOPI         # if i<4 jump to LOOPI
+    halt $zero,$zero,$zero,$zero, 0, 0         # halt
+
+    .word 256 1                  # matrix 1 starts at adddress 0x100
+	.word 257 2
+	.word 258 3
+	.word 259 4
+	.word 260 5
+	.word 261 6
+	.word 262 7
+	.word 263 8
+	.word 264 9
+	.word 265 10
+	.word 266 11
+	.word 267 12
+	.word 268 13
+	.word 269 14
+	.word 270 15
+	.word 271 16
+	.word 272 1                  # matrix 2 starts at address 0x110 
+	.word 273 2
+	.word 274 3
+	.word 275 4
+	.word 276 5
+	.word 277 6
+	.word 278 7
+	.word 279 8
+	.word 280 9
+	.word 281 10
+	.word 282 11
+	.word 283 12
+	.word 284 13
+	.word 285 14
+	.word 286 15
+	.word 287 16
+
+  # matrix 3 starts at address 0x120
\ No newline at end of file
@@ -0,0 +1,354 @@
+/**
+ * @file call_graph.c
+ * @brief Call graph profiler (-callgraph).
+ *
+ * A shadow call stack follows the program: a jal that links a register
+ * calls the function at its target, a taken branch through $ra returns to
+ * the frame that expects that PC (frames above it are dropped), an
+ * interrupt entry pushes a frame for its handler and reti pops up to the
+ * innermost one. A return that no frame expects is a plain jump.
+ *
+ * Functions are named after the label at their entry PC, from the map
+ * written by `asm -map`; the root frame is the label at PC 0 or "_start",
+ * unlabeled entries are "pc_XXX". Every cycle is charged to the node of
+ * the calling context tree on top of the stack, so a cycle costs one
+ * increment; a call or return walks the callee list of one node.
+ *
+ * The report lists per function the calls, inclusive cycles (recursive
+ * activations counted once), exclusive cycles and the deepest recursion.
+ * The folded file has one "root;caller;callee cycles" line per context,
+ * the input of flamegraph.pl and compatible tools.
+ *
+ * Functions Implemented:
+ * - call_graph_open: Allocates the profiler and reads the symbol map.
+ * - call_graph_cycle: Profiles one cycle.
+ * - call_graph_close: Writes the report and the folded stacks.
+ */
+
+#include "simulator_functions.h"
+
+#define ROOT_NAME "_start"
+
+// Reads the "<address hex> <label>" lines of the symbol map; the first label of an address names it
+static int read_symbols(call_graph* graph, const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return 0;
+    }
+
+    char line[CALL_NAME_LENGTH + 16];
+    char name[CALL_NAME_LENGTH];
+    unsigned int address;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "%x %63s", &address, name) == 2 && address < MEM_SIZE && graph->names[address][0] == '\0')
+        {
+            strcpy(graph->names[address], name);
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// Returns the context of the function at entry called from context parent, adding it on the first call
+static int child_context(call_graph* graph, int parent, int entry)
+{
+    int child = parent >= 0 ? graph->contexts[parent].first_child : -1;
+    for (; child >= 0; child = graph->contexts[child].next_sibling)
+    {
+        if (graph->contexts[child].entry == entry)
+        {
+            return child;
+        }
+    }
+
+    if (graph->context_count == graph->context_capacity)
+    {
+        int capacity = graph->context_capacity ? graph->context_capacity * 2 : 256;
+        call_context* contexts = (call_context*)realloc(graph->contexts, (size_t)capacity * sizeof(call_context));
+        if (!contexts)
+        {
+            perror("Failed to grow the calling context tree");
+            exit(EXIT_FAILURE);
+        }
+        graph->contexts = contexts;
+        graph->context_capacity = capacity;
+    }
+
+    child = graph->context_count++;
+    call_context* context = &graph->contexts[child];
+    context->parent = parent;
+    context->entry = entry;
+    context->first_child = -1;
+    context->cycles = 0;
+    context->next_sibling = -1;
+    if (parent >= 0)
+    {
+        context->next_sibling = graph->contexts[parent].first_child;
+        graph->contexts[parent].first_child = child;
+    }
+    return child;
+}
+
+// Pushes a frame for the function at entry
+static void push_frame(call_graph* graph, int entry, int return_pc, int interrupt)
+{
+    if (graph->depth == graph->frame_capacity)
+    {
+        int capacity = graph->frame_capacity ? graph->frame_capacity * 2 : 64;
+        call_frame* frames = (call_frame*)realloc(graph->frames, (size_t)capacity * sizeof(call_frame));
+        if (!frames)
+        {
+            perror("Failed to grow the shadow call stack");
+            exit(EXIT_FAILURE);
+        }
+        graph->frames = frames;
+        graph->frame_capacity = capacity;
+    }
+
+    call_frame* frame = &graph->frames[graph->depth];
+    frame->context = child_context(graph, graph->depth ? graph->frames[graph->depth - 1].context : -1, entry);
+    frame->return_pc = return_pc;
+    frame->interrupt = interrupt;
+    graph->depth++;
+    if (graph->depth > graph->max_depth)
+    {
+        graph->max_depth = graph->depth;
+    }
+
+    call_function* function = &graph->functions[entry];
+    function->calls++;
+    function->interrupt |= interrupt;
+    if (function->active++ == 0)
+    {
+        function->outer_entry = graph->cycles;
+    }
+    if (function->active > function->max_active)
+    {
+        function->max_active = function->active;
+    }
+}
+
+// Pops frames down to, and including, frame index first
+static void pop_frames(call_graph* graph, int first)
+{
+    while (graph->depth > first)
+    {
+        graph->depth--;
+        call_function* function = &graph->functions[graph->contexts[graph->frames[graph->depth].context].entry];
+        if (--function->active == 0)
+        {
+            function->inclusive += graph->cycles - function->outer_entry;
+        }
+    }
+}
+
+// Allocates the profiler, reads the symbol map ("-" for none) and pushes the root frame
+call_graph* call_graph_open(const char* symbols_filename)
+{
+    call_graph* graph = (call_graph*)calloc(1, sizeof(call_graph));
+    if (!graph)
+    {
+        perror("Failed to allocate the call graph profiler");
+        return NULL;
+    }
+    if (strcmp(symbols_filename, "-") != 0 && !read_symbols(graph, symbols_filename))
+    {
+        free(graph);
+        return NULL;
+    }
+
+    push_frame(graph, 0, -1, 0);
+    return graph;
+}
+
+// Charges a cycle to the current stack, then applies the call, return or reti of the instruction and an interrupt entry
+void call_graph_cycle(call_graph* graph, const instruction_decode* instruction, int pc, int next_pc, int stalled, int handler)
+{
+    /*
+        INPUT: instruction and pc (the instruction of the cycle), next_pc (the PC after it: irqreturn when a handler was
+               entered), stalled (1 if it waits for the data memory port), handler (entry PC of the handler entered at
+               the end of the cycle, -1 if none)
+    */
+
+    graph->contexts[graph->frames[graph->depth - 1].context].cycles++;
+    graph->cycles++;
+
+    if (!stalled)
+    {
+        long opcode = instruction->opcode;
+        if (opcode == JAL && instruction->rd != 0)
+        {
+            push_frame(graph, next_pc & MASK_12_BIT, pc + 1, 0);
+        }
+        else if (opcode >= BEQ && opcode <= BGE && instruction->rm == RETURN_REGISTER && next_pc != pc + 1)
+        {
+            int frame = graph->depth - 1;
+            while (frame > 0 && graph->frames[frame].return_pc != next_pc)
+            {
+                frame--;
+            }
+            if (frame > 0)
+            {
+                pop_frames(graph, frame);
+            }
+            else
+            {
+                graph->unmatched_returns++;
+            }
+        }
+        else if (opcode == RETI)
+        {
+            int frame = graph->depth - 1;
+            while (frame > 0 && !graph->frames[frame].interrupt)
+            {
+                frame--;
+            }
+            if (frame > 0)
+            {
+                pop_frames(graph, frame);
+            }
+            else
+            {
+                graph->unmatched_returns++;
+            }
+        }
+    }
+
+    if (handler >= 0)
+    {
+        push_frame(graph, handler & MASK_12_BIT, next_pc, 1);
+    }
+}
+
+// Name of the function at entry
+static const char* function_name(const call_graph* graph, int entry, char buffer[CALL_NAME_LENGTH])
+{
+    if (graph->names[entry][0] != '\0')
+    {
+        return graph->names[entry];
+    }
+    if (entry == 0)
+    {
+        return ROOT_NAME;
+    }
+    sprintf(buffer, "pc_%03X", entry);
+    return buffer;
+}
+
+// Profile whose functions compare_inclusive orders (qsort passes no context)
+static const call_graph* sorted_graph;
+
+// Orders functions by inclusive cycles, then by entry PC
+static int compare_inclusive(const void* a, const void* b)
+{
+    const call_function* first = &sorted_graph->functions[*(const int*)a];
+    const call_function* second = &sorted_graph->functions[*(const int*)b];
+    if (first->inclusive != second->inclusive)
+    {
+        return first->inclusive > second->inclusive ? -1 : 1;
+    }
+    return *(const int*)a - *(const int*)b;
+}
+
+// Writes the per-function report
+static void write_report(call_graph* graph, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return;
+    }
+
+    unsigned long long exclusive[MEM_SIZE] = { 0 };
+    for (int i = 0; i < graph->context_count; i++)
+    {
+        exclusive[graph->contexts[i].entry] += graph->contexts[i].cycles;
+    }
+    int entries[MEM_SIZE];
+    int count = 0;
+    for (int entry = 0; entry < MEM_SIZE; entry++)
+    {
+        if (graph->functions[entry].calls)
+        {
+            entries[count++] = entry;
+        }
+    }
+    sorted_graph = graph;
+    qsort(entries, count, sizeof(int), compare_inclusive);
+
+    double total = graph->cycles ? (double)graph->cycles : 1.0;
+    fprintf(file, "cycles: %llu, calling contexts: %d, deepest stack: %d frames, unmatched returns: %llu\n\n",
+        graph->cycles, graph->context_count, graph->max_depth, graph->unmatched_returns);
+    fprintf(file, "%-24s %5s %10s %12s %6s %12s %6s %9s\n", "function", "PC", "calls", "inclusive", "%", "exclusive", "%", "recursion");
+    for (int i = 0; i < count; i++)
+    {
+        char buffer[CALL_NAME_LENGTH];
+        const call_function* function = &graph->functions[entries[i]];
+        fprintf(file, "%-24s %5.3X %10llu %12llu %6.2f %12llu %6.2f %9d%s\n", function_name(graph, entries[i], buffer), entries[i],
+            function->calls, function->inclusive, 100.0 * function->inclusive / total, exclusive[entries[i]],
+            100.0 * exclusive[entries[i]] / total, function->max_active, function->interrupt ? " interrupt" : "");
+    }
+    fclose(file);
+}
+
+// Writes one "root;...;function cycles" line per context that was ever on top of the stack
+static void write_folded(call_graph* graph, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return;
+    }
+
+    int* path = (int*)malloc(((size_t)graph->max_depth + 1) * sizeof(int));
+    if (!path)
+    {
+        perror("Failed to allocate the folded stack path");
+        fclose(file);
+        return;
+    }
+    for (int i = 0; i < graph->context_count; i++)
+    {
+        if (graph->contexts[i].cycles == 0)
+        {
+            continue;
+        }
+        int length = 0;
+        for (int context = i; context >= 0; context = graph->contexts[context].parent)
+        {
+            path[length++] = context;
+        }
+        while (length-- > 0)
+        {
+            char buffer[CALL_NAME_LENGTH];
+            fputs(function_name(graph, graph->contexts[path[length]].entry, buffer), file);
+            fputc(length ? ';' : ' ', file);
+        }
+        fprintf(file, "%llu\n", graph->contexts[i].cycles);
+    }
+    free(path);
+    fclose(file);
+}
+
+// Charges the cycles after the last profiled one (halt, and the wait for the disk) and unwinds the stack
+void call_graph_close(call_graph* graph, unsigned long long cycles, const char* report_filename, const char* folded_filename)
+{
+    if (cycles > graph->cycles)
+    {
+        graph->contexts[graph->frames[graph->depth - 1].context].cycles += cycles - graph->cycles;
+        graph->cycles = cycles;
+    }
+    pop_frames(graph, 0);
+
+    write_report(graph, report_filename);
+    write_folded(graph, folded_filename);
+    free(graph->contexts);
+    free(graph->frames);
+    free(graph);
+}
@@ -0,0 +1,435 @@
+/**
+ * @file cosim.c
+ * @brief Lockstep co-simulation of the reference interpreter and a fast engine.
+ *
+ * With -cosim <engine> <block> the program runs on two machines built from the
+ * same inputs: the reference interpreter (simulate_cycle_reference, which
+ * writes the output files) and the chosen fast engine (whose outputs go to the
+ * null device). After every cycle the cheap part of the state is compared:
+ * cycle result, PC, registers, I/O registers, the disk controller and the
+ * graphics accelerator, the memory DMA engine, the interrupt return stack and VL. Every <block> cycles the memories (data memory,
+ * frame buffer, disk, vector registers) are compared too, and on a match both
+ * machines are checkpointed.
+ *
+ * A mismatch only says the machines diverged somewhere after the last
+ * checkpoint. The first differing cycle is then found by bisection: both
+ * machines are restored from the checkpoint, run to the middle of the
+ * interval and compared in full, and the half that still contains the
+ * divergence is kept. The report names the cycle, the instruction that ran in
+ * it and every piece of state that differs.
+ *
+ * Functions Implemented:
+ * - cosim_find_engine: Looks up a fast engine by name.
+ * - cosim_run: Runs the co-simulation.
+ */
+
+#include "simulator_functions.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define OUTPUT_FILE_COUNT 10   // Output files passed to simulate()
+#define DIFF_MEMORY_LINES 8    // Differing memory words listed in the report
+
+// Engines that can be checked against the reference interpreter
+static const struct
+{
+    const char* name;
+    cycle_function run;
+} engines[] = {
+    { "predecoded", simulate_cycle },
+};
+
+// Everything a cycle can change, for the shadow machine's storage and for checkpoints
+typedef struct
+{
+    int registers[REG_NUM];
+    int IOR[IOR_NUM];
+    int data_memory[MEM_SIZE];
+    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE];
+    int disk[NUMBER_OF_SECTORS][SECTOR_SIZE];
+    int pc;
+    unsigned int cycle;
+    disk_controller disk_ctl;
+    gfx_accel gfx;
+    vector_unit vector;
+    mem_dma memdma;
+    irq_controller irq_ctl;
+    perf_counters perf;
+    irq2_source irq2;
+    long irq2_offset; // File position that matches irq2.buffer
+} machine_image;
+
+// Looks up a fast engine by name
+cycle_function cosim_find_engine(const char* name)
+{
+    for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+    {
+        if (strcmp(engines[i].name, name) == 0)
+        {
+            return engines[i].run;
+        }
+    }
+    return NULL;
+}
+
+// Copies the machine into a checkpoint
+static void save_checkpoint(const sim_state* state, machine_image* image)
+{
+    memcpy(image->registers, state->registers, sizeof(image->registers));
+    memcpy(image->IOR, state->IOR, sizeof(image->IOR));
+    memcpy(image->data_memory, state->data_memory, sizeof(image->data_memory));
+    memcpy(image->screen, state->screen, sizeof(image->screen));
+    memcpy(image->disk, state->disk, sizeof(image->disk));
+    image->pc = state->pc;
+    image->cycle = state->cycle;
+    image->disk_ctl = state->disk_ctl;
+    image->gfx = state->gfx;
+    image->vector = state->vector;
+    image->memdma = state->memdma;
+    image->irq_ctl = state->irq_ctl;
+    image->perf = state->perf;
+    image->irq2 = state->irq2;
+    image->irq2_offset = state->irq2.file ? ftell(state->irq2.file) : 0;
+}
+
+// Puts the machine back in the state of a checkpoint
+static void restore_checkpoint(sim_state* state, const machine_image* image)
+{
+    memcpy(state->registers, image->registers, sizeof(image->registers));
+    memcpy(state->IOR, image->IOR, sizeof(image->IOR));
+    memcpy(state->data_memory, image->data_memory, sizeof(image->data_memory));
+    memcpy(state->screen, image->screen, sizeof(image->screen));
+    memcpy(state->disk, image->disk, sizeof(image->disk));
+    state->pc = image->pc;
+    state->cycle = image->cycle;
+    state->disk_ctl = image->disk_ctl;
+    state->gfx = image->gfx;
+    state->vector = image->vector;
+    state->memdma = image->memdma;
+    state->irq_ctl = image->irq_ctl;
+    state->perf = image->perf;
+    state->irq2 = image->irq2;
+    if (state->irq2.file)
+    {
+        fseek(state->irq2.file, image->irq2_offset, SEEK_SET);
+    }
+}
+
+// Compares the disk controllers: the command in service and the queue
+static int disk_state_matches(const disk_controller* a, const disk_controller* b)
+{
+    if (a->timer != b->timer || a->count != b->count || a->track != b->track || a->completed != b->completed || a->rejected != b->rejected
+        || a->dma_command != b->dma_command || a->dma_moved != b->dma_moved)
+    {
+        return 0;
+    }
+    for (int i = 0; i < a->count; i++)
+    {
+        if (memcmp(&a->queue[(a->first + i) % MAX_DISK_QUEUE], &b->queue[(b->first + i) % MAX_DISK_QUEUE], sizeof(disk_command)) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Compares the state checked on every cycle
+static int core_state_matches(const sim_state* a, const sim_state* b)
+{
+    return a->pc == b->pc && a->cycle == b->cycle && disk_state_matches(&a->disk_ctl, &b->disk_ctl)
+        && a->gfx.timer == b->gfx.timer && a->vector.length == b->vector.length
+        && a->memdma.timer == b->memdma.timer && memcmp(&a->irq_ctl, &b->irq_ctl, sizeof(irq_controller)) == 0
+        && memcmp(&a->perf, &b->perf, sizeof(perf_counters)) == 0
+        && memcmp(a->registers, b->registers, REG_NUM * sizeof(int)) == 0
+        && memcmp(a->IOR, b->IOR, IOR_NUM * sizeof(int)) == 0;
+}
+
+// Compares the memories, checked at block boundaries
+static int memory_matches(const sim_state* a, const sim_state* b)
+{
+    return memcmp(a->data_memory, b->data_memory, MEM_SIZE * sizeof(int)) == 0
+        && memcmp(a->screen, b->screen, MONITOR_SIZE * MONITOR_SIZE) == 0
+        && memcmp(a->disk, b->disk, MAX_DISK_ENTRIES * sizeof(int)) == 0
+        && memcmp(a->vector.registers, b->vector.registers, sizeof(a->vector.registers)) == 0;
+}
+
+// Runs a machine until its cycle counter reaches target. Returns the last cycle result.
+static int run_until(sim_state* state, cycle_function run, unsigned int target)
+{
+    int result = CYCLE_CONTINUE;
+
+    while (state->cycle < target && result == CYCLE_CONTINUE)
+    {
+        result = run(state);
+    }
+    return result;
+}
+
+// Lists every difference between the two machines
+static void print_state_diff(const sim_state* reference, const sim_state* fast)
+{
+    static const char* register_names[REG_NUM] = {
+        "$zero", "$imm1", "$imm2", "$v0", "$a0", "$a1", "$a2", "$t0",
+        "$t1", "$t2", "$s0", "$s1", "$s2", "$gp", "$sp", "$ra" };
+    int listed = 0;
+    int count = 0;
+
+    if (reference->pc != fast->pc)
+    {
+        fprintf(stderr, "  pc: reference %03X, fast %03X\n", reference->pc, fast->pc);
+    }
+    if (reference->cycle != fast->cycle)
+    {
+        fprintf(stderr, "  cycle: reference %u, fast %u\n", reference->cycle, fast->cycle);
+    }
+    if (!disk_state_matches(&reference->disk_ctl, &fast->disk_ctl))
+    {
+        fprintf(stderr, "  disk: reference timer %d, %d queued, %u done; fast timer %d, %d queued, %u done\n",
+            reference->disk_ctl.timer, reference->disk_ctl.count, reference->disk_ctl.completed,
+            fast->disk_ctl.timer, fast->disk_ctl.count, fast->disk_ctl.completed);
+    }
+    if (reference->gfx.timer != fast->gfx.timer)
+    {
+        fprintf(stderr, "  gfx: reference timer %d, fast timer %d\n", reference->gfx.timer, fast->gfx.timer);
+    }
+    if (reference->memdma.timer != fast->memdma.timer)
+    {
+        fprintf(stderr, "  memory dma: reference timer %d, fast timer %d\n", reference->memdma.timer, fast->memdma.timer);
+    }
+    if (memcmp(&reference->irq_ctl, &fast->irq_ctl, sizeof(irq_controller)) != 0)
+    {
+        fprintf(stderr, "  interrupt controller: reference depth %d, fast depth %d\n", reference->irq_ctl.depth, fast->irq_ctl.depth);
+    }
+    if (memcmp(&reference->perf, &fast->perf, sizeof(perf_counters)) != 0)
+    {
+        fprintf(stderr, "  performance counters: batched events differ\n");
+    }
+    if (reference->vector.length != fast->vector.length)
+    {
+        fprintf(stderr, "  VL: reference %d, fast %d\n", reference->vector.length, fast->vector.length);
+    }
+    for (int i = 0; i < REG_NUM; i++)
+    {
+        if (reference->registers[i] != fast->registers[i])
+        {
+            fprintf(stderr, "  %s: reference %08X, fast %08X\n", register_names[i], reference->registers[i], fast->registers[i]);
+        }
+    }
+    for (int i = 0; i < IOR_NUM; i++)
+    {
+        if (reference->IOR[i] != fast->IOR[i])
+        {
+            fprintf(stderr, "  IOR[%d]: reference %08X, fast %08X\n", i, reference->IOR[i], fast->IOR[i]);
+        }
+    }
+
+    for (int i = 0; i < MEM_SIZE; i++)
+    {
+        if (reference->data_memory[i] != fast->data_memory[i])
+        {
+            if (listed++ < DIFF_MEMORY_LINES)
+            {
+                fprintf(stderr, "  MEM[%03X]: reference %08X, fast %08X\n", i, reference->data_memory[i], fast->data_memory[i]);
+            }
+        }
+    }
+    if (listed > DIFF_MEMORY_LINES)
+    {
+        fprintf(stderr, "  ... %d data memory words differ\n", listed);
+    }
+
+    for (int i = 0; i < MONITOR_SIZE * MONITOR_SIZE; i++)
+    {
+        count += reference->screen[0][i] != fast->screen[0][i];
+    }
+    if (count)
+    {
+        fprintf(stderr, "  %d monitor pixels differ\n", count);
+    }
+
+    count = 0;
+    for (int i = 0; i < MAX_DISK_ENTRIES; i++)
+    {
+        count += reference->disk[0][i] != fast->disk[0][i];
+    }
+    if (count)
+    {
+        fprintf(stderr, "  %d disk words differ\n", count);
+    }
+
+    count = 0;
+    for (int v = 0; v < VECTOR_REGISTERS; v++)
+    {
+        for (int i = 0; i < MAX_VECTOR_LENGTH; i++)
+        {
+            count += reference->vector.registers[v][i] != fast->vector.registers[v][i];
+        }
+    }
+    if (count)
+    {
+        fprintf(stderr, "  %d vector register elements differ\n", count);
+    }
+}
+
+// Runs the reference interpreter and a fast engine side by side. Returns 1 if they diverged.
+int cosim_run(sim_state* reference, sim_options* options)
+{
+    /*
+        INPUT: reference (machine at cycle 0, writing the real output files), options (engine, block size, irq2 source)
+        OUTPUT: 0 when both engines ran to the same halt, 1 at the first divergence (reference left at that cycle).
+    */
+
+    cycle_function fast_run = cosim_find_engine(options->cosim_engine);
+    unsigned int block = options->cosim_block ? options->cosim_block : 1;
+    unsigned int checkpoints = 1;
+    int diverged = 0;
+    int reference_result;
+    int fast_result;
+
+    FILE* sink = fopen(NULL_DEVICE, "w");
+    FILE* sinks[OUTPUT_FILE_COUNT];
+    sim_state* fast = (sim_state*)calloc(1, sizeof(sim_state));
+    machine_image* storage = (machine_image*)malloc(sizeof(machine_image));
+    machine_image* reference_checkpoint = (machine_image*)malloc(sizeof(machine_image));
+    machine_image* fast_checkpoint = (machine_image*)malloc(sizeof(machine_image));
+
+    if (!fast_run || !sink || !fast || !storage || !reference_checkpoint || !fast_checkpoint)
+    {
+        fprintf(stderr, "Error: Failed to set up the co-simulation\n");
+        if (sink)
+        {
+            fclose(sink);
+        }
+        free(fast);
+        free(storage);
+        free(reference_checkpoint);
+        free(fast_checkpoint);
+        return 1;
+    }
+
+    // The fast machine starts as a copy of the reference one, with its own memories and irq2 stream
+    for (int i = 0; i < OUTPUT_FILE_COUNT; i++)
+    {
+        sinks[i] = sink;
+    }
+    save_checkpoint(reference, storage);
+    fast->output_files = sinks;
+    fast->registers = storage->registers;
+    fast->IOR = storage->IOR;
+    fast->data_memory = storage->data_memory;
+    fast->screen = storage->screen;
+    fast->disk = storage->disk;
+    fast->instruction_memory = reference->instruction_memory;
+    fast->pc = reference->pc;
+    fast->cycle = reference->cycle;
+    fast->disk_ctl = reference->disk_ctl;
+    fast->gfx = reference->gfx;
+    fast->vector = reference->vector;
+    fast->memdma = reference->memdma;
+    fast->irq_ctl = reference->irq_ctl;
+    fast->perf = reference->perf;
+    irq2_open(&fast->irq2, options->irq2_filename, &options->irq2);
+    predecode_program(fast);
+
+    save_checkpoint(reference, reference_checkpoint);
+    save_checkpoint(fast, fast_checkpoint);
+
+    // Lockstep run: registers every cycle, memories every block
+    for (;;)
+    {
+        reference_result = simulate_cycle_reference(reference);
+        fast_result = fast_run(fast);
+
+        int boundary = reference_result != CYCLE_CONTINUE || reference->cycle - reference_checkpoint->cycle >= block;
+        if (reference_result != fast_result || !core_state_matches(reference, fast) || (boundary && !memory_matches(reference, fast)))
+        {
+            diverged = 1;
+            break;
+        }
+        if (reference_result != CYCLE_CONTINUE)
+        {
+            break;
+        }
+        if (boundary)
+        {
+            save_checkpoint(reference, reference_checkpoint);
+            save_checkpoint(fast, fast_checkpoint);
+            checkpoints++;
+        }
+    }
+
+    if (!diverged)
+    {
+        fprintf(stderr, "Co-simulation: %s matches the reference for %u cycles (%u checkpoints)\n",
+            options->cosim_engine, reference->cycle, checkpoints);
+    }
+    else
+    {
+        // Bisection between the last matching checkpoint and the cycle the mismatch was seen
+        FILE** output_files = reference->output_files;
+        FILE* video_file = reference->video.file;
+        irq_stats* stats = reference->irq_stats;
+        unsigned int good = reference_checkpoint->cycle;
+        unsigned int bad = reference->cycle;
+        unsigned int replays = 0;
+
+        // Replayed cycles must not reach the output files a second time
+        reference->output_files = sinks;
+        reference->video.file = NULL;
+        reference->irq_stats = NULL;
+
+        while (bad - good > 1)
+        {
+            unsigned int middle = good + (bad - good) / 2;
+
+            restore_checkpoint(reference, reference_checkpoint);
+            restore_checkpoint(fast, fast_checkpoint);
+            reference_result = run_until(reference, simulate_cycle_reference, middle);
+            fast_result = run_until(fast, fast_run, middle);
+            replays++;
+
+            if (reference_result == fast_result && core_state_matches(reference, fast) && memory_matches(reference, fast))
+            {
+                good = middle;
+                save_checkpoint(reference, reference_checkpoint);
+                save_checkpoint(fast, fast_checkpoint);
+            }
+            else
+            {
+                bad = middle;
+            }
+        }
+
+        // Last matching state, then the one cycle that makes the machines differ
+        restore_checkpoint(reference, reference_checkpoint);
+        restore_checkpoint(fast, fast_checkpoint);
+        int pc = reference->pc;
+        reference_result = simulate_cycle_reference(reference);
+        fast_result = fast_run(fast);
+
+        fprintf(stderr, "Co-simulation: %s diverges from the reference in cycle %u (found with %u replays)\n",
+            options->cosim_engine, good, replays);
+        fprintf(stderr, "  instruction: PC=%03X %s\n", pc, reference->instruction_memory[pc]);
+        if (reference_result != fast_result)
+        {
+            fprintf(stderr, "  cycle result: reference %d, fast %d\n", reference_result, fast_result);
+        }
+        print_state_diff(reference, fast);
+
+        reference->output_files = output_files;
+        reference->video.file = video_file;
+        reference->irq_stats = stats;
+    }
+
+    irq2_close(&fast->irq2);
+    fclose(sink);
+    free(fast);
+    free(storage);
+    free(reference_checkpoint);
+    free(fast_checkpoint);
+    return diverged;
+}
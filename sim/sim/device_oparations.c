@@ -7,7 +7,7 @@
  *
  * Functions Implemented:
  * - update_monitor: Updates the monitor pixel data.
- * - handle_disk: Manages disk read/write operations.
+ * - handle_disk: Manages disk read/write operations (the queued controller is in disk_queue.c).
  * - manage_disk_status: Updates the disk's status during operations.
  * - handle_timer: Handles timer-based interrupts and events.
  * - dma_read_sector: Reads a sector from the disk to memory.
@@ -47,45 +47,80 @@ void update_monitor(unsigned int monitor_addr, unsigned int monitor_data, unsign
 }
 
 // Function to manage disk operations and their timing
-void handle_disk(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], int* disk_timer)
+void handle_disk(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], disk_controller* disk_ctl)
 {
-    // Check for a new command to execute
+    // Queued controller (-disk_queue / -disk_model)
+    if (disk_ctl->queued)
+    {
+        disk_queue_submit(disk_ctl, IOR, disk, data_memory);
+        return;
+    }
+
+    // A new command is ignored while the disk is busy
+    if (IOR[17] != 0)
+    {
+        if (IOR[14] == 1 || IOR[14] == 2)
+        {
+            disk_ctl->rejected++;
+        }
+        return;
+    }
+
+    // Check for a new command to execute. The service time already counts this cycle, hence the transfer delay of -1.
     if (IOR[14] == 1)
     { // diskcmd == 1 (read command)
         // Perform a DMA read operation from the specified sector to the memory buffer
-        dma_read_sector(IOR[15], IOR[16], data_memory, disk); // IOR[15] = sector, IOR[16] = buffer address
+        dma_transfer_start(disk_ctl, 1, IOR[15], IOR[16], -1, DISK_SERVICE_CYCLES, disk, data_memory); // IOR[15] = sector, IOR[16] = buffer address
         IOR[17] = 1;                                    // Mark the disk as busy
-        *disk_timer = 1024;                             // Set the disk service time to 1024 cycles
+        disk_ctl->timer = DISK_SERVICE_CYCLES;          // Set the disk service time to 1024 cycles
+        disk_ctl->transfer_cycles += DISK_SERVICE_CYCLES;
     }
     else if (IOR[14] == 2)
     { // diskcmd == 2 (write command)
         // Perform a DMA write operation from the memory buffer to the specified sector
-        dma_write_sector(IOR[15], IOR[16], data_memory, disk); // IOR[15] = sector, IOR[16] = buffer address
+        dma_transfer_start(disk_ctl, 2, IOR[15], IOR[16], -1, DISK_SERVICE_CYCLES, disk, data_memory); // IOR[15] = sector, IOR[16] = buffer address
         IOR[17] = 1;                                     // Mark the disk as busy
-        *disk_timer = 1024;                              // Set the disk service time to 1024 cycles
+        disk_ctl->timer = DISK_SERVICE_CYCLES;           // Set the disk service time to 1024 cycles
+        disk_ctl->transfer_cycles += DISK_SERVICE_CYCLES;
     }
 }
 
-void manage_disk_status(int IOR[IOR_NUM], int* disk_timer)
+// Counts down the disk service time. Returns 1 when the transfer completed and irq1 was raised.
+int manage_disk_status(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], disk_controller* disk_ctl)
 {
+    if (disk_ctl->queued)
+    {
+        return disk_queue_tick(disk_ctl, IOR, disk, data_memory);
+    }
+
     // Check if the disk is busy (diskstatus = 1)
     if (IOR[17] == 1)
     {
         // Decrement the disk timer
-        (*disk_timer)--;
+        disk_ctl->timer--;
 
+        // With -dma the command also waits for the last words of its transfer
+        if (disk_ctl->timer == 0 && dma_transfer_pending(disk_ctl))
+        {
+            disk_ctl->timer = 1;
+        }
         // If the operation is complete
-        if (*disk_timer == 0)
+        else if (disk_ctl->timer == 0)
         {
             IOR[17] = 0; // Mark the disk as free (diskstatus = 0)
             IOR[14] = 0; // Reset diskcmd to 0 (no command)
             IOR[4]  = 1;  // Set irq1status to 1 to trigger the status interrupt - letting the proccessor know finished performing a read or write command.
+            disk_ctl->completed++;
+            disk_ctl->latency_total += DISK_SERVICE_CYCLES;
+            disk_ctl->latency_max = DISK_SERVICE_CYCLES;
+            return 1;
         }
     }
+    return 0;
 }
 
-// Handles timer-based interrupts and events.
-void handle_timer_status(int IOR[IOR_NUM])
+// Handles timer-based interrupts and events. Returns 1 when irq0 was raised.
+int handle_timer_status(int IOR[IOR_NUM])
 {
     // Check if the timer is enabled (timerenable = 1) -IOR that says if timer is enabled or not
     if (IOR[11] == 1)
@@ -98,8 +133,10 @@ void handle_timer_status(int IOR[IOR_NUM])
         {
             IOR[3] = 1;  // Set irq0status to trigger an interrupt
             IOR[12] = 0; // Reset timercurrent to zero
+            return 1;
         }
     }
+    return 0;
 }
 
 // Function to read a sector from the disk to the memory buffer
@@ -0,0 +1,244 @@
+/**
+ * @file disk_queue.c
+ * @brief Queued disk controller with a seek and rotation latency model.
+ *
+ * Selected with -disk_queue <depth> and/or -disk_model <seek> <rotation>;
+ * without them handle_disk keeps the original single-command device.
+ *
+ * Queue: a diskcmd write is accepted while fewer than depth commands are
+ * outstanding (depth 0 keeps one command and ignores writes while busy, as
+ * the original device). Commands are served in order; the sector transfer
+ * starts with the command's service (see dma_engine.c), and every completion
+ * sets irq1status. diskcmd reads the command in service, diskstatus is 1 while
+ * any command is outstanding, and registers 24-27 expose the queue:
+ * diskqueue (outstanding commands), diskdone (completed commands),
+ * diskrejected (writes dropped because the queue was full or the command
+ * was invalid) and disktrack (track under the head). They are refreshed
+ * every cycle, so guest writes to them do not stick.
+ *
+ * Service time: DISK_SERVICE_CYCLES per command, or with -disk_model a
+ * disk of 16 tracks of DISK_SECTORS_PER_TRACK sectors, spinning once every
+ * rotation cycles from cycle 0: the head moves seek cycles per track, waits
+ * for the start of the sector to come around, then reads it for
+ * rotation / DISK_SECTORS_PER_TRACK cycles.
+ *
+ * Functions Implemented:
+ * - disk_queue_options_valid: Checks the queue and model parameters.
+ * - disk_queue_configure: Sets up an idle controller.
+ * - disk_queue_submit: Accepts a diskcmd write.
+ * - disk_queue_tick: Advances the command in service.
+ * - disk_queue_report: Writes the -disk_stats report.
+ */
+
+#include "simulator_functions.h"
+
+#define DISK_MAX_SEEK 1000000       // Cycles per track
+#define DISK_MAX_ROTATION 10000000  // Cycles per revolution
+
+// Checks the -disk_queue and -disk_model parameters
+int disk_queue_options_valid(const sim_options* options)
+{
+    if (options->disk_queue < 0 || options->disk_queue > MAX_DISK_QUEUE)
+    {
+        fprintf(stderr, "Error: -disk_queue depth must be between 0 and %d\n", MAX_DISK_QUEUE);
+        return 0;
+    }
+    if (options->disk_model && (options->disk_seek > DISK_MAX_SEEK || options->disk_rotation < DISK_SECTORS_PER_TRACK
+        || options->disk_rotation > DISK_MAX_ROTATION))
+    {
+        fprintf(stderr, "Error: -disk_model needs at most %d cycles per track and %d to %d cycles per revolution\n",
+            DISK_MAX_SEEK, DISK_SECTORS_PER_TRACK, DISK_MAX_ROTATION);
+        return 0;
+    }
+    if (options->dma_bandwidth < 0 || options->dma_bandwidth > MAX_DMA_BANDWIDTH)
+    {
+        fprintf(stderr, "Error: -dma bandwidth must be between 1 and %d words per cycle\n", MAX_DMA_BANDWIDTH);
+        return 0;
+    }
+    return 1;
+}
+
+// Sets up an idle controller
+void disk_queue_configure(disk_controller* disk_ctl, const sim_options* options)
+{
+    memset(disk_ctl, 0, sizeof(*disk_ctl));
+    disk_ctl->queued = options->disk_queue > 0 || options->disk_model;
+    disk_ctl->depth = options->disk_queue;
+    if (options->disk_model)
+    {
+        disk_ctl->seek_per_track = options->disk_seek;
+        disk_ctl->rotation = options->disk_rotation;
+    }
+    disk_ctl->dma_bandwidth = options->dma_bandwidth;
+    disk_ctl->dma_priority = options->dma_priority;
+}
+
+// Cycles to serve a command that starts at cycle start, of which the last transfer are under the sector.
+// Moves the head to the sector's track.
+static int service_time(disk_controller* disk_ctl, int sector, unsigned int start, int* transfer)
+{
+    if (disk_ctl->rotation == 0)
+    {
+        disk_ctl->transfer_cycles += DISK_SERVICE_CYCLES;
+        *transfer = DISK_SERVICE_CYCLES;
+        return DISK_SERVICE_CYCLES;
+    }
+
+    int track = sector / DISK_SECTORS_PER_TRACK;
+    unsigned int distance = track > disk_ctl->track ? track - disk_ctl->track : disk_ctl->track - track;
+    unsigned int seek = distance * disk_ctl->seek_per_track;
+    unsigned int slot = disk_ctl->rotation / DISK_SECTORS_PER_TRACK;
+
+    // Angle of the platter when the head arrives, and how long until the sector starts under it
+    unsigned int angle = (unsigned int)(((unsigned long long)start + seek) % disk_ctl->rotation);
+    unsigned int target = (unsigned int)(sector % DISK_SECTORS_PER_TRACK) * slot;
+    unsigned int wait = (target + disk_ctl->rotation - angle) % disk_ctl->rotation;
+
+    disk_ctl->track = track;
+    disk_ctl->seek_cycles += seek;
+    disk_ctl->rotation_cycles += wait;
+    disk_ctl->transfer_cycles += slot;
+    *transfer = (int)slot;
+    return (int)(seek + wait + slot);
+}
+
+// Starts the service time and the sector transfer of the command at the head of the queue.
+// ticking is 1 when the timer still counts down in this cycle, after the transfer had its turn at the port.
+static void start_command(disk_controller* disk_ctl, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], unsigned int cycle, int ticking)
+{
+    disk_command* command = &disk_ctl->queue[disk_ctl->first];
+    int transfer;
+
+    disk_ctl->timer = service_time(disk_ctl, command->sector, cycle, &transfer);
+    dma_transfer_start(disk_ctl, command->command, command->sector, command->buffer, disk_ctl->timer - transfer - ticking, transfer,
+        disk, data_memory);
+}
+
+// Refreshes the disk registers from the controller state
+static void publish(const disk_controller* disk_ctl, int IOR[IOR_NUM])
+{
+    IOR[14] = disk_ctl->count > 0 ? disk_ctl->queue[disk_ctl->first].command : 0;
+    IOR[17] = disk_ctl->count > 0;
+    IOR[IOR_DISK_QUEUE] = disk_ctl->count;
+    IOR[IOR_DISK_DONE] = (int)disk_ctl->completed;
+    IOR[IOR_DISK_REJECTED] = (int)disk_ctl->rejected;
+    IOR[IOR_DISK_TRACK] = disk_ctl->track;
+}
+
+// Accepts the command just written to diskcmd
+void disk_queue_submit(disk_controller* disk_ctl, int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE])
+{
+    /*
+        INPUT: IOR[14] (command), IOR[15] (sector), IOR[16] (buffer), IOR[8] (current cycle)
+        OUTPUT: The command is queued, and started when the disk was idle, or counted as rejected.
+    */
+
+    int command = IOR[14];
+    int capacity = disk_ctl->depth > 0 ? disk_ctl->depth : 1;
+
+    if (command != 1 && command != 2)
+    {
+        publish(disk_ctl, IOR); // Not a command, diskcmd keeps showing the one in service
+        return;
+    }
+
+    if (disk_ctl->count == capacity)
+    {
+        disk_ctl->rejected++;
+    }
+    else if (IOR[15] < 0 || IOR[15] >= NUMBER_OF_SECTORS || IOR[16] < 0 || IOR[16] > MEM_SIZE - SECTOR_SIZE)
+    {
+        fprintf(stderr, "Error: Disk command with sector %d and buffer %d is out of range, rejected\n", IOR[15], IOR[16]);
+        disk_ctl->rejected++;
+    }
+    else
+    {
+        disk_command* entry = &disk_ctl->queue[(disk_ctl->first + disk_ctl->count) % MAX_DISK_QUEUE];
+        entry->command = command;
+        entry->sector = IOR[15];
+        entry->buffer = IOR[16];
+        entry->submitted = (unsigned int)IOR[8];
+        disk_ctl->count++;
+        if (disk_ctl->count > disk_ctl->max_count)
+        {
+            disk_ctl->max_count = disk_ctl->count;
+        }
+        if (disk_ctl->count == 1)
+        {
+            start_command(disk_ctl, disk, data_memory, (unsigned int)IOR[8], 1);
+        }
+    }
+    publish(disk_ctl, IOR);
+}
+
+// Advances the command in service by one cycle. Returns 1 when it completed and raised irq1.
+int disk_queue_tick(disk_controller* disk_ctl, int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE])
+{
+    if (disk_ctl->count == 0 || --disk_ctl->timer > 0)
+    {
+        publish(disk_ctl, IOR);
+        return 0;
+    }
+    if (dma_transfer_pending(disk_ctl))
+    {
+        disk_ctl->timer = 1; // Completes once the last word moved
+        publish(disk_ctl, IOR);
+        return 0;
+    }
+
+    // Completed: the next command starts in the same cycle
+    unsigned int latency = (unsigned int)IOR[8] + 1 - disk_ctl->queue[disk_ctl->first].submitted;
+    disk_ctl->latency_total += latency;
+    if (latency > disk_ctl->latency_max)
+    {
+        disk_ctl->latency_max = latency;
+    }
+    disk_ctl->completed++;
+    disk_ctl->first = (disk_ctl->first + 1) % MAX_DISK_QUEUE;
+    disk_ctl->count--;
+    if (disk_ctl->count > 0)
+    {
+        start_command(disk_ctl, disk, data_memory, (unsigned int)IOR[8], 0);
+    }
+
+    IOR[4] = 1; // irq1status: one completion interrupt per command
+    publish(disk_ctl, IOR);
+    return 1;
+}
+
+// Writes the -disk_stats report
+void disk_queue_report(const disk_controller* disk_ctl, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return;
+    }
+
+    unsigned long long busy = disk_ctl->seek_cycles + disk_ctl->rotation_cycles + disk_ctl->transfer_cycles;
+
+    fprintf(file, "controller: %s, depth %d, %s\n", disk_ctl->queued ? "queued" : "single command", disk_ctl->depth,
+        disk_ctl->rotation ? "seek and rotation model" : "flat service time");
+    if (disk_ctl->rotation)
+    {
+        fprintf(file, "model: %u cycles per track, %u cycles per revolution\n", disk_ctl->seek_per_track, disk_ctl->rotation);
+    }
+    fprintf(file, "completed: %u\n", disk_ctl->completed);
+    fprintf(file, "rejected: %u\n", disk_ctl->rejected);
+    fprintf(file, "outstanding at exit: %d\n", disk_ctl->count);
+    fprintf(file, "deepest queue: %d\n", disk_ctl->max_count);
+    if (disk_ctl->completed > 0)
+    {
+        fprintf(file, "latency (accepted to completed): avg %.1f max %u cycles\n",
+            (double)disk_ctl->latency_total / disk_ctl->completed, disk_ctl->latency_max);
+    }
+    if (busy > 0)
+    {
+        fprintf(file, "service: %llu cycles, seek %llu (%.1f%%), rotation %llu (%.1f%%), transfer %llu (%.1f%%)\n", busy,
+            disk_ctl->seek_cycles, 100.0 * disk_ctl->seek_cycles / busy, disk_ctl->rotation_cycles, 100.0 * disk_ctl->rotation_cycles / busy,
+            disk_ctl->transfer_cycles, 100.0 * disk_ctl->transfer_cycles / busy);
+    }
+    dma_report(disk_ctl, file);
+    fclose(file);
+}
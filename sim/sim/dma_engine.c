@@ -0,0 +1,179 @@
+/**
+ * @file dma_engine.c
+ * @brief Cycle-spread disk DMA sharing the data memory port with lw/sw.
+ *
+ * Without -dma a sector is copied in one go when its command starts, as the
+ * original device did. With -dma <bandwidth> <cpu|dma> the words move one
+ * by one while the sector passes under the head: nothing during the seek and
+ * rotation wait of -disk_model, then an even rate over the transfer time
+ * (the whole 1024 cycles with the flat model). Word i of a read is in memory
+ * only once the engine moved it, and a write takes each word as it is when
+ * the engine reaches it.
+ *
+ * The data memory port moves bandwidth words per cycle. A lw/sw needs one of
+ * them and a vlw/vsw needs VL; the transfer needs the words that came due.
+ * With cpu priority the transfer gets what the instruction leaves and falls
+ * behind (a DMA stall cycle); with dma priority the instruction waits a
+ * cycle, without retiring, whenever the transfer leaves it too few words (a
+ * CPU stall cycle). A command only
+ * completes once all its words moved, so stalls can delay completions (late
+ * cycles). The counts are part of the -disk_stats report.
+ *
+ * Functions Implemented:
+ * - dma_transfer_start: Starts moving a sector.
+ * - dma_arbitrate: Shares one cycle of the data memory port.
+ * - dma_transfer_pending: Holds a completion until the last word moved.
+ * - dma_report: Writes the DMA lines of the disk report.
+ */
+
+#include "simulator_functions.h"
+
+// Starts moving a sector, at once without -dma
+void dma_transfer_start(disk_controller* disk_ctl, int command, int sector, int buffer, int delay, int duration,
+    int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE])
+{
+    /*
+        INPUT: command (1 = read, 2 = write), delay (cycles from the next arbitration until the sector reaches the head,
+               -1 when it is already there and this cycle's service time already passed), duration (cycles the sector
+               takes to pass under the head)
+    */
+
+    if (disk_ctl->dma_bandwidth == 0)
+    {
+        if (disk_ctl->mem_trace && (unsigned int)sector < NUMBER_OF_SECTORS)
+        {
+            mem_trace_range(disk_ctl->mem_trace, MEM_SOURCE_DISK, command == 1, buffer, SECTOR_SIZE);
+        }
+        if (command == 1)
+        {
+            dma_read_sector(sector, buffer, data_memory, disk);
+        }
+        else
+        {
+            dma_write_sector(sector, buffer, data_memory, disk);
+        }
+        return;
+    }
+
+    disk_ctl->dma_command = command;
+    disk_ctl->dma_sector = sector;
+    disk_ctl->dma_buffer = buffer;
+    disk_ctl->dma_moved = 0;
+    disk_ctl->dma_elapsed = 0;
+    disk_ctl->dma_delay = delay;
+    disk_ctl->dma_duration = duration > 0 ? duration : 1;
+}
+
+// Words of the transfer that passed under the head by now
+static int words_due(const disk_controller* disk_ctl)
+{
+    if (disk_ctl->dma_elapsed <= disk_ctl->dma_delay)
+    {
+        return 0;
+    }
+    long long passed = disk_ctl->dma_elapsed - disk_ctl->dma_delay;
+    if (passed >= disk_ctl->dma_duration)
+    {
+        return SECTOR_SIZE;
+    }
+    return (int)((passed * SECTOR_SIZE + disk_ctl->dma_duration - 1) / disk_ctl->dma_duration);
+}
+
+// Moves the next count words of the transfer
+static void move_words(disk_controller* disk_ctl, int count, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE])
+{
+    if (disk_ctl->mem_trace && (unsigned int)disk_ctl->dma_sector < NUMBER_OF_SECTORS)
+    {
+        mem_trace_range(disk_ctl->mem_trace, MEM_SOURCE_DISK, disk_ctl->dma_command == 1, disk_ctl->dma_buffer + disk_ctl->dma_moved, count);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int word = disk_ctl->dma_moved++;
+        unsigned int address = (unsigned int)disk_ctl->dma_buffer + word;
+
+        if (address >= MEM_SIZE || (unsigned int)disk_ctl->dma_sector >= NUMBER_OF_SECTORS)
+        {
+            continue; // Outside the memories, the word is lost
+        }
+        if (disk_ctl->dma_command == 1)
+        {
+            data_memory[address] = disk[disk_ctl->dma_sector][word];
+        }
+        else
+        {
+            disk[disk_ctl->dma_sector][word] = data_memory[address];
+        }
+    }
+    disk_ctl->dma_words += count;
+}
+
+// Shares this cycle's data memory port between lw/sw/vlw/vsw and the transfer
+int dma_arbitrate(disk_controller* disk_ctl, int cpu_words, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE])
+{
+    /*
+        INPUT: cpu_words (words the instruction of this cycle reads or writes: 1 for lw/sw, VL for vlw/vsw, else 0)
+        OUTPUT: Moves the words the transfer was granted. Returns 1 if the access must wait for the next cycle.
+    */
+
+    if (disk_ctl->dma_command == 0)
+    {
+        return 0;
+    }
+
+    disk_ctl->dma_elapsed++;
+    int wanted = words_due(disk_ctl) - disk_ctl->dma_moved;
+    if (wanted <= 0)
+    {
+        return 0;
+    }
+
+    int available = disk_ctl->dma_bandwidth;
+    int stall = 0;
+    if (disk_ctl->dma_priority == DMA_PRIORITY_CPU)
+    {
+        available = cpu_words < available ? available - cpu_words : 0;
+        if (cpu_words && available < wanted)
+        {
+            disk_ctl->dma_stall_cycles++;
+        }
+    }
+    else if (cpu_words && available - wanted < cpu_words)
+    {
+        stall = 1;
+        disk_ctl->cpu_stall_cycles++;
+    }
+
+    move_words(disk_ctl, wanted < available ? wanted : available, disk, data_memory);
+    if (disk_ctl->dma_moved == SECTOR_SIZE)
+    {
+        disk_ctl->dma_command = 0;
+    }
+    return stall;
+}
+
+// Returns 1 while the transfer still has words to move, counting the cycle as a late completion
+int dma_transfer_pending(disk_controller* disk_ctl)
+{
+    if (disk_ctl->dma_command == 0)
+    {
+        return 0;
+    }
+    disk_ctl->dma_late_cycles++;
+    return 1;
+}
+
+// Writes the DMA lines of the disk report
+void dma_report(const disk_controller* disk_ctl, FILE* file)
+{
+    if (disk_ctl->dma_bandwidth == 0)
+    {
+        fprintf(file, "dma: instant sector copies\n");
+        return;
+    }
+    fprintf(file, "dma: %d words per cycle, %s priority\n", disk_ctl->dma_bandwidth,
+        disk_ctl->dma_priority == DMA_PRIORITY_CPU ? "cpu" : "dma");
+    fprintf(file, "dma words moved: %llu\n", disk_ctl->dma_words);
+    fprintf(file, "dma stall cycles (transfer lost the port to lw/sw): %llu\n", disk_ctl->dma_stall_cycles);
+    fprintf(file, "cpu stall cycles (lw/sw waited for the transfer): %llu\n", disk_ctl->cpu_stall_cycles);
+    fprintf(file, "late completion cycles (waiting for the last words): %llu\n", disk_ctl->dma_late_cycles);
+}
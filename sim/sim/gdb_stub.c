@@ -0,0 +1,688 @@
+/**
+ * @file gdb_stub.c
+ * @brief GDB Remote Serial Protocol stub.
+ *
+ * With -gdb the simulator waits for one debugger connection on a local TCP
+ * port (a number) or Unix socket (a path), and runs the program only when the
+ * client asks for it. The target looks like this to the client:
+ * - 17 registers of 32 bits: $zero..$ra (0-15) and pc (16), little-endian.
+ * - Code addresses are instruction indices, the same values as pc.
+ * - Data memory is a byte-addressed view: word w is at bytes 4*w..4*w+3.
+ *
+ * Supported packets: ?, g, G, p, P, m, M, c, s, Z0/z0 and Z1/z1 (breakpoints),
+ * Z2/z2, Z3/z3 and Z4/z4 (write, read and access watchpoints), k, D,
+ * qSupported, qAttached and qXfer:features:read:target.xml. Ctrl-C stops a
+ * running program.
+ *
+ * Breakpoints and watchpoints are installed in the predecoded table (see
+ * predecode.c), so the cycle loop runs unchanged until one of them hits.
+ *
+ * Functions Implemented:
+ * - gdb_serve: Accepts a client and serves its requests until the program ends.
+ */
+
+#include "simulator_functions.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET gdb_socket;
+#define close_socket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int gdb_socket;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#endif
+
+#define GDB_PACKET_SIZE 4096
+#define GDB_REGISTERS (REG_NUM + 1)       // $zero..$ra, then pc
+#define GDB_POLL_CYCLES 65536             // Cycles between two checks for Ctrl-C while running
+#define GDB_DATA_BYTES (MEM_SIZE * 4)     // Size of the byte view of the data memory
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+// Register description sent to clients that ask for it
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\"><feature name=\"org.simp.core\">"
+    "<reg name=\"zero\" bitsize=\"32\" regnum=\"0\"/><reg name=\"imm1\" bitsize=\"32\"/>"
+    "<reg name=\"imm2\" bitsize=\"32\"/><reg name=\"v0\" bitsize=\"32\"/>"
+    "<reg name=\"a0\" bitsize=\"32\"/><reg name=\"a1\" bitsize=\"32\"/>"
+    "<reg name=\"a2\" bitsize=\"32\"/><reg name=\"t0\" bitsize=\"32\"/>"
+    "<reg name=\"t1\" bitsize=\"32\"/><reg name=\"t2\" bitsize=\"32\"/>"
+    "<reg name=\"s0\" bitsize=\"32\"/><reg name=\"s1\" bitsize=\"32\"/>"
+    "<reg name=\"s2\" bitsize=\"32\"/><reg name=\"gp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/><reg name=\"ra\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "</feature></target>";
+
+// Connection state
+typedef struct
+{
+    gdb_socket client;
+    unsigned char input[GDB_PACKET_SIZE]; // Bytes received but not consumed yet
+    int input_length;
+    int input_position;
+    char packet[GDB_PACKET_SIZE + 1];      // Last packet received (without framing)
+    char reply[GDB_PACKET_SIZE + 1];       // Reply being built
+} gdb_session;
+
+// Opens the listening socket and waits for one client
+static gdb_socket gdb_accept(const char* address)
+{
+    gdb_socket listener;
+    gdb_socket client;
+    char* end;
+    long port = strtol(address, &end, 10);
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    {
+        fprintf(stderr, "Error: Failed to initialize sockets\n");
+        return INVALID_SOCKET;
+    }
+#endif
+
+    if (*end == '\0' && port > 0 && port < 65536)
+    {
+        struct sockaddr_in addr;
+        int reuse = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // Local connections only
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET)
+        {
+            fprintf(stderr, "Error: Failed to create the debugger socket\n");
+            return INVALID_SOCKET;
+        }
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            fprintf(stderr, "Error: Failed to bind the debugger to port %ld\n", port);
+            close_socket(listener);
+            return INVALID_SOCKET;
+        }
+    }
+    else
+    {
+#ifdef _WIN32
+        fprintf(stderr, "Error: Invalid debugger port: %s\n", address);
+        return INVALID_SOCKET;
+#else
+        struct sockaddr_un addr;
+
+        if (strlen(address) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Error: Debugger socket path is too long: %s\n", address);
+            return INVALID_SOCKET;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, address);
+        unlink(address); // A stale socket file from an earlier run would make bind fail
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener == INVALID_SOCKET)
+        {
+            fprintf(stderr, "Error: Failed to create the debugger socket\n");
+            return INVALID_SOCKET;
+        }
+        if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            fprintf(stderr, "Error: Failed to bind the debugger to %s\n", address);
+            close_socket(listener);
+            return INVALID_SOCKET;
+        }
+#endif
+    }
+
+    if (listen(listener, 1) != 0)
+    {
+        fprintf(stderr, "Error: Failed to listen for the debugger on %s\n", address);
+        close_socket(listener);
+        return INVALID_SOCKET;
+    }
+
+    fprintf(stderr, "Waiting for the debugger on %s\n", address);
+    client = accept(listener, NULL, NULL);
+    close_socket(listener);
+
+    if (client != INVALID_SOCKET && *end == '\0')
+    {
+        int nodelay = 1; // Packets are tiny and strictly request/reply
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+    }
+    return client;
+}
+
+// Reads one byte from the client. Returns -1 when the connection is closed.
+static int gdb_read_byte(gdb_session* session)
+{
+    if (session->input_position == session->input_length)
+    {
+        int received = recv(session->client, (char*)session->input, sizeof(session->input), 0);
+        if (received <= 0)
+        {
+            return -1;
+        }
+        session->input_length = received;
+        session->input_position = 0;
+    }
+    return session->input[session->input_position++];
+}
+
+// Returns 1 if the client sent Ctrl-C while the program was running
+static int gdb_interrupt_pending(gdb_session* session)
+{
+    fd_set readable;
+    struct timeval no_wait = { 0, 0 };
+
+    if (session->input_position == session->input_length)
+    {
+        FD_ZERO(&readable);
+        FD_SET(session->client, &readable);
+        if (select((int)session->client + 1, &readable, NULL, NULL, &no_wait) <= 0)
+        {
+            return 0;
+        }
+    }
+
+    // Anything else received while running is dropped, the client waits for the stop reply
+    return gdb_read_byte(session) == 0x03;
+}
+
+// Value of a hex digit, or -1
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses a hex number at *text and moves past it
+static unsigned int parse_hex(const char** text)
+{
+    unsigned int value = 0;
+
+    while (hex_digit(**text) >= 0)
+    {
+        value = value * 16 + hex_digit(**text);
+        (*text)++;
+    }
+    return value;
+}
+
+// Writes a 32-bit value as 8 hex digits in target (little-endian) byte order
+static void put_word_hex(char* out, unsigned int value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        sprintf(out + i * 2, "%02x", (value >> (i * 8)) & 0xFF);
+    }
+}
+
+// Reads a 32-bit value from 8 hex digits in target byte order
+static unsigned int get_word_hex(const char* text)
+{
+    unsigned int value = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        value |= (unsigned int)(hex_digit(text[i * 2]) * 16 + hex_digit(text[i * 2 + 1])) << (i * 8);
+    }
+    return value;
+}
+
+// Receives one packet into session->packet. Returns its length, or -1 when the connection is closed.
+static int gdb_receive_packet(gdb_session* session)
+{
+    for (;;)
+    {
+        int c;
+        int length = 0;
+        unsigned char checksum = 0;
+
+        // Skip acks and anything else until the start of a packet
+        do
+        {
+            c = gdb_read_byte(session);
+            if (c < 0)
+            {
+                return -1;
+            }
+        } while (c != '$');
+
+        while ((c = gdb_read_byte(session)) != '#')
+        {
+            if (c < 0)
+            {
+                return -1;
+            }
+            if (length < GDB_PACKET_SIZE)
+            {
+                session->packet[length++] = (char)c;
+            }
+            checksum += (unsigned char)c;
+        }
+        session->packet[length] = '\0';
+
+        int high = gdb_read_byte(session);
+        int low = gdb_read_byte(session);
+        if (high < 0 || low < 0)
+        {
+            return -1;
+        }
+
+        if (hex_digit((char)high) * 16 + hex_digit((char)low) == checksum)
+        {
+            send(session->client, "+", 1, 0);
+            return length;
+        }
+        send(session->client, "-", 1, 0); // Ask for a retransmission
+    }
+}
+
+// Sends data as one packet and waits for the client to acknowledge it
+static void gdb_send_packet(gdb_session* session, const char* data)
+{
+    size_t length = strlen(data);
+    char* frame = (char*)malloc(length + 5); // "$", data, "#xx" and the terminator of sprintf
+    unsigned char checksum = 0;
+
+    if (!frame)
+    {
+        perror("Failed to allocate the packet buffer");
+        return;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        checksum += (unsigned char)data[i];
+    }
+    frame[0] = '$';
+    memcpy(frame + 1, data, length);
+    sprintf(frame + 1 + length, "#%02x", checksum);
+
+    // Resend on '-', give up on a closed connection
+    for (int attempt = 0; attempt < 8; attempt++)
+    {
+        send(session->client, frame, (int)length + 4, 0);
+        int ack = gdb_read_byte(session);
+        if (ack != '-')
+        {
+            break;
+        }
+    }
+    free(frame);
+}
+
+// Reads register n (0-15 general purpose, 16 pc)
+static unsigned int read_register(sim_state* state, int n)
+{
+    return n == REG_NUM ? (unsigned int)state->pc : (unsigned int)state->registers[n];
+}
+
+// Writes register n (0-15 general purpose, 16 pc)
+static void write_register(sim_state* state, int n, unsigned int value)
+{
+    if (n == REG_NUM)
+    {
+        state->pc = value & MASK_12_BIT;
+    }
+    else
+    {
+        state->registers[n] = (int)value;
+    }
+}
+
+// Reads one byte of the data memory view
+static unsigned int read_data_byte(sim_state* state, unsigned int address)
+{
+    return ((unsigned int)state->data_memory[address / 4] >> ((address % 4) * 8)) & 0xFF;
+}
+
+// Writes one byte of the data memory view
+static void write_data_byte(sim_state* state, unsigned int address, unsigned int value)
+{
+    unsigned int shift = (address % 4) * 8;
+    unsigned int word = (unsigned int)state->data_memory[address / 4];
+
+    word = (word & ~(0xFFu << shift)) | ((value & 0xFF) << shift);
+    state->data_memory[address / 4] = (int)word;
+}
+
+// Runs the program for one step or until something stops it. Returns a CYCLE_* code, or -1 on Ctrl-C.
+static int gdb_resume(gdb_session* session, sim_state* state, int step)
+{
+    predecoded_instruction* entry = &state->program[state->pc];
+
+    // A breakpoint at the current PC is where the last stop happened: run that instruction for real
+    int result = entry->execute(state, entry);
+
+    if (step || result != CYCLE_CONTINUE)
+    {
+        return result;
+    }
+
+    for (;;)
+    {
+        for (int i = 0; i < GDB_POLL_CYCLES; i++)
+        {
+            result = simulate_cycle(state);
+            if (result != CYCLE_CONTINUE)
+            {
+                return result;
+            }
+        }
+        if (gdb_interrupt_pending(session))
+        {
+            return -1;
+        }
+    }
+}
+
+// Builds the stop reply for the result of gdb_resume
+static void stop_reply(sim_state* state, int result, char* reply)
+{
+    static const char* watch_names[] = { "", "watch", "rwatch", "awatch" };
+
+    switch (result)
+    {
+    case CYCLE_HALTED:
+        strcpy(reply, "W00");
+        break;
+    case CYCLE_WATCHPOINT:
+        sprintf(reply, "T%02x%s:%x;", GDB_SIGTRAP, watch_names[state->watch_hit_type], state->watch_hit_address * 4);
+        break;
+    case -1:
+        sprintf(reply, "S%02x", GDB_SIGINT);
+        break;
+    default: // Breakpoint or completed step
+        sprintf(reply, "S%02x", GDB_SIGTRAP);
+        break;
+    }
+}
+
+// Handles Z/z packets. Returns 0 for a malformed or unsupported request.
+static int set_trap(sim_state* state, const char* args, int insert)
+{
+    int type = *args - '0';
+    unsigned int address;
+    unsigned int length;
+
+    if (args[1] != ',')
+    {
+        return 0;
+    }
+    args += 2;
+    address = parse_hex(&args);
+    if (*args++ != ',')
+    {
+        return 0;
+    }
+    length = parse_hex(&args);
+
+    // Software and hardware breakpoints are the same trap here
+    if (type == 0 || type == 1)
+    {
+        return insert ? set_breakpoint(state, (int)address) : clear_breakpoint(state, (int)address);
+    }
+
+    // Watchpoints: the byte range is widened to whole words
+    if (type >= 2 && type <= 4 && length > 0 && address < GDB_DATA_BYTES)
+    {
+        int watch_type = type == 2 ? WATCH_WRITE : (type == 3 ? WATCH_READ : WATCH_ACCESS);
+        unsigned int first = address / 4;
+        unsigned int last = (address + length - 1) / 4;
+        if (last >= MEM_SIZE)
+        {
+            last = MEM_SIZE - 1;
+        }
+        return insert ? set_watchpoint(state, first, last, watch_type) : clear_watchpoint(state, first, last, watch_type);
+    }
+    return 0;
+}
+
+// Handles qXfer:features:read:target.xml:offset,length
+static void read_target_xml(const char* args, char* reply)
+{
+    unsigned int offset = parse_hex(&args);
+    unsigned int length;
+    size_t total = sizeof(target_xml) - 1;
+
+    if (*args++ != ',')
+    {
+        strcpy(reply, "E01");
+        return;
+    }
+    length = parse_hex(&args);
+    if (length > GDB_PACKET_SIZE - 1)
+    {
+        length = GDB_PACKET_SIZE - 1;
+    }
+    if (offset >= total)
+    {
+        strcpy(reply, "l");
+        return;
+    }
+    if (length > total - offset)
+    {
+        length = (unsigned int)(total - offset);
+    }
+    reply[0] = offset + length < total ? 'm' : 'l';
+    memcpy(reply + 1, target_xml + offset, length);
+    reply[length + 1] = '\0';
+}
+
+// Runs the program under control of a GDB client
+void gdb_serve(sim_state* state, const char* address)
+{
+    /*
+        INPUT: state (predecoded machine at cycle 0), address (TCP port number or Unix socket path)
+        OUTPUT: Returns when the program halted, or the client killed it. If the client detaches or
+                the connection drops, the program runs to completion without the debugger.
+    */
+
+    gdb_session* session = (gdb_session*)calloc(1, sizeof(gdb_session));
+    int finished = 0; // 1 once the program halted or was killed
+
+    if (!session)
+    {
+        perror("Failed to allocate the debugger session");
+        return;
+    }
+
+    session->client = gdb_accept(address);
+    if (session->client == INVALID_SOCKET)
+    {
+        fprintf(stderr, "Error: No debugger connected, running without it\n");
+        free(session);
+        while (simulate_cycle(state) == CYCLE_CONTINUE);
+        return;
+    }
+
+    while (!finished)
+    {
+        char* reply = session->reply;
+        const char* args;
+
+        if (gdb_receive_packet(session) < 0)
+        {
+            break;
+        }
+        args = session->packet + 1;
+        reply[0] = '\0';
+
+        switch (session->packet[0])
+        {
+        case '?': // Why the target stopped
+            sprintf(reply, "S%02x", GDB_SIGTRAP);
+            break;
+
+        case 'g': // Read all registers
+            for (int n = 0; n < GDB_REGISTERS; n++)
+            {
+                put_word_hex(reply + n * 8, read_register(state, n));
+            }
+            break;
+
+        case 'G': // Write all registers
+            if (strlen(args) < GDB_REGISTERS * 8)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (int n = 0; n < GDB_REGISTERS; n++)
+            {
+                write_register(state, n, get_word_hex(args + n * 8));
+            }
+            strcpy(reply, "OK");
+            break;
+
+        case 'p': // Read one register
+        {
+            unsigned int n = parse_hex(&args);
+            if (n >= GDB_REGISTERS)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            put_word_hex(reply, read_register(state, n));
+            break;
+        }
+
+        case 'P': // Write one register
+        {
+            unsigned int n = parse_hex(&args);
+            if (n >= GDB_REGISTERS || *args != '=' || strlen(args + 1) < 8)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            write_register(state, n, get_word_hex(args + 1));
+            strcpy(reply, "OK");
+            break;
+        }
+
+        case 'm': // Read memory
+        case 'M': // Write memory
+        {
+            unsigned int start = parse_hex(&args);
+            unsigned int length;
+            if (*args++ != ',')
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            length = parse_hex(&args);
+            if (start >= GDB_DATA_BYTES || length > GDB_DATA_BYTES - start || length > GDB_PACKET_SIZE / 2)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            if (session->packet[0] == 'm')
+            {
+                for (unsigned int i = 0; i < length; i++)
+                {
+                    sprintf(reply + i * 2, "%02x", read_data_byte(state, start + i));
+                }
+                break;
+            }
+            if (*args++ != ':' || strlen(args) < length * 2)
+            {
+                strcpy(reply, "E01");
+                break;
+            }
+            for (unsigned int i = 0; i < length; i++)
+            {
+                write_data_byte(state, start + i, hex_digit(args[i * 2]) * 16 + hex_digit(args[i * 2 + 1]));
+            }
+            strcpy(reply, "OK");
+            break;
+        }
+
+        case 'c': // Continue, optionally from a new address
+        case 's': // Single cycle
+        {
+            int result;
+            if (*args != '\0')
+            {
+                write_register(state, REG_NUM, parse_hex(&args));
+            }
+            result = gdb_resume(session, state, session->packet[0] == 's');
+            stop_reply(state, result, reply);
+            finished = result == CYCLE_HALTED;
+            break;
+        }
+
+        case 'Z': // Insert breakpoint / watchpoint
+        case 'z': // Remove breakpoint / watchpoint
+            strcpy(reply, set_trap(state, args, session->packet[0] == 'Z') ? "OK" : "E01");
+            break;
+
+        case 'k': // Kill: stop here and write the outputs
+            finished = 1;
+            continue;
+
+        case 'D': // Detach: the program runs on without the debugger
+            strcpy(reply, "OK");
+            gdb_send_packet(session, reply);
+            clear_debug_traps(state);
+            while (simulate_cycle(state) == CYCLE_CONTINUE);
+            finished = 1;
+            continue;
+
+        case 'H': // Thread selection, there is only one
+            strcpy(reply, "OK");
+            break;
+
+        case 'q':
+            if (strncmp(session->packet, "qSupported", 10) == 0)
+            {
+                sprintf(reply, "PacketSize=%x;qXfer:features:read+", GDB_PACKET_SIZE);
+            }
+            else if (strcmp(session->packet, "qAttached") == 0)
+            {
+                strcpy(reply, "1");
+            }
+            else if (strncmp(session->packet, "qXfer:features:read:target.xml:", 31) == 0)
+            {
+                read_target_xml(session->packet + 31, reply);
+            }
+            break;
+
+        default: // Unsupported packets get an empty reply
+            break;
+        }
+
+        gdb_send_packet(session, reply);
+    }
+
+    // Connection lost before the end: finish the run so the output files are complete
+    if (!finished)
+    {
+        clear_debug_traps(state);
+        while (simulate_cycle(state) == CYCLE_CONTINUE);
+    }
+
+    close_socket(session->client);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(session);
+}
@@ -0,0 +1,297 @@
+/**
+ * @file gfx_accel.c
+ * @brief 2D graphics accelerator for the monitor: fill, blit, line and circle.
+ *
+ * A nonzero write to gfxcmd starts a command with the parameters in
+ * gfxpos, gfxend, gfxcolor and gfxsrc. Points are packed like monitoraddr
+ * (x in bits 8-15, y in bits 0-7), so a pixel drawn here lands where a
+ * monitorcmd write of the same address would:
+ * - 1 fill:   rectangle with corners gfxpos and gfxend, in gfxcolor.
+ * - 2 blit:   rectangle with corners gfxpos and gfxend, copied row by row
+ *             from data memory at gfxsrc, 4 pixels per word (byte 0 first).
+ * - 3 line:   from gfxpos to gfxend, in gfxcolor.
+ * - 4 circle: outline centered at gfxpos with radius gfxend, in gfxcolor.
+ * - 5 disc:   filled circle centered at gfxpos with radius gfxend.
+ * Shapes are clipped to the screen. The pixels are drawn (and a blit source
+ * read) when the command starts; the device then stays busy for one cycle
+ * per GFX_PIXELS_PER_CYCLE pixels. While busy gfxstatus is 1, gfxcmd reads
+ * the running command and writes to it are ignored. On completion gfxcmd
+ * and gfxstatus clear and the caller raises the interrupt (irq2status, or
+ * its own source with -irqctl, see irq_controller.c).
+ *
+ * Functions Implemented:
+ * - gfx_accel_tick: Starts, times and completes commands.
+ */
+
+#include "simulator_functions.h"
+
+#define GFX_MAX_RADIUS 512 // Largest circle radius, anything bigger covers the screen anyway
+
+// Blits copy whole rows on hosts that store the low byte of a word first (Windows always does)
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define GFX_LITTLE_ENDIAN 1
+#else
+#define GFX_LITTLE_ENDIAN 0
+#endif
+
+// Clip rectangle of the pixels touched by a command, for the video stream
+typedef struct
+{
+    int x0, y0, x1, y1; // Inclusive, x0 > x1 when nothing was drawn
+} gfx_box;
+
+// Sets one pixel if it is on the screen. Returns 1 if it was drawn.
+static int plot(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], gfx_box* box, int x, int y, unsigned char color)
+{
+    if (x < 0 || x >= MONITOR_SIZE || y < 0 || y >= MONITOR_SIZE)
+    {
+        return 0;
+    }
+    screen[y][x] = color;
+    if (box->x0 > box->x1)
+    {
+        box->x0 = box->x1 = x;
+        box->y0 = box->y1 = y;
+        return 1;
+    }
+    box->x0 = x < box->x0 ? x : box->x0;
+    box->x1 = x > box->x1 ? x : box->x1;
+    box->y0 = y < box->y0 ? y : box->y0;
+    box->y1 = y > box->y1 ? y : box->y1;
+    return 1;
+}
+
+// Fills rows y0..y1, columns x0..x1 (already on the screen). Returns the pixel count.
+static int fill_rect(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int x0, int y0, int x1, int y1, unsigned char color)
+{
+    for (int y = y0; y <= y1; y++)
+    {
+        memset(&screen[y][x0], color, (size_t)(x1 - x0 + 1));
+    }
+    return (x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+// Copies packed pixels from data memory into rows y0..y1, columns x0..x1. Returns the pixel count, -1 if the source does not fit.
+static int blit_rect(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int data_memory[MEM_SIZE], int source, int x0, int y0, int x1, int y1)
+{
+    int width = x1 - x0 + 1;
+    int pixels = width * (y1 - y0 + 1);
+
+    if (source < 0 || source > MEM_SIZE - (pixels + 3) / 4)
+    {
+        fprintf(stderr, "Error: gfx blit of %d pixels from address %d is outside data memory\n", pixels, source);
+        return -1;
+    }
+
+#if GFX_LITTLE_ENDIAN
+    // Byte 0 of a word is stored first, so the packed pixels are already in screen order: one copy per row
+    const unsigned char* bytes = (const unsigned char*)&data_memory[source];
+    for (int y = y0; y <= y1; y++, bytes += width)
+    {
+        memcpy(&screen[y][x0], bytes, (size_t)width);
+    }
+#else
+    const unsigned int* words = (const unsigned int*)&data_memory[source];
+    int k = 0;
+    for (int y = y0; y <= y1; y++)
+    {
+        unsigned char* row = &screen[y][x0];
+        for (int x = 0; x < width; x++, k++)
+        {
+            row[x] = (unsigned char)(words[k >> 2] >> ((k & 3) * 8));
+        }
+    }
+#endif
+    return pixels;
+}
+
+// Draws a line with Bresenham's algorithm. Returns the pixel count.
+static int draw_line(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], gfx_box* box, int x0, int y0, int x1, int y1, unsigned char color)
+{
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    int pixels = 0;
+
+    for (;;)
+    {
+        pixels += plot(screen, box, x0, y0, color);
+        if (x0 == x1 && y0 == y1)
+        {
+            return pixels;
+        }
+        int e2 = 2 * error;
+        if (e2 >= dy)
+        {
+            error += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx)
+        {
+            error += dx;
+            y0 += sy;
+        }
+    }
+}
+
+// Draws a circle outline with the midpoint algorithm. Returns the pixel count.
+static int draw_circle(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], gfx_box* box, int cx, int cy, int radius, unsigned char color)
+{
+    int x = radius, y = 0;
+    int error = 1 - radius;
+    int pixels = 0;
+
+    while (x >= y)
+    {
+        // The eight octants; on the diagonals and axes some points coincide, they are drawn twice
+        pixels += plot(screen, box, cx + x, cy + y, color) + plot(screen, box, cx - x, cy + y, color);
+        pixels += plot(screen, box, cx + x, cy - y, color) + plot(screen, box, cx - x, cy - y, color);
+        pixels += plot(screen, box, cx + y, cy + x, color) + plot(screen, box, cx - y, cy + x, color);
+        pixels += plot(screen, box, cx + y, cy - x, color) + plot(screen, box, cx - y, cy - x, color);
+        y++;
+        if (error < 0)
+        {
+            error += 2 * y + 1;
+        }
+        else
+        {
+            x--;
+            error += 2 * (y - x) + 1;
+        }
+    }
+    return pixels;
+}
+
+// Fills every pixel within radius of the center, one span per row. Returns the pixel count.
+static int draw_disc(unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], gfx_box* box, int cx, int cy, int radius, unsigned char color)
+{
+    int pixels = 0;
+
+    for (int dy = -radius; dy <= radius; dy++)
+    {
+        int y = cy + dy;
+        if (y < 0 || y >= MONITOR_SIZE)
+        {
+            continue;
+        }
+
+        // Largest half width with dx^2 + dy^2 <= radius^2
+        int room = radius * radius - dy * dy;
+        int half = (int)sqrt((double)room);
+        while (half * half > room)
+        {
+            half--;
+        }
+        while ((half + 1) * (half + 1) <= room)
+        {
+            half++;
+        }
+
+        int x0 = cx - half < 0 ? 0 : cx - half;
+        int x1 = cx + half >= MONITOR_SIZE ? MONITOR_SIZE - 1 : cx + half;
+        if (x0 > x1)
+        {
+            continue;
+        }
+        pixels += fill_rect(screen, x0, y, x1, y, color);
+        plot(screen, box, x0, y, color);
+        plot(screen, box, x1, y, color);
+    }
+    return pixels;
+}
+
+// Draws the command in gfxcmd. Returns the pixel count, -1 if the command was rejected.
+static int draw(int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int data_memory[MEM_SIZE], gfx_box* box)
+{
+    int x0 = (IOR[IOR_GFX_POS] >> 8) & 0xFF, y0 = IOR[IOR_GFX_POS] & 0xFF;
+    int x1 = (IOR[IOR_GFX_END] >> 8) & 0xFF, y1 = IOR[IOR_GFX_END] & 0xFF;
+    unsigned char color = IOR[IOR_GFX_COLOR] & 0xFF;
+    int command = IOR[IOR_GFX_CMD];
+
+    if (command == GFX_FILL || command == GFX_BLIT)
+    {
+        // Corners in any order
+        box->x0 = x0 < x1 ? x0 : x1;
+        box->x1 = x0 < x1 ? x1 : x0;
+        box->y0 = y0 < y1 ? y0 : y1;
+        box->y1 = y0 < y1 ? y1 : y0;
+        if (command == GFX_FILL)
+        {
+            return fill_rect(screen, box->x0, box->y0, box->x1, box->y1, color);
+        }
+        return blit_rect(screen, data_memory, IOR[IOR_GFX_SRC], box->x0, box->y0, box->x1, box->y1);
+    }
+    if (command == GFX_LINE)
+    {
+        return draw_line(screen, box, x0, y0, x1, y1, color);
+    }
+    if (command == GFX_CIRCLE || command == GFX_DISC)
+    {
+        int radius = IOR[IOR_GFX_END];
+        if (radius < 0 || radius > GFX_MAX_RADIUS)
+        {
+            fprintf(stderr, "Error: gfx circle radius %d must be between 0 and %d\n", radius, GFX_MAX_RADIUS);
+            return -1;
+        }
+        if (command == GFX_CIRCLE)
+        {
+            return draw_circle(screen, box, x0, y0, radius, color);
+        }
+        return draw_disc(screen, box, x0, y0, radius, color);
+    }
+
+    fprintf(stderr, "Error: Unknown gfx command %d\n", command);
+    return -1;
+}
+
+// Starts a command written to gfxcmd, or advances the one running. Returns 1 when it completed.
+int gfx_accel_tick(gfx_accel* gfx, int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int data_memory[MEM_SIZE], monitor_video* video)
+{
+    /*
+        INPUT: video (stream whose dirty rows track the drawn pixels, NULL when capture is off)
+        OUTPUT: Draws a new command and sets the busy time; on completion clears gfxcmd/gfxstatus.
+    */
+
+    if (gfx->timer > 0)
+    {
+        if (--gfx->timer > 0)
+        {
+            IOR[IOR_GFX_CMD] = gfx->command; // Writes while busy do not stick
+            IOR[IOR_GFX_STATUS] = 1;
+            return 0;
+        }
+        gfx->command = 0;
+        IOR[IOR_GFX_CMD] = 0;
+        IOR[IOR_GFX_STATUS] = 0;
+        return 1;
+    }
+
+    IOR[IOR_GFX_STATUS] = 0;
+    if (IOR[IOR_GFX_CMD] == 0)
+    {
+        return 0;
+    }
+
+    gfx_box box = { 1, 1, 0, 0 };
+    int pixels = draw(IOR, screen, data_memory, &box);
+    if (pixels < 0)
+    {
+        IOR[IOR_GFX_CMD] = 0;
+        return 0;
+    }
+
+    if (gfx->mem_trace && IOR[IOR_GFX_CMD] == GFX_BLIT)
+    {
+        mem_trace_range(gfx->mem_trace, MEM_SOURCE_GFX, 0, IOR[IOR_GFX_SRC], (pixels + 3) / 4);
+    }
+
+    if (video && box.x0 <= box.x1)
+    {
+        monitor_video_mark_rect(video, box.x0, box.y0, box.x1, box.y1);
+    }
+
+    gfx->command = IOR[IOR_GFX_CMD];
+    gfx->timer = pixels > GFX_PIXELS_PER_CYCLE ? (pixels + GFX_PIXELS_PER_CYCLE - 1) / GFX_PIXELS_PER_CYCLE : 1;
+    IOR[IOR_GFX_STATUS] = 1;
+    return 0;
+}
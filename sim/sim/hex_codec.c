@@ -0,0 +1,322 @@
+/**
+ * @file hex_codec.c
+ * @brief Bulk hex encoding and decoding for the memory, disk and monitor dumps.
+ *
+ * The dump files hold one fixed-width hex value per line ("%08X\n" for words,
+ * "%02X\n" for pixels). Instead of one fprintf/fscanf call per value, these
+ * kernels convert whole arrays in memory so the caller can move the file with
+ * a single fread/fwrite.
+ *
+ * Vector paths are selected at compile time:
+ * - AVX2 (__AVX2__): 8 words per iteration.
+ * - SSSE3/SSE4 (__SSSE3__, __SSE4_1__ or __AVX__, and with AVX2): 4 words or
+ *   16 pixels per iteration. The pixel kernel has no AVX2 version, since its
+ *   output shuffles would have to cross the 128-bit lanes.
+ * - Scalar fallback with a byte-to-digits table everywhere else.
+ * All paths produce byte-identical output.
+ *
+ * Functions Implemented:
+ * - hex_encode_words: Encodes 32-bit words as "%08X\n" lines.
+ * - hex_encode_bytes: Encodes bytes as "%02X\n" lines.
+ * - hex_decode_words: Parses whitespace-separated hex words like fscanf("%8x").
+ */
+
+#include "simulator_functions.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HEX_CODEC_AVX2
+#define HEX_CODEC_SSE
+#elif defined(__SSSE3__) || defined(__SSE4_1__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define HEX_CODEC_SSE
+#endif
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// Two ASCII digits for every byte value, built on first use
+static char byte_to_hex[256][2];
+static int byte_to_hex_ready = 0;
+
+static void build_byte_table(void)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        byte_to_hex[i][0] = hex_digits[i >> 4];
+        byte_to_hex[i][1] = hex_digits[i & 0xF];
+    }
+    byte_to_hex_ready = 1;
+}
+
+// Scalar encoding of one word as 8 digits and a newline
+static void encode_word_scalar(char* out, unsigned int word)
+{
+    memcpy(out + 0, byte_to_hex[(word >> 24) & 0xFF], 2);
+    memcpy(out + 2, byte_to_hex[(word >> 16) & 0xFF], 2);
+    memcpy(out + 4, byte_to_hex[(word >> 8) & 0xFF], 2);
+    memcpy(out + 6, byte_to_hex[word & 0xFF], 2);
+    out[8] = '\n';
+}
+
+#ifdef HEX_CODEC_SSE
+// Converts 4 words into 32 digits (two registers of 16 digits, 2 words each)
+static void encode_4_words_sse(char* out, const int* words)
+{
+    const __m128i to_big_endian = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)words), to_big_endian);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+    __m128i lo = _mm_and_si128(v, low_nibble);
+    __m128i first = _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(hi, lo));  // words 0 and 1
+    __m128i second = _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(hi, lo)); // words 2 and 3
+
+    _mm_storel_epi64((__m128i*)(out + 0), first);
+    out[8] = '\n';
+    _mm_storel_epi64((__m128i*)(out + 9), _mm_srli_si128(first, 8));
+    out[17] = '\n';
+    _mm_storel_epi64((__m128i*)(out + 18), second);
+    out[26] = '\n';
+    _mm_storel_epi64((__m128i*)(out + 27), _mm_srli_si128(second, 8));
+    out[35] = '\n';
+}
+
+// Converts 16 bytes into 16 "XX\n" lines (48 bytes). A -1 shuffle index gives 0, filled by the other half or a newline.
+static void encode_16_bytes_sse(char* out, const unsigned char* bytes)
+{
+    const __m128i digits = _mm_loadu_si128((const __m128i*)hex_digits);
+    const __m128i low_nibble = _mm_set1_epi8(0x0F);
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    __m128i v = _mm_loadu_si128((const __m128i*)bytes);
+    __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, low_nibble));
+    __m128i first = _mm_unpacklo_epi8(hi, lo);  // digit pairs of bytes 0-7
+    __m128i second = _mm_unpackhi_epi8(hi, lo); // digit pairs of bytes 8-15
+
+    __m128i out0 = _mm_shuffle_epi8(first, _mm_setr_epi8(0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1, 10));
+    __m128i out1 = _mm_or_si128(
+        _mm_shuffle_epi8(first, _mm_setr_epi8(11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(second, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, 2, 3, -1, 4, 5)));
+    __m128i out2 = _mm_shuffle_epi8(second, _mm_setr_epi8(-1, 6, 7, -1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15, -1));
+
+    // Every third output byte is a newline, starting at offset 2
+    out0 = _mm_or_si128(out0, _mm_and_si128(newline, _mm_setr_epi8(0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0)));
+    out1 = _mm_or_si128(out1, _mm_and_si128(newline, _mm_setr_epi8(0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0)));
+    out2 = _mm_or_si128(out2, _mm_and_si128(newline, _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1)));
+
+    _mm_storeu_si128((__m128i*)(out + 0), out0);
+    _mm_storeu_si128((__m128i*)(out + 16), out1);
+    _mm_storeu_si128((__m128i*)(out + 32), out2);
+}
+#endif
+
+#ifdef HEX_CODEC_AVX2
+// Converts 8 words into 64 digits (two 128-bit lanes of 4 words)
+static void encode_8_words_avx2(char* out, const int* words)
+{
+    const __m256i to_big_endian = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hex_digits));
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)words), to_big_endian);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble);
+    __m256i lo = _mm256_and_si256(v, low_nibble);
+    __m256i first = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(hi, lo));  // words 0,1 | 4,5
+    __m256i second = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(hi, lo)); // words 2,3 | 6,7
+
+    __m128i parts[4] = {
+        _mm256_castsi256_si128(first), _mm256_castsi256_si128(second),
+        _mm256_extracti128_si256(first, 1), _mm256_extracti128_si256(second, 1) };
+
+    for (int i = 0; i < 4; i++)
+    {
+        char* line = out + i * 18;
+        _mm_storel_epi64((__m128i*)line, parts[i]);
+        line[8] = '\n';
+        _mm_storel_epi64((__m128i*)(line + 9), _mm_srli_si128(parts[i], 8));
+        line[17] = '\n';
+    }
+}
+#endif
+
+// Encodes count words as "%08X\n" lines into out (count * 9 bytes). Returns the number of bytes written.
+size_t hex_encode_words(char* out, const int* words, int count)
+{
+    int i = 0;
+
+    if (!byte_to_hex_ready)
+    {
+        build_byte_table();
+    }
+
+#ifdef HEX_CODEC_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        encode_8_words_avx2(out + (size_t)i * 9, words + i);
+    }
+#endif
+#ifdef HEX_CODEC_SSE
+    for (; i + 4 <= count; i += 4)
+    {
+        encode_4_words_sse(out + (size_t)i * 9, words + i);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        encode_word_scalar(out + (size_t)i * 9, (unsigned int)words[i]);
+    }
+    return (size_t)count * 9;
+}
+
+// Encodes count bytes as "%02X\n" lines into out (count * 3 bytes). Returns the number of bytes written.
+size_t hex_encode_bytes(char* out, const unsigned char* bytes, int count)
+{
+    int i = 0;
+
+    if (!byte_to_hex_ready)
+    {
+        build_byte_table();
+    }
+
+#ifdef HEX_CODEC_SSE
+    for (; i + 16 <= count; i += 16)
+    {
+        encode_16_bytes_sse(out + (size_t)i * 3, bytes + i);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        memcpy(out + (size_t)i * 3, byte_to_hex[bytes[i]], 2);
+        out[(size_t)i * 3 + 2] = '\n';
+    }
+    return (size_t)count * 3;
+}
+
+// Value of a hex digit, or -1
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int is_space(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+#ifdef HEX_CODEC_SSE
+// Decodes exactly 8 hex digits at p. Returns 0 if any of them is not a hex digit.
+static int decode_8_digits_sse(const char* p, unsigned int* value)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i*)p);
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+    if ((_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) & 0xFF) != 0xFF)
+    {
+        return 0;
+    }
+
+    __m128i nibbles = _mm_or_si128(
+        _mm_and_si128(is_digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+        _mm_andnot_si128(is_digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    __m128i pairs = _mm_maddubs_epi16(nibbles, _mm_set1_epi16(0x0110)); // high * 16 + low
+    __m128i bytes = _mm_packus_epi16(pairs, pairs);
+    unsigned int x = (unsigned int)_mm_cvtsi128_si32(bytes);
+
+    *value = (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+    return 1;
+}
+#endif
+
+// Decodes one "%8x" field at in[*pos]. Returns 0 if no value could be read.
+static int decode_word_scalar(const char* in, size_t len, size_t* pos, int* word)
+{
+    size_t p = *pos;
+    int width = 8;
+    int negative = 0;
+    unsigned int value = 0;
+    int digits = 0;
+
+    while (p < len && is_space(in[p]))
+    {
+        p++;
+    }
+    if (p < len && (in[p] == '-' || in[p] == '+'))
+    {
+        negative = in[p] == '-';
+        p++;
+        width--;
+    }
+    if (width >= 2 && p + 1 < len && in[p] == '0' && (in[p + 1] == 'x' || in[p + 1] == 'X') && p + 2 < len && hex_value(in[p + 2]) >= 0)
+    {
+        p += 2;
+        width -= 2;
+    }
+    while (digits < width && p < len && hex_value(in[p]) >= 0)
+    {
+        value = value * 16 + hex_value(in[p]);
+        p++;
+        digits++;
+    }
+    if (digits == 0)
+    {
+        return 0;
+    }
+
+    *word = (int)(negative ? 0u - value : value);
+    *pos = p;
+    return 1;
+}
+
+// Parses up to count whitespace-separated hex words (fscanf "%8x" semantics). Returns the number parsed.
+int hex_decode_words(const char* in, size_t len, int* words, int count)
+{
+    size_t pos = 0;
+    int parsed = 0;
+
+    while (parsed < count)
+    {
+        // Fast path: the common "XXXXXXXX\n" or "XXXXXXXX\r\n" line
+        if (pos + 9 <= len && (in[pos + 8] == '\n' || in[pos + 8] == '\r'))
+        {
+            unsigned int value;
+#ifdef HEX_CODEC_SSE
+            if (decode_8_digits_sse(in + pos, &value))
+#else
+            int ok = 1;
+            value = 0;
+            for (int i = 0; i < 8 && ok; i++)
+            {
+                int digit = hex_value(in[pos + i]);
+                ok = digit >= 0;
+                value = value * 16 + digit;
+            }
+            if (ok)
+#endif
+            {
+                words[parsed++] = (int)value;
+                pos += 9;
+                if (pos < len && in[pos - 1] == '\r' && in[pos] == '\n')
+                {
+                    pos++;
+                }
+                continue;
+            }
+        }
+
+        // General path: leading blanks, short lines, prefixes, end of file
+        if (!decode_word_scalar(in, len, &pos, &words[parsed]))
+        {
+            break;
+        }
+        parsed++;
+    }
+    return parsed;
+}
@@ -3,13 +3,12 @@
  * @brief Handles loading data from input files into memory.
  *
  * This file includes functions to read initial states for the instruction memory,
- * data memory, disk contents, and IRQ2 events.
+ * data memory and disk contents. IRQ2 events are streamed by irq2_events.c.
  *
  * Functions:
  * - load_instruction_memory: Loads the instruction memory from a file.
  * - load_data_memory: Loads the data memory from a file.
  * - load_disk_contents: Loads the disk contents from a file.
- * - load_irq2_events: Loads IRQ2 event timings from a file.
  */
 
 #include "simulator_functions.h"
@@ -38,66 +37,64 @@ void load_instruction_memory(char* filename, char instruction_memory[MEM_SIZE][1
         }
         line++;
     }
+    fclose(file);
 }
     
 
-// Load data memory from dmemin.txt
-void load_data_memory(char* filename, int data_memory[MEM_SIZE])
+// Reads a whole file into a malloc'ed buffer. Returns NULL if the file cannot be read.
+static char* read_whole_file(char* filename, size_t* length)
 {
-    FILE* file = fopen(filename, "r");
+    FILE* file = fopen(filename, "rb");
     if (!file)
     {
         printf("Error: Cannot open file %s\n", filename);
-        return;
+        return NULL;
     }
-    for (int i = 0; i < MEM_SIZE; i++)
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char* buffer = (char*)malloc(size > 0 ? (size_t)size : 1);
+    if (!buffer)
     {
-        if (fscanf(file, "%8x", &data_memory[i]) != 1)
-        {
-            data_memory[i] = 0; // Default to zero
-        }
+        fclose(file);
+        return NULL;
     }
+    *length = fread(buffer, 1, size > 0 ? (size_t)size : 0, file);
     fclose(file);
+    return buffer;
 }
 
-// Load disk contents from diskin.txt into a two-dimensional array
-void load_disk_contents(char* filename, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE])
+// Load data memory from dmemin.txt. Returns the number of words in the file.
+int load_data_memory(char* filename, int data_memory[MEM_SIZE])
 {
-    FILE* file = fopen(filename, "r");
-    if (!file)
-    {
-        printf("Error: Cannot open file %s\n", filename);
-        return;
-    }
-
-    for (int sector = 0; sector < NUMBER_OF_SECTORS; sector++)
+    size_t length;
+    char* text = read_whole_file(filename, &length);
+    if (!text)
     {
-        for (int word = 0; word < SECTOR_SIZE; word++)
-        {
-            if (fscanf(file, "%8x", &disk[sector][word]) != 1)
-            {
-                disk[sector][word] = 0; // Default to zero
-            }
-        }
+        return 0;
     }
 
-    fclose(file);
+    // Missing or malformed lines default to zero
+    int parsed = hex_decode_words(text, length, data_memory, MEM_SIZE);
+    memset(data_memory + parsed, 0, (MEM_SIZE - parsed) * sizeof(int));
+    free(text);
+    return parsed;
 }
 
-// Load IRQ2 events from irq2in.txt
-int load_irq2_events(char* filename, unsigned int irq2_events[])
+// Load disk contents from diskin.txt into a two-dimensional array
+void load_disk_contents(char* filename, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE])
 {
-    FILE* file = fopen(filename, "r");
-    if (!file)
+    size_t length;
+    char* text = read_whole_file(filename, &length);
+    if (!text)
     {
-        printf("Error: Cannot open file %s\n", filename);
-        return -1;
-    }
-    int count = 0;
-    while (count < MAX_IRQ2_EVENTS && fscanf(file, "%u", &irq2_events[count]) == 1)
-    {
-        count++;
+        return;
     }
-    fclose(file);
-    return count;
-}
\ No newline at end of file
+
+    // The sectors are contiguous, so the whole disk decodes as one array
+    int parsed = hex_decode_words(text, length, &disk[0][0], MAX_DISK_ENTRIES);
+    memset(&disk[0][0] + parsed, 0, (MAX_DISK_ENTRIES - parsed) * sizeof(int));
+    free(text);
+}
@@ -16,7 +16,7 @@
 
  // Function to handle I/O operations
 void IO_operation(instruction_decode* instruction, int data_memory[MEM_SIZE], FILE* hwregtrace, FILE* leds, FILE* display7seg, FILE* monitor, int* PC, int register_array[REG_NUM], int IOR[],
-    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int* disk_timer)
+    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], disk_controller* disk_ctl)
 {
     /*
         Handles I/O operations (in, out, reti) for the processor.
@@ -35,13 +35,18 @@ void IO_operation(instruction_decode* instruction, int data_memory[MEM_SIZE], FI
         "irq0enable", "irq1enable", "irq2enable", "irq0status", "irq1status", "irq2status",
         "irqhandler", "irqreturn", "clks", "leds", "display7seg", "timerenable",
         "timercurrent", "timermax", "diskcmd", "disksector", "diskbuffer",
-        "diskstatus", "reserved", "reserved", "monitoraddr", "monitordata", "monitorcmd" };
+        "diskstatus", "perfctl", "perfinstr", "monitoraddr", "monitordata", "monitorcmd",
+        "monitorvsync", "diskqueue", "diskdone", "diskrejected", "disktrack", "gfxcmd", "gfxpos",
+        "gfxend", "gfxcolor", "gfxsrc", "gfxstatus", "dmasrc", "dmadst", "dmalen", "dmamode", "dmastride",
+        "dmastart", "irqpending", "irqmask", "irqprio", "irqdepth", "irqactive", "irqvec0", "irqvec1", "irqvec2",
+        "irqvec3", "irqvec4", "perfalu", "perfbranch", "perftaken", "perfload", "perfstore", "perfio", "perfvector",
+        "perfirq", "perfisr", "perfdiskbusy", "perfdmabusy" };
 
     // Identify the register address (for in/out operations)
     int reg_address = register_array[instruction->rs] + register_array[instruction->rt];
 
     // Validate register address
-    if (reg_address < 0 || reg_address > 22)
+    if (reg_address < 0 || reg_address >= IOR_NUM)
     {
         fprintf(stderr, "Error: Invalid register address %d\n", reg_address);
         return;
@@ -96,9 +101,9 @@ void IO_operation(instruction_decode* instruction, int data_memory[MEM_SIZE], FI
             update_monitor(IOR[20], IOR[21], screen);
         }
 
-        else if (reg_address == 14 && IOR[17] == 0) // Disk update
+        else if (reg_address == 14) // Disk update
         {
-            handle_disk(IOR, disk, data_memory, disk_timer);
+            handle_disk(IOR, disk, data_memory, disk_ctl);
         }
 
         break;
@@ -129,7 +134,7 @@ void IO_operation(instruction_decode* instruction, int data_memory[MEM_SIZE], FI
 
 
 // Handles interrupts based on the IRQ status and enable registers
-void handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file)
+int handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file)
 {
     /*
         Handles interrupts based on the IRQ status and enable registers.
@@ -143,11 +148,14 @@ void handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file)
         - Saves the current PC to irqreturn.
         - Jumps to irqhandler if an interrupt is pending.
         - Clears the interrupt flags after servicing.
+        OUTPUT: The sources that were serviced (bit n = IRQn), 0 if the handler was not entered.
     */
   
     // Compute the irq signal
     int irq = (IOR[0] & IOR[3]) | (IOR[1] & IOR[4]) | (IOR[2] & IOR[5]);
 
+    int serviced = 0;
+
     // If irq is active and not already in ISR
     if (irq && *PC != IOR[6])
     {
@@ -162,15 +170,19 @@ void handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file)
         if (IOR[0] & IOR[3])
         {
             IOR[3] = 0; // Clear irq0status
+            serviced |= 1;
         }
         if (IOR[1] & IOR[4])
         {
             IOR[4] = 0; // Clear irq1status
+            serviced |= 2;
         }
         if (IOR[2] & IOR[5])
         {
             IOR[5] = 0; // Clear irq2status
+            serviced |= 4;
         }
     }
+    return serviced;
 }
 
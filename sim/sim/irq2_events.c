@@ -0,0 +1,258 @@
+/**
+ * @file irq2_events.c
+ * @brief Streams IRQ2 events from irq2in.txt or from a synthetic generator.
+ *
+ * Only the next event is kept: the file is read through a small buffer as the
+ * simulation reaches each event, so its size is not limited. Every event must
+ * come strictly after the previous one. A file entry that does not is dropped
+ * with a warning instead of blocking all the events after it.
+ *
+ * Generators (selected with -irq2_periodic, -irq2_poisson or -irq2_burst):
+ * - Periodic: first, first + period, first + 2 * period, ...
+ * - Poisson: exponentially distributed gaps with a given mean (at least 1 cycle),
+ *   from a seeded xorshift generator so runs are reproducible.
+ * - Burst: every period cycles from first, length events spacing cycles apart.
+ * A generator stops when its next cycle would not fit in 32 bits.
+ *
+ * Functions Implemented:
+ * - irq2_generator_valid: Checks generator parameters.
+ * - irq2_open: Starts a file or generator source.
+ * - irq2_advance: Moves to the next event.
+ * - irq2_close: Closes the source and reports dropped entries.
+ */
+
+#include "simulator_functions.h"
+
+#define IRQ2_MAX_WARNINGS 10 // Dropped entries reported one by one, the rest only counted
+
+// Reads the next byte of the file through the buffer. Returns EOF at the end.
+static int read_char(irq2_source* source)
+{
+    if (source->position == source->length)
+    {
+        source->length = fread(source->buffer, 1, sizeof(source->buffer), source->file);
+        source->position = 0;
+        if (source->length == 0)
+        {
+            return EOF;
+        }
+    }
+    return (unsigned char)source->buffer[source->position++];
+}
+
+// Reads the next decimal number of the file. Returns 0 at the end of the events.
+static int read_event(irq2_source* source, unsigned int* value)
+{
+    int c;
+    unsigned long long number = 0;
+
+    do
+    {
+        c = read_char(source);
+    } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+
+    if (c == EOF)
+    {
+        return 0;
+    }
+    if (c < '0' || c > '9')
+    {
+        fprintf(stderr, "Error: Invalid irq2 event after %u events, ignoring the rest of the file\n", source->events);
+        return 0;
+    }
+
+    while (c >= '0' && c <= '9')
+    {
+        number = number * 10 + (c - '0');
+        if (number > 0xFFFFFFFFull)
+        {
+            fprintf(stderr, "Error: irq2 event does not fit in 32 bits, ignoring the rest of the file\n");
+            return 0;
+        }
+        c = read_char(source);
+    }
+    *value = (unsigned int)number;
+    return 1;
+}
+
+// Next xorshift32 value of the Poisson generator
+static unsigned int next_random(irq2_source* source)
+{
+    unsigned int x = source->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    source->random = x;
+    return x;
+}
+
+// Produces the next generated event after the current one. Returns 0 when the generator is done.
+static int generate_event(irq2_source* source, unsigned int* value)
+{
+    irq2_generator* generator = &source->generator;
+    unsigned long long next;
+
+    switch (generator->kind)
+    {
+    case IRQ2_PERIODIC:
+        next = source->events == 0 ? generator->first : (unsigned long long)source->next + generator->period;
+        break;
+
+    case IRQ2_POISSON:
+    {
+        // Uniform in (0, 1] from the top 24 bits, then the inverse of the exponential distribution
+        double uniform = ((next_random(source) >> 8) + 1) / 16777216.0;
+        double gap = -generator->mean * log(uniform) + 0.5;
+        unsigned long long base = source->events == 0 ? 0 : source->next;
+        next = base + (gap < 1.0 ? 1 : (unsigned long long)gap);
+        break;
+    }
+
+    case IRQ2_BURST:
+        if (source->events == 0)
+        {
+            source->burst_start = generator->first;
+            source->burst_index = 0;
+        }
+        else if (source->burst_index == generator->length)
+        {
+            if ((unsigned long long)source->burst_start + generator->period > 0xFFFFFFFFull)
+            {
+                return 0;
+            }
+            source->burst_start += generator->period;
+            source->burst_index = 0;
+        }
+        next = (unsigned long long)source->burst_start + (unsigned long long)source->burst_index * generator->spacing;
+        source->burst_index++;
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (next > 0xFFFFFFFFull)
+    {
+        return 0;
+    }
+    *value = (unsigned int)next;
+    return 1;
+}
+
+// Checks that a generator produces strictly increasing cycles
+int irq2_generator_valid(const irq2_generator* generator)
+{
+    switch (generator->kind)
+    {
+    case IRQ2_FILE:
+        return 1;
+
+    case IRQ2_PERIODIC:
+        if (generator->period == 0)
+        {
+            fprintf(stderr, "Error: -irq2_periodic needs a period of at least 1 cycle\n");
+            return 0;
+        }
+        return 1;
+
+    case IRQ2_POISSON:
+        if (!(generator->mean > 0.0))
+        {
+            fprintf(stderr, "Error: -irq2_poisson needs a positive mean gap\n");
+            return 0;
+        }
+        return 1;
+
+    case IRQ2_BURST:
+        if (generator->length == 0 || generator->spacing == 0)
+        {
+            fprintf(stderr, "Error: -irq2_burst needs at least 1 event per burst and a spacing of at least 1 cycle\n");
+            return 0;
+        }
+        // The last event of a burst must come before the first event of the next one
+        if ((unsigned long long)(generator->length - 1) * generator->spacing >= generator->period)
+        {
+            fprintf(stderr, "Error: -irq2_burst bursts overlap: %u events %u cycles apart do not fit in a period of %u cycles\n",
+                generator->length, generator->spacing, generator->period);
+            return 0;
+        }
+        return 1;
+
+    default:
+        fprintf(stderr, "Error: Unknown irq2 generator %d\n", generator->kind);
+        return 0;
+    }
+}
+
+// Starts streaming events from the file, or from the generator when one is selected
+void irq2_open(irq2_source* source, const char* filename, const irq2_generator* generator)
+{
+    memset(source, 0, sizeof(*source));
+    source->generator = *generator;
+    source->random = generator->seed != 0 ? generator->seed : 1; // xorshift never leaves 0
+
+    if (generator->kind == IRQ2_FILE)
+    {
+        source->file = filename ? fopen(filename, "rb") : NULL;
+        if (!source->file)
+        {
+            printf("Error: Cannot open file %s\n", filename ? filename : "(none)");
+            return;
+        }
+    }
+
+    irq2_advance(source);
+}
+
+// Moves to the next event
+void irq2_advance(irq2_source* source)
+{
+    /*
+        INPUT: source (has_next and next describe the event that was just delivered, if any)
+        OUTPUT: next holds the following event and has_next is 1, or has_next is 0 when there are no more events.
+    */
+
+    unsigned int value;
+
+    for (;;)
+    {
+        int produced = source->generator.kind == IRQ2_FILE ? (source->file && read_event(source, &value)) : generate_event(source, &value);
+        if (!produced)
+        {
+            source->has_next = 0;
+            return;
+        }
+
+        // Ordering check: an event at or before the previous one could never be delivered
+        if (source->events > 0 && value <= source->next)
+        {
+            if (source->rejected < IRQ2_MAX_WARNINGS)
+            {
+                fprintf(stderr, "Warning: irq2 event %u is not after the previous event %u, dropped\n", value, source->next);
+            }
+            source->rejected++;
+            continue;
+        }
+
+        source->next = value;
+        source->has_next = 1;
+        source->events++;
+        return;
+    }
+}
+
+// Closes the file and reports dropped entries
+void irq2_close(irq2_source* source)
+{
+    if (source->file)
+    {
+        fclose(source->file);
+        source->file = NULL;
+    }
+    if (source->rejected > IRQ2_MAX_WARNINGS)
+    {
+        fprintf(stderr, "Warning: %u irq2 events were dropped for being out of order\n", source->rejected);
+    }
+    source->has_next = 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file irq_controller.c
+ * @brief Prioritized, nestable, vectored interrupt controller (-irqctl).
+ *
+ * Without -irqctl handle_interrupts keeps the original single line: any
+ * enabled status jumps to irqhandler, and the graphics accelerator and the
+ * memory DMA engine complete through irq2. With it, five sources are told
+ * apart: 0 timer, 1 disk, 2 external irq2, 3 graphics accelerator and
+ * 4 memory DMA.
+ * - Status: sources 0-2 keep irq0status..irq2status (irq2status now stays
+ *   set until it is taken, like the others); sources 3 and 4 latch bits 3
+ *   and 4 of irqpending, which the program may clear. irqpending bits 0-2
+ *   mirror the three status registers.
+ * - Enable: a source is requested when it is pending and its irqmask bit
+ *   is set (reset value 0x07); sources 0-2 also need irq0enable..irq2enable.
+ * - Priority: 4 bits per source in irqprio (source n in bits 4n..4n+3),
+ *   higher wins, ties go to the lower source number.
+ * - Vectors: the handler of source n is irqvec<n>, or irqhandler when 0.
+ * - Nesting: entering a handler pushes the return PC and the source's
+ *   priority on a stack of IRQ_STACK_DEPTH frames and sets irqreturn. A
+ *   request preempts the running handler only with a strictly higher
+ *   priority, so with the default priorities (all 0) handlers never nest.
+ *   reti returns to irqreturn, pops the frame and sets irqreturn to the
+ *   return PC of the frame below. irqdepth and irqactive (source of the
+ *   innermost handler, -1 outside handlers) are refreshed every cycle.
+ * Only the selected source's status is cleared on entry; the others stay
+ * pending and are taken in priority order after its reti.
+ *
+ * Functions Implemented:
+ * - irq_controller_configure: Selects the mode and sets the register reset values.
+ * - irq_controller_raise: Raises a device completion.
+ * - irq_controller_dispatch: Enters the handler of the highest priority request.
+ * - irq_controller_return: Pops the frame of a reti.
+ */
+
+#include "simulator_functions.h"
+
+#define IRQ_DEVICE_SOURCES 0x18 // Sources latched in irqpending: gfx and memory DMA
+
+// Selects the mode and sets the register reset values
+void irq_controller_configure(irq_controller* controller, int IOR[IOR_NUM], const sim_options* options)
+{
+    memset(controller, 0, sizeof(*controller));
+    controller->enabled = options->irq_controller;
+    if (controller->enabled)
+    {
+        IOR[IOR_IRQ_MASK] = IRQ_MASK_DEFAULT;
+        IOR[IOR_IRQ_ACTIVE] = -1;
+    }
+}
+
+// Raises the completion of a device that has no status register of its own. Returns the raised bit for irq_stats.
+int irq_controller_raise(const irq_controller* controller, int IOR[IOR_NUM], int source)
+{
+    if (!controller->enabled)
+    {
+        IOR[5] = 1; // irq2status, shared with the external line
+        return 4;
+    }
+    IOR[IOR_IRQ_PENDING] |= 1 << source;
+    return 1 << source;
+}
+
+// Refreshes irqdepth and irqactive
+static void publish(const irq_controller* controller, int IOR[IOR_NUM])
+{
+    IOR[IOR_IRQ_DEPTH] = controller->depth;
+    IOR[IOR_IRQ_ACTIVE] = controller->depth > 0 ? controller->stack[controller->depth - 1].source : -1;
+}
+
+// Enters the handler of the highest priority request, if it preempts the running one
+int irq_controller_dispatch(irq_controller* controller, int* PC, int IOR[IOR_NUM])
+{
+    /*
+        INPUT: PC (next instruction, the return address), IOR (statuses, mask, priorities and vectors)
+        OUTPUT: The source that was taken as bit n, 0 if no handler was entered.
+    */
+
+    int pending = (IOR[3] != 0) | ((IOR[4] != 0) << 1) | ((IOR[5] != 0) << 2) | (IOR[IOR_IRQ_PENDING] & IRQ_DEVICE_SOURCES);
+    int enabled = (IOR[0] != 0) | ((IOR[1] != 0) << 1) | ((IOR[2] != 0) << 2) | IRQ_DEVICE_SOURCES;
+    int requests = pending & enabled & IOR[IOR_IRQ_MASK];
+    int best = -1;
+    int best_priority = -1;
+
+    IOR[IOR_IRQ_PENDING] = pending;
+    for (int source = 0; source < IRQ_CTL_SOURCES; source++)
+    {
+        int priority = (IOR[IOR_IRQ_PRIO] >> (4 * source)) & 0xF;
+        if ((requests & (1 << source)) && priority > best_priority)
+        {
+            best = source;
+            best_priority = priority;
+        }
+    }
+
+    int level = controller->depth > 0 ? controller->stack[controller->depth - 1].priority : -1;
+    if (best < 0 || best_priority <= level || controller->depth == IRQ_STACK_DEPTH)
+    {
+        publish(controller, IOR);
+        return 0;
+    }
+
+    irq_frame* frame = &controller->stack[controller->depth++];
+    frame->return_pc = *PC;
+    frame->source = best;
+    frame->priority = best_priority;
+    IOR[7] = *PC;
+    *PC = IOR[IOR_IRQ_VECTOR + best] != 0 ? IOR[IOR_IRQ_VECTOR + best] : IOR[6];
+
+    if (best < 3)
+    {
+        IOR[3 + best] = 0;
+    }
+    IOR[IOR_IRQ_PENDING] &= ~(1 << best);
+    publish(controller, IOR);
+    return 1 << best;
+}
+
+// Pops the frame of the reti that just returned to irqreturn
+void irq_controller_return(irq_controller* controller, int IOR[IOR_NUM])
+{
+    if (controller->depth == 0)
+    {
+        return; // reti outside a handler only jumps to irqreturn
+    }
+    controller->depth--;
+    if (controller->depth > 0)
+    {
+        IOR[7] = controller->stack[controller->depth - 1].return_pc;
+    }
+    publish(controller, IOR);
+}
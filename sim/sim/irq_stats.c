@@ -0,0 +1,306 @@
+/**
+ * @file irq_stats.c
+ * @brief Interrupt latency and handler occupancy instrumentation.
+ *
+ * Enabled with -irq_stats <report> and/or -irq_timeline <file>. For every
+ * source (irq0 timer, irq1 disk, irq2 external) it counts:
+ * - raised:     statuses set by the device.
+ * - serviced:   handler entries that cleared the status.
+ * - lost:       raises while the status was still set, merged into the pending one.
+ * - dropped:    statuses cleared before the handler took them (irq2 only lasts one cycle).
+ * - suppressed: cycles the interrupt was pending and enabled, but PC was at irqhandler.
+ * - reentered:  handler entries before the reti of the previous entry.
+ * and two log2 histograms: latency (cycles from raise to handler entry) and
+ * occupancy (cycles from handler entry to reti, charged to every source the
+ * entry serviced).
+ *
+ * Timeline lines are "<cycle> <EVENT> irq<n> [<cycles>]", with EVENT one of
+ * RAISE, LOST, DROP, SUPPRESS, ENTER (latency) and RETI (occupancy).
+ *
+ * Functions Implemented:
+ * - irq_stats_open: Allocates the statistics and opens the timeline.
+ * - irq_status_bits: Packs the status flags.
+ * - irq_stats_raise: Records device raises.
+ * - irq_stats_dispatch: Records handler entries and pending interrupts that were not taken.
+ * - irq_stats_return: Records reti.
+ * - irq_stats_report: Writes the report.
+ */
+
+#include "simulator_functions.h"
+
+#define IRQ_BAR_WIDTH 40 // Width of the longest histogram bar in the report
+
+// Allocates the statistics and opens the optional timeline
+irq_stats* irq_stats_open(const char* timeline_filename)
+{
+    irq_stats* stats = (irq_stats*)calloc(1, sizeof(irq_stats));
+    if (!stats)
+    {
+        perror("Failed to allocate the interrupt statistics");
+        return NULL;
+    }
+
+    for (int source = 0; source < IRQ_SOURCES; source++)
+    {
+        stats->latency[source].min = 0xFFFFFFFFu;
+        stats->occupancy[source].min = 0xFFFFFFFFu;
+    }
+
+    if (timeline_filename)
+    {
+        stats->timeline = fopen(timeline_filename, "w");
+        if (!stats->timeline)
+        {
+            fprintf(stderr, "Error: Failed to open file: %s\n", timeline_filename);
+        }
+    }
+    return stats;
+}
+
+// Returns the irq0-2 status flags as bits 0-2
+int irq_status_bits(int IOR[IOR_NUM])
+{
+    return (IOR[3] != 0) | ((IOR[4] != 0) << 1) | ((IOR[5] != 0) << 2);
+}
+
+// Histogram bucket of a cycle count: 0, 1, 2-3, 4-7, ...
+static int bucket_of(unsigned int cycles)
+{
+    int bucket = 0;
+
+    while (cycles != 0)
+    {
+        bucket++;
+        cycles >>= 1;
+    }
+    return bucket;
+}
+
+// Adds one sample to a histogram
+static void histogram_add(irq_histogram* histogram, unsigned int cycles)
+{
+    histogram->samples++;
+    histogram->total += cycles;
+    if (cycles < histogram->min)
+    {
+        histogram->min = cycles;
+    }
+    if (cycles > histogram->max)
+    {
+        histogram->max = cycles;
+    }
+    histogram->buckets[bucket_of(cycles)]++;
+}
+
+// Appends one line to the timeline
+static void timeline_event(irq_stats* stats, unsigned int cycle, const char* event, int source, long long cycles)
+{
+    if (!stats->timeline)
+    {
+        return;
+    }
+    if (cycles < 0)
+    {
+        fprintf(stats->timeline, "%u %s irq%d\n", cycle, event, source);
+    }
+    else
+    {
+        fprintf(stats->timeline, "%u %s irq%d %lld\n", cycle, event, source, cycles);
+    }
+}
+
+// Records the statuses raised by the devices in this cycle
+void irq_stats_raise(irq_stats* stats, unsigned int cycle, int raised, int status_before)
+{
+    /*
+        INPUT: raised (bit n = the device of IRQn set its status), status_before (status bits before the devices ran)
+    */
+
+    for (int source = 0; source < IRQ_SOURCES; source++)
+    {
+        if (!(raised & (1 << source)))
+        {
+            continue;
+        }
+        stats->raised[source]++;
+
+        // Still set: this raise merges into the earlier one and is lost
+        if (status_before & (1 << source))
+        {
+            stats->lost[source]++;
+            timeline_event(stats, cycle, "LOST", source, -1);
+            continue;
+        }
+
+        // The earlier raise was cleared without reaching the handler
+        if (stats->pending[source])
+        {
+            stats->dropped[source]++;
+            timeline_event(stats, cycle, "DROP", source, -1);
+        }
+        stats->pending[source] = 1;
+        stats->raised_at[source] = cycle;
+        timeline_event(stats, cycle, "RAISE", source, -1);
+    }
+}
+
+// Records a handler entry, or why pending interrupts were not taken
+void irq_stats_dispatch(irq_stats* stats, int IOR[IOR_NUM], unsigned int cycle, int serviced)
+{
+    /*
+        INPUT: IOR (after handle_interrupts), serviced (return value of handle_interrupts)
+    */
+
+    for (int source = 0; source < IRQ_SOURCES; source++)
+    {
+        if (serviced & (1 << source))
+        {
+            stats->serviced[source]++;
+            if (stats->in_handler)
+            {
+                stats->reentered[source]++;
+            }
+            if (stats->pending[source])
+            {
+                unsigned int latency = cycle - stats->raised_at[source];
+                histogram_add(&stats->latency[source], latency);
+                timeline_event(stats, cycle, "ENTER", source, latency);
+                stats->pending[source] = 0;
+            }
+            else
+            {
+                timeline_event(stats, cycle, "ENTER", source, -1); // Status set by the program, not a device
+            }
+            continue;
+        }
+
+        // handle_interrupts only declines an enabled, set status when PC is already at irqhandler
+        if (serviced == 0 && (IOR[source] & IOR[3 + source]))
+        {
+            stats->suppressed[source]++;
+            timeline_event(stats, cycle, "SUPPRESS", source, -1);
+        }
+
+        // Cleared by the program (or the one-cycle irq2 pulse) before the handler took it
+        if (stats->pending[source] && IOR[3 + source] == 0)
+        {
+            stats->dropped[source]++;
+            timeline_event(stats, cycle, "DROP", source, -1);
+            stats->pending[source] = 0;
+        }
+    }
+
+    if (serviced)
+    {
+        stats->in_handler = 1;
+        stats->handler_sources = serviced;
+        stats->handler_entry = cycle;
+    }
+}
+
+// Records a reti
+void irq_stats_return(irq_stats* stats, unsigned int cycle)
+{
+    if (!stats->in_handler)
+    {
+        return;
+    }
+
+    for (int source = 0; source < IRQ_SOURCES; source++)
+    {
+        if (stats->handler_sources & (1 << source))
+        {
+            histogram_add(&stats->occupancy[source], cycle - stats->handler_entry);
+            timeline_event(stats, cycle, "RETI", source, cycle - stats->handler_entry);
+        }
+    }
+    stats->in_handler = 0;
+}
+
+// Writes one histogram with its summary line
+static void write_histogram(FILE* file, const char* title, int source, irq_histogram* histogram)
+{
+    unsigned long long largest = 0;
+
+    if (histogram->samples == 0)
+    {
+        fprintf(file, "irq%d %s: no samples\n", source, title);
+        return;
+    }
+
+    fprintf(file, "irq%d %s: samples=%llu min=%u avg=%.1f max=%u\n", source, title, histogram->samples,
+        histogram->min, (double)histogram->total / histogram->samples, histogram->max);
+
+    for (int bucket = 0; bucket < IRQ_HISTOGRAM_BUCKETS; bucket++)
+    {
+        if (histogram->buckets[bucket] > largest)
+        {
+            largest = histogram->buckets[bucket];
+        }
+    }
+
+    for (int bucket = bucket_of(histogram->min); bucket <= bucket_of(histogram->max); bucket++)
+    {
+        unsigned long long count = histogram->buckets[bucket];
+        unsigned int low = bucket == 0 ? 0 : 1u << (bucket - 1);
+        unsigned int high = bucket == 0 ? 0 : (bucket == 32 ? 0xFFFFFFFFu : (1u << bucket) - 1);
+        char range[32];
+        int bar = (int)((count * IRQ_BAR_WIDTH + largest - 1) / largest);
+
+        if (low == high)
+        {
+            snprintf(range, sizeof(range), "%u", low);
+        }
+        else
+        {
+            snprintf(range, sizeof(range), "%u-%u", low, high);
+        }
+        fprintf(file, "  %21s %10llu ", range, count);
+        for (int i = 0; i < bar; i++)
+        {
+            fputc('#', file);
+        }
+        fputc('\n', file);
+    }
+}
+
+// Writes the report, closes the timeline and frees the statistics
+void irq_stats_report(irq_stats* stats, const char* filename)
+{
+    if (filename)
+    {
+        FILE* file = fopen(filename, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        }
+        else
+        {
+            fprintf(file, "%-6s %10s %10s %10s %10s %10s %10s\n", "source", "raised", "serviced", "lost", "dropped", "suppressed", "reentered");
+            for (int source = 0; source < IRQ_SOURCES; source++)
+            {
+                fprintf(file, "irq%-3d %10llu %10llu %10llu %10llu %10llu %10llu\n", source, stats->raised[source], stats->serviced[source],
+                    stats->lost[source], stats->dropped[source], stats->suppressed[source], stats->reentered[source]);
+            }
+
+            fprintf(file, "\nLatency: cycles from the device raising the status to the handler entry\n");
+            for (int source = 0; source < IRQ_SOURCES; source++)
+            {
+                write_histogram(file, "latency", source, &stats->latency[source]);
+            }
+
+            fprintf(file, "\nOccupancy: cycles from the handler entry to reti\n");
+            for (int source = 0; source < IRQ_SOURCES; source++)
+            {
+                write_histogram(file, "occupancy", source, &stats->occupancy[source]);
+            }
+            fclose(file);
+        }
+    }
+
+    if (stats->timeline)
+    {
+        fclose(stats->timeline);
+    }
+    free(stats);
+}
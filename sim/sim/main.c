@@ -20,16 +20,22 @@ int main(int argc, char* argv[])
     int IOR[IOR_NUM] = { 0 };
     int disk[NUMBER_OF_SECTORS][SECTOR_SIZE] = { 0 };
     unsigned char screen[MONITOR_SIZE][MONITOR_SIZE] = { 0 };
-    unsigned int interupt2_events[MEM_SIZE] = { 0 };
 
     // clear instruction_memory
     for (int i = 0; i < MEM_SIZE; i++) {
         strcpy(instruction_memory[i], "000000000000");  
     }
 
+    sim_options options = { 0 };
+
     // Validate the number of arguments
-    if (argc != 15) {
-        fprintf(stderr, "Usage: %s imemin.txt dmemin.txt diskin.txt irq2in.txt dmemout.txt regout.txt trace.txt hwregtrace.txt cycles.txt leds.txt display7seg.txt diskout.txt monitor.txt monitor.yuv - not good\n", argv[1]);
+    if (argc < 15) {
+        fprintf(stderr, "Usage: %s imemin.txt dmemin.txt diskin.txt irq2in.txt dmemout.txt regout.txt trace.txt hwregtrace.txt cycles.txt leds.txt display7seg.txt diskout.txt monitor.txt monitor.yuv [options] - not good\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // Optional flags after the file names
+    if (!parse_options(argc, argv, 15, &options)) {
         return EXIT_FAILURE;
     }
 
@@ -79,15 +85,18 @@ int main(int argc, char* argv[])
 
     // Load initial data
     load_instruction_memory(argv[1], instruction_memory);
-    load_data_memory(argv[2], data_memory);
+    options.data_words = load_data_memory(argv[2], data_memory); // Initialized words for -mem_stats
     load_disk_contents(argv[3], disk);
-    load_irq2_events(argv[4], interupt2_events);
+    options.irq2_filename = argv[4]; // IRQ2 events are streamed while the simulation runs
 
 
     // Pointer output files array
     FILE* output_files[] = {dmemout_file, regout_file, trace_file, hwregtrace_file, cycles_file, leds_file, display7seg_file, diskout_file, monitor_file, monitor_yuv_file};
 
-    simulate(output_files, IOR, registers, data_memory, screen, disk, instruction_memory, interupt2_events);
+    // A co-simulation that found a divergence fails the run
+    if (simulate(output_files, IOR, registers, data_memory, screen, disk, instruction_memory, &options) != 0) {
+        return EXIT_FAILURE;
+    }
 
     return EXIT_SUCCESS;
 
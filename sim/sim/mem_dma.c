@@ -0,0 +1,164 @@
+/**
+ * @file mem_dma.c
+ * @brief Memory-to-memory DMA engine: block copy, fill and strided copy.
+ *
+ * A nonzero write to dmastart starts a transfer of dmalen words described by
+ * dmasrc, dmadst, dmamode and dmastride:
+ * - 0 copy:   MEM[dst + i] = MEM[src + i], overlapping blocks as memmove.
+ * - 1 fill:   MEM[dst + i] = dmasrc (the value, not an address).
+ * - 2 stride: MEM[dst + i * dst_stride] = MEM[src + i * src_stride], with the
+ *             signed 16-bit strides packed in dmastride (source in bits 16-31,
+ *             destination in bits 0-15), in increasing i.
+ * The words move when the transfer starts. The engine then stays busy for
+ * the setup cycles plus one cycle per rate words (-memdma <setup> <rate>,
+ * MEMDMA_SETUP_CYCLES and MEMDMA_WORDS_PER_CYCLE without the flag). While
+ * busy dmastart reads 1 and writes to it are ignored; on completion it
+ * clears and the caller raises the interrupt (irq2status, or its own source
+ * with -irqctl, see irq_controller.c). A transfer
+ * that would touch a word outside data memory is reported and not started.
+ *
+ * Functions Implemented:
+ * - mem_dma_configure: Sets up an idle engine.
+ * - mem_dma_tick: Starts, times and completes transfers.
+ */
+
+#include "simulator_functions.h"
+
+// Sets up an idle engine with the -memdma timing
+void mem_dma_configure(mem_dma* dma, const sim_options* options)
+{
+    memset(dma, 0, sizeof(*dma));
+    dma->setup = options->memdma_rate ? options->memdma_setup : MEMDMA_SETUP_CYCLES;
+    dma->rate = options->memdma_rate ? options->memdma_rate : MEMDMA_WORDS_PER_CYCLE;
+}
+
+// Sign-extends a 16-bit stride
+static int stride_of(int packed)
+{
+    return (int)(short)(packed & 0xFFFF);
+}
+
+// Checks that words first, first + stride, ... (count of them) are all in data memory
+static int range_valid(int first, int stride, int count)
+{
+    long long last = (long long)first + (long long)stride * (count - 1);
+    return first >= 0 && first < MEM_SIZE && last >= 0 && last < MEM_SIZE;
+}
+
+// Writes value to count consecutive words
+static void fill_words(int* words, int value, int count)
+{
+    unsigned int byte = (unsigned int)value & 0xFF;
+
+    // Words made of one repeated byte (0, -1, ...) are a plain memset
+    if ((unsigned int)value == byte * 0x01010101u)
+    {
+        memset(words, (int)byte, (size_t)count * sizeof(int));
+        return;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        words[i] = value;
+    }
+}
+
+// Records the words a transfer reads and writes, before they move
+static void record_transfer(mem_trace* trace, int mode, int source, int source_stride, int destination, int destination_stride, int length)
+{
+    if (mode != MEMDMA_STRIDE)
+    {
+        if (mode == MEMDMA_COPY)
+        {
+            mem_trace_range(trace, MEM_SOURCE_MEMDMA, 0, source, length);
+        }
+        mem_trace_range(trace, MEM_SOURCE_MEMDMA, 1, destination, length);
+        return;
+    }
+    for (int i = 0; i < length; i++)
+    {
+        mem_trace_range(trace, MEM_SOURCE_MEMDMA, 0, source + i * source_stride, 1);
+        mem_trace_range(trace, MEM_SOURCE_MEMDMA, 1, destination + i * destination_stride, 1);
+    }
+}
+
+// Moves the words of the transfer in the registers. Returns 0 if it reaches outside data memory.
+static int transfer(mem_dma* dma, int IOR[IOR_NUM], int data_memory[MEM_SIZE])
+{
+    int source = IOR[IOR_DMA_SRC];
+    int destination = IOR[IOR_DMA_DST];
+    int length = IOR[IOR_DMA_LEN];
+    int mode = IOR[IOR_DMA_MODE];
+    int source_stride = mode == MEMDMA_STRIDE ? stride_of(IOR[IOR_DMA_STRIDE] >> 16) : 1;
+    int destination_stride = mode == MEMDMA_STRIDE ? stride_of(IOR[IOR_DMA_STRIDE]) : 1;
+
+    if (mode != MEMDMA_COPY && mode != MEMDMA_FILL && mode != MEMDMA_STRIDE)
+    {
+        fprintf(stderr, "Error: Unknown DMA mode %d\n", mode);
+        return 0;
+    }
+    if (length <= 0)
+    {
+        return length == 0;
+    }
+    if (!range_valid(destination, destination_stride, length) || (mode != MEMDMA_FILL && !range_valid(source, source_stride, length)))
+    {
+        fprintf(stderr, "Error: DMA of %d words from %d to %d is outside data memory\n", length, source, destination);
+        return 0;
+    }
+
+    if (dma->mem_trace)
+    {
+        record_transfer(dma->mem_trace, mode, source, source_stride, destination, destination_stride, length);
+    }
+
+    if (mode == MEMDMA_COPY)
+    {
+        memmove(&data_memory[destination], &data_memory[source], (size_t)length * sizeof(int));
+    }
+    else if (mode == MEMDMA_FILL)
+    {
+        fill_words(&data_memory[destination], source, length);
+    }
+    else
+    {
+        for (int i = 0; i < length; i++)
+        {
+            data_memory[destination + i * destination_stride] = data_memory[source + i * source_stride];
+        }
+    }
+    return 1;
+}
+
+// Starts a transfer written to dmastart, or advances the one running. Returns 1 when it completed.
+int mem_dma_tick(mem_dma* dma, int IOR[IOR_NUM], int data_memory[MEM_SIZE])
+{
+    if (dma->timer > 0)
+    {
+        if (--dma->timer > 0)
+        {
+            IOR[IOR_DMA_START] = 1; // Writes while busy do not stick
+            return 0;
+        }
+        IOR[IOR_DMA_START] = 0;
+        return 1;
+    }
+
+    if (IOR[IOR_DMA_START] == 0)
+    {
+        return 0;
+    }
+    if (!transfer(dma, IOR, data_memory))
+    {
+        IOR[IOR_DMA_START] = 0;
+        return 0;
+    }
+
+    int length = IOR[IOR_DMA_LEN];
+    dma->timer = dma->setup + (length + dma->rate - 1) / dma->rate;
+    if (dma->timer < 1)
+    {
+        dma->timer = 1;
+    }
+    IOR[IOR_DMA_START] = 1;
+    return 0;
+}
@@ -0,0 +1,567 @@
+/**
+ * @file mem_trace.c
+ * @brief Data memory access recording and analytics (-mem_trace, -mem_stats).
+ *
+ * Every word that lw/sw, vlw/vsw, the disk sector transfers, the memory DMA
+ * engine and graphics blits read or write is counted. Stalled instructions
+ * are counted in the cycle they finally run.
+ *
+ * -mem_trace <file> writes one binary record per access (a whole vector,
+ * sector, DMA run or blit is one record): the "SMMT" magic and a version
+ * byte (1), then per record
+ * - tag byte: bit 0 write, bits 1-3 source (MEM_SOURCE_*), bit 4 a count follows;
+ * - cycle since the previous record, LEB128 varint;
+ * - first word address, 16 bits little-endian;
+ * - word count, varint, only with tag bit 4 (otherwise 1);
+ * - PC, 16 bits little-endian, only for lw/sw and vlw/vsw.
+ * A lw or sw takes 6 bytes.
+ *
+ * -mem_stats <report> <window> writes:
+ * - words per source, and read and write heatmaps (one character per word);
+ * - the working set of every window of cycles: distinct words read, written
+ *   and accessed, accesses and the lowest $sp;
+ * - the reuse distance histogram: distinct words accessed between two
+ *   accesses to the same word (LRU stack distance);
+ * - the stack high-water mark: the highest and lowest $sp once it is nonzero;
+ * - reads of words nothing wrote before, not counting dmemin.txt words.
+ *
+ * Functions Implemented:
+ * - mem_trace_open: Allocates the recorder and opens the trace file.
+ * - mem_trace_cycle: Starts a cycle.
+ * - mem_trace_instruction: Records a lw/sw/vlw/vsw.
+ * - mem_trace_range: Records a device access.
+ * - mem_trace_close: Writes the report and frees the recorder.
+ */
+
+#include "simulator_functions.h"
+
+#define MEM_TRACE_VERSION 1
+#define MEM_BAR_WIDTH 40         // Width of the longest histogram bar in the report
+#define MEM_HEATMAP_ROW 64       // Words per heatmap row
+#define MEM_HOTTEST 16           // Words listed by access count
+#define SP_NONE 0x7FFFFFFF       // No $sp sample in the window yet
+#define UNDEFINED_REPORTED 2     // defined[]: not written yet, already counted as an uninitialized word
+
+static const char* source_names[MEM_SOURCES] = { "lw/sw", "vlw/vsw", "disk", "memdma", "gfx" };
+
+// Allocates the recorder and opens the -mem_trace file
+mem_trace* mem_trace_open(const sim_options* options)
+{
+    mem_trace* trace = (mem_trace*)calloc(1, sizeof(mem_trace));
+    if (!trace)
+    {
+        perror("Failed to allocate the memory access recorder");
+        return NULL;
+    }
+
+    trace->window = options->mem_stats_window;
+    trace->current.sp_low = SP_NONE;
+    trace->data_words = options->data_words;
+    memset(trace->defined, 1, (size_t)options->data_words);
+
+    if (options->mem_trace_filename)
+    {
+        trace->file = fopen(options->mem_trace_filename, "wb");
+        if (!trace->file)
+        {
+            fprintf(stderr, "Error: Failed to open file: %s\n", options->mem_trace_filename);
+            free(trace);
+            return NULL;
+        }
+        fputs(MEM_TRACE_MAGIC, trace->file);
+        fputc(MEM_TRACE_VERSION, trace->file);
+    }
+    return trace;
+}
+
+// Writes an unsigned LEB128 varint
+static void put_varint(FILE* file, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        fputc((int)((value & 0x7F) | 0x80), file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+// Writes the record of one access
+static void write_record(mem_trace* trace, int source, int write, int address, int count)
+{
+    FILE* file = trace->file;
+
+    fputc(write | (source << 1) | ((count > 1) << 4), file);
+    put_varint(file, trace->cycle - trace->last_cycle);
+    fputc(address & 0xFF, file);
+    fputc((address >> 8) & 0xFF, file);
+    if (count > 1)
+    {
+        put_varint(file, (unsigned int)count);
+    }
+    if (source == MEM_SOURCE_CPU || source == MEM_SOURCE_VECTOR)
+    {
+        fputc(trace->pc & 0xFF, file);
+        fputc((trace->pc >> 8) & 0xFF, file);
+    }
+    trace->last_cycle = trace->cycle;
+}
+
+// Adds delta at stamp in the Fenwick tree of live stamps
+static void live_add(mem_trace* trace, unsigned int stamp, int delta)
+{
+    for (; stamp < MEM_REUSE_CLOCK; stamp += stamp & (0u - stamp))
+    {
+        trace->live[stamp] += (unsigned int)delta;
+    }
+}
+
+// Live stamps up to and including stamp
+static unsigned int live_prefix(const mem_trace* trace, unsigned int stamp)
+{
+    unsigned int count = 0;
+    for (; stamp > 0; stamp -= stamp & (0u - stamp))
+    {
+        count += trace->live[stamp];
+    }
+    return count;
+}
+
+// Orders packed (stamp << 16 | address) keys
+static int compare_keys(const void* a, const void* b)
+{
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Renumbers the last uses 1..n in the same order once the stamps run out
+static void renumber_stamps(mem_trace* trace)
+{
+    unsigned long long keys[MEM_SIZE];
+    unsigned int count = 0;
+
+    for (int address = 0; address < MEM_SIZE; address++)
+    {
+        if (trace->last_use[address])
+        {
+            keys[count++] = ((unsigned long long)trace->last_use[address] << 16) | (unsigned int)address;
+        }
+    }
+    qsort(keys, count, sizeof(keys[0]), compare_keys);
+
+    memset(trace->live, 0, sizeof(trace->live));
+    for (unsigned int i = 0; i < count; i++)
+    {
+        trace->last_use[keys[i] & 0xFFFF] = i + 1;
+        live_add(trace, i + 1, 1);
+    }
+    trace->clock = count;
+}
+
+// Log2 bucket of a reuse distance
+static int reuse_bucket(unsigned int distance)
+{
+    int bucket = 0;
+    while (distance > 0 && bucket < MEM_REUSE_BUCKETS - 1)
+    {
+        distance >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Counts one word access in every statistic
+static void account(mem_trace* trace, int source, int write, unsigned int address)
+{
+    unsigned int mark = trace->window_index + 1;
+
+    if (trace->read_mark[address] != mark && trace->write_mark[address] != mark)
+    {
+        trace->current.words++; // First access to the word in this window
+    }
+    trace->current.accesses++;
+
+    if (write)
+    {
+        trace->writes[address]++;
+        trace->source_writes[source]++;
+        trace->defined[address] = 1;
+        if (trace->write_mark[address] != mark)
+        {
+            trace->write_mark[address] = mark;
+            trace->current.write_words++;
+        }
+    }
+    else
+    {
+        trace->reads[address]++;
+        trace->source_reads[source]++;
+        if (trace->defined[address] != 1)
+        {
+            trace->uninit_reads++;
+            if (trace->defined[address] == 0)
+            {
+                if (trace->uninit_words < MEM_UNINIT_LISTED)
+                {
+                    mem_uninit* entry = &trace->uninit[trace->uninit_words];
+                    entry->address = address;
+                    entry->cycle = trace->cycle;
+                    entry->pc = source == MEM_SOURCE_CPU || source == MEM_SOURCE_VECTOR ? trace->pc : -1;
+                    entry->source = source;
+                }
+                trace->uninit_words++;
+                trace->defined[address] = UNDEFINED_REPORTED;
+            }
+        }
+        if (trace->read_mark[address] != mark)
+        {
+            trace->read_mark[address] = mark;
+            trace->current.read_words++;
+        }
+    }
+
+    // Reuse distance: words whose last use is more recent than this word's
+    if (trace->clock + 1 >= MEM_REUSE_CLOCK)
+    {
+        renumber_stamps(trace);
+    }
+    unsigned int previous = trace->last_use[address];
+    if (previous)
+    {
+        trace->reuse[reuse_bucket(trace->live_count - live_prefix(trace, previous))]++;
+        live_add(trace, previous, -1);
+        trace->live_count--;
+    }
+    else
+    {
+        trace->cold++;
+    }
+    trace->last_use[address] = ++trace->clock;
+    live_add(trace, trace->clock, 1);
+    trace->live_count++;
+}
+
+// Closes the current working-set window and opens the next one
+static void finish_window(mem_trace* trace)
+{
+    if (trace->window_count == trace->window_capacity)
+    {
+        unsigned int capacity = trace->window_capacity ? trace->window_capacity * 2 : 256;
+        mem_window* windows = (mem_window*)realloc(trace->windows, capacity * sizeof(mem_window));
+        if (!windows)
+        {
+            perror("Failed to grow the working-set windows");
+            trace->window = 0; // Keep running without them
+            return;
+        }
+        trace->windows = windows;
+        trace->window_capacity = capacity;
+    }
+    trace->windows[trace->window_count++] = trace->current;
+    memset(&trace->current, 0, sizeof(trace->current));
+    trace->current.sp_low = SP_NONE;
+    trace->window_index++;
+}
+
+// Starts a cycle: stamps the following records and samples $sp
+void mem_trace_cycle(mem_trace* trace, unsigned int cycle, int pc, int sp)
+{
+    trace->cycle = cycle;
+    trace->pc = pc;
+
+    while (trace->window && cycle / trace->window > trace->window_index)
+    {
+        finish_window(trace);
+    }
+
+    if (sp != 0)
+    {
+        if (!trace->sp_seen || sp > trace->sp_top)
+        {
+            trace->sp_top = sp;
+        }
+        if (!trace->sp_seen || sp < trace->sp_low)
+        {
+            trace->sp_low = sp;
+            trace->sp_low_cycle = cycle;
+            trace->sp_low_pc = pc;
+        }
+        trace->sp_seen = 1;
+        if (sp < trace->current.sp_low)
+        {
+            trace->current.sp_low = sp;
+        }
+    }
+}
+
+// Records a device access to count consecutive words, clipped to data memory
+void mem_trace_range(mem_trace* trace, int source, int write, int address, int count)
+{
+    if (address < 0 || address >= MEM_SIZE || count <= 0)
+    {
+        return;
+    }
+    if (count > MEM_SIZE - address)
+    {
+        count = MEM_SIZE - address;
+    }
+    if (trace->file)
+    {
+        write_record(trace, source, write, address, count);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        account(trace, source, write, (unsigned int)(address + i));
+    }
+}
+
+// Records the words a lw/sw/vlw/vsw is about to access; out of bounds accesses fail and are not recorded
+void mem_trace_instruction(mem_trace* trace, const instruction_decode* instruction, const int registers[REG_NUM], int vector_length)
+{
+    long opcode = instruction->opcode;
+    unsigned int address = (unsigned int)registers[instruction->rs] + (unsigned int)registers[instruction->rt];
+
+    if (opcode == LW || opcode == SW)
+    {
+        if (address < MEM_SIZE)
+        {
+            mem_trace_range(trace, MEM_SOURCE_CPU, opcode == SW, (int)address, 1);
+        }
+    }
+    else if (opcode == VLW || opcode == VSW)
+    {
+        if (vector_length > 0 && address <= (unsigned int)(MEM_SIZE - vector_length))
+        {
+            mem_trace_range(trace, MEM_SOURCE_VECTOR, opcode == VSW, (int)address, vector_length);
+        }
+    }
+}
+
+// Floor of log2, 0 for 0
+static int log2_floor(unsigned long long value)
+{
+    int bits = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        bits++;
+    }
+    return bits;
+}
+
+// Writes a heatmap, one character per word on a log scale, skipping rows without accesses
+static void write_heatmap(FILE* file, const char* title, const unsigned long long counts[MEM_SIZE])
+{
+    static const char levels[] = " .:-=+*#%@";
+    unsigned long long largest = 0;
+
+    for (int address = 0; address < MEM_SIZE; address++)
+    {
+        if (counts[address] > largest)
+        {
+            largest = counts[address];
+        }
+    }
+    fprintf(file, "\n%s heatmap: %d words per row, ' ' none, '.' 1 up to '@' %llu (log scale)\n", title, MEM_HEATMAP_ROW, largest);
+    if (largest == 0)
+    {
+        return;
+    }
+
+    int scale = log2_floor(largest) > 0 ? log2_floor(largest) : 1;
+    for (int row = 0; row < MEM_SIZE; row += MEM_HEATMAP_ROW)
+    {
+        char line[MEM_HEATMAP_ROW + 1];
+        int used = 0;
+        for (int i = 0; i < MEM_HEATMAP_ROW; i++)
+        {
+            unsigned long long count = counts[row + i];
+            int level = count == 0 ? 0 : 1 + log2_floor(count) * 8 / scale;
+            line[i] = levels[level];
+            used |= count != 0;
+        }
+        line[MEM_HEATMAP_ROW] = '\0';
+        if (used)
+        {
+            fprintf(file, "  %03X |%s|\n", row, line);
+        }
+    }
+}
+
+// Writes the hottest words by accesses
+static void write_hottest(FILE* file, const mem_trace* trace)
+{
+    int listed[MEM_HOTTEST];
+    int count = 0;
+
+    // Selection of the MEM_HOTTEST largest, ties to the lower address
+    for (; count < MEM_HOTTEST; count++)
+    {
+        int best = -1;
+        for (int address = 0; address < MEM_SIZE; address++)
+        {
+            unsigned long long total = trace->reads[address] + trace->writes[address];
+            int taken = 0;
+            for (int i = 0; i < count; i++)
+            {
+                taken |= listed[i] == address;
+            }
+            if (total > 0 && !taken && (best < 0 || total > trace->reads[best] + trace->writes[best]))
+            {
+                best = address;
+            }
+        }
+        if (best < 0)
+        {
+            break;
+        }
+        listed[count] = best;
+    }
+
+    fprintf(file, "\nHottest words:\n  %7s %12s %12s\n", "address", "reads", "writes");
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(file, "  %7.3X %12llu %12llu\n", listed[i], trace->reads[listed[i]], trace->writes[listed[i]]);
+    }
+}
+
+// Writes the reuse distance histogram
+static void write_reuse(FILE* file, const mem_trace* trace)
+{
+    unsigned long long largest = 0;
+
+    for (int bucket = 0; bucket < MEM_REUSE_BUCKETS; bucket++)
+    {
+        if (trace->reuse[bucket] > largest)
+        {
+            largest = trace->reuse[bucket];
+        }
+    }
+
+    fprintf(file, "\nReuse distance: distinct words accessed since the previous access to the same word\n");
+    fprintf(file, "  %9s %12llu\n", "first", trace->cold);
+    for (int bucket = 0; bucket < MEM_REUSE_BUCKETS; bucket++)
+    {
+        unsigned long long count = trace->reuse[bucket];
+        unsigned int low = bucket == 0 ? 0 : 1u << (bucket - 1);
+        unsigned int high = bucket == 0 ? 0 : (1u << bucket) - 1;
+        char range[32];
+        int bar = largest ? (int)((count * MEM_BAR_WIDTH + largest - 1) / largest) : 0;
+
+        if (low == high)
+        {
+            snprintf(range, sizeof(range), "%u", low);
+        }
+        else
+        {
+            snprintf(range, sizeof(range), "%u-%u", low, high);
+        }
+        fprintf(file, "  %9s %12llu ", range, count);
+        for (int i = 0; i < bar; i++)
+        {
+            fputc('#', file);
+        }
+        fputc('\n', file);
+    }
+}
+
+// Writes the -mem_stats report
+static void write_report(const mem_trace* trace, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return;
+    }
+
+    unsigned long long reads = 0, writes = 0;
+    int read_words = 0, write_words = 0, words = 0;
+    for (int address = 0; address < MEM_SIZE; address++)
+    {
+        read_words += trace->reads[address] != 0;
+        write_words += trace->writes[address] != 0;
+        words += trace->reads[address] != 0 || trace->writes[address] != 0;
+    }
+
+    fprintf(file, "%-8s %12s %12s\n", "source", "reads", "writes");
+    for (int source = 0; source < MEM_SOURCES; source++)
+    {
+        fprintf(file, "%-8s %12llu %12llu\n", source_names[source], trace->source_reads[source], trace->source_writes[source]);
+        reads += trace->source_reads[source];
+        writes += trace->source_writes[source];
+    }
+    fprintf(file, "%-8s %12llu %12llu\n", "total", reads, writes);
+    fprintf(file, "words accessed: %d of %d (%d read, %d written)\n", words, MEM_SIZE, read_words, write_words);
+
+    write_hottest(file, trace);
+    write_heatmap(file, "Read", trace->reads);
+    write_heatmap(file, "Write", trace->writes);
+    write_reuse(file, trace);
+
+    fprintf(file, "\nStack: ");
+    if (trace->sp_seen)
+    {
+        fprintf(file, "$sp highest %03X, lowest %03X, high-water mark %d words at cycle %u, PC %03X\n",
+            trace->sp_top, trace->sp_low, trace->sp_top - trace->sp_low, trace->sp_low_cycle, trace->sp_low_pc);
+    }
+    else
+    {
+        fprintf(file, "$sp never set\n");
+    }
+
+    fprintf(file, "\nUninitialized reads: %llu reads of %u words (dmemin.txt words count as written: %d)\n",
+        trace->uninit_reads, trace->uninit_words, trace->data_words);
+    if (trace->uninit_words > 0)
+    {
+        fprintf(file, "  %7s %10s %4s %s\n", "address", "cycle", "PC", "source");
+        for (unsigned int i = 0; i < trace->uninit_words && i < MEM_UNINIT_LISTED; i++)
+        {
+            const mem_uninit* entry = &trace->uninit[i];
+            char pc[8] = "-";
+            if (entry->pc >= 0)
+            {
+                snprintf(pc, sizeof(pc), "%03X", entry->pc & MASK_12_BIT);
+            }
+            fprintf(file, "  %7.3X %10u %4s %s\n", entry->address, entry->cycle, pc, source_names[entry->source]);
+        }
+    }
+
+    if (trace->window)
+    {
+        unsigned int peak = 0;
+        fprintf(file, "\nWorking set per %u cycles:\n  %10s %6s %6s %6s %10s %6s\n", trace->window,
+            "cycle", "words", "read", "write", "accesses", "low $sp");
+        for (unsigned int i = 0; i <= trace->window_count; i++)
+        {
+            const mem_window* window = i < trace->window_count ? &trace->windows[i] : &trace->current;
+            char sp[16] = "-";
+            if (window->sp_low != SP_NONE)
+            {
+                snprintf(sp, sizeof(sp), "%03X", window->sp_low);
+            }
+            fprintf(file, "  %10llu %6u %6u %6u %10u %6s\n", (unsigned long long)i * trace->window, window->words,
+                window->read_words, window->write_words, window->accesses, sp);
+            if (window->words > peak)
+            {
+                peak = window->words;
+            }
+        }
+        fprintf(file, "peak working set: %u words\n", peak);
+    }
+    fclose(file);
+}
+
+// Writes the -mem_stats report, closes the trace file and frees the recorder
+void mem_trace_close(mem_trace* trace, const char* report_filename)
+{
+    if (report_filename)
+    {
+        write_report(trace, report_filename);
+    }
+    if (trace->file)
+    {
+        fclose(trace->file);
+    }
+    free(trace->windows);
+    free(trace);
+}
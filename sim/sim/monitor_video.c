@@ -0,0 +1,176 @@
+/**
+ * @file monitor_video.c
+ * @brief Streams the monitor frame buffer into a video file while the program runs.
+ *
+ * Frames are captured every N cycles and/or whenever the guest writes the
+ * monitorvsync register. Two stream formats are supported:
+ * - Raw: consecutive 256x256 grayscale frames, playable as a YUV400 video.
+ * - Delta: only the changed span of every changed row is stored per frame.
+ *
+ * Delta stream layout (all fields little-endian):
+ *   header: "SMVD", u16 width, u16 height
+ *   frame:  u32 cycle, u16 span_count, then span_count spans of
+ *           u8 row, u8 first_x, u16 length, length pixel bytes
+ * The decoder starts from a black frame and applies the spans frame by frame.
+ *
+ * Functions Implemented:
+ * - monitor_video_open: Opens the stream and writes the header.
+ * - monitor_video_mark_pixel: Records a changed pixel.
+ * - monitor_video_mark_rect: Records a changed rectangle (graphics accelerator).
+ * - monitor_video_tick: Captures a frame on the capture period or vsync.
+ * - monitor_video_capture: Appends one frame to the stream.
+ * - monitor_video_close: Writes the last frame and closes the stream.
+ */
+
+#include "simulator_functions.h"
+
+// Writes a 16-bit value in little-endian byte order
+static void write_u16(FILE* file, unsigned int value)
+{
+    unsigned char bytes[2] = { value & 0xFF, (value >> 8) & 0xFF };
+    fwrite(bytes, 1, 2, file);
+}
+
+// Writes a 32-bit value in little-endian byte order
+static void write_u32(FILE* file, unsigned int value)
+{
+    unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF };
+    fwrite(bytes, 1, 4, file);
+}
+
+// Opens the video stream and writes the stream header
+int monitor_video_open(monitor_video* video, const char* filename, int delta, unsigned int interval)
+{
+    memset(video, 0, sizeof(*video));
+
+    video->file = fopen(filename, "wb");
+    if (!video->file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return 0;
+    }
+
+    video->delta = delta;
+    video->interval = interval;
+    video->next_capture = interval;
+
+    if (delta)
+    {
+        fwrite(VIDEO_DELTA_MAGIC, 1, 4, video->file);
+        write_u16(video->file, MONITOR_SIZE);
+        write_u16(video->file, MONITOR_SIZE);
+    }
+    return 1;
+}
+
+// Records that the pixel at monitor_addr changed since the last frame
+void monitor_video_mark_pixel(monitor_video* video, unsigned int monitor_addr)
+{
+    unsigned char x = (monitor_addr >> 8) & 0xFF; // Same address split as update_monitor
+    unsigned char y = monitor_addr & 0xFF;
+
+    monitor_video_mark_rect(video, x, y, x, y);
+}
+
+// Records that the pixels of rows y0..y1, columns x0..x1 changed since the last frame
+void monitor_video_mark_rect(monitor_video* video, int x0, int y0, int x1, int y1)
+{
+    for (int y = y0; y <= y1; y++)
+    {
+        if (!video->row_dirty[y])
+        {
+            video->row_dirty[y] = 1;
+            video->dirty_rows[video->dirty_count++] = (unsigned char)y;
+            video->dirty_min_x[y] = (unsigned char)x0;
+            video->dirty_max_x[y] = (unsigned char)x1;
+            continue;
+        }
+
+        if (x0 < video->dirty_min_x[y])
+        {
+            video->dirty_min_x[y] = (unsigned char)x0;
+        }
+        if (x1 > video->dirty_max_x[y])
+        {
+            video->dirty_max_x[y] = (unsigned char)x1;
+        }
+    }
+}
+
+// Captures a frame when the capture period elapsed or the guest wrote monitorvsync
+void monitor_video_tick(monitor_video* video, unsigned int cycle, int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE])
+{
+    int capture = 0;
+
+    // Guest-triggered vsync: the register is self-clearing
+    if (IOR[IOR_MONITOR_VSYNC] != 0)
+    {
+        IOR[IOR_MONITOR_VSYNC] = 0;
+        capture = 1;
+    }
+
+    // Periodic capture
+    if (video->interval != 0 && cycle >= video->next_capture)
+    {
+        video->next_capture = cycle + video->interval;
+        capture = 1;
+    }
+
+    if (capture)
+    {
+        monitor_video_capture(video, cycle, screen);
+    }
+}
+
+// Appends the current frame to the video stream
+void monitor_video_capture(monitor_video* video, unsigned int cycle, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE])
+{
+    if (!video->delta)
+    {
+        // Raw YUV400: the whole frame buffer is one contiguous block
+        fwrite(screen, sizeof(unsigned char), MONITOR_SIZE * MONITOR_SIZE, video->file);
+    }
+    else
+    {
+        // Delta: only the changed span of each dirty row, cost scales with the change
+        write_u32(video->file, cycle);
+        write_u16(video->file, video->dirty_count);
+        for (int i = 0; i < video->dirty_count; i++)
+        {
+            int y = video->dirty_rows[i];
+            int first_x = video->dirty_min_x[y];
+            int length = video->dirty_max_x[y] - first_x + 1;
+
+            fputc(y, video->file);
+            fputc(first_x, video->file);
+            write_u16(video->file, length);
+            fwrite(&screen[y][first_x], sizeof(unsigned char), length, video->file);
+        }
+    }
+
+    // Reset the dirty rows only, never the whole table
+    for (int i = 0; i < video->dirty_count; i++)
+    {
+        video->row_dirty[video->dirty_rows[i]] = 0;
+    }
+    video->dirty_count = 0;
+    video->frames++;
+}
+
+// Writes the final frame and closes the video stream
+void monitor_video_close(monitor_video* video, unsigned int cycle, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE])
+{
+    if (!video->file)
+    {
+        return;
+    }
+
+    // Make sure the stream ends with the final state of the monitor
+    if (video->frames == 0 || video->dirty_count != 0)
+    {
+        monitor_video_capture(video, cycle, screen);
+    }
+
+    fclose(video->file);
+    video->file = NULL;
+}
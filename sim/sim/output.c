@@ -13,6 +13,8 @@
  * - write_monitor_pixels: Writes the monitor's pixel data to a text file.
  * - write_monitor_yuv: Writes the monitor's pixel data to a binary YUV file.
  * - log_trace: Logs a trace of executed instructions.
+ * - trace_delta_open: Starts a delta-encoded trace (-trace_delta).
+ * - log_trace_delta: Logs a trace line as a keyframe or as the changed registers.
  * - log_hw_register: Logs hardware register interactions.
  * - log_led_change: Logs changes to the LED state.
  * - log_display_change: Logs changes to the 7-segment display state.
@@ -24,14 +26,15 @@
  // Writes the contents of the data memory to dmemout.txt
 void write_data_memory(FILE* file, int data_memory[MEM_SIZE])
 {
-    // Write each memory value to the file in hexadecimal format
-    for (int i = 0; i < MEM_SIZE; i++)
+    // Encode all words as 8-character hex lines into one buffer and write it at once
+    char* buffer = (char*)malloc((size_t)MEM_SIZE * 9);
+    if (!buffer)
     {
-        fprintf(file, "%08X\n", data_memory[i]); // Each value is written as an 8-character hex number
-
-        
+        perror("Failed to allocate the dmemout buffer");
+        return;
     }
-
+    fwrite(buffer, 1, hex_encode_words(buffer, data_memory, MEM_SIZE), file);
+    free(buffer);
 }
 
 // Writes the values of registers R3-R15 to regout.txt
@@ -88,76 +91,49 @@ void write_disk_contents(FILE* file, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE]) {
         perror("Invalid file pointer");
         return;
     }
-    int last_x = -1;
-    int last_y = -1;
-    for (int sector = 0; sector < NUMBER_OF_SECTORS; sector++) {
-        for (int line = 0; line < SECTOR_SIZE; line++) {
-            if (disk[sector][line] != 0) {
-                last_x = sector;
-                last_y = line;
 
-            }
-        }
+    // The file ends at the last non-zero word
+    const int* words = &disk[0][0];
+    int count = MAX_DISK_ENTRIES;
+    while (count > 0 && words[count - 1] == 0) {
+        count--;
     }
-    // Iterate through the disk contents and write to the file
-    for (int sector = 0; sector < NUMBER_OF_SECTORS; sector++) {
-        for (int line = 0; line < SECTOR_SIZE; line++) {
-            if (last_x == -1 && last_y == -1) {
-                break;
-            }
-            fprintf(file, "%08X\n", disk[sector][line]);
-            if (sector == last_x && line == last_y) {
-                break;
-            }
-            
-        }
-        if (last_x == -1) {
-            break;
-        }
-        if (sector == last_x) {
-            break;
-        }
-        
+    if (count == 0) {
+        return;
     }
+
+    char* buffer = (char*)malloc((size_t)count * 9);
+    if (!buffer) {
+        perror("Failed to allocate the diskout buffer");
+        return;
+    }
+    fwrite(buffer, 1, hex_encode_words(buffer, words, count), file);
+    free(buffer);
 }
 
 // Writes the pixel data to monitor.txt
 void write_monitor_pixels(FILE* file, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE])
 {
-    int last_x = -1;
-    int last_y = -1;
-    for (int i = 0; i < MONITOR_SIZE; i++)
+    // The file ends at the last non-zero pixel
+    const unsigned char* pixels = &screen[0][0];
+    int count = MONITOR_SIZE * MONITOR_SIZE;
+    while (count > 0 && pixels[count - 1] == 0)
     {
-        for (int j = 0; j < MONITOR_SIZE; j++)
-        {
-            if (screen[i][j] != 0) {
-                last_x = i;
-                last_y = j;
-                
-            }
-        }
+        count--;
+    }
+    if (count == 0)
+    {
+        return;
     }
 
-    for (int i = 0; i < MONITOR_SIZE; i++)
+    char* buffer = (char*)malloc((size_t)count * 3);
+    if (!buffer)
     {
-        for (int j = 0; j < MONITOR_SIZE; j++)
-        {
-            if (last_x == -1 && last_y == -1) {
-                break;
-            }
-            fprintf(file, "%02X\n", screen[i][j]); // Write each pixel as a 2-character hex value
-            if (i == last_x && j == last_y) {
-                break;
-            }
-        }
-        if (last_x == -1) {
-            break;
-        }
-        if (i == last_x) {
-            break;
-        }
-       
+        perror("Failed to allocate the monitor.txt buffer");
+        return;
     }
+    fwrite(buffer, 1, hex_encode_bytes(buffer, pixels, count), file); // Each pixel as a 2-character hex value
+    free(buffer);
 }
 
 // Writes the pixel data in binary format to monitor.yuv
@@ -193,6 +169,75 @@ void log_trace(FILE* file, unsigned int pc, const char* instruction, int registe
     fprintf(file, "\n");
 }
 
+// Sign-extends the 12-bit immediate whose 3 hex digits start at offset in an instruction
+static int trace_immediate(const char* instruction, int offset)
+{
+    int value = 0;
+    for (int i = offset; i < offset + 3; i++)
+    {
+        char c = instruction[i];
+        value = value * 16 + (c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c - '0');
+    }
+    return value >= 0x800 ? value - 0x1000 : value;
+}
+
+// Starts a delta-encoded trace: writes the header, the first line is a keyframe
+void trace_delta_open(trace_delta* trace, FILE* file, unsigned int interval)
+{
+    /*
+        Format (decoded back to trace.txt by simp-trace):
+        - Header: "SMTD <interval>".
+        - Keyframe, every interval lines from the first: "K " and the line log_trace writes.
+        - Other lines: "<PC> <instruction>" and " <r>=<value>" for each register that differs
+          from the previous line, both in hex without leading zeros. $imm1 and $imm2 are
+          compared with the immediates of the instruction instead, so they rarely appear.
+    */
+
+    memset(trace, 0, sizeof(*trace));
+    trace->interval = interval;
+    fprintf(file, "SMTD %u\n", interval);
+}
+
+// Logs one trace line in the -trace_delta format
+void log_trace_delta(trace_delta* trace, FILE* file, unsigned int pc, const char* instruction, int registers[REG_NUM])
+{
+    if (!file || !instruction)
+    {
+        perror("Invalid file pointer or instruction");
+        return;
+    }
+
+    if (trace->since_keyframe == 0)
+    {
+        fputs("K ", file);
+        log_trace(file, pc, instruction, registers);
+    }
+    else
+    {
+        // Longest line: PC, instruction and all 16 registers as " F=FFFFFFFF"
+        char line[4 + CMD_BYTES + REG_NUM * 11 + 2];
+        int length = snprintf(line, sizeof(line), "%03X %s", pc, instruction);
+
+        trace->previous[1] = trace_immediate(instruction, 6);
+        trace->previous[2] = trace_immediate(instruction, 9);
+        for (int i = 0; i < REG_NUM; i++)
+        {
+            if (registers[i] != trace->previous[i])
+            {
+                length += snprintf(line + length, sizeof(line) - length, " %X=%X", i, (unsigned int)registers[i]);
+            }
+        }
+        line[length++] = '\n';
+        fwrite(line, 1, length, file);
+    }
+
+    memcpy(trace->previous, registers, sizeof(trace->previous));
+    if (++trace->since_keyframe == trace->interval)
+    {
+        trace->since_keyframe = 0;
+    }
+}
+
 // Logs hardware register interactions to hwregtrace.txt - need to open the file for writing when use!!
 void log_hw_register(FILE* file, unsigned int cycle, const char* action, const char* reg_name, char* data)
 {
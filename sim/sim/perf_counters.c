@@ -0,0 +1,120 @@
+/**
+ * @file perf_counters.c
+ * @brief Guest-readable performance counters (perfctl, perfinstr, perfalu .. perfdmabusy).
+ *
+ * perfctl (I/O register 18) bit 0 starts and stops counting; writing bit 1
+ * clears every counter and reads back 0. The counters are I/O registers 19
+ * and 50-60:
+ * - perfinstr: instructions retired (halt is not counted);
+ * - perfalu, perfbranch, perfload, perfstore, perfio, perfvector: retired
+ *   per class (load/store include vlw/vsw, vector is the other vector ops);
+ * - perftaken: branches that jumped and jal;
+ * - perfirq: interrupt handler entries; perfisr: cycles that started in a
+ *   handler, up to and including its reti;
+ * - perfdiskbusy / perfdmabusy: cycles the disk had a command in service and
+ *   the memory DMA engine was busy.
+ * An instruction stalled by -dma retires, and counts, in the cycle it runs.
+ * The out that enables counting is not counted, the one that disables it is.
+ * Handlers are tracked only while counting: enable the counters outside them.
+ *
+ * Counting is batched. With perfctl 0 the cycle loop only tests it. While
+ * counting, a cycle adds to a tally per opcode and a few totals in
+ * sim_state; the registers are brought up to date before every `in`, the only
+ * way a program reads them, and when perfctl is written.
+ *
+ * Functions Implemented:
+ * - perf_counters_flush: Adds the batched events to the registers.
+ * - perf_counters_cycle: Counts one cycle and applies perfctl writes.
+ */
+
+#include "simulator_functions.h"
+
+// Sum of the tally over opcodes first..last
+static unsigned int retired_between(const perf_counters* perf, int first, int last)
+{
+    unsigned int count = 0;
+    for (int opcode = first; opcode <= last; opcode++)
+    {
+        count += perf->retired[opcode];
+    }
+    return count;
+}
+
+// Adds the events counted since the last flush to the perf* registers
+void perf_counters_flush(perf_counters* perf, int IOR[IOR_NUM])
+{
+    IOR[IOR_PERF_INSTR] += (int)retired_between(perf, 0, PERF_OPCODES - 1);
+    IOR[IOR_PERF_ALU] += (int)retired_between(perf, ADD, SRL);
+    IOR[IOR_PERF_BRANCH] += (int)retired_between(perf, BEQ, JAL);
+    IOR[IOR_PERF_LOAD] += (int)(perf->retired[LW] + perf->retired[VLW]);
+    IOR[IOR_PERF_STORE] += (int)(perf->retired[SW] + perf->retired[VSW]);
+    IOR[IOR_PERF_IO] += (int)retired_between(perf, RETI, OUT);
+    IOR[IOR_PERF_VECTOR] += (int)(perf->retired[VSETVL] + retired_between(perf, VADD, VREDSUM));
+    IOR[IOR_PERF_TAKEN] += (int)perf->taken;
+    IOR[IOR_PERF_IRQ] += (int)perf->interrupts;
+    IOR[IOR_PERF_ISR] += (int)perf->isr_cycles;
+    IOR[IOR_PERF_DISK_BUSY] += (int)perf->disk_busy;
+    IOR[IOR_PERF_DMA_BUSY] += (int)perf->dma_busy;
+
+    memset(perf->retired, 0, sizeof(perf->retired));
+    perf->taken = perf->interrupts = perf->isr_cycles = perf->disk_busy = perf->dma_busy = 0;
+}
+
+// Counts the events of a cycle, then applies a perfctl write of the cycle
+void perf_counters_cycle(sim_state* state, long opcode, int pc, int stalled, int serviced)
+{
+    /*
+        INPUT: opcode and pc (the instruction of the cycle), stalled (1 if it waits for the data memory port),
+               serviced (sources whose handler was entered at the end of the cycle, 0 if none)
+    */
+
+    perf_counters* perf = &state->perf;
+    int* IOR = state->IOR;
+
+    if (perf->control & PERF_ENABLE)
+    {
+        perf->isr_cycles += perf->in_isr != 0;
+        if (!stalled)
+        {
+            perf->retired[opcode & (PERF_OPCODES - 1)]++;
+
+            // The PC after the instruction: irqreturn when a handler was entered after it
+            int next = serviced ? IOR[7] : state->pc;
+            if (opcode >= BEQ && opcode <= JAL && next != pc + 1)
+            {
+                perf->taken++;
+            }
+            if (opcode == RETI && !state->irq_ctl.enabled)
+            {
+                perf->in_isr = 0;
+            }
+        }
+        if (serviced)
+        {
+            perf->interrupts++;
+            perf->in_isr = 1;
+        }
+        if (state->irq_ctl.enabled)
+        {
+            perf->in_isr = state->irq_ctl.depth;
+        }
+        perf->disk_busy += state->disk_ctl.timer > 0;
+        perf->dma_busy += state->memdma.timer > 0;
+    }
+
+    if (IOR[IOR_PERF_CTL] != perf->control)
+    {
+        perf_counters_flush(perf, IOR);
+        if (IOR[IOR_PERF_CTL] & PERF_RESET)
+        {
+            IOR[IOR_PERF_CTL] &= ~PERF_RESET;
+            IOR[IOR_PERF_INSTR] = 0;
+            memset(&IOR[IOR_PERF_ALU], 0, (IOR_PERF_DMA_BUSY - IOR_PERF_ALU + 1) * sizeof(int));
+        }
+        if (!(perf->control & PERF_ENABLE))
+        {
+            perf->in_isr = 0; // Not tracked while the counters were off
+        }
+        perf->control = IOR[IOR_PERF_CTL];
+    }
+}
@@ -0,0 +1,235 @@
+/**
+ * @file predecode.c
+ * @brief Predecoded execution engine and debugger traps.
+ *
+ * The instruction memory cannot be written by the program, so every
+ * instruction is decoded once when the simulation starts. Each entry of the
+ * table holds the decoded fields and the handler that runs one cycle with
+ * them; the cycle loop is a single indirect call through the entry at PC.
+ *
+ * Breakpoints and watchpoints cost nothing until they are used:
+ * - A breakpoint replaces the handler at its PC with trap_handler, which
+ *   stops before the instruction runs. No other PC is affected.
+ * - Armed watchpoints replace the handlers of the lw/sw/vlw/vsw instructions
+ *   only, with one that checks the accessed words after the instruction ran.
+ *
+ * Slots that hold no instruction get a handler that reports the bad text
+ * only when the program runs them.
+ *
+ * Functions Implemented:
+ * - predecode_program: Builds the handler table from the instruction memory.
+ * - simulate_cycle: Runs one cycle through the handler table.
+ * - run_predecoded: Default handler, runs one cycle with a predecoded instruction.
+ * - trap_handler: Breakpoint handler.
+ * - set_breakpoint / clear_breakpoint: Arm and disarm breakpoints.
+ * - set_watchpoint / clear_watchpoint: Arm and disarm data watchpoints.
+ * - clear_debug_traps: Removes every breakpoint and watchpoint.
+ */
+
+#include "simulator_functions.h"
+
+// Handler of a slot that holds no instruction: reports it, then runs the zeroed no-op
+static int invalid_handler(sim_state* state, predecoded_instruction* instruction)
+{
+    instruction_decode ignored;
+    int scratch[REG_NUM] = { 0 };
+
+    decode_instruction(instruction->text, &ignored, scratch); // Prints why the text is not an instruction
+    return run_predecoded(state, instruction);
+}
+
+// Decodes the whole instruction memory into the handler table
+void predecode_program(sim_state* state)
+{
+    /*
+        INPUT: state (instruction_memory must be loaded)
+        OUTPUT: Fills state->program; every entry starts with run_predecoded as its handler (invalid_handler without an instruction).
+    */
+
+    int scratch[REG_NUM] = { 0 }; // decode_instruction loads $imm1/$imm2, keep the real registers untouched
+
+    for (int pc = 0; pc < MEM_SIZE; pc++)
+    {
+        predecoded_instruction* entry = &state->program[pc];
+        const char* text = state->instruction_memory[pc];
+
+        // A slot that is not an instruction (the empty one after the last line of imemin.txt) keeps the zeroed
+        // no-op; its error is reported only if the program runs it, as the reference interpreter does
+        memset(&entry->decoded, 0, sizeof(entry->decoded));
+        int valid = strlen(text) == 12 && strspn(text, "0123456789abcdefABCDEF") == 12;
+        if (valid)
+        {
+            decode_instruction(text, &entry->decoded, scratch);
+        }
+        entry->text = text;
+        entry->handler = valid ? run_predecoded : invalid_handler;
+        entry->execute = entry->handler;
+    }
+}
+
+// Runs one cycle through the predecoded table
+int simulate_cycle(sim_state* state)
+{
+    predecoded_instruction* entry = &state->program[state->pc];
+
+    return entry->handler(state, entry);
+}
+
+// Default handler: the same cycle as the reference interpreter, without the text decoding
+int run_predecoded(sim_state* state, predecoded_instruction* instruction)
+{
+    state->IOR[8] = state->cycle; // Update clock counter
+    if (!state->irq_ctl.enabled)
+    {
+        state->IOR[5] = 0;        // reset irq2 after one clock cycle (it latches with -irqctl)
+    }
+
+    // What decode_instruction does on every cycle of the reference interpreter
+    state->registers[1] = instruction->decoded.imm1;
+    state->registers[2] = instruction->decoded.imm2;
+
+    return complete_cycle(state, &instruction->decoded, instruction->text);
+}
+
+// Breakpoint handler: leaves the machine untouched so the cycle can be rerun later
+int trap_handler(sim_state* state, predecoded_instruction* instruction)
+{
+    (void)state;
+    (void)instruction;
+    return CYCLE_BREAKPOINT;
+}
+
+// Returns the value a register operand has while the instruction runs
+static int operand_value(sim_state* state, predecoded_instruction* instruction, int reg)
+{
+    if (reg == 1)
+    {
+        return instruction->decoded.imm1;
+    }
+    if (reg == 2)
+    {
+        return instruction->decoded.imm2;
+    }
+    return state->registers[reg];
+}
+
+// lw/sw/vlw/vsw handler while watchpoints are armed: runs the instruction, then checks the accessed words
+static int watch_handler(sim_state* state, predecoded_instruction* instruction)
+{
+    long opcode = instruction->decoded.opcode;
+    unsigned int address = operand_value(state, instruction, instruction->decoded.rs) + operand_value(state, instruction, instruction->decoded.rt);
+    unsigned int count = opcode == VLW || opcode == VSW ? (unsigned int)state->vector.length : 1;
+    int access = opcode == SW || opcode == VSW ? WATCH_WRITE : WATCH_READ;
+    int result = run_predecoded(state, instruction);
+
+    // A -dma stall did not access memory, the retry in a later cycle does
+    if (result != CYCLE_CONTINUE || state->stalled || count == 0 || address >= MEM_SIZE || address > MEM_SIZE - count)
+    {
+        return result;
+    }
+
+    for (int i = 0; i < state->watch_count; i++)
+    {
+        watchpoint* watch = &state->watches[i];
+        if ((watch->type & access) && address <= watch->last && address + count - 1 >= watch->first)
+        {
+            state->watch_hit_type = watch->type;
+            state->watch_hit_address = address > watch->first ? address : watch->first;
+            return CYCLE_WATCHPOINT;
+        }
+    }
+    return result;
+}
+
+// Installs the execute handler of every lw/sw/vlw/vsw, depending on whether watchpoints are armed
+static void update_memory_handlers(sim_state* state)
+{
+    cycle_handler execute = state->watch_count > 0 ? watch_handler : run_predecoded;
+
+    for (int pc = 0; pc < MEM_SIZE; pc++)
+    {
+        predecoded_instruction* entry = &state->program[pc];
+        long opcode = entry->decoded.opcode;
+        if (opcode != LW && opcode != SW && opcode != VLW && opcode != VSW)
+        {
+            continue;
+        }
+        if (entry->handler != trap_handler)
+        {
+            entry->handler = execute;
+        }
+        entry->execute = execute;
+    }
+}
+
+// Arms a breakpoint at pc
+int set_breakpoint(sim_state* state, int pc)
+{
+    if (pc < 0 || pc >= MEM_SIZE)
+    {
+        return 0;
+    }
+    state->program[pc].handler = trap_handler;
+    return 1;
+}
+
+// Disarms the breakpoint at pc
+int clear_breakpoint(sim_state* state, int pc)
+{
+    if (pc < 0 || pc >= MEM_SIZE)
+    {
+        return 0;
+    }
+    state->program[pc].handler = state->program[pc].execute;
+    return 1;
+}
+
+// Watches the data memory words first..last
+int set_watchpoint(sim_state* state, unsigned int first, unsigned int last, int type)
+{
+    if (state->watch_count == MAX_WATCHPOINTS || first > last)
+    {
+        return 0;
+    }
+
+    watchpoint* watch = &state->watches[state->watch_count++];
+    watch->first = first;
+    watch->last = last;
+    watch->type = type;
+
+    if (state->watch_count == 1)
+    {
+        update_memory_handlers(state);
+    }
+    return 1;
+}
+
+// Removes a watchpoint set with the same range and type
+int clear_watchpoint(sim_state* state, unsigned int first, unsigned int last, int type)
+{
+    for (int i = 0; i < state->watch_count; i++)
+    {
+        watchpoint* watch = &state->watches[i];
+        if (watch->first == first && watch->last == last && watch->type == type)
+        {
+            state->watches[i] = state->watches[--state->watch_count];
+            if (state->watch_count == 0)
+            {
+                update_memory_handlers(state);
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Removes every breakpoint and watchpoint
+void clear_debug_traps(sim_state* state)
+{
+    state->watch_count = 0;
+    update_memory_handlers(state);
+    for (int pc = 0; pc < MEM_SIZE; pc++)
+    {
+        state->program[pc].handler = state->program[pc].execute;
+    }
+}
@@ -7,6 +7,8 @@
  *
  * Functions Implemented:
  * - simulate: Manages the Fetch-Decode-Execute loop.
+ * - simulate_cycle_reference: Runs one cycle, decoding the instruction from its hex text.
+ * - complete_cycle: Executes a decoded instruction and updates the devices for one cycle.
  * - fetch_instruction: Fetches instructions from memory based on the program counter.
  * - decode_instruction: Decodes the fetched instructions into components.
  * - execute_instruction: Executes a single decoded instruction.
@@ -16,86 +18,302 @@
 #include "simulator_functions.h"
 
  // Main simulation function: Fetch - Decode - Execute loop
-void simulate(FILE* output_files[], int IOR[23], int registers[REG_NUM], int data_memory[MEM_SIZE], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], char instruction_memory[MEM_SIZE][CMD_BYTES + 1], unsigned int interupt2_events[MEM_SIZE])
+int simulate(FILE* output_files[], int IOR[IOR_NUM], int registers[REG_NUM], int data_memory[MEM_SIZE], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], char instruction_memory[MEM_SIZE][CMD_BYTES + 1], sim_options* options)
 {
-    unsigned int pc = 0; // Program Counter initialization
-    unsigned int cycle = 0; // clock cycle initialization 
-    unsigned int halted = 0; 
-    unsigned disk_timer = 0; // Initialize disk timer
-    int* intup2_pointer = interupt2_events;
- 
-    while (!halted)
+    // The machine state is large (it holds the predecoded program), keep it off the stack
+    sim_state* state = (sim_state*)calloc(1, sizeof(sim_state));
+    int diverged = 0;
+    if (!state)
     {
-        IOR[8] = cycle; // Update clock counter
+        perror("Failed to allocate the simulator state");
+        return 1;
+    }
 
-        IOR[5] = 0; //reset irq2 after one clock cycle.
+    state->output_files = output_files;
+    state->IOR = IOR;
+    state->registers = registers;
+    state->data_memory = data_memory;
+    state->screen = screen;
+    state->disk = disk;
+    state->instruction_memory = instruction_memory;
+    state->pc = 0; // Program Counter initialization
+    state->cycle = 0; // clock cycle initialization
+    disk_queue_configure(&state->disk_ctl, options); // Disk starts idle, queued when selected
+    mem_dma_configure(&state->memdma, options);
+    irq_controller_configure(&state->irq_ctl, IOR, options);
+    vector_unit_reset(&state->vector, options->vector_length ? options->vector_length : DEFAULT_VECTOR_LENGTH);
+    state->trace_window = options->trace_window;
+    state->trace_first = options->trace_first;
+    state->trace_last = options->trace_last;
+    if (!state_probe_configure(&state->probe, options))
+    {
+        free(state);
+        return 1;
+    }
+    irq2_open(&state->irq2, options->irq2_filename, &options->irq2);
 
-        // Fetch instruction
-        const char* instruction = fetch_instruction(instruction_memory, &pc);
+    // Optional delta-encoded trace
+    if (options->trace_keyframe)
+    {
+        trace_delta_open(&state->trace, output_files[2], options->trace_keyframe);
+    }
 
+    // Optional monitor video stream
+    if (options->video_filename)
+    {
+        monitor_video_open(&state->video, options->video_filename, options->video_delta, options->video_interval);
+    }
 
-        if (!instruction)
-        {
-            fprintf(stderr, "Error: Failed to fetch instruction at PC=%u\n", pc);
-            break;
-        }
+    // Optional interrupt instrumentation
+    if (options->irq_stats_filename || options->irq_timeline_filename)
+    {
+        state->irq_stats = irq_stats_open(options->irq_timeline_filename);
+    }
+
+    // Optional data memory access recorder, shared with the devices that move words
+    if (options->mem_trace_filename || options->mem_stats_filename)
+    {
+        state->mem_trace = mem_trace_open(options);
+        state->disk_ctl.mem_trace = state->mem_trace;
+        state->gfx.mem_trace = state->mem_trace;
+        state->memdma.mem_trace = state->mem_trace;
+    }
+
+    // Optional call graph profiler
+    if (options->callgraph_report)
+    {
+        state->call_graph = call_graph_open(options->callgraph_symbols);
+    }
+
+    // Decode the program once; the cycle loop dispatches through the handler table
+    predecode_program(state);
+
+    if (options->gdb_address)
+    {
+        gdb_serve(state, options->gdb_address);
+    }
+    else if (options->cosim_engine)
+    {
+        diverged = cosim_run(state, options);
+    }
+    else if (state->probe.active)
+    {
+        state_probe_run(state, options->reference_engine ? simulate_cycle_reference : simulate_cycle);
+    }
+    else if (options->reference_engine)
+    {
+        while (simulate_cycle_reference(state) == CYCLE_CONTINUE);
+    }
+    else
+    {
+        while (simulate_cycle(state) == CYCLE_CONTINUE);
+    }
+
+    // Final output writing
+    write_data_memory(output_files[0], data_memory);
+    write_registers(output_files[1], registers);
+    write_disk_contents(output_files[7], disk);
+    write_monitor_pixels(output_files[8], screen);
+    write_monitor_yuv(output_files[9], screen);
+    write_cycle_count(output_files[4], state->cycle);
+    state_probe_close(&state->probe, state);
+    monitor_video_close(&state->video, state->cycle, screen);
+    irq2_close(&state->irq2);
+    if (state->irq_stats)
+    {
+        irq_stats_report(state->irq_stats, options->irq_stats_filename);
+    }
+    if (options->disk_stats_filename)
+    {
+        disk_queue_report(&state->disk_ctl, options->disk_stats_filename);
+    }
+    if (state->mem_trace)
+    {
+        mem_trace_close(state->mem_trace, options->mem_stats_filename);
+    }
+    if (state->call_graph)
+    {
+        call_graph_close(state->call_graph, state->cycle, options->callgraph_report, options->callgraph_folded);
+    }
 
+    free(state);
+    return diverged;
+}
 
-        // Decode instruction
-        instruction_decode decoded_instruction;
-        decode_instruction(instruction, &decoded_instruction, registers);
+// Runs one cycle of the original interpreter: the instruction is fetched and decoded from its hex text every time
+int simulate_cycle_reference(sim_state* state)
+{
+    /*
+        INPUT: state (machine state)
+        OUTPUT: CYCLE_CONTINUE, or CYCLE_HALTED once the program stopped.
+    */
 
+    state->IOR[8] = state->cycle; // Update clock counter
 
-        // Log instruction trace before execution - but woth the instruction to be performed
-        log_trace(output_files[2], pc, instruction, registers);
+    if (!state->irq_ctl.enabled)
+    {
+        state->IOR[5] = 0; //reset irq2 after one clock cycle.
+    }
 
+    // Fetch instruction
+    const char* instruction = fetch_instruction(state->instruction_memory, &state->pc);
 
-        // Check halt condition: if disk timer is not done eventhough there are no other instructoins -> prosseccor continues
-        if (decoded_instruction.opcode == HALT && disk_timer == 0)
-        {
-            cycle++;
-            halted = 1;
-            break;
-        }
-        // Check halt condition: if disk timer is done and there are no other instructoins -> prosseccor stops
-        if (decoded_instruction.opcode == HALT && disk_timer != 0) {
-            manage_disk_status(IOR, &disk_timer);
-            cycle++;
-            continue;
+    if (!instruction)
+    {
+        fprintf(stderr, "Error: Failed to fetch instruction at PC=%u\n", state->pc);
+        return CYCLE_HALTED;
+    }
+
+    // Decode instruction
+    instruction_decode decoded_instruction;
+    decode_instruction(instruction, &decoded_instruction, state->registers);
+
+    return complete_cycle(state, &decoded_instruction, instruction);
+}
+
+// Runs the rest of a cycle once the instruction is decoded and $imm1/$imm2 are loaded
+int complete_cycle(sim_state* state, instruction_decode* decoded_instruction, const char* instruction)
+{
+    /*
+        Shared by the reference interpreter and the predecoded engine, so both retire instructions
+        and update the devices in exactly the same order.
+        INPUT: state (machine state), decoded_instruction (fields of the instruction at PC), instruction (hex text for the trace)
+        OUTPUT: CYCLE_CONTINUE, or CYCLE_HALTED once the program stopped.
+    */
+
+    int* IOR = state->IOR;
+    int* registers = state->registers;
+    FILE** output_files = state->output_files;
+
+    // Log instruction trace before execution - but woth the instruction to be performed
+    if (state->trace_window && (state->cycle < state->trace_first || state->cycle > state->trace_last)) {
+        // -trace_window: outside the logged cycles
+    }
+    else if (state->trace.interval) {
+        log_trace_delta(&state->trace, output_files[2], state->pc, instruction, registers);
+    }
+    else {
+        log_trace(output_files[2], state->pc, instruction, registers);
+    }
+
+    if (state->mem_trace) {
+        mem_trace_cycle(state->mem_trace, state->cycle, state->pc, registers[14]);
+    }
+
+    // Check halt condition: if disk timer is not done eventhough there are no other instructoins -> prosseccor continues
+    if (decoded_instruction->opcode == HALT && state->disk_ctl.timer == 0)
+    {
+        state->cycle++;
+        return CYCLE_HALTED;
+    }
+    // Check halt condition: if disk timer is done and there are no other instructoins -> prosseccor stops
+    if (decoded_instruction->opcode == HALT && state->disk_ctl.timer != 0) {
+        dma_arbitrate(&state->disk_ctl, 0, state->disk, state->data_memory);
+        int status_before = state->irq_stats ? irq_status_bits(IOR) : 0;
+        if (manage_disk_status(IOR, state->disk, state->data_memory, &state->disk_ctl) && state->irq_stats) {
+            irq_stats_raise(state->irq_stats, state->cycle, 2, status_before);
         }
+        state->cycle++;
+        return CYCLE_CONTINUE;
+    }
 
-        // Execute instruction
-        execute_instruction(&decoded_instruction, registers, &pc, data_memory, IOR, screen,
-            output_files[3], output_files[5], output_files[6], output_files[8], &disk_timer, disk);
+    // -dma: the sector transfer and lw/sw/vlw/vsw share the data memory port
+    int stalled = 0;
+    if (state->disk_ctl.dma_command != 0) {
+        int memory_words = decoded_instruction->opcode == LW || decoded_instruction->opcode == SW ? 1
+            : decoded_instruction->opcode == VLW || decoded_instruction->opcode == VSW ? state->vector.length : 0;
+        stalled = dma_arbitrate(&state->disk_ctl, memory_words, state->disk, state->data_memory);
+    }
+    state->stalled = stalled;
 
-        //Handling interups:
+    // Execute instruction, unless it waits for the data memory port (it runs again next cycle)
+    int pc = state->pc;
+    if (state->perf.control && decoded_instruction->opcode == IN) {
+        perf_counters_flush(&state->perf, IOR); // The program may read a counter
+    }
+    if (!stalled) {
+        if (state->mem_trace) {
+            mem_trace_instruction(state->mem_trace, decoded_instruction, registers, state->vector.length);
+        }
+        execute_instruction(decoded_instruction, registers, &state->pc, state->data_memory, IOR, state->screen,
+            output_files[3], output_files[5], output_files[6], output_files[8], &state->disk_ctl, state->disk, &state->vector);
+    }
 
-        //IRQ2 status
-        if (cycle == *intup2_pointer) {
-            IOR[5] = 1;
-            intup2_pointer = intup2_pointer + 1;
+    // Monitor video: track written pixels and capture frames
+    if (state->video.file)
+    {
+        if (decoded_instruction->opcode == OUT && registers[decoded_instruction->rs] + registers[decoded_instruction->rt] == 22
+            && registers[decoded_instruction->rm] == 1)
+        {
+            monitor_video_mark_pixel(&state->video, IOR[20]);
         }
+        monitor_video_tick(&state->video, state->cycle, IOR, state->screen);
+    }
 
-        //IRQ1 - Manage disk timer
-        manage_disk_status(IOR, &disk_timer);
+    //Handling interups:
+    int raised = 0; // Sources raised by the devices in this cycle (bit n = IRQn)
+    int status_before = state->irq_stats ? irq_status_bits(IOR) : 0;
 
-        //IRQ0 - Handle timer interrupt
-        handle_timer_status(IOR);
+    //IRQ2 status
+    if (state->irq2.has_next && state->cycle == state->irq2.next) {
+        IOR[5] = 1;
+        raised |= 4;
+        irq2_advance(&state->irq2);
+    }
 
-        //Handle pending interrupts
-        handle_interrupts(&pc, IOR, output_files[3]);//to check if 3
+    //IRQ1 - Manage disk timer
+    if (manage_disk_status(IOR, state->disk, state->data_memory, &state->disk_ctl)) {
+        raised |= 2;
+    }
 
-        cycle++; // increasing clock by 1
+    //IRQ2 (own source with -irqctl) - Graphics accelerator completion
+    if (gfx_accel_tick(&state->gfx, IOR, state->screen, state->data_memory, state->video.file ? &state->video : NULL)) {
+        raised |= irq_controller_raise(&state->irq_ctl, IOR, IRQ_GFX);
     }
 
-    // Final output writing
-    write_data_memory(output_files[0], data_memory);
-    write_registers(output_files[1], registers);
-    write_disk_contents(output_files[7], disk);
-    write_monitor_pixels(output_files[8], screen);
-    write_monitor_yuv(output_files[9], screen);
-    write_cycle_count(output_files[4], cycle);
+    //IRQ2 (own source with -irqctl) - Memory DMA completion
+    if (mem_dma_tick(&state->memdma, IOR, state->data_memory)) {
+        raised |= irq_controller_raise(&state->irq_ctl, IOR, IRQ_MEMDMA);
+    }
 
+    //IRQ0 - Handle timer interrupt
+    if (handle_timer_status(IOR)) {
+        raised |= 1;
+    }
+
+    //Handle pending interrupts
+    int serviced;
+    if (state->irq_ctl.enabled) {
+        if (decoded_instruction->opcode == RETI && !stalled) {
+            irq_controller_return(&state->irq_ctl, IOR);
+        }
+        serviced = irq_controller_dispatch(&state->irq_ctl, &state->pc, IOR);
+    }
+    else {
+        serviced = handle_interrupts(&state->pc, IOR, output_files[3]);//to check if 3
+    }
+
+    // Interrupt instrumentation, also records the reti of this cycle
+    if (state->irq_stats) {
+        if (decoded_instruction->opcode == RETI) {
+            irq_stats_return(state->irq_stats, state->cycle);
+        }
+        irq_stats_raise(state->irq_stats, state->cycle, raised, status_before);
+        irq_stats_dispatch(state->irq_stats, IOR, state->cycle, serviced);
+    }
+
+    // Guest performance counters, batched until the program reads them
+    if (state->perf.control | IOR[IOR_PERF_CTL]) {
+        perf_counters_cycle(state, decoded_instruction->opcode, pc, stalled, serviced);
+    }
+
+    // Call graph profile: the call, return or reti of this cycle, then the handler entered after it
+    if (state->call_graph) {
+        call_graph_cycle(state->call_graph, decoded_instruction, pc, serviced ? IOR[7] : state->pc, stalled, serviced ? state->pc : -1);
+    }
+
+    state->cycle++; // increasing clock by 1
+    return CYCLE_CONTINUE;
 }
 
 // Fetches an instruction from memory based on the program counter (PC)
@@ -202,16 +420,17 @@ void decode_instruction(const char* instruction, instruction_decode* decoded_ins
 
 //Executes a decoded instruction.
 void execute_instruction(instruction_decode* decoded_instruction, int register_array[REG_NUM], int* PC, int data_memory[MEM_SIZE],
-    int IOR[23], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], FILE* hwregtrace_file, FILE* leds_file, FILE* display7seg_file, FILE* monitor_file, int* disk_timer, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE])
+    int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], FILE* hwregtrace_file, FILE* leds_file, FILE* display7seg_file, FILE* monitor_file, disk_controller* disk_ctl, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE],
+    vector_unit* vector)
  {
    
     /*
         Executes the instruction and updates the program counter.
-        Based on the opcode, it performs arithmetic, comparison, memory, or I/O operations.
+        Based on the opcode, it performs arithmetic, comparison, memory, I/O or vector operations.
     */
 
     // Validate opcode range
-    if (decoded_instruction->opcode < 0 || decoded_instruction->opcode > 21)
+    if (decoded_instruction->opcode < 0 || decoded_instruction->opcode > VREDSUM)
     {
         fprintf(stderr, "Error: Unsupported opcode: %d\n", decoded_instruction->opcode);
         return;
@@ -253,7 +472,7 @@ void execute_instruction(instruction_decode* decoded_instruction, int register_a
     case 18: // reti (return from interrupt)
     case 19: // in (read from I/O register)
     case 20: // out (write to I/O register)
-        IO_operation(decoded_instruction, data_memory, hwregtrace_file, leds_file, display7seg_file, monitor_file, PC, register_array, IOR, screen, disk, disk_timer);
+        IO_operation(decoded_instruction, data_memory, hwregtrace_file, leds_file, display7seg_file, monitor_file, PC, register_array, IOR, screen, disk, disk_ctl);
         break;
 
         // Halt operation
@@ -261,6 +480,18 @@ void execute_instruction(instruction_decode* decoded_instruction, int register_a
         // No specific action here; handled in the simulation loop
         break;
 
+        // Vector extension (vsetvl, vlw, vsw, vadd, vsub, vmac, vsplat, vredsum)
+    case 22: // vsetvl (set vector length)
+    case 23: // vlw (vector load)
+    case 24: // vsw (vector store)
+    case 25: // vadd
+    case 26: // vsub
+    case 27: // vmac
+    case 28: // vsplat (broadcast a scalar)
+    case 29: // vredsum (sum of the elements)
+        vector_operation(decoded_instruction, register_array, PC, data_memory, vector);
+        break;
+
         // Default case (should not be reached due to validation above)
     default:
         fprintf(stderr, "Unexpected opcode: %d\n", decoded_instruction->opcode);
@@ -14,9 +14,8 @@
 #define REG_NUM 16
 #define CMD_BYTES 12
 #define MEM_SIZE 4096
-#define IOR_NUM 23
+#define IOR_NUM 61
 #define MONITOR_SIZE 256
-#define MAX_IRQ2_EVENTS 4096
 #define SECTOR_SIZE 128
 #define NUMBER_OF_SECTORS 128
 #define MAX_DISK_ENTRIES (NUMBER_OF_SECTORS * SECTOR_SIZE)
@@ -44,10 +43,138 @@
 #define IN 19
 #define OUT 20
 #define HALT 21
+#define VSETVL 22  // Vector extension, see vector_unit.c
+#define VLW 23
+#define VSW 24
+#define VADD 25
+#define VSUB 26
+#define VMAC 27
+#define VSPLAT 28
+#define VREDSUM 29
 
 // Masks
 #define MASK_12_BIT 0xFFF
 
+// I/O registers added after the original 0-22 map
+#define IOR_MONITOR_VSYNC 23 // Write 1 to capture the current frame into the video stream
+#define IOR_DISK_QUEUE 24    // Disk commands accepted and not completed yet (queued disk controller)
+#define IOR_DISK_DONE 25     // Disk commands completed so far (queued disk controller)
+#define IOR_DISK_REJECTED 26 // diskcmd writes dropped because the queue was full (queued disk controller)
+#define IOR_DISK_TRACK 27    // Track under the disk head (queued disk controller)
+#define IOR_GFX_CMD 28       // Graphics accelerator command, starts on write, 0 when idle
+#define IOR_GFX_POS 29       // First point (x << 8 | y): corner, line start or circle center
+#define IOR_GFX_END 30       // Second point (x << 8 | y): opposite corner or line end; circle radius
+#define IOR_GFX_COLOR 31     // Luminance of fill, line and circle pixels
+#define IOR_GFX_SRC 32       // Blit source in data memory, 4 pixels per word
+#define IOR_GFX_STATUS 33    // 1 while the graphics accelerator is busy
+#define IOR_DMA_SRC 34       // Memory DMA source address (fill: the value)
+#define IOR_DMA_DST 35       // Memory DMA destination address
+#define IOR_DMA_LEN 36       // Memory DMA length in words
+#define IOR_DMA_MODE 37      // MEMDMA_COPY, MEMDMA_FILL or MEMDMA_STRIDE
+#define IOR_DMA_STRIDE 38    // Signed 16-bit strides: source in bits 16-31, destination in bits 0-15
+#define IOR_DMA_START 39     // Write nonzero to start, reads 1 while the transfer runs
+#define IOR_IRQ_PENDING 40   // -irqctl: pending sources, bit n = source n
+#define IOR_IRQ_MASK 41      // -irqctl: enabled sources, bit n = source n
+#define IOR_IRQ_PRIO 42      // -irqctl: 4-bit priority of source n in bits 4n..4n+3
+#define IOR_IRQ_DEPTH 43     // -irqctl: handlers on the return stack
+#define IOR_IRQ_ACTIVE 44    // -irqctl: source of the innermost handler, -1 outside handlers
+#define IOR_IRQ_VECTOR 45    // -irqctl: irqvec0..irqvec4, handler PC of each source (0 = irqhandler)
+#define IOR_PERF_CTL 18      // Performance counters: bit 0 counts, writing bit 1 clears them (see perf_counters.c)
+#define IOR_PERF_INSTR 19    // Instructions retired while counting
+#define IOR_PERF_ALU 50      // add .. srl retired
+#define IOR_PERF_BRANCH 51   // beq .. jal retired
+#define IOR_PERF_TAKEN 52    // Branches taken and jal
+#define IOR_PERF_LOAD 53     // lw and vlw retired
+#define IOR_PERF_STORE 54    // sw and vsw retired
+#define IOR_PERF_IO 55       // in, out and reti retired
+#define IOR_PERF_VECTOR 56   // Vector instructions other than vlw/vsw retired
+#define IOR_PERF_IRQ 57      // Interrupt handler entries
+#define IOR_PERF_ISR 58      // Cycles spent in interrupt handlers
+#define IOR_PERF_DISK_BUSY 59 // Cycles the disk had a command in service
+#define IOR_PERF_DMA_BUSY 60 // Cycles the memory DMA engine was busy
+
+// Monitor video capture
+#define VIDEO_DELTA_MAGIC "SMVD"
+
+// Result of running one cycle
+#define CYCLE_CONTINUE 0   // The cycle completed, the machine keeps running
+#define CYCLE_HALTED 1     // HALT retired with no disk transfer pending
+#define CYCLE_BREAKPOINT 2 // A breakpoint trap fired before the instruction ran
+#define CYCLE_WATCHPOINT 3 // The instruction completed and touched a watched address
+
+// IRQ2 event sources
+#define IRQ2_FILE 0       // Cycle numbers read from irq2in.txt
+#define IRQ2_PERIODIC 1   // first, first + period, ...
+#define IRQ2_POISSON 2    // Exponential gaps with a given mean
+#define IRQ2_BURST 3      // Bursts of length events spacing cycles apart, one burst every period cycles
+#define IRQ2_READ_BUFFER 4096
+
+// Queued disk controller
+#define MAX_DISK_QUEUE 64         // Deepest -disk_queue
+#define DISK_SERVICE_CYCLES 1024  // Service time of every command without -disk_model
+#define DISK_SECTORS_PER_TRACK 8  // -disk_model geometry: 16 tracks of 8 sectors
+#define DMA_PRIORITY_CPU 0        // -dma: lw/sw win the data memory port, the transfer waits
+#define DMA_PRIORITY_DMA 1        // -dma: the transfer wins the port, lw/sw wait
+#define MAX_DMA_BANDWIDTH SECTOR_SIZE
+
+// Graphics accelerator commands (gfxcmd)
+#define GFX_FILL 1
+#define GFX_BLIT 2
+#define GFX_LINE 3
+#define GFX_CIRCLE 4
+#define GFX_DISC 5
+#define GFX_PIXELS_PER_CYCLE 16   // Drawing rate, sets how long a command keeps the device busy
+
+// Memory-to-memory DMA engine
+#define MEMDMA_COPY 0
+#define MEMDMA_FILL 1
+#define MEMDMA_STRIDE 2
+#define MEMDMA_SETUP_CYCLES 2      // Cycles before the first word without -memdma
+#define MEMDMA_WORDS_PER_CYCLE 4   // Transfer rate without -memdma
+
+// Vector extension
+#define VECTOR_REGISTERS 8         // $vr0-$vr7
+#define MAX_VECTOR_LENGTH 64       // Largest -vlen
+#define DEFAULT_VECTOR_LENGTH 8    // Hardware vector length without -vlen
+
+// Memory access recorder (-mem_trace, -mem_stats)
+#define MEM_TRACE_MAGIC "SMMT"
+#define MEM_SOURCES 5              // Who accessed data memory, the source field of the records
+#define MEM_SOURCE_CPU 0           // lw/sw
+#define MEM_SOURCE_VECTOR 1        // vlw/vsw
+#define MEM_SOURCE_DISK 2          // Disk sector transfers
+#define MEM_SOURCE_MEMDMA 3        // Memory DMA engine
+#define MEM_SOURCE_GFX 4           // Graphics accelerator blits
+#define MEM_REUSE_BUCKETS 13       // Reuse distance 0, 1, 2-3, ..., 2048-4095 words
+#define MEM_REUSE_CLOCK 65536      // Access stamps handed out before the live ones are renumbered
+#define MEM_UNINIT_LISTED 16       // Uninitialized words listed in the report
+
+// Call graph profiler (-callgraph)
+#define CALL_NAME_LENGTH 64        // Longest label read from the symbol map, with its terminator
+#define RETURN_REGISTER 15         // $ra: a taken branch to it is a return
+
+// Interrupt instrumentation
+#define IRQ_SOURCES 3             // irq0 (timer), irq1 (disk), irq2 (external)
+
+// Interrupt controller (-irqctl)
+#define IRQ_CTL_SOURCES 5         // The three lines, then the device completions below
+#define IRQ_GFX 3                 // Graphics accelerator completion
+#define IRQ_MEMDMA 4              // Memory DMA completion
+#define IRQ_STACK_DEPTH 8         // Nested handlers on the hardware return stack
+#define IRQ_MASK_DEFAULT 0x07     // irqmask reset value: the timer, disk and external lines
+#define IRQ_HISTOGRAM_BUCKETS 33  // 0, 1, 2-3, 4-7, ..., 2^31 and up
+
+// Performance counters (perfctl)
+#define PERF_ENABLE 1             // perfctl bit 0: count
+#define PERF_RESET 2              // perfctl bit 1: clear the counters, reads back 0
+#define PERF_OPCODES 256          // Tally entries, one per value of the 8-bit opcode field
+
+// Debugger
+#define MAX_WATCHPOINTS 16
+#define WATCH_WRITE 1  // sw
+#define WATCH_READ 2   // lw
+#define WATCH_ACCESS 3 // lw or sw
+
 // Structs
 typedef struct
 {
@@ -60,6 +187,408 @@ typedef struct
     int imm2;    // Immediate value 2
 } instruction_decode;
 
+// IRQ2 event generator parameters (kind = IRQ2_FILE when events come from irq2in.txt)
+typedef struct
+{
+    int kind;                  // IRQ2_FILE, IRQ2_PERIODIC, IRQ2_POISSON or IRQ2_BURST
+    unsigned int first;        // Cycle of the first event (periodic, burst)
+    unsigned int period;       // Cycles between events (periodic) or burst starts (burst)
+    unsigned int length;       // Events per burst
+    unsigned int spacing;      // Cycles between the events of a burst
+    double mean;               // Mean gap in cycles (Poisson)
+    unsigned int seed;         // Random seed (Poisson)
+} irq2_generator;
+
+// Streaming IRQ2 event source: events are produced one at a time, in increasing cycle order
+typedef struct
+{
+    irq2_generator generator;
+    FILE* file;                      // irq2in.txt when generator.kind == IRQ2_FILE
+    char buffer[IRQ2_READ_BUFFER];   // Read-ahead window over the file
+    size_t length;                   // Valid bytes in buffer
+    size_t position;                 // Next unread byte in buffer
+    unsigned int random;             // Poisson generator state
+    unsigned int burst_start;        // Cycle of the current burst's first event
+    unsigned int burst_index;        // Index of the next event in the current burst
+    int has_next;                    // 0 once the source is exhausted
+    unsigned int next;               // Cycle of the next event
+    unsigned int events;             // Events produced so far
+    unsigned int rejected;           // File entries dropped because they were not after the previous event
+} irq2_source;
+
+// One disk command waiting in, or at the head of, the controller queue
+typedef struct
+{
+    int command;            // 1 = read, 2 = write
+    int sector;
+    int buffer;             // Data memory address of the 128-word buffer
+    unsigned int submitted; // Cycle the diskcmd write was accepted
+} disk_command;
+
+typedef struct mem_trace mem_trace;
+typedef struct call_graph call_graph;
+
+// Disk controller. Without -disk_queue and -disk_model only timer is used, by the original single-command device.
+typedef struct
+{
+    int timer;                           // Cycles left in the command in service (0 = idle)
+    int queued;                          // 1 when -disk_queue or -disk_model replaced the single-command device
+    int depth;                           // Commands held, the one in service included (0 = single command, busy writes ignored)
+    unsigned int seek_per_track;         // -disk_model: cycles per track of head movement
+    unsigned int rotation;               // -disk_model: cycles per revolution (0 = flat DISK_SERVICE_CYCLES)
+    disk_command queue[MAX_DISK_QUEUE];  // Ring buffer, queue[first] is in service
+    int first;                           // Index of the command in service
+    int count;                           // Commands in the ring
+    int track;                           // Track under the head
+    unsigned int completed;              // Commands completed
+    unsigned int rejected;               // diskcmd writes dropped (queue full or invalid command)
+    int max_count;                       // Deepest the queue got
+    unsigned long long latency_total;    // Sum of cycles from acceptance to completion
+    unsigned int latency_max;
+    unsigned long long seek_cycles;      // Service time spent moving the head
+    unsigned long long rotation_cycles;  // Service time spent waiting for the sector
+    unsigned long long transfer_cycles;  // Service time spent under the sector
+    int dma_bandwidth;                   // -dma: data memory words per cycle, shared by lw/sw and the DMA (0 = instant copies)
+    int dma_priority;                    // -dma: DMA_PRIORITY_CPU or DMA_PRIORITY_DMA
+    int dma_command;                     // Transfer in progress: 1 = read, 2 = write, 0 = none
+    int dma_sector;
+    int dma_buffer;
+    int dma_moved;                       // Words of the transfer moved so far
+    int dma_elapsed;                     // Cycles since the transfer started
+    int dma_delay;                       // Cycles until the sector reaches the head
+    int dma_duration;                    // Cycles the sector takes to pass under the head
+    unsigned long long dma_words;        // Words moved by the engine
+    unsigned long long dma_stall_cycles; // Cycles the transfer had words due but lost the port to lw/sw
+    unsigned long long cpu_stall_cycles; // Cycles a lw/sw waited for the transfer
+    unsigned long long dma_late_cycles;  // Cycles completions waited for the last words
+    mem_trace* mem_trace;                // Records the sector words moved (NULL when off)
+} disk_controller;
+
+// Graphics accelerator: the command being drawn
+typedef struct
+{
+    int command; // Running command (0 = idle)
+    int timer;   // Cycles until it completes
+    mem_trace* mem_trace; // Records the words blits read (NULL when off)
+} gfx_accel;
+
+// Handler entry on the interrupt controller's return stack
+typedef struct
+{
+    int return_pc; // PC to resume at reti
+    int source;    // Source whose handler runs
+    int priority;  // Its priority, a request must be higher to preempt it
+} irq_frame;
+
+// Interrupt controller state
+typedef struct
+{
+    int enabled;                        // -irqctl, 0 keeps handle_interrupts
+    int depth;                          // Frames on the stack
+    irq_frame stack[IRQ_STACK_DEPTH];
+} irq_controller;
+
+// Memory-to-memory DMA engine
+typedef struct
+{
+    int timer; // Cycles until the running transfer completes (0 = idle)
+    int setup; // -memdma: cycles added to every transfer
+    int rate;  // -memdma: words per cycle
+    mem_trace* mem_trace; // Records the words transfers move (NULL when off)
+} mem_dma;
+
+// Performance counter events not yet added to the perf* registers
+typedef struct
+{
+    int control;                        // perfctl the counters run with (0 = off)
+    int in_isr;                         // 1 from a handler entry to its reti (the nesting depth with -irqctl)
+    unsigned int retired[PERF_OPCODES]; // Instructions retired per opcode
+    unsigned int taken;                 // Branches taken and jal
+    unsigned int interrupts;            // Handler entries
+    unsigned int isr_cycles;            // Cycles that started in a handler
+    unsigned int disk_busy;             // Cycles with a disk command in service
+    unsigned int dma_busy;              // Cycles the memory DMA engine was busy
+} perf_counters;
+
+// Vector register file
+typedef struct
+{
+    int max_length;                                          // Hardware vector length (-vlen)
+    int length;                                              // VL: elements the vector instructions work on
+    int registers[VECTOR_REGISTERS][MAX_VECTOR_LENGTH];
+} vector_unit;
+
+// Log2 histogram of cycle counts
+typedef struct
+{
+    unsigned long long samples;
+    unsigned long long total;
+    unsigned int min;
+    unsigned int max;
+    unsigned long long buckets[IRQ_HISTOGRAM_BUCKETS];
+} irq_histogram;
+
+// Interrupt latency and handler occupancy statistics, per source
+typedef struct
+{
+    FILE* timeline;                               // Optional event log (NULL when off)
+    int pending[IRQ_SOURCES];                     // 1 while a device-raised status waits for the handler
+    unsigned int raised_at[IRQ_SOURCES];          // Cycle the pending status was raised
+    unsigned long long raised[IRQ_SOURCES];       // Statuses raised by the devices
+    unsigned long long serviced[IRQ_SOURCES];     // Handler entries that cleared the status
+    unsigned long long lost[IRQ_SOURCES];         // Raised while the status was still set
+    unsigned long long dropped[IRQ_SOURCES];      // Status cleared before the handler took it
+    unsigned long long suppressed[IRQ_SOURCES];   // Pending and enabled, but PC was at irqhandler
+    unsigned long long reentered[IRQ_SOURCES];    // Handler entered again before the previous reti
+    irq_histogram latency[IRQ_SOURCES];           // Cycles from raise to handler entry
+    irq_histogram occupancy[IRQ_SOURCES];         // Cycles from handler entry to reti
+    int in_handler;                               // 1 between a handler entry and its reti
+    int handler_sources;                          // Sources serviced by the current handler entry
+    unsigned int handler_entry;                   // Cycle of the current handler entry
+} irq_stats;
+
+// Working set of one -mem_stats window
+typedef struct
+{
+    unsigned int words;       // Distinct words accessed
+    unsigned int read_words;  // Distinct words read
+    unsigned int write_words; // Distinct words written
+    unsigned int accesses;    // Word accesses
+    int sp_low;               // Lowest $sp in the window
+} mem_window;
+
+// Read of a word nothing had written yet
+typedef struct
+{
+    unsigned int address;
+    unsigned int cycle;
+    int pc;
+    int source;               // MEM_SOURCE_*
+} mem_uninit;
+
+// Memory access recorder and analytics (-mem_trace, -mem_stats)
+struct mem_trace
+{
+    FILE* file;                                   // -mem_trace: binary access records (NULL when off)
+    unsigned int cycle;                           // Cycle of the accesses being recorded
+    unsigned int last_cycle;                      // Cycle of the previous record, records hold the difference
+    int pc;                                       // PC of the instruction of this cycle
+    int data_words;                               // Words loaded from dmemin.txt, initialized from the start
+    unsigned long long reads[MEM_SIZE];           // Word reads per address
+    unsigned long long writes[MEM_SIZE];          // Word writes per address
+    unsigned long long source_reads[MEM_SOURCES];
+    unsigned long long source_writes[MEM_SOURCES];
+    unsigned char defined[MEM_SIZE];              // 1 once the word holds a loaded or written value
+    unsigned long long uninit_reads;              // Reads of undefined words
+    unsigned int uninit_words;                    // Distinct undefined words read
+    mem_uninit uninit[MEM_UNINIT_LISTED];         // The first of them
+    unsigned int window;                          // -mem_stats: cycles per working-set window
+    unsigned int window_index;                    // Window of the current cycle
+    unsigned int read_mark[MEM_SIZE];             // window_index + 1 once read in the current window
+    unsigned int write_mark[MEM_SIZE];            // window_index + 1 once written in the current window
+    mem_window current;
+    mem_window* windows;                          // Finished windows
+    unsigned int window_count;
+    unsigned int window_capacity;
+    unsigned int clock;                           // Last access stamp handed out
+    unsigned int last_use[MEM_SIZE];              // Stamp of the last access per word (0 = never)
+    unsigned int live[MEM_REUSE_CLOCK];           // Fenwick tree over the stamps that are some word's last use
+    unsigned int live_count;
+    unsigned long long cold;                      // First accesses
+    unsigned long long reuse[MEM_REUSE_BUCKETS];  // Distinct words accessed since the previous access to the same word
+    int sp_seen;                                  // 1 once $sp was nonzero
+    int sp_top;                                   // Highest $sp
+    int sp_low;                                   // Lowest $sp
+    unsigned int sp_low_cycle;
+    int sp_low_pc;
+};
+
+// Function of the call graph profile, named after the label at its entry PC
+typedef struct
+{
+    int interrupt;                    // 1 once entered as an interrupt handler
+    unsigned long long calls;         // Calls, or handler entries
+    unsigned long long inclusive;     // Cycles with the function anywhere on the stack, recursion counted once
+    int active;                       // Activations on the stack
+    int max_active;                   // Deepest recursion
+    unsigned long long outer_entry;   // Cycle count when the outermost activation started
+} call_function;
+
+// Node of the calling context tree: a chain of functions from the start of the program
+typedef struct
+{
+    int parent;                       // Context of the caller, -1 for the root
+    int entry;                        // Entry PC of the function
+    int first_child;                  // Contexts of its callees, -1 if none
+    int next_sibling;
+    unsigned long long cycles;        // Cycles with this context on top of the stack
+} call_context;
+
+// Frame of the shadow call stack
+typedef struct
+{
+    int context;
+    int return_pc;                    // PC after the jal, or irqreturn for an interrupt
+    int interrupt;                    // 1 when entered by an interrupt, left by reti
+} call_frame;
+
+// Call graph profiler (-callgraph)
+struct call_graph
+{
+    char names[MEM_SIZE][CALL_NAME_LENGTH]; // Label per PC from the symbol map, "" if none
+    call_function functions[MEM_SIZE];      // Indexed by entry PC
+    call_context* contexts;
+    int context_count;
+    int context_capacity;
+    call_frame* frames;
+    int depth;                              // Frames on the stack, the root included
+    int frame_capacity;
+    int max_depth;
+    unsigned long long cycles;              // Cycles profiled so far
+    unsigned long long unmatched_returns;   // Returns through $ra and retis with no frame to pop
+};
+
+// Optional features selected with flags after the 14 file names
+typedef struct
+{
+    char* video_filename;        // -video / -video_delta: monitor video stream
+    int video_delta;             // 1 = delta-encoded rows, 0 = raw YUV frames
+    unsigned int video_interval; // Capture a frame every N cycles (0 = only on vsync)
+    char* gdb_address;           // -gdb: TCP port or Unix socket path of the debugger stub
+    int reference_engine;        // -reference: decode every instruction from its hex text on every cycle
+    char* irq2_filename;         // irq2in.txt
+    irq2_generator irq2;         // -irq2_periodic / -irq2_poisson / -irq2_burst: replaces the file events
+    char* irq_stats_filename;    // -irq_stats: interrupt latency and occupancy report
+    char* irq_timeline_filename; // -irq_timeline: one line per interrupt event
+    char* cosim_engine;          // -cosim: fast engine checked against the reference interpreter
+    unsigned int cosim_block;    // -cosim: cycles between memory comparisons and checkpoints
+    int disk_queue;              // -disk_queue: depth of the disk command queue (0 = single command)
+    int disk_model;              // -disk_model: 1 to time commands by seek distance and rotation
+    unsigned int disk_seek;      // -disk_model: cycles per track of head movement
+    unsigned int disk_rotation;  // -disk_model: cycles per revolution
+    char* disk_stats_filename;   // -disk_stats: disk controller report
+    int dma_bandwidth;           // -dma: words per cycle of the data memory port (0 = instant sector copies)
+    int dma_priority;            // -dma: DMA_PRIORITY_CPU or DMA_PRIORITY_DMA
+    int vector_length;           // -vlen: hardware vector length (0 = DEFAULT_VECTOR_LENGTH)
+    int memdma_setup;            // -memdma: cycles added to every memory DMA transfer
+    int memdma_rate;             // -memdma: words per cycle (0 = MEMDMA_SETUP_CYCLES / MEMDMA_WORDS_PER_CYCLE)
+    int irq_controller;          // -irqctl: prioritized, nestable, vectored interrupts
+    unsigned int trace_keyframe; // -trace_delta: lines between keyframes (0 = full trace lines)
+    int trace_window;            // -trace_window: 1 to log only cycles trace_first..trace_last
+    unsigned int trace_first;    // -trace_window: first logged cycle
+    unsigned int trace_last;     // -trace_window: last logged cycle (before trace_first = no lines)
+    char* state_hash_filename;   // -state_hash: periodic state hashes
+    unsigned int state_hash_interval; // -state_hash: cycles between hashes
+    unsigned int state_hash_first;    // -state_hash: first hashed cycle
+    char* state_dump_filename;   // -state_dump: full state at one cycle
+    unsigned int state_dump_cycle;    // -state_dump: the cycle
+    unsigned int max_cycles;     // -max_cycles: stop after this many cycles (0 = no limit)
+    char* mem_trace_filename;    // -mem_trace: binary data memory access records
+    char* mem_stats_filename;    // -mem_stats: heatmaps, working sets, reuse distances, stack depth, uninitialized reads
+    unsigned int mem_stats_window; // -mem_stats: cycles per working-set window
+    char* callgraph_symbols;     // -callgraph: symbol map written by asm -map ("-" = none)
+    char* callgraph_report;      // -callgraph: per-function calls, inclusive and exclusive cycles
+    char* callgraph_folded;      // -callgraph: folded stacks for flame graph tools
+    int data_words;              // Words in dmemin.txt, set by main
+} sim_options;
+
+// Streaming monitor video capture state
+typedef struct
+{
+    FILE* file;                               // Video stream (NULL when capture is off)
+    int delta;                                // 1 = delta-encoded rows, 0 = raw YUV frames
+    unsigned int interval;                    // Capture period in cycles (0 = only on vsync)
+    unsigned int next_capture;                // Cycle of the next periodic capture
+    unsigned int frames;                      // Number of frames written so far
+    unsigned char row_dirty[MONITOR_SIZE];    // 1 if the row changed since the last frame
+    unsigned char dirty_rows[MONITOR_SIZE];   // Indices of the dirty rows, in order of first change
+    int dirty_count;                          // Number of entries in dirty_rows
+    unsigned char dirty_min_x[MONITOR_SIZE];  // Leftmost changed pixel per dirty row
+    unsigned char dirty_max_x[MONITOR_SIZE];  // Rightmost changed pixel per dirty row
+} monitor_video;
+
+// Run comparison probes (-state_hash, -state_dump, -max_cycles)
+typedef struct
+{
+    int active;                 // 1 when any probe is armed, the run goes through state_probe_run
+    FILE* hash_file;            // -state_hash output (NULL when off)
+    unsigned int hash_interval; // Cycles between hashes
+    unsigned int hash_first;    // First hashed cycle
+    const char* dump_filename;  // -state_dump output (NULL when off)
+    unsigned int dump_cycle;    // Cycle whose starting state is dumped
+    unsigned int max_cycles;    // -max_cycles (0 = no limit)
+} state_probe;
+
+// Delta-encoded trace state (-trace_delta)
+typedef struct
+{
+    unsigned int interval;       // Lines from one keyframe to the next (0 = full trace lines)
+    unsigned int since_keyframe; // Lines since the last keyframe, 0 = the next line is one
+    int previous[REG_NUM];       // Registers of the previous line
+} trace_delta;
+
+typedef struct sim_state sim_state;
+typedef struct predecoded_instruction predecoded_instruction;
+
+// Runs one cycle with the given instruction. Returns one of the CYCLE_* codes.
+typedef int (*cycle_handler)(sim_state* state, predecoded_instruction* instruction);
+
+// Runs one cycle of a whole engine. Returns one of the CYCLE_* codes.
+typedef int (*cycle_function)(sim_state* state);
+
+// One entry of the predecoded instruction table
+struct predecoded_instruction
+{
+    cycle_handler handler;      // Called for every cycle at this PC (trap_handler when a breakpoint is armed)
+    cycle_handler execute;      // The handler that really runs the instruction, used to resume from a breakpoint
+    instruction_decode decoded; // Fields decoded once when the program is loaded
+    const char* text;           // Hex text of the instruction, for the trace
+};
+
+// Data watchpoint on a range of data memory words
+typedef struct
+{
+    unsigned int first; // First watched word
+    unsigned int last;  // Last watched word
+    int type;           // WATCH_WRITE, WATCH_READ or WATCH_ACCESS
+} watchpoint;
+
+// Complete machine state, shared by the execution engines and the debugger stub
+struct sim_state
+{
+    FILE** output_files;
+    int* IOR;
+    int* registers;
+    int* data_memory;
+    unsigned char (*screen)[MONITOR_SIZE];
+    int (*disk)[SECTOR_SIZE];
+    char (*instruction_memory)[CMD_BYTES + 1];
+    int pc;                        // Program counter
+    unsigned int cycle;            // Clock cycle
+    int stalled;                   // 1 when the instruction of the last cycle waited for the data memory port
+    disk_controller disk_ctl;      // Disk command in service, and the queue when enabled
+    gfx_accel gfx;                 // Graphics accelerator command in progress
+    vector_unit vector;            // Vector registers and VL
+    mem_dma memdma;                // Memory-to-memory DMA transfer in progress
+    irq2_source irq2;              // Pending irq2 events
+    irq_controller irq_ctl;        // Vectors, priorities and the return stack with -irqctl
+    perf_counters perf;            // Guest performance counter events waiting to reach the registers
+    irq_stats* irq_stats;          // Interrupt instrumentation (NULL when off)
+    mem_trace* mem_trace;          // Data memory access recorder (NULL when off)
+    call_graph* call_graph;        // Call graph profiler (NULL when off)
+    monitor_video video;           // Optional monitor video stream
+    trace_delta trace;             // Delta trace encoder, interval 0 when trace.txt has full lines
+    int trace_window;              // 1 when only cycles trace_first..trace_last reach trace.txt
+    unsigned int trace_first;
+    unsigned int trace_last;
+    state_probe probe;             // State hashes, dump and cycle limit for comparing runs
+    predecoded_instruction program[MEM_SIZE];
+    watchpoint watches[MAX_WATCHPOINTS];
+    int watch_count;
+    int watch_hit_type;            // Type of the access that stopped the run
+    unsigned int watch_hit_address; // Word address of the access that stopped the run
+};
+
 /*
 // Global variables
 extern char instruction_memory[MEM_SIZE][CMD_BYTES + 1];
@@ -84,12 +613,10 @@ extern int irq2_event_count;
 
 void load_instruction_memory(char* filename, char instruction_memory[MEM_SIZE][13]);
 // Loads instruction memory from a file.
-void load_data_memory(char* filename, int data_memory[MEM_SIZE]);
-// Loads data memory from a file.
+int load_data_memory(char* filename, int data_memory[MEM_SIZE]);
+// Loads data memory from a file. Returns the number of words in it.
 void load_disk_contents(char* filename, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE]);
 // Loads disk contents from a file.
-int load_irq2_events(char* filename, unsigned int irq2_events[]);
-// Loads IRQ2 events from a file.
 
 
 ////////////////////////////////
@@ -110,12 +637,28 @@ void write_monitor_yuv(FILE* file, unsigned char screen[MONITOR_SIZE][MONITOR_SI
 // Writes the monitor pixel data to a binary YUV file.
 
 
+//////////////////////////////////
+///   Bulk Hex Conversion     ///
+/////////////////////////////////
+
+size_t hex_encode_words(char* out, const int* words, int count);
+// Encodes words as "%08X\n" lines (9 bytes each). Returns the number of bytes written.
+size_t hex_encode_bytes(char* out, const unsigned char* bytes, int count);
+// Encodes bytes as "%02X\n" lines (3 bytes each). Returns the number of bytes written.
+int hex_decode_words(const char* in, size_t len, int* words, int count);
+// Parses up to count hex words with fscanf("%8x") semantics. Returns the number parsed.
+
+
 /////////////////////////////////
 ///    Logging Functions   /////
 ////////////////////////////////
 
 void log_trace(FILE* file, unsigned int pc, const char* instruction, int registers[16]);
 // Logs the executed instructions trace.
+void trace_delta_open(trace_delta* trace, FILE* file, unsigned int interval);
+// Starts a -trace_delta trace: writes the header and makes the next line a keyframe.
+void log_trace_delta(trace_delta* trace, FILE* file, unsigned int pc, const char* instruction, int registers[REG_NUM]);
+// Logs a trace line as a keyframe or as the registers changed since the previous line.
 void log_hw_register(FILE* file, unsigned int cycle, const char* action, const char* reg_name, char* data);// Logs hardware register interactions.
 void log_led_change(FILE* file, unsigned int cycle, int led_status);
 // Logs changes to the LED state.
@@ -127,13 +670,19 @@ void log_display_change(FILE* file, unsigned int cycle, int display_status);
 ///   Simulation Functions  /////
 ////////////////////////////////
 
-void simulate(FILE* output_files[], int IOR[23], int registers[REG_NUM], int data_memory[MEM_SIZE], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], char instruction_memory[MEM_SIZE][CMD_BYTES + 1], unsigned int interupt2_events[MEM_SIZE]);// Runs the simulation of the fetch-decode-execute loop.
+int simulate(FILE* output_files[], int IOR[IOR_NUM], int registers[REG_NUM], int data_memory[MEM_SIZE], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], char instruction_memory[MEM_SIZE][CMD_BYTES + 1], sim_options* options);// Runs the simulation of the fetch-decode-execute loop. Returns 1 if a co-simulation diverged.
 const char* fetch_instruction(const char instruction_memory[MEM_SIZE][CMD_BYTES + 1], int* PC);
 // Fetches the next instruction from memory.
 void decode_instruction(const char* instruction, instruction_decode* decoded_instruction, int registers[]);
 // Decodes an instruction into its components.
 int str_hex_2_bin(const char* array_of_char, int start_index, int slice_width);
 // Converts a portion of a hex string to an integer.
+int parse_options(int argc, char* argv[], int first_option, sim_options* options);
+// Parses the optional flags that follow the file names. Returns 0 on a bad flag.
+int simulate_cycle_reference(sim_state* state);
+// Runs one cycle, fetching and decoding the instruction from its hex text. Returns a CYCLE_* code.
+int complete_cycle(sim_state* state, instruction_decode* decoded_instruction, const char* instruction);
+// Traces, executes and retires one decoded instruction, then updates the devices. Returns a CYCLE_* code.
 
 
 //////////////////////////////////
@@ -141,7 +690,8 @@ int str_hex_2_bin(const char* array_of_char, int start_index, int slice_width);
 ////////////////////////////////
 
 void execute_instruction(instruction_decode* decoded_instruction, int register_array[REG_NUM], int* PC, int data_memory[MEM_SIZE],
-    int IOR[23], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], FILE* hwregtrace_file, FILE* leds_file, FILE* display7seg_file, FILE* monitor_file, int* disk_timer, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE]);
+    int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], FILE* hwregtrace_file, FILE* leds_file, FILE* display7seg_file, FILE* monitor_file, disk_controller* disk_ctl, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE],
+    vector_unit* vector);
 // Executes a single decoded instruction.
 void arithmetic_operation(instruction_decode* decoded_instruction, int register_array[REG_NUM], int* PC);
 // Performs arithmetic operations (e.g., ADD, SUB).
@@ -150,27 +700,243 @@ void comparison_operation(instruction_decode* decoded_instruction, int register_
 void load_store_operation(instruction_decode* decoded_instruction, int data_memory[MEM_SIZE], int register_array[REG_NUM], int* PC);
 // Executes memory load and store operations.
 void IO_operation(instruction_decode* instruction, int data_memory[MEM_SIZE], FILE* hwregtrace, FILE* leds, FILE* display7seg, FILE* monitor, int* PC, int register_array[REG_NUM], int IOR[],
-    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int* disk_timer);
+    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], disk_controller* disk_ctl);
 // Executes I/O instructions (e.g., IN, OUT).
 
 
+///////////////////////////////////////////
+////  Vector Extension Functions  ////////
+/////////////////////////////////////////
+
+void vector_unit_reset(vector_unit* vector, int max_length);
+// Clears the vector registers and sets the hardware vector length (VL starts at it).
+void vector_operation(instruction_decode* instruction, int register_array[REG_NUM], int* PC, int data_memory[MEM_SIZE], vector_unit* vector);
+// Executes a vector instruction (VSETVL to VREDSUM).
+
+
 ///////////////////////////////////////////
 ////  Device Management Functions  //////
 /////////////////////////////////////////
 
 void update_monitor(unsigned int monitor_addr, unsigned int monitor_data, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE]);
 // Updates a specific pixel in the monitor's frame buffer.
-void handle_disk(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], int* disk_timer);
+void handle_disk(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], disk_controller* disk_ctl);
 // Manages disk read/write operations.
-void manage_disk_status(int IOR[IOR_NUM], int* disk_timer);
-// Updates the status of the disk.
-void handle_timer_status(int IOR[IOR_NUM]);
-// Handles timer-based interrupts and events.
+int manage_disk_status(int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE], disk_controller* disk_ctl);
+// Updates the status of the disk. Returns 1 when a transfer completed and raised irq1.
+int handle_timer_status(int IOR[IOR_NUM]);
+// Handles timer-based interrupts and events. Returns 1 when irq0 was raised.
 void dma_read_sector(unsigned int sector, unsigned int buffer_address, int data_memory[MEM_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE]);
 // Reads a sector from the disk into memory using DMA.
 void dma_write_sector(unsigned int sector, unsigned int buffer_address, int data_memory[MEM_SIZE], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE]);
 // Writes a sector from memory to the disk using DMA.
-void handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file);
+int handle_interrupts(int* PC, int IOR[IOR_NUM], FILE* hwregtrace_file);
+// Jumps to the interrupt handler when an enabled interrupt is pending. Returns the serviced sources (bit n = IRQn).
+
+
+///////////////////////////////////////////
+////  Queued Disk Controller Functions  //
+/////////////////////////////////////////
+
+int disk_queue_options_valid(const sim_options* options);
+// Checks the -disk_queue and -disk_model parameters. Prints the problem and returns 0 otherwise.
+void disk_queue_configure(disk_controller* disk_ctl, const sim_options* options);
+// Sets up an idle controller, queued when -disk_queue or -disk_model was given.
+void disk_queue_submit(disk_controller* disk_ctl, int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE]);
+// Accepts the command written to diskcmd, starting it at once when the disk is idle.
+int disk_queue_tick(disk_controller* disk_ctl, int IOR[IOR_NUM], int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE]);
+// Advances the command in service by one cycle. Returns 1 when it completed and raised irq1.
+void disk_queue_report(const disk_controller* disk_ctl, const char* filename);
+// Writes the disk controller report.
+
+
+///////////////////////////////////////////
+////  DMA Engine Functions  //////////////
+/////////////////////////////////////////
+
+void dma_transfer_start(disk_controller* disk_ctl, int command, int sector, int buffer, int delay, int duration,
+    int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE]);
+// Starts moving a sector: at once without -dma, otherwise word by word while it passes under the head after delay cycles.
+int dma_arbitrate(disk_controller* disk_ctl, int cpu_words, int disk[NUMBER_OF_SECTORS][SECTOR_SIZE], int data_memory[MEM_SIZE]);
+// Shares this cycle's data memory port between lw/sw/vlw/vsw and the transfer and moves the granted words. Returns 1 if the access must wait.
+int dma_transfer_pending(disk_controller* disk_ctl);
+// Returns 1 while the transfer still has words to move; counts the cycle as a late completion.
+void dma_report(const disk_controller* disk_ctl, FILE* file);
+// Appends the DMA engine lines to the disk report.
+
+
+///////////////////////////////////////////
+////  Graphics Accelerator Functions  ////
+/////////////////////////////////////////
+
+int gfx_accel_tick(gfx_accel* gfx, int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE], int data_memory[MEM_SIZE], monitor_video* video);
+// Starts a command written to gfxcmd or advances the running one. Returns 1 when it completed.
+
+
+///////////////////////////////////////////
+////  Memory DMA Engine Functions  ///////
+/////////////////////////////////////////
+
+void mem_dma_configure(mem_dma* dma, const sim_options* options);
+// Sets up an idle engine with the -memdma timing.
+int mem_dma_tick(mem_dma* dma, int IOR[IOR_NUM], int data_memory[MEM_SIZE]);
+// Starts a transfer written to dmastart or advances the running one. Returns 1 when it completed.
+
+
+///////////////////////////////////////////
+////  Run Comparison Probe Functions  ////
+/////////////////////////////////////////
+
+int state_probe_configure(state_probe* probe, const sim_options* options);
+// Opens the -state_hash file and arms -state_dump and -max_cycles. Returns 0 if the file cannot be opened.
+void state_probe_run(sim_state* state, cycle_function run);
+// Runs an engine until the program ends or the cycle limit, hashing and dumping the state on the way.
+void state_probe_close(state_probe* probe, const sim_state* state);
+// Writes the hash of the final state and closes the hash file.
+
+
+///////////////////////////////////////////
+////  Interrupt Controller Functions  ////
+/////////////////////////////////////////
+
+void irq_controller_configure(irq_controller* controller, int IOR[IOR_NUM], const sim_options* options);
+// Selects the -irqctl mode and sets the reset values of its registers.
+int irq_controller_raise(const irq_controller* controller, int IOR[IOR_NUM], int source);
+// Raises a device completion: irq2status without -irqctl, its irqpending bit with it. Returns the raised bit.
+int irq_controller_dispatch(irq_controller* controller, int* PC, int IOR[IOR_NUM]);
+// Enters the handler of the highest priority request if it preempts the running one. Returns the source taken as a bit.
+void irq_controller_return(irq_controller* controller, int IOR[IOR_NUM]);
+// Pops the handler frame after a reti.
+
+
+///////////////////////////////////////////
+////  Performance Counter Functions  /////
+///////////////////////////////////////
+
+void perf_counters_flush(perf_counters* perf, int IOR[IOR_NUM]);
+// Adds the events counted since the last flush to the perf* registers.
+void perf_counters_cycle(sim_state* state, long opcode, int pc, int stalled, int serviced);
+// Counts the events of a cycle and applies perfctl writes. Called only while perfctl or the counters are nonzero.
+
+
+///////////////////////////////////////////
+////  IRQ2 Event Source Functions  ///////
+/////////////////////////////////////////
+
+int irq2_generator_valid(const irq2_generator* generator);
+// Checks that a generator produces strictly increasing cycles. Prints the problem and returns 0 otherwise.
+void irq2_open(irq2_source* source, const char* filename, const irq2_generator* generator);
+// Starts streaming events from the file, or from the generator when one is selected.
+void irq2_advance(irq2_source* source);
+// Moves to the next event; clears has_next when the source is exhausted.
+void irq2_close(irq2_source* source);
+// Closes the file and reports dropped entries.
+
+
+///////////////////////////////////////////
+////  Interrupt Statistics Functions  ////
+/////////////////////////////////////////
+
+irq_stats* irq_stats_open(const char* timeline_filename);
+// Allocates the statistics and opens the optional timeline. Returns NULL on failure.
+int irq_status_bits(int IOR[IOR_NUM]);
+// Returns the irq0-2 status flags as bits 0-2.
+void irq_stats_raise(irq_stats* stats, unsigned int cycle, int raised, int status_before);
+// Records the statuses raised by the devices in this cycle.
+void irq_stats_dispatch(irq_stats* stats, int IOR[IOR_NUM], unsigned int cycle, int serviced);
+// Records a handler entry, or why pending interrupts were not taken.
+void irq_stats_return(irq_stats* stats, unsigned int cycle);
+// Records a reti.
+void irq_stats_report(irq_stats* stats, const char* filename);
+// Writes the report, closes the timeline and frees the statistics.
+
+
+///////////////////////////////////////////
+////  Memory Access Recorder Functions  //
+///////////////////////////////////////
+
+mem_trace* mem_trace_open(const sim_options* options);
+// Allocates the recorder and opens the -mem_trace file. Returns NULL on failure.
+void mem_trace_cycle(mem_trace* trace, unsigned int cycle, int pc, int sp);
+// Starts a cycle: stamps the following records and samples $sp.
+void mem_trace_instruction(mem_trace* trace, const instruction_decode* instruction, const int registers[REG_NUM], int vector_length);
+// Records the words a lw/sw/vlw/vsw is about to access.
+void mem_trace_range(mem_trace* trace, int source, int write, int address, int count);
+// Records a device access to count consecutive words.
+void mem_trace_close(mem_trace* trace, const char* report_filename);
+// Writes the -mem_stats report, closes the trace file and frees the recorder.
+
+
+///////////////////////////////////////////
+////  Call Graph Profiler Functions  /////
+/////////////////////////////////////////
+
+call_graph* call_graph_open(const char* symbols_filename);
+// Allocates the profiler, reads the symbol map and starts the root frame. Returns NULL on failure.
+void call_graph_cycle(call_graph* graph, const instruction_decode* instruction, int pc, int next_pc, int stalled, int handler);
+// Charges a cycle to the current stack, then applies its call, return, reti and interrupt entry.
+void call_graph_close(call_graph* graph, unsigned long long cycles, const char* report_filename, const char* folded_filename);
+// Charges the remaining cycles, writes the report and the folded stacks and frees the profiler.
+
+
+///////////////////////////////////////////
+////  Predecoded Engine Functions  ///////
+/////////////////////////////////////////
+
+void predecode_program(sim_state* state);
+// Decodes the whole instruction memory once into the handler table.
+int simulate_cycle(sim_state* state);
+// Runs one cycle through the predecoded table. Returns a CYCLE_* code.
+int run_predecoded(sim_state* state, predecoded_instruction* instruction);
+// Default handler: runs one cycle with a predecoded instruction.
+int trap_handler(sim_state* state, predecoded_instruction* instruction);
+// Breakpoint handler: stops before the instruction runs.
+int set_breakpoint(sim_state* state, int pc);
+// Arms a breakpoint at pc. Returns 0 if pc is out of range.
+int clear_breakpoint(sim_state* state, int pc);
+// Disarms the breakpoint at pc. Returns 0 if pc is out of range.
+int set_watchpoint(sim_state* state, unsigned int first, unsigned int last, int type);
+// Watches data memory words first..last. Returns 0 if the table is full.
+int clear_watchpoint(sim_state* state, unsigned int first, unsigned int last, int type);
+// Removes a watchpoint. Returns 0 if it was not set.
+void clear_debug_traps(sim_state* state);
+// Removes every breakpoint and watchpoint.
+
+
+///////////////////////////////////////////
+////  Co-Simulation Functions  ///////////
+/////////////////////////////////////////
+
+cycle_function cosim_find_engine(const char* name);
+// Returns the fast engine with that name, or NULL.
+int cosim_run(sim_state* reference, sim_options* options);
+// Runs the reference interpreter and a fast engine in lockstep. Returns 1 at the first divergence.
+
+
+///////////////////////////////////////////
+////  GDB Remote Stub Functions  /////////
+/////////////////////////////////////////
+
+void gdb_serve(sim_state* state, const char* address);
+// Runs the program under control of a GDB client connected to address (TCP port or Unix socket path).
+
+
+///////////////////////////////////////////
+////  Monitor Video Capture Functions  ////
+/////////////////////////////////////////
+
+int monitor_video_open(monitor_video* video, const char* filename, int delta, unsigned int interval);
+// Opens the video stream and writes the stream header. Returns 0 on failure.
+void monitor_video_mark_pixel(monitor_video* video, unsigned int monitor_addr);
+// Records that the pixel at monitor_addr changed since the last frame.
+void monitor_video_mark_rect(monitor_video* video, int x0, int y0, int x1, int y1);
+// Records that the pixels of rows y0..y1, columns x0..x1 changed since the last frame.
+void monitor_video_tick(monitor_video* video, unsigned int cycle, int IOR[IOR_NUM], unsigned char screen[MONITOR_SIZE][MONITOR_SIZE]);
+// Captures a frame when the capture period elapsed or the guest wrote monitorvsync.
+void monitor_video_capture(monitor_video* video, unsigned int cycle, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE]);
+// Appends the current frame to the video stream.
+void monitor_video_close(monitor_video* video, unsigned int cycle, unsigned char screen[MONITOR_SIZE][MONITOR_SIZE]);
+// Writes the final frame and closes the video stream.
 
 #endif // SIMULATOR_FUNCTIONS_H
 
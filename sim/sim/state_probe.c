@@ -0,0 +1,197 @@
+/**
+ * @file state_probe.c
+ * @brief Periodic machine state hashes and dumps, to compare two runs (see simp-diverge).
+ *
+ * - -state_hash <file> <interval> <first>: at the start of cycles first,
+ *   first + interval, ... a line "<cycle> <hash>" with a 64-bit hash of the
+ *   machine state, and "<cycle> <hash> end" for the state the run ends in.
+ * - -state_dump <file> <cycle>: the full state at the start of that cycle.
+ * - -max_cycles <n>: the run ends after n cycles, with the usual output files.
+ * The state is PC, registers except $imm1/$imm2, I/O registers, data memory,
+ * disk, frame buffer, VL and the vector registers. Only nonzero words enter the hash, each mixed
+ * with its position, and only nonzero words are dumped, so a build with more
+ * I/O registers (all zero) hashes the same as an older one.
+ *
+ * Functions Implemented:
+ * - state_probe_configure: Opens the hash file and arms the dump and the cycle limit.
+ * - state_probe_run: Runs an engine with the probes.
+ * - state_probe_close: Writes the end hash and closes the file.
+ */
+
+#include "simulator_functions.h"
+
+#define HASH_OFFSET 0xCBF29CE484222325ull // FNV-1a 64-bit
+#define HASH_PRIME 0x100000001B3ull
+
+// Regions of the state, mixed into the position of each word
+#define REGION_CORE 0
+#define REGION_REGISTERS 1
+#define REGION_IOR 2
+#define REGION_MEMORY 3
+#define REGION_DISK 4
+#define REGION_SCREEN 5
+#define REGION_VECTOR 6
+
+// Mixes the nonzero words of one region into the hash
+static unsigned long long hash_words(unsigned long long hash, int region, const int* words, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (words[i] != 0)
+        {
+            hash = (hash ^ (((unsigned long long)region << 56) | ((unsigned long long)i << 32) | (unsigned int)words[i])) * HASH_PRIME;
+        }
+    }
+    return hash;
+}
+
+// Mixes the frame buffer into the hash, 4 pixels per word
+static unsigned long long hash_screen(unsigned long long hash, const unsigned char screen[MONITOR_SIZE][MONITOR_SIZE])
+{
+    int words[MONITOR_SIZE / 4];
+
+    for (int y = 0; y < MONITOR_SIZE; y++)
+    {
+        memcpy(words, screen[y], MONITOR_SIZE);
+        for (int i = 0; i < MONITOR_SIZE / 4; i++)
+        {
+            if (words[i] != 0)
+            {
+                hash = (hash ^ (((unsigned long long)REGION_SCREEN << 56) | ((unsigned long long)(y * MONITOR_SIZE / 4 + i) << 32)
+                    | (unsigned int)words[i])) * HASH_PRIME;
+            }
+        }
+    }
+    return hash;
+}
+
+// Hash of the machine state
+static unsigned long long state_hash(const sim_state* state)
+{
+    unsigned long long hash = HASH_OFFSET;
+    int core[2] = { state->pc, state->vector.length };
+    int registers[REG_NUM];
+
+    memcpy(registers, state->registers, sizeof(registers));
+    registers[1] = registers[2] = 0; // Reloaded by every instruction, and not by every engine between cycles
+
+    hash = hash_words(hash, REGION_CORE, core, 2);
+    hash = hash_words(hash, REGION_REGISTERS, registers, REG_NUM);
+    hash = hash_words(hash, REGION_IOR, state->IOR, IOR_NUM);
+    hash = hash_words(hash, REGION_MEMORY, state->data_memory, MEM_SIZE);
+    hash = hash_words(hash, REGION_DISK, &state->disk[0][0], NUMBER_OF_SECTORS * SECTOR_SIZE);
+    hash = hash_screen(hash, state->screen);
+    hash = hash_words(hash, REGION_VECTOR, &state->vector.registers[0][0], VECTOR_REGISTERS * MAX_VECTOR_LENGTH);
+    return hash;
+}
+
+// Writes the full state, one "<kind> <index> <value>" line per nonzero word
+static void write_dump(const sim_state* state, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Failed to open file: %s\n", filename);
+        return;
+    }
+
+    fprintf(file, "cycle %u\npc %03X\n", state->cycle, state->pc);
+    for (int i = 0; i < REG_NUM; i++)
+    {
+        fprintf(file, "reg %d %08X\n", i, state->registers[i]);
+    }
+    for (int i = 0; i < IOR_NUM; i++)
+    {
+        if (state->IOR[i] != 0)
+        {
+            fprintf(file, "ior %d %08X\n", i, state->IOR[i]);
+        }
+    }
+    for (int i = 0; i < MEM_SIZE; i++)
+    {
+        if (state->data_memory[i] != 0)
+        {
+            fprintf(file, "mem %d %08X\n", i, state->data_memory[i]);
+        }
+    }
+    for (int i = 0; i < NUMBER_OF_SECTORS * SECTOR_SIZE; i++)
+    {
+        if (state->disk[i / SECTOR_SIZE][i % SECTOR_SIZE] != 0)
+        {
+            fprintf(file, "disk %d %08X\n", i, state->disk[i / SECTOR_SIZE][i % SECTOR_SIZE]);
+        }
+    }
+    for (int i = 0; i < MONITOR_SIZE * MONITOR_SIZE; i++)
+    {
+        if (state->screen[i / MONITOR_SIZE][i % MONITOR_SIZE] != 0)
+        {
+            fprintf(file, "pixel %d %02X\n", i, state->screen[i / MONITOR_SIZE][i % MONITOR_SIZE]);
+        }
+    }
+    fprintf(file, "vl %d\n", state->vector.length);
+    fclose(file);
+}
+
+// Opens the hash file and arms the dump and the cycle limit. Returns 0 if the hash file cannot be opened.
+int state_probe_configure(state_probe* probe, const sim_options* options)
+{
+    memset(probe, 0, sizeof(*probe));
+    probe->active = options->state_hash_filename || options->state_dump_filename || options->max_cycles;
+    probe->hash_interval = options->state_hash_interval;
+    probe->hash_first = options->state_hash_first;
+    probe->dump_filename = options->state_dump_filename;
+    probe->dump_cycle = options->state_dump_cycle;
+    probe->max_cycles = options->max_cycles;
+
+    if (options->state_hash_filename)
+    {
+        probe->hash_file = fopen(options->state_hash_filename, "w");
+        if (!probe->hash_file)
+        {
+            fprintf(stderr, "Error: Failed to open file: %s\n", options->state_hash_filename);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Runs an engine until the program ends or -max_cycles, hashing and dumping the state on the way
+void state_probe_run(sim_state* state, cycle_function run)
+{
+    state_probe* probe = &state->probe;
+
+    for (;;)
+    {
+        if (probe->max_cycles && state->cycle >= probe->max_cycles)
+        {
+            return;
+        }
+        if (probe->hash_file && state->cycle >= probe->hash_first && (state->cycle - probe->hash_first) % probe->hash_interval == 0)
+        {
+            fprintf(probe->hash_file, "%u %016llX\n", state->cycle, state_hash(state));
+        }
+        if (probe->dump_filename && state->cycle == probe->dump_cycle)
+        {
+            write_dump(state, probe->dump_filename);
+        }
+        if (run(state) != CYCLE_CONTINUE)
+        {
+            return;
+        }
+    }
+}
+
+// Writes the hash of the state the run ended in and closes the hash file
+void state_probe_close(state_probe* probe, const sim_state* state)
+{
+    if (probe->dump_filename && state->cycle == probe->dump_cycle)
+    {
+        write_dump(state, probe->dump_filename); // The dump cycle is the one the run ends in
+    }
+    if (probe->hash_file)
+    {
+        fprintf(probe->hash_file, "%u %016llX end\n", state->cycle, state_hash(state));
+        fclose(probe->hash_file);
+        probe->hash_file = NULL;
+    }
+}
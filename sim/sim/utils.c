@@ -7,6 +7,7 @@
  *
  * Functions:
  * - str_hex_2_bin: Converts a portion of a hex string to an integer.
+ * - parse_options: Parses the optional command-line flags.
  */
 
 #include "simulator_functions.h"
@@ -44,3 +45,252 @@ int str_hex_2_bin(const char* string, int start_index, int slice_width)
     return result;
 }
 
+// Parses the optional flags that follow the 14 file names
+int parse_options(int argc, char* argv[], int first_option, sim_options* options)
+{
+    /*
+        Supported flags:
+        - -video <file> <N>:       raw YUV stream, a frame every N cycles (0 = only on monitorvsync)
+        - -video_delta <file> <N>: same, but only the changed rows of every frame are stored
+        - -gdb <port|path>:        wait for a GDB client on a local TCP port or Unix socket
+        - -reference:              decode every instruction from its hex text on every cycle
+        - -irq2_periodic <first> <period>:               irq2 at first, first + period, ...
+        - -irq2_poisson <mean> <seed>:                   irq2 with exponential gaps of the given mean
+        - -irq2_burst <first> <length> <spacing> <period>: bursts of length irq2 events, one burst every period cycles
+          A generator replaces the events of irq2in.txt.
+        - -irq_stats <file>:       interrupt latency and handler occupancy report
+        - -irq_timeline <file>:    one line per interrupt raise, entry, reti, loss or suppression
+        - -cosim <engine> <N>:     run the reference interpreter and a fast engine in lockstep, comparing
+                                   registers every cycle and memories every N cycles
+        - -disk_queue <depth>:     queued disk controller accepting up to depth outstanding commands
+        - -disk_model <seek> <rotation>: disk service time from the track distance (seek cycles per track)
+                                   and the platter position (rotation cycles per revolution)
+        - -disk_stats <file>:      disk controller report
+        - -dma <bandwidth> <cpu|dma>: move sectors word by word while they pass under the head, sharing
+                                   bandwidth words per cycle of the data memory port with lw/sw
+        - -irqctl:                 prioritized, nestable, vectored interrupt controller (irq_controller.c)
+        - -memdma <setup> <rate>:  memory DMA transfers take setup cycles plus one cycle per rate words
+        - -trace_delta <N>:        delta-encoded trace.txt with a full keyframe every N lines (see simp-trace)
+        - -trace_window <first> <last>: log only cycles first..last to trace.txt (first > last: none)
+        - -state_hash <file> <N> <first>: state hash at the start of every N-th cycle from first, and at the end
+        - -state_dump <file> <cycle>: full machine state at the start of cycle
+        - -max_cycles <n>:         stop after n cycles
+        - -mem_trace <file>:       binary record of every data memory access (see mem_trace.c)
+        - -mem_stats <file> <N>:   data memory report: heatmaps, working set every N cycles, reuse distances,
+                                   stack depth and uninitialized reads
+        - -callgraph <symbols> <report> <folded>: call graph profile from the asm -map symbols ("-" = none),
+                                   per-function report and folded stacks for flame graphs
+        - -vlen <n>:               hardware vector length of the vector extension (1 to MAX_VECTOR_LENGTH)
+        OUTPUT: Returns 1 on success, 0 if a flag is unknown or misses its arguments.
+    */
+
+    for (int i = first_option; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-video") == 0 || strcmp(argv[i], "-video_delta") == 0) && i + 2 < argc)
+        {
+            options->video_delta = strcmp(argv[i], "-video_delta") == 0;
+            options->video_filename = argv[i + 1];
+            options->video_interval = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-gdb") == 0 && i + 1 < argc)
+        {
+            options->gdb_address = argv[++i];
+        }
+        else if (strcmp(argv[i], "-reference") == 0)
+        {
+            options->reference_engine = 1;
+        }
+        else if (strcmp(argv[i], "-irq_stats") == 0 && i + 1 < argc)
+        {
+            options->irq_stats_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-irq_timeline") == 0 && i + 1 < argc)
+        {
+            options->irq_timeline_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-cosim") == 0 && i + 2 < argc)
+        {
+            if (!cosim_find_engine(argv[i + 1]))
+            {
+                fprintf(stderr, "Error: Unknown engine for -cosim: %s\n", argv[i + 1]);
+                return 0;
+            }
+            options->cosim_engine = argv[i + 1];
+            options->cosim_block = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-disk_queue") == 0 && i + 1 < argc)
+        {
+            options->disk_queue = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-disk_model") == 0 && i + 2 < argc)
+        {
+            options->disk_model = 1;
+            options->disk_seek = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            options->disk_rotation = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-dma") == 0 && i + 2 < argc)
+        {
+            options->dma_bandwidth = atoi(argv[i + 1]);
+            if (strcmp(argv[i + 2], "cpu") == 0)
+            {
+                options->dma_priority = DMA_PRIORITY_CPU;
+            }
+            else if (strcmp(argv[i + 2], "dma") == 0)
+            {
+                options->dma_priority = DMA_PRIORITY_DMA;
+            }
+            else
+            {
+                fprintf(stderr, "Error: -dma priority must be cpu or dma: %s\n", argv[i + 2]);
+                return 0;
+            }
+            if (options->dma_bandwidth < 1)
+            {
+                fprintf(stderr, "Error: -dma needs at least 1 word per cycle\n");
+                return 0;
+            }
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-irqctl") == 0)
+        {
+            options->irq_controller = 1;
+        }
+        else if (strcmp(argv[i], "-memdma") == 0 && i + 2 < argc)
+        {
+            options->memdma_setup = atoi(argv[i + 1]);
+            options->memdma_rate = atoi(argv[i + 2]);
+            if (options->memdma_setup < 0 || options->memdma_rate < 1)
+            {
+                fprintf(stderr, "Error: -memdma needs at least 0 setup cycles and 1 word per cycle\n");
+                return 0;
+            }
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-trace_delta") == 0 && i + 1 < argc)
+        {
+            int interval = atoi(argv[++i]);
+            if (interval < 1)
+            {
+                fprintf(stderr, "Error: -trace_delta needs a keyframe interval of at least 1\n");
+                return 0;
+            }
+            options->trace_keyframe = (unsigned int)interval;
+        }
+        else if (strcmp(argv[i], "-trace_window") == 0 && i + 2 < argc)
+        {
+            options->trace_window = 1;
+            options->trace_first = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            options->trace_last = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-state_hash") == 0 && i + 3 < argc)
+        {
+            options->state_hash_filename = argv[i + 1];
+            options->state_hash_interval = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            options->state_hash_first = (unsigned int)strtoul(argv[i + 3], NULL, 10);
+            if (options->state_hash_interval == 0)
+            {
+                fprintf(stderr, "Error: -state_hash needs an interval of at least 1 cycle\n");
+                return 0;
+            }
+            i += 3;
+        }
+        else if (strcmp(argv[i], "-state_dump") == 0 && i + 2 < argc)
+        {
+            options->state_dump_filename = argv[i + 1];
+            options->state_dump_cycle = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-max_cycles") == 0 && i + 1 < argc)
+        {
+            options->max_cycles = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-mem_trace") == 0 && i + 1 < argc)
+        {
+            options->mem_trace_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-mem_stats") == 0 && i + 2 < argc)
+        {
+            options->mem_stats_filename = argv[i + 1];
+            options->mem_stats_window = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            if (options->mem_stats_window == 0)
+            {
+                fprintf(stderr, "Error: -mem_stats needs a window of at least 1 cycle\n");
+                return 0;
+            }
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-callgraph") == 0 && i + 3 < argc)
+        {
+            options->callgraph_symbols = argv[i + 1];
+            options->callgraph_report = argv[i + 2];
+            options->callgraph_folded = argv[i + 3];
+            i += 3;
+        }
+        else if (strcmp(argv[i], "-vlen") == 0 && i + 1 < argc)
+        {
+            options->vector_length = atoi(argv[++i]);
+            if (options->vector_length < 1 || options->vector_length > MAX_VECTOR_LENGTH)
+            {
+                fprintf(stderr, "Error: -vlen must be between 1 and %d\n", MAX_VECTOR_LENGTH);
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "-disk_stats") == 0 && i + 1 < argc)
+        {
+            options->disk_stats_filename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-irq2_periodic") == 0 && i + 2 < argc)
+        {
+            options->irq2.kind = IRQ2_PERIODIC;
+            options->irq2.first = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            options->irq2.period = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-irq2_poisson") == 0 && i + 2 < argc)
+        {
+            options->irq2.kind = IRQ2_POISSON;
+            options->irq2.mean = strtod(argv[i + 1], NULL);
+            options->irq2.seed = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-irq2_burst") == 0 && i + 4 < argc)
+        {
+            options->irq2.kind = IRQ2_BURST;
+            options->irq2.first = (unsigned int)strtoul(argv[i + 1], NULL, 10);
+            options->irq2.length = (unsigned int)strtoul(argv[i + 2], NULL, 10);
+            options->irq2.spacing = (unsigned int)strtoul(argv[i + 3], NULL, 10);
+            options->irq2.period = (unsigned int)strtoul(argv[i + 4], NULL, 10);
+            i += 4;
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown or incomplete option: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    if (options->cosim_engine && options->gdb_address)
+    {
+        fprintf(stderr, "Error: -cosim and -gdb cannot be combined\n");
+        return 0;
+    }
+    if ((options->state_hash_filename || options->state_dump_filename || options->max_cycles) && (options->cosim_engine || options->gdb_address))
+    {
+        fprintf(stderr, "Error: -state_hash, -state_dump and -max_cycles cannot be combined with -cosim or -gdb\n");
+        return 0;
+    }
+    if ((options->mem_trace_filename || options->mem_stats_filename) && options->cosim_engine)
+    {
+        fprintf(stderr, "Error: -mem_trace and -mem_stats cannot be combined with -cosim\n");
+        return 0;
+    }
+    if (options->callgraph_report && options->cosim_engine)
+    {
+        fprintf(stderr, "Error: -callgraph cannot be combined with -cosim\n");
+        return 0;
+    }
+    return disk_queue_options_valid(options) && irq2_generator_valid(&options->irq2);
+}
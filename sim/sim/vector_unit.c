@@ -0,0 +1,254 @@
+/**
+ * @file vector_unit.c
+ * @brief Vector extension of the SIMP ISA: eight registers of up to 64 words.
+ *
+ * The opcodes after HALT work on the vector registers $vr0-$vr7, whose first
+ * VL elements take part in an instruction (elements from VL on are left
+ * unchanged). VL is set by vsetvl and can be at most the hardware length,
+ * -vlen (DEFAULT_VECTOR_LENGTH without the flag). Every vector instruction
+ * takes one cycle, like the scalar ones. With R = scalar register and
+ * V = vector register:
+ * - vsetvl  R, R, R, R:  VL = rs + rt + rm, clamped to 0..hardware length; rd = VL
+ * - vlw     V, R, R, R:  vd[i] = MEM[rs + rt + i] + rm
+ * - vsw     V, R, R, R:  MEM[rs + rt + i] = vd[i] + rm
+ * - vadd    V, V, V, V:  vd[i] = vs[i] + vt[i] + vm[i]
+ * - vsub    V, V, V, V:  vd[i] = vs[i] - vt[i] - vm[i]
+ * - vmac    V, V, V, V:  vd[i] = vs[i] * vt[i] + vm[i]
+ * - vsplat  V, R, R, R:  vd[i] = rs + rt + rm
+ * - vredsum R, V, R, R:  rd = vs[0] + ... + vs[VL - 1] + rt + rm
+ * A vlw/vsw reaching past the data memory is reported and does nothing.
+ *
+ * The elementwise kernels use the widest integer vectors the build allows:
+ * - AVX2 (__AVX2__): 8 words per iteration.
+ * - SSE4.1 (__SSE4_1__ or __AVX__): 4 words per iteration.
+ * - Scalar loop everywhere else.
+ * Arithmetic wraps modulo 2^32 on every path, so all give the same results.
+ *
+ * Functions Implemented:
+ * - vector_unit_reset: Clears the registers and sets the hardware length.
+ * - vector_operation: Executes one vector instruction.
+ */
+
+#include "simulator_functions.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VECTOR_UNIT_AVX2
+#define VECTOR_UNIT_SSE
+#elif defined(__SSE4_1__) || defined(__AVX__)
+#include <smmintrin.h>
+#define VECTOR_UNIT_SSE
+#endif
+
+// Elementwise operations of the kernels
+#define LANES_ADD 0
+#define LANES_SUB 1
+#define LANES_MAC 2
+
+// Clears the registers and sets the hardware vector length
+void vector_unit_reset(vector_unit* vector, int max_length)
+{
+    memset(vector, 0, sizeof(*vector));
+    vector->max_length = max_length;
+    vector->length = max_length;
+}
+
+// d[i] = s[i] op t[i] op m[i] for the first count elements
+static void lanes(int operation, int* d, const int* s, const int* t, const int* m, int count)
+{
+    int i = 0;
+
+#ifdef VECTOR_UNIT_AVX2
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i vs = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i vt = _mm256_loadu_si256((const __m256i*)(t + i));
+        __m256i vm = _mm256_loadu_si256((const __m256i*)(m + i));
+        __m256i result = operation == LANES_ADD ? _mm256_add_epi32(_mm256_add_epi32(vs, vt), vm)
+            : operation == LANES_SUB ? _mm256_sub_epi32(_mm256_sub_epi32(vs, vt), vm)
+            : _mm256_add_epi32(_mm256_mullo_epi32(vs, vt), vm);
+        _mm256_storeu_si256((__m256i*)(d + i), result);
+    }
+#endif
+#ifdef VECTOR_UNIT_SSE
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i vs = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i vt = _mm_loadu_si128((const __m128i*)(t + i));
+        __m128i vm = _mm_loadu_si128((const __m128i*)(m + i));
+        __m128i result = operation == LANES_ADD ? _mm_add_epi32(_mm_add_epi32(vs, vt), vm)
+            : operation == LANES_SUB ? _mm_sub_epi32(_mm_sub_epi32(vs, vt), vm)
+            : _mm_add_epi32(_mm_mullo_epi32(vs, vt), vm);
+        _mm_storeu_si128((__m128i*)(d + i), result);
+    }
+#endif
+
+    // Scalar tail, and the whole vector on builds without SIMD
+    for (; i < count; i++)
+    {
+        unsigned int vs = (unsigned int)s[i], vt = (unsigned int)t[i], vm = (unsigned int)m[i];
+        d[i] = (int)(operation == LANES_ADD ? vs + vt + vm : operation == LANES_SUB ? vs - vt - vm : vs * vt + vm);
+    }
+}
+
+// d[i] = s[i] + value for the first count elements
+static void lanes_add_scalar(int* d, const int* s, int value, int count)
+{
+    int i = 0;
+
+    if (value == 0)
+    {
+        memmove(d, s, (size_t)count * sizeof(int));
+        return;
+    }
+#ifdef VECTOR_UNIT_SSE
+    __m128i broadcast = _mm_set1_epi32(value);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_si128((__m128i*)(d + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(s + i)), broadcast));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        d[i] = (int)((unsigned int)s[i] + (unsigned int)value);
+    }
+}
+
+// Sum of the first count elements, modulo 2^32
+static int lanes_sum(const int* s, int count)
+{
+    unsigned int sum = 0;
+    int i = 0;
+
+#ifdef VECTOR_UNIT_SSE
+    __m128i partial = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4)
+    {
+        partial = _mm_add_epi32(partial, _mm_loadu_si128((const __m128i*)(s + i)));
+    }
+    partial = _mm_add_epi32(partial, _mm_srli_si128(partial, 8));
+    partial = _mm_add_epi32(partial, _mm_srli_si128(partial, 4));
+    sum = (unsigned int)_mm_cvtsi128_si32(partial);
+#endif
+    for (; i < count; i++)
+    {
+        sum += (unsigned int)s[i];
+    }
+    return (int)sum;
+}
+
+// Checks that the vector register fields of an instruction name $vr0-$vr7
+static int vector_registers_valid(const instruction_decode* instruction)
+{
+    int fields[4] = { instruction->rd, instruction->rs, instruction->rt, instruction->rm };
+    // Operands that are vector registers: bit 3 = rd, bit 2 = rs, bit 1 = rt, bit 0 = rm
+    int vector_fields;
+
+    switch (instruction->opcode)
+    {
+    case VLW:
+    case VSW:
+    case VSPLAT:
+        vector_fields = 0x8;
+        break;
+    case VADD:
+    case VSUB:
+    case VMAC:
+        vector_fields = 0xF;
+        break;
+    case VREDSUM:
+        vector_fields = 0x4;
+        break;
+    default:
+        vector_fields = 0;
+        break;
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        if ((vector_fields & (8 >> i)) && fields[i] >= VECTOR_REGISTERS)
+        {
+            fprintf(stderr, "Error: Invalid vector register $vr%d\n", fields[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Executes one vector instruction
+void vector_operation(instruction_decode* instruction, int register_array[REG_NUM], int* PC, int data_memory[MEM_SIZE], vector_unit* vector)
+{
+    /*
+        INPUT: instruction (one of VSETVL..VREDSUM), vector (register file and VL)
+        OUTPUT: Updates the vector or scalar destination, or data memory for vsw. PC moves to the next instruction.
+    */
+
+    (*PC)++;
+    if (!vector_registers_valid(instruction))
+    {
+        return;
+    }
+
+    int rs = register_array[instruction->rs];
+    int rt = register_array[instruction->rt];
+    int rm = register_array[instruction->rm];
+    int length = vector->length;
+    unsigned int address = (unsigned int)rs + (unsigned int)rt;
+
+    switch (instruction->opcode)
+    {
+    case VSETVL:
+    {
+        long long requested = (long long)rs + rt + rm;
+        vector->length = requested < 0 ? 0 : requested > vector->max_length ? vector->max_length : (int)requested;
+        register_array[instruction->rd] = vector->length;
+        break;
+    }
+
+    case VLW:
+    case VSW:
+        if (address > (unsigned int)(MEM_SIZE - length))
+        {
+            fprintf(stderr, "Error: Memory access out of bounds during '%s'. Address: %u, length %d\n",
+                instruction->opcode == VLW ? "vlw" : "vsw", address, length);
+            return;
+        }
+        if (instruction->opcode == VLW)
+        {
+            lanes_add_scalar(vector->registers[instruction->rd], &data_memory[address], rm, length);
+        }
+        else
+        {
+            lanes_add_scalar(&data_memory[address], vector->registers[instruction->rd], rm, length);
+        }
+        break;
+
+    case VADD:
+    case VSUB:
+    case VMAC:
+        lanes(instruction->opcode == VADD ? LANES_ADD : instruction->opcode == VSUB ? LANES_SUB : LANES_MAC,
+            vector->registers[instruction->rd], vector->registers[instruction->rs], vector->registers[instruction->rt],
+            vector->registers[instruction->rm], length);
+        break;
+
+    case VSPLAT:
+    {
+        int value = (int)((unsigned int)rs + (unsigned int)rt + (unsigned int)rm);
+        for (int i = 0; i < length; i++)
+        {
+            vector->registers[instruction->rd][i] = value;
+        }
+        break;
+    }
+
+    case VREDSUM:
+        // rt and rm are scalar registers here, only rs names a vector register
+        register_array[instruction->rd] = (int)((unsigned int)lanes_sum(vector->registers[instruction->rs], length)
+            + (unsigned int)rt + (unsigned int)rm);
+        break;
+
+    default:
+        fprintf(stderr, "Error: Unsupported vector opcode %ld\n", instruction->opcode);
+        break;
+    }
+}
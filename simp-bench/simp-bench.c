@@ -0,0 +1,648 @@
+#define _CRT_SECURE_NO_WARNINGS
+#ifndef _WIN32
+#define _GNU_SOURCE //sched_setaffinity
+#endif
+
+#include "../sim/sim/simulator_functions.h"
+
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define NULL_DEVICE "NUL"
+#else
+#include <sched.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define DEFAULT_REPETITIONS 20
+#define DEFAULT_WARMUP 3
+#define DEFAULT_BATCH_NS 2000000.0 //a repetition runs one batch, of at least this long
+#define MAX_BATCH (1 << 30)
+#define CALIBRATION_FRACTION 10 //the probe batch takes at least this fraction of DEFAULT_BATCH_NS
+#define CALIBRATION_RUNS 5 //timings of the probe batch, the fastest sets the batch
+#define MAX_RECALIBRATIONS 3 //times the repetitions are redone with a larger batch when one was too short
+#define RECALIBRATION_MARGIN 1.2
+#define MAX_REPETITIONS 10000
+#define SYNTHETIC_LINES 512 //instructions of the built-in program
+#define IMEM_FILE "simp-bench.imemin.tmp"
+#define DMEM_FILE "simp-bench.dmemin.tmp"
+#define DISK_FILE "simp-bench.diskin.tmp"
+
+
+/*
+    Microbenchmarks of the simulator's building blocks, each run in isolation on realistic inputs:
+    - str_hex_2_bin:           the field slices of every instruction line;
+    - decode_instruction:      every instruction line;
+    - execute_instruction:     the arithmetic, branch and jal instructions of the program and its lw/sw with an
+                               immediate address, through the opcode dispatch (the other lw/sw depend on
+                               register values, in/out/reti/halt on the devices);
+    - log_trace:               one trace line per instruction, to the null device;
+    - load_instruction_memory, load_data_memory, load_disk_contents: a full imemin, dmemin and diskin file;
+    - write_monitor_pixels:    a screen with a few shapes, to the null device;
+    - dma_read_sector, dma_write_sector: one 128-word sector;
+    - memdma_copy, memdma_stride: a 1024-word memory DMA transfer, started and completed.
+    The instructions come from an imemin.txt given on the command line, or from a built-in program of
+    SYNTHETIC_LINES lines with the instruction mix of the examples.
+
+    Each benchmark is calibrated: a probe batch long enough for the clock is timed CALIBRATION_RUNS times,
+    and the batch size (operations) is DEFAULT_BATCH_NS over the fastest time per operation. After the
+    warmup it is timed for a number of repetitions of one batch; if a repetition took less than
+    DEFAULT_BATCH_NS the batch grows and all repetitions are timed again. The summary is per operation: minimum, median,
+    mean, standard deviation and maximum in nanoseconds. The process is pinned to one CPU so the
+    repetitions run on the same core and cache.
+*/
+
+
+/*Inputs shared by the benchmarks*/
+typedef struct Bench_Data{
+    char (*lines)[CMD_BYTES + 1]; //instruction lines
+    int line_count;
+    instruction_decode* executable; //the decoded lines execute_instruction can run on its own
+    int executable_count;
+    char instruction_memory[MEM_SIZE][CMD_BYTES + 1];
+    int data_memory[MEM_SIZE];
+    int registers[REG_NUM];
+    int IOR[IOR_NUM];
+    int disk[NUMBER_OF_SECTORS][SECTOR_SIZE];
+    unsigned char screen[MONITOR_SIZE][MONITOR_SIZE];
+    disk_controller disk_ctl;
+    vector_unit vector;
+    mem_dma memdma;
+    int memdma_failed; //the engine refused a transfer setup, the memdma timings are meaningless
+    FILE* null_file;
+}Bench_Data;
+
+/*Runs count operations of a benchmark and returns a value that depends on them*/
+typedef unsigned int (*Bench_Function)(Bench_Data* data, long long count);
+
+typedef struct Benchmark{
+    const char* name;
+    Bench_Function run;
+}Benchmark;
+
+/*Per-operation times of one benchmark, in nanoseconds*/
+typedef struct Bench_Result{
+    const char* name;
+    long long batch;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double max;
+}Bench_Result;
+
+
+static volatile unsigned int sink; //keeps the results of the benchmarks alive
+static unsigned int random_state = 12345;
+
+
+/*xorshift32: the same inputs on every run*/
+unsigned int next_random()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/*Monotonic clock in nanoseconds*/
+double now_ns()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1e9 + (double)time.tv_nsec;
+#endif
+}
+
+/*Pins the process to one CPU. Returns 0 if the system refused.*/
+int pin_cpu(int cpu)
+{
+#ifdef _WIN32
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return 0;
+#endif
+}
+
+
+/*Encodes one instruction line*/
+void encode_line(char* line, int opcode, int rd, int rs, int rt, int rm, int imm1, int imm2)
+{
+    sprintf(line, "%02X%X%X%X%X%03X%03X", opcode, rd, rs, rt, rm, imm1 & MASK_12_BIT, imm2 & MASK_12_BIT);
+}
+
+/*Built-in program: mostly arithmetic, then branches, loads and stores, a few jal and in/out, like the examples*/
+void synthetic_program(Bench_Data* data)
+{
+    for (int i = 0; i < SYNTHETIC_LINES; i++) {
+        unsigned int kind = next_random() % 100;
+        int rd = 3 + next_random() % 12; //$v0..$sp
+        int rs = next_random() % 16;
+        int rt = next_random() % 16;
+        int imm1 = (int)(next_random() % 512);
+        int imm2 = (int)(next_random() % 4096) - 2048;
+        if (kind < 50) {
+            encode_line(data->lines[i], (int)(next_random() % (SRL + 1)), rd, rs, rt, next_random() % 16, imm1, imm2);
+        }
+        else if (kind < 70) {
+            encode_line(data->lines[i], BEQ + (int)(next_random() % 6), 0, rs, rt, 1, next_random() % SYNTHETIC_LINES, imm2);
+        }
+        else if (kind < 73) {
+            encode_line(data->lines[i], JAL, 15, 0, 0, 1, next_random() % SYNTHETIC_LINES, 0);
+        }
+        else if (kind < 85) {
+            encode_line(data->lines[i], LW, rd, 1, 0, 0, 256 + imm1, 0);
+        }
+        else if (kind < 95) {
+            encode_line(data->lines[i], SW, rd, 1, 0, rt, 256 + imm1, 0);
+        }
+        else {
+            encode_line(data->lines[i], kind < 98 ? IN : OUT, rd, 1, 0, rt, (int)(next_random() % 23), 0);
+        }
+    }
+    data->line_count = SYNTHETIC_LINES;
+}
+
+/*Reads the instruction lines of an imemin.txt. Returns 0 if it has none.*/
+int read_program(Bench_Data* data, const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    char line[64];
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return 0;
+    }
+    data->line_count = 0;
+    while (data->line_count < MEM_SIZE && fgets(line, sizeof(line), file) != NULL) {
+        if (strlen(line) >= CMD_BYTES) {
+            memcpy(data->lines[data->line_count], line, CMD_BYTES);
+            data->lines[data->line_count++][CMD_BYTES] = '\0';
+        }
+    }
+    fclose(file);
+    if (data->line_count == 0) {
+        fprintf(stderr, "Error: no instructions in %s\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/*Writes count words, one 8-digit hex word per line*/
+int write_words_file(const char* filename, const int* words, int count)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%08X\n", (unsigned int)words[i]);
+    }
+    fclose(file);
+    return 1;
+}
+
+/*Prepares the inputs of every benchmark and the files the loaders read. Returns 0 on failure.*/
+int prepare_data(Bench_Data* data, const char* program_filename)
+{
+    data->lines = (char(*)[CMD_BYTES + 1])calloc(MEM_SIZE, CMD_BYTES + 1);
+    data->executable = (instruction_decode*)calloc(MEM_SIZE, sizeof(instruction_decode));
+    if (data->lines == NULL || data->executable == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    if (program_filename != NULL) {
+        if (!read_program(data, program_filename)) {
+            return 0;
+        }
+    }
+    else {
+        synthetic_program(data);
+    }
+
+    // Decode once; the instructions execute_instruction runs alone must keep their accesses in data memory
+    for (int i = 0; i < data->line_count; i++) {
+        instruction_decode decoded;
+        decode_instruction(data->lines[i], &decoded, data->registers);
+        if (decoded.opcode <= JAL || ((decoded.opcode == LW || decoded.opcode == SW) && decoded.rs == 1 && decoded.rt == 0
+            && (unsigned int)decoded.imm1 < MEM_SIZE)) {
+            data->executable[data->executable_count++] = decoded;
+        }
+    }
+    if (data->executable_count == 0) {
+        fprintf(stderr, "Error: the program has no instructions execute_instruction can run alone\n");
+        return 0;
+    }
+
+    for (int i = 0; i < MEM_SIZE; i++) {
+        data->data_memory[i] = (int)next_random();
+    }
+    for (int i = 0; i < NUMBER_OF_SECTORS; i++) {
+        for (int j = 0; j < SECTOR_SIZE; j++) {
+            data->disk[i][j] = (int)next_random();
+        }
+    }
+
+    // A frame like the graphics examples draw: a gradient, a filled disc and a few lines
+    for (int y = 0; y < MONITOR_SIZE; y++) {
+        for (int x = 0; x < MONITOR_SIZE; x++) {
+            int dx = x - 128, dy = y - 128;
+            data->screen[y][x] = dx * dx + dy * dy < 60 * 60 ? 255 : (x % 64 == 0 || y % 64 == 0) ? 128 : (unsigned char)(y / 4);
+        }
+    }
+
+    vector_unit_reset(&data->vector, DEFAULT_VECTOR_LENGTH);
+    sim_options options = { 0 };
+    options.memdma_setup = 0;
+    options.memdma_rate = MEM_SIZE; //one cycle per transfer: the benchmark times the copy, not the wait
+    mem_dma_configure(&data->memdma, &options);
+
+    data->null_file = fopen(NULL_DEVICE, "w");
+    if (data->null_file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", NULL_DEVICE);
+        return 0;
+    }
+
+    FILE* imem = fopen(IMEM_FILE, "w");
+    if (imem == NULL) {
+        fprintf(stderr, "Error opening file %s\n", IMEM_FILE);
+        return 0;
+    }
+    for (int i = 0; i < data->line_count; i++) {
+        fprintf(imem, "%s\n", data->lines[i]);
+    }
+    fclose(imem);
+    return write_words_file(DMEM_FILE, data->data_memory, MEM_SIZE)
+        && write_words_file(DISK_FILE, &data->disk[0][0], MAX_DISK_ENTRIES);
+}
+
+
+/*The fields of one instruction line, as decode_instruction slices them*/
+unsigned int bench_str_hex_2_bin(Bench_Data* data, long long count)
+{
+    static const int slices[7][2] = { { 0, 2 }, { 2, 1 }, { 3, 1 }, { 4, 1 }, { 5, 1 }, { 6, 3 }, { 9, 3 } };
+    unsigned int result = 0;
+    int line = 0, field = 0;
+    for (long long i = 0; i < count; i++) {
+        result += (unsigned int)str_hex_2_bin(data->lines[line], slices[field][0], slices[field][1]);
+        if (++field == 7) {
+            field = 0;
+            line = line + 1 == data->line_count ? 0 : line + 1;
+        }
+    }
+    return result;
+}
+
+unsigned int bench_decode_instruction(Bench_Data* data, long long count)
+{
+    instruction_decode decoded;
+    unsigned int result = 0;
+    int line = 0;
+    for (long long i = 0; i < count; i++) {
+        decode_instruction(data->lines[line], &decoded, data->registers);
+        result += (unsigned int)decoded.opcode + (unsigned int)decoded.imm2;
+        line = line + 1 == data->line_count ? 0 : line + 1;
+    }
+    return result;
+}
+
+unsigned int bench_execute_instruction(Bench_Data* data, long long count)
+{
+    int pc = 0;
+    int index = 0;
+    for (long long i = 0; i < count; i++) {
+        instruction_decode* decoded = &data->executable[index];
+        data->registers[1] = decoded->imm1;
+        data->registers[2] = decoded->imm2;
+        execute_instruction(decoded, data->registers, &pc, data->data_memory, data->IOR, data->screen,
+            data->null_file, data->null_file, data->null_file, data->null_file, &data->disk_ctl, data->disk, &data->vector);
+        index = index + 1 == data->executable_count ? 0 : index + 1;
+    }
+    return (unsigned int)pc + (unsigned int)data->registers[3];
+}
+
+unsigned int bench_log_trace(Bench_Data* data, long long count)
+{
+    int line = 0;
+    for (long long i = 0; i < count; i++) {
+        log_trace(data->null_file, (unsigned int)line, data->lines[line], data->registers);
+        line = line + 1 == data->line_count ? 0 : line + 1;
+    }
+    return (unsigned int)line;
+}
+
+unsigned int bench_load_instruction_memory(Bench_Data* data, long long count)
+{
+    for (long long i = 0; i < count; i++) {
+        load_instruction_memory(IMEM_FILE, data->instruction_memory);
+    }
+    return (unsigned int)data->instruction_memory[0][0];
+}
+
+unsigned int bench_load_data_memory(Bench_Data* data, long long count)
+{
+    unsigned int result = 0;
+    for (long long i = 0; i < count; i++) {
+        result += (unsigned int)load_data_memory(DMEM_FILE, data->data_memory);
+    }
+    return result;
+}
+
+unsigned int bench_load_disk_contents(Bench_Data* data, long long count)
+{
+    for (long long i = 0; i < count; i++) {
+        load_disk_contents(DISK_FILE, data->disk);
+    }
+    return (unsigned int)data->disk[NUMBER_OF_SECTORS - 1][SECTOR_SIZE - 1];
+}
+
+unsigned int bench_write_monitor_pixels(Bench_Data* data, long long count)
+{
+    for (long long i = 0; i < count; i++) {
+        write_monitor_pixels(data->null_file, data->screen);
+    }
+    return (unsigned int)data->screen[128][128];
+}
+
+unsigned int bench_dma_read_sector(Bench_Data* data, long long count)
+{
+    for (long long i = 0; i < count; i++) {
+        dma_read_sector((unsigned int)(i % NUMBER_OF_SECTORS), (unsigned int)(i % 16) * SECTOR_SIZE, data->data_memory, data->disk);
+    }
+    return (unsigned int)data->data_memory[0];
+}
+
+unsigned int bench_dma_write_sector(Bench_Data* data, long long count)
+{
+    for (long long i = 0; i < count; i++) {
+        dma_write_sector((unsigned int)(i % NUMBER_OF_SECTORS), (unsigned int)(i % 16) * SECTOR_SIZE, data->data_memory, data->disk);
+    }
+    return (unsigned int)data->disk[0][0];
+}
+
+/*Starts a memory DMA transfer and ticks the engine until it completes, or stops when the engine refuses the setup*/
+unsigned int memdma_transfers(Bench_Data* data, long long count, int mode, int strides)
+{
+    for (long long i = 0; i < count && !data->memdma_failed; i++) {
+        data->IOR[IOR_DMA_SRC] = (int)(i & 1) * 1024;
+        data->IOR[IOR_DMA_DST] = 2048;
+        data->IOR[IOR_DMA_LEN] = 1024;
+        data->IOR[IOR_DMA_MODE] = mode;
+        data->IOR[IOR_DMA_STRIDE] = strides;
+        data->IOR[IOR_DMA_START] = 1;
+        //a refused setup clears dmastart without completing, and the engine then stays idle
+        while (!mem_dma_tick(&data->memdma, data->IOR, data->data_memory)) {
+            if (data->IOR[IOR_DMA_START] == 0) {
+                data->memdma_failed = 1;
+                break;
+            }
+        }
+    }
+    return (unsigned int)data->data_memory[2048];
+}
+
+unsigned int bench_memdma_copy(Bench_Data* data, long long count)
+{
+    return memdma_transfers(data, count, MEMDMA_COPY, 0);
+}
+
+unsigned int bench_memdma_stride(Bench_Data* data, long long count)
+{
+    return memdma_transfers(data, count, MEMDMA_STRIDE, (1 << 16) | 1); //unit strides through the gather/scatter loop
+}
+
+
+static const Benchmark benchmarks[] = {
+    { "str_hex_2_bin", bench_str_hex_2_bin },
+    { "decode_instruction", bench_decode_instruction },
+    { "execute_instruction", bench_execute_instruction },
+    { "log_trace", bench_log_trace },
+    { "load_instruction_memory", bench_load_instruction_memory },
+    { "load_data_memory", bench_load_data_memory },
+    { "load_disk_contents", bench_load_disk_contents },
+    { "write_monitor_pixels", bench_write_monitor_pixels },
+    { "dma_read_sector", bench_dma_read_sector },
+    { "dma_write_sector", bench_dma_write_sector },
+    { "memdma_copy", bench_memdma_copy },
+    { "memdma_stride", bench_memdma_stride },
+};
+
+
+int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/*Batch of operations that takes target_ns at ns_per_op, at least 1 and at most MAX_BATCH*/
+long long batch_for(double target_ns, double ns_per_op)
+{
+    double batch = ns_per_op > 0 ? ceil(target_ns / ns_per_op) : MAX_BATCH;
+    return batch < 1 ? 1 : batch > MAX_BATCH ? MAX_BATCH : (long long)batch;
+}
+
+/*Calibrates, warms up and times one benchmark*/
+void run_benchmark(const Benchmark* benchmark, Bench_Data* data, int warmup, int repetitions, Bench_Result* result)
+{
+    double samples[MAX_REPETITIONS];
+    long long batch = 1;
+
+    // Double a probe batch until it is long enough for the clock, then size the batch from its fastest run
+    for (;;) {
+        double start = now_ns();
+        sink += benchmark->run(data, batch);
+        if (now_ns() - start >= DEFAULT_BATCH_NS / CALIBRATION_FRACTION || batch >= MAX_BATCH) {
+            break;
+        }
+        batch *= 2;
+    }
+    double fastest = HUGE_VAL;
+    for (int i = 0; i < CALIBRATION_RUNS; i++) {
+        double start = now_ns();
+        sink += benchmark->run(data, batch);
+        fastest = fmin(fastest, now_ns() - start);
+    }
+    batch = batch_for(DEFAULT_BATCH_NS, fastest / (double)batch);
+
+    for (int i = 0; i < warmup; i++) {
+        sink += benchmark->run(data, batch);
+    }
+    // A repetition shorter than DEFAULT_BATCH_NS means the operations got faster than calibrated: grow the batch and time again
+    for (int attempt = 0;; attempt++) {
+        double shortest = HUGE_VAL;
+        for (int i = 0; i < repetitions; i++) {
+            double start = now_ns();
+            sink += benchmark->run(data, batch);
+            double elapsed = now_ns() - start;
+            samples[i] = elapsed / (double)batch;
+            shortest = fmin(shortest, elapsed);
+        }
+        if (shortest >= DEFAULT_BATCH_NS || batch >= MAX_BATCH) {
+            break;
+        }
+        if (attempt == MAX_RECALIBRATIONS) {
+            fprintf(stderr, "Warning: %s: a repetition took %.0f ns, less than the %.0f ns target\n", benchmark->name,
+                shortest, DEFAULT_BATCH_NS);
+            break;
+        }
+        batch = batch_for(DEFAULT_BATCH_NS * RECALIBRATION_MARGIN, shortest / (double)batch);
+    }
+
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+    double sum = 0, squares = 0;
+    for (int i = 0; i < repetitions; i++) {
+        sum += samples[i];
+    }
+    result->mean = sum / repetitions;
+    for (int i = 0; i < repetitions; i++) {
+        squares += (samples[i] - result->mean) * (samples[i] - result->mean);
+    }
+    result->name = benchmark->name;
+    result->batch = batch;
+    result->min = samples[0];
+    result->max = samples[repetitions - 1];
+    result->median = repetitions % 2 ? samples[repetitions / 2] : (samples[repetitions / 2 - 1] + samples[repetitions / 2]) / 2;
+    result->stddev = repetitions > 1 ? sqrt(squares / (repetitions - 1)) : 0;
+}
+
+/*Writes the results as one JSON object*/
+int write_json(const char* filename, const Bench_Result* results, int count, int warmup, int repetitions, int cpu, const char* program)
+{
+    FILE* file = strcmp(filename, "-") == 0 ? stdout : fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return 0;
+    }
+    fprintf(file, "{\n  \"timestamp\": %lld,\n  \"program\": ", (long long)time(NULL));
+    if (program != NULL) {
+        fputc('"', file);
+        for (const char* p = program; *p; p++) {
+            if (*p == '"' || *p == '\\') {
+                fputc('\\', file);
+            }
+            fputc(*p, file);
+        }
+        fputc('"', file);
+    }
+    else {
+        fputs("null", file);
+    }
+    fprintf(file, ",\n  \"cpu\": %d,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [\n",
+        cpu, warmup, repetitions);
+    for (int i = 0; i < count; i++) {
+        const Bench_Result* result = &results[i];
+        fprintf(file, "    { \"name\": \"%s\", \"batch\": %lld, \"min\": %.3f, \"median\": %.3f, \"mean\": %.3f, \"stddev\": %.3f, \"max\": %.3f }%s\n",
+            result->name, result->batch, result->min, result->median, result->mean, result->stddev, result->max, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 1;
+}
+
+
+int main(int argc, char* argv[]){
+
+    const char* program = NULL;
+    const char* json = NULL;
+    const char* filter = NULL;
+    int repetitions = DEFAULT_REPETITIONS;
+    int warmup = DEFAULT_WARMUP;
+    int cpu = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-cpu") == 0 && i + 1 < argc) {
+            cpu = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        }
+        else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else if (argv[i][0] != '-' && program == NULL) {
+            program = argv[i];
+        }
+        else {
+            fprintf(stderr, "Usage: %s [imemin.txt] [-reps N] [-warmup N] [-cpu N|-1] [-filter TEXT] [-json FILE|-]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS || warmup < 0) {
+        fprintf(stderr, "Error: -reps must be 1 to %d and -warmup at least 0\n", MAX_REPETITIONS);
+        return 2;
+    }
+    if (cpu >= 0 && !pin_cpu(cpu)) {
+        fprintf(stderr, "Warning: could not pin to CPU %d, the results may be noisier\n", cpu);
+        cpu = -1;
+    }
+
+    Bench_Data* data = (Bench_Data*)calloc(1, sizeof(Bench_Data));
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 2;
+    }
+    int ok = prepare_data(data, program);
+    int total = (int)(sizeof(benchmarks) / sizeof(benchmarks[0]));
+    Bench_Result results[sizeof(benchmarks) / sizeof(benchmarks[0])];
+    int count = 0;
+
+    if (ok) {
+        if (json == NULL || strcmp(json, "-") != 0) {
+            printf("%d instructions (%s), %d repetitions after %d warmup batches, CPU %d\n", data->line_count,
+                program ? program : "built-in program", repetitions, warmup, cpu);
+            printf("%-24s %12s %10s %10s %10s %10s %10s\n", "benchmark (ns/op)", "batch", "min", "median", "mean", "stddev", "max");
+        }
+        for (int i = 0; i < total; i++) {
+            if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL) {
+                continue;
+            }
+            Bench_Result* result = &results[count++];
+            run_benchmark(&benchmarks[i], data, warmup, repetitions, result);
+            if (data->memdma_failed) {
+                fprintf(stderr, "Error: the memory DMA engine refused the %s transfer\n", result->name);
+                ok = 0;
+                break;
+            }
+            if (json == NULL || strcmp(json, "-") != 0) {
+                printf("%-24s %12lld %10.1f %10.1f %10.1f %10.1f %10.1f\n", result->name, result->batch, result->min,
+                    result->median, result->mean, result->stddev, result->max);
+            }
+        }
+        if (ok && json != NULL) {
+            ok = write_json(json, results, count, warmup, repetitions, cpu, program);
+        }
+    }
+
+    remove(IMEM_FILE);
+    remove(DMEM_FILE);
+    remove(DISK_FILE);
+    if (data->null_file != NULL) {
+        fclose(data->null_file);
+    }
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,409 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define REG_NUM 16
+#define MAX_IOR 256 //more than any simulator build has
+#define MEM_SIZE 4096
+#define DISK_WORDS (128 * 128)
+#define SCREEN_PIXELS (256 * 256)
+#define PATH_SIZE 1024
+#define COMMAND_SIZE 8192
+#define LINE_SIZE 512
+#define DEFAULT_INTERVAL 10000 //cycles between the hashes of the first pass
+#define SPLIT 64 //hashes per interval in each refining pass
+#define DEFAULT_CONTEXT 5 //trace lines shown before and after the divergent cycle
+#define MAX_LISTED 16 //differing words listed per memory
+
+
+/*
+    Finds the first cycle in which two simulator runs differ, without full traces.
+
+    Each run is a directory with imemin.txt, dmemin.txt, diskin.txt and irq2in.txt and the simulator
+    to run there (two program versions under one simulator, or one program under two simulator builds).
+    1. Both runs record a state hash every -interval cycles (sim -state_hash) and the first differing
+       hash brackets the divergence between two hashed cycles.
+    2. The bracket is re-run with SPLIT hashes in it, again and again, until it is one cycle wide.
+    3. Both runs dump their state at that cycle (sim -state_dump) and log only the trace lines around
+       it (sim -trace_window); the report shows both windows and every differing register, I/O register,
+       memory word, disk word and pixel.
+    The simulator's own output files go to diverge_a_* and diverge_b_* in the run directories.
+*/
+
+
+/*One side of the comparison*/
+typedef struct Run{
+    const char* dir;
+    const char* sim;
+    const char* tag; //"a" or "b", prefix of the files written in dir
+}Run;
+
+/*One line of a -state_hash file*/
+typedef struct Hash_Entry{
+    unsigned int cycle;
+    unsigned long long hash;
+    int end; //1 for the state the run ended in
+}Hash_Entry;
+
+typedef struct Hash_List{
+    Hash_Entry* entries;
+    int count;
+}Hash_List;
+
+/*A -state_dump file, missing words are 0*/
+typedef struct State_Dump{
+    unsigned int cycle;
+    int pc;
+    int vl;
+    int registers[REG_NUM];
+    int IOR[MAX_IOR];
+    int memory[MEM_SIZE];
+    int disk[DISK_WORDS];
+    int pixels[SCREEN_PIXELS];
+}State_Dump;
+
+
+static const char* register_names[REG_NUM] = {
+    "$zero", "$imm1", "$imm2", "$v0", "$a0", "$a1", "$a2", "$t0",
+    "$t1", "$t2", "$s0", "$s1", "$s2", "$gp", "$sp", "$ra" };
+
+
+/*Path of a file the tool writes for a run*/
+void run_file(char* path, const Run* run, const char* name)
+{
+    snprintf(path, PATH_SIZE, "%s/diverge_%s_%s", run->dir, run->tag, name);
+}
+
+/*Runs the simulator of a run with extra flags. Returns 0 if it could not run.*/
+int run_sim(const Run* run, const char* flags, const char* sim_flags)
+{
+    char command[COMMAND_SIZE];
+    char line[COMMAND_SIZE + 2];
+    const char* d = run->dir;
+    const char* t = run->tag;
+
+    snprintf(command, sizeof(command), "\"%s\" \"%s/imemin.txt\" \"%s/dmemin.txt\" \"%s/diskin.txt\" \"%s/irq2in.txt\" "
+        "\"%s/diverge_%s_dmemout.txt\" \"%s/diverge_%s_regout.txt\" \"%s/diverge_%s_trace.txt\" \"%s/diverge_%s_hwregtrace.txt\" "
+        "\"%s/diverge_%s_cycles.txt\" \"%s/diverge_%s_leds.txt\" \"%s/diverge_%s_display7seg.txt\" \"%s/diverge_%s_diskout.txt\" "
+        "\"%s/diverge_%s_monitor.txt\" \"%s/diverge_%s_monitor.yuv\" %s %s > \"%s/diverge_%s_sim.log\" 2>&1",
+        run->sim, d, d, d, d, d, t, d, t, d, t, d, t, d, t, d, t, d, t, d, t, d, t, d, t, flags, sim_flags, d, t);
+#ifdef _WIN32
+    snprintf(line, sizeof(line), "\"%s\"", command); //cmd.exe drops the outer quotes
+#else
+    snprintf(line, sizeof(line), "%s", command);
+#endif
+    if (system(line) != 0) {
+        fprintf(stderr, "Error: the simulator of run %s failed, see %s/diverge_%s_sim.log\n", t, d, t);
+        return 0;
+    }
+    return 1;
+}
+
+/*Reads a -state_hash file. Returns 0 if it cannot be read.*/
+int load_hashes(const char* filename, Hash_List* list)
+{
+    FILE* file = fopen(filename, "r");
+    char line[LINE_SIZE];
+    int capacity = 1024;
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return 0;
+    }
+    list->count = 0;
+    list->entries = (Hash_Entry*)malloc(capacity * sizeof(Hash_Entry));
+    if (list->entries == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        fclose(file);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        Hash_Entry entry;
+        char end[8] = "";
+        if (sscanf(line, "%u %llx %7s", &entry.cycle, &entry.hash, end) < 2) {
+            continue;
+        }
+        entry.end = strcmp(end, "end") == 0;
+        if (list->count == capacity) {
+            capacity *= 2;
+            Hash_Entry* grown = (Hash_Entry*)realloc(list->entries, capacity * sizeof(Hash_Entry));
+            if (grown == NULL) {
+                fprintf(stderr, "Memory allocation failed\n");
+                fclose(file);
+                return 0;
+            }
+            list->entries = grown;
+        }
+        list->entries[list->count++] = entry;
+    }
+    fclose(file);
+    if (list->count == 0) {
+        fprintf(stderr, "Error: no state hashes in %s\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/*Index of the first entry that differs between the lists, -1 if they are the same*/
+int first_mismatch(const Hash_List* a, const Hash_List* b)
+{
+    int i = 0;
+    for (; i < a->count && i < b->count; i++) {
+        const Hash_Entry* x = &a->entries[i];
+        const Hash_Entry* y = &b->entries[i];
+        if (x->cycle != y->cycle || x->hash != y->hash || x->end != y->end) {
+            return i;
+        }
+    }
+    return a->count == b->count ? -1 : i;
+}
+
+/*Hashes both runs and narrows [*good, *bad] to the first mismatch. Returns -1 on error, 0 if the runs match, 1 otherwise.*/
+int hash_pass(const Run runs[2], const char* flags, const char* sim_flags, long long* good, unsigned int* bad, unsigned int* matched)
+{
+    Hash_List lists[2];
+    char path[PATH_SIZE];
+
+    for (int r = 0; r < 2; r++) {
+        run_file(path, &runs[r], "hashes.txt");
+        char run_flags[COMMAND_SIZE / 2];
+        snprintf(run_flags, sizeof(run_flags), "-state_hash \"%s\" %s", path, flags);
+        if (!run_sim(&runs[r], run_flags, sim_flags) || !load_hashes(path, &lists[r])) {
+            return -1;
+        }
+    }
+
+    int result = 1;
+    int i = first_mismatch(&lists[0], &lists[1]);
+    if (i < 0) {
+        *matched = lists[0].entries[lists[0].count - 1].cycle;
+        result = 0;
+    }
+    else {
+        // Past the end of one list, the other one's entry brackets the divergence
+        const Hash_Entry* x = i < lists[0].count ? &lists[0].entries[i] : NULL;
+        const Hash_Entry* y = i < lists[1].count ? &lists[1].entries[i] : NULL;
+        *good = i > 0 ? (long long)lists[0].entries[i - 1].cycle : -1;
+        *bad = x == NULL ? y->cycle : y == NULL ? x->cycle : x->cycle < y->cycle ? x->cycle : y->cycle;
+        if (x != NULL && y != NULL && x->cycle == y->cycle && x->hash == y->hash) {
+            *good = x->cycle; //same state, but only one run ends there
+            *bad = x->cycle;
+        }
+    }
+    free(lists[0].entries);
+    free(lists[1].entries);
+    return result;
+}
+
+/*Reads a -state_dump file. Returns 0 if it cannot be read.*/
+int load_dump(const char* filename, State_Dump* dump)
+{
+    FILE* file = fopen(filename, "r");
+    char line[LINE_SIZE];
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", filename);
+        return 0;
+    }
+    memset(dump, 0, sizeof(*dump));
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char kind[16];
+        unsigned int index, value;
+        if (sscanf(line, "cycle %u", &dump->cycle) == 1 || sscanf(line, "pc %x", (unsigned int*)&dump->pc) == 1
+            || sscanf(line, "vl %d", &dump->vl) == 1) {
+            continue;
+        }
+        if (sscanf(line, "%15s %u %x", kind, &index, &value) != 3) {
+            continue;
+        }
+        if (strcmp(kind, "reg") == 0 && index < REG_NUM) {
+            dump->registers[index] = (int)value;
+        }
+        else if (strcmp(kind, "ior") == 0 && index < MAX_IOR) {
+            dump->IOR[index] = (int)value;
+        }
+        else if (strcmp(kind, "mem") == 0 && index < MEM_SIZE) {
+            dump->memory[index] = (int)value;
+        }
+        else if (strcmp(kind, "disk") == 0 && index < DISK_WORDS) {
+            dump->disk[index] = (int)value;
+        }
+        else if (strcmp(kind, "pixel") == 0 && index < SCREEN_PIXELS) {
+            dump->pixels[index] = (int)value;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+/*Lists the differing words of one memory, the first MAX_LISTED of them*/
+void print_word_diff(const char* name, const int* a, const int* b, int count, int pixels)
+{
+    int differing = 0;
+    for (int i = 0; i < count; i++) {
+        if (a[i] == b[i]) {
+            continue;
+        }
+        if (differing < MAX_LISTED) {
+            if (pixels) {
+                printf("  %s (%d,%d): a=%02X b=%02X\n", name, i % 256, i / 256, a[i], b[i]);
+            }
+            else {
+                printf("  %s[%d]: a=%08X b=%08X\n", name, i, a[i], b[i]);
+            }
+        }
+        differing++;
+    }
+    if (differing > MAX_LISTED) {
+        printf("  ... %d %s words differ in all\n", differing, name);
+    }
+}
+
+/*Prints the lines of a trace window, marking the cycle that diverged*/
+void print_trace(const Run* run, unsigned int first, long long marked)
+{
+    char path[PATH_SIZE];
+    char line[LINE_SIZE];
+
+    run_file(path, run, "trace.txt");
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file %s\n", path);
+        return;
+    }
+    printf("trace of run %s (%s):\n", run->tag, run->dir);
+    for (unsigned int cycle = first; fgets(line, sizeof(line), file) != NULL; cycle++) {
+        printf("%c %10u  %s", (long long)cycle == marked ? '>' : ' ', cycle, line);
+    }
+    fclose(file);
+}
+
+/*Dumps both runs at the divergent cycle and prints the report*/
+int report(const Run runs[2], const char* sim_flags, unsigned int cycle, unsigned int context)
+{
+    char path[PATH_SIZE];
+    char flags[COMMAND_SIZE / 2];
+    unsigned int first = cycle > context + 1 ? cycle - 1 - context : 0;
+    unsigned int last = cycle + context;
+    State_Dump* dumps = (State_Dump*)malloc(2 * sizeof(State_Dump));
+
+    if (dumps == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    for (int r = 0; r < 2; r++) {
+        run_file(path, &runs[r], "state.txt");
+        remove(path);
+        snprintf(flags, sizeof(flags), "-state_dump \"%s\" %u -trace_window %u %u -max_cycles %u", path, cycle, first, last, last + 1);
+        if (!run_sim(&runs[r], flags, sim_flags) || !load_dump(path, &dumps[r])) {
+            free(dumps);
+            return 0;
+        }
+    }
+
+    if (cycle == 0) {
+        printf("The runs differ from the start: the inputs are not the same\n\n");
+    }
+    else {
+        printf("The runs first differ at the start of cycle %u, after the instruction of cycle %u\n\n", cycle, cycle - 1);
+    }
+    print_trace(&runs[0], first, (long long)cycle - 1);
+    print_trace(&runs[1], first, (long long)cycle - 1);
+
+    State_Dump* a = &dumps[0];
+    State_Dump* b = &dumps[1];
+    printf("\nstate at the start of cycle %u (a = %s, b = %s):\n", cycle, runs[0].dir, runs[1].dir);
+    if (a->pc != b->pc) {
+        printf("  PC: a=%03X b=%03X\n", a->pc, b->pc);
+    }
+    for (int i = 3; i < REG_NUM; i++) { //$imm1/$imm2 are in the traces
+        if (a->registers[i] != b->registers[i]) {
+            printf("  %s: a=%08X b=%08X\n", register_names[i], a->registers[i], b->registers[i]);
+        }
+    }
+    for (int i = 0; i < MAX_IOR; i++) {
+        if (a->IOR[i] != b->IOR[i]) {
+            printf("  IOR[%d]: a=%08X b=%08X\n", i, a->IOR[i], b->IOR[i]);
+        }
+    }
+    if (a->vl != b->vl) {
+        printf("  VL: a=%d b=%d\n", a->vl, b->vl);
+    }
+    print_word_diff("mem", a->memory, b->memory, MEM_SIZE, 0);
+    print_word_diff("disk", a->disk, b->disk, DISK_WORDS, 0);
+    print_word_diff("pixel", a->pixels, b->pixels, SCREEN_PIXELS, 1);
+    free(dumps);
+    return 1;
+}
+
+
+int main(int argc, char* argv[]){
+
+    unsigned int interval = DEFAULT_INTERVAL;
+    unsigned int context = DEFAULT_CONTEXT;
+    char sim_flags[COMMAND_SIZE / 4] = "";
+
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s <dir a> <sim a> <dir b> <sim b> [-interval CYCLES] [-context LINES] [-- simulator options]\n", argv[0]);
+        return 2;
+    }
+    for (int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            for (int j = i + 1; j < argc; j++) {
+                strncat(sim_flags, argv[j], sizeof(sim_flags) - strlen(sim_flags) - 2);
+                strcat(sim_flags, " ");
+            }
+            break;
+        }
+        if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc) {
+            interval = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-context") == 0 && i + 1 < argc) {
+            context = (unsigned int)strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (interval == 0) {
+        fprintf(stderr, "Error: -interval must be at least 1\n");
+        return 2;
+    }
+
+    Run runs[2] = { { argv[1], argv[2], "a" }, { argv[3], argv[4], "b" } };
+    char flags[COMMAND_SIZE / 4];
+    long long good = -1;
+    unsigned int bad = 0;
+    unsigned int matched = 0;
+    int passes = 1;
+
+    snprintf(flags, sizeof(flags), "%u 0 -trace_window 1 0", interval);
+    int result = hash_pass(runs, flags, sim_flags, &good, &bad, &matched);
+    if (result < 0) {
+        return 2;
+    }
+    if (result == 0) {
+        printf("The runs match: same state every %u cycles and at the end, cycle %u\n", interval, matched);
+        return 0;
+    }
+
+    // Narrow the bracket, each pass hashing SPLIT points between the last match and the first mismatch
+    while (good >= 0 && bad - good > 1) {
+        unsigned int step = (unsigned int)((bad - good + SPLIT - 1) / SPLIT);
+        snprintf(flags, sizeof(flags), "%u %lld -max_cycles %u -trace_window 1 0", step, good, bad);
+        if (hash_pass(runs, flags, sim_flags, &good, &bad, &matched) != 1) {
+            fprintf(stderr, "Error: the runs are not reproducible, the re-run did not diverge before cycle %u\n", bad);
+            return 2;
+        }
+        passes++;
+    }
+    if (good >= 0 && (unsigned int)good == bad) {
+        printf("Both runs reach the same state at cycle %u, but only one of them ends there\n", bad);
+    }
+
+    printf("Found in %d hash passes\n", passes);
+    return report(runs, sim_flags, bad, context) ? 1 : 2;
+}
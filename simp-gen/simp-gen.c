@@ -0,0 +1,1032 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MEM_SIZE 4096
+#define DATA_BASE 2048 //first word of the data region, $gp holds it
+#define MAX_FOOTPRINT (MEM_SIZE - DATA_BASE)
+#define MAX_LENGTH 3000 //leaves room for the leaf functions and the interrupt handler
+#define MAX_LOOP_DEPTH 3 //one counter register per level: $s0, $s1, $s2
+#define MAX_FUNCTIONS 8
+#define MAX_SKIP 4 //instructions a forward branch may jump over
+#define SECTOR_SIZE 128
+#define NUMBER_OF_SECTORS 128
+#define INITIAL_WORDS 32 //.word directives seeding the data region
+#define IMM_MIN -2048
+#define IMM_MAX 2047
+#define OPCODE_HALT 21
+#define PATH_SIZE 1024
+#define COMMAND_SIZE 8192
+
+/*Instruction classes of the mix, also used to count the executed instructions*/
+#define CLASS_ALU 0
+#define CLASS_BRANCH 1
+#define CLASS_MEM 2
+#define CLASS_IO 3
+#define CLASS_CALL 4
+#define CLASS_COUNT 5
+
+/*Fit of the simulator time per instruction class in the run mode*/
+#define FIT_UNKNOWNS (CLASS_COUNT + 1) //the startup cost and one cost per class
+#define FIT_SAMPLES_PER_UNKNOWN 10 //programs that must pass per fitted unknown
+#define FIT_MAX_CONDITION 1e6 //of the scaled normal equations; above it the mixes are too alike to tell the classes apart
+#define FIT_MIN_R2 0.9
+
+
+/*What the generated program may contain*/
+typedef struct Generator_Options{
+    unsigned int seed;
+    int length; //static instructions of the main body
+    int weights[CLASS_COUNT];
+    int mix_given; //-mix was on the command line, the run mode keeps it instead of drawing one per program
+    int loop_depth;
+    int loop_iterations; //each loop runs 1..loop_iterations times
+    int footprint; //data words the program touches, from DATA_BASE
+    int timer_period; //0: no interrupts
+    int disk_commands;
+}Generator_Options;
+
+/*State while one program is written*/
+typedef struct Generator{
+    const Generator_Options* options;
+    FILE* out;
+    unsigned int random;
+    int emitted; //static instructions written so far
+    int labels;
+    int functions;
+    int disk_left;
+}Generator;
+
+/*Result of one program in the run mode*/
+typedef struct Run_Result{
+    unsigned int seed;
+    int ok;
+    unsigned long long counts[CLASS_COUNT]; //executed instructions per class, halt not included
+    unsigned long long cycles;
+    double asm_seconds;
+    double sim_seconds;
+}Run_Result;
+
+
+static const char* class_names[] = { "alu", "branch", "mem", "io", "call" };
+static const char* alu_names[] = { "add", "sub", "mac", "and", "or", "xor", "sll", "sra", "srl" };
+static const char* branch_names[] = { "beq", "bne", "blt", "bgt", "ble", "bge" };
+static const char* data_registers[] = { "$v0", "$a0", "$a1", "$a2", "$t0", "$t1", "$t2" };
+static const char* counter_registers[] = { "$s0", "$s1", "$s2" };
+#define DATA_REGISTER_COUNT 7
+
+
+/*Next xorshift32 value, the same generator the simulator uses for irq2 events*/
+unsigned int next_random(Generator* gen)
+{
+    unsigned int x = gen->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gen->random = x;
+    return x;
+}
+
+
+/*Start the generator from a seed. Consecutive seeds are scrambled first, their first xorshift values would be alike*/
+void seed_random(Generator* gen, unsigned int seed)
+{
+    gen->random = seed * 2654435761u + 0x9E3779B9u;
+    if (gen->random == 0)
+    {
+        gen->random = 1; //xorshift never leaves 0
+    }
+}
+
+
+/*Uniform integer in low..high*/
+int random_range(Generator* gen, int low, int high)
+{
+    return low + (int)(next_random(gen) % (unsigned int)(high - low + 1));
+}
+
+
+/*A register that holds a value the program may read: a data register, $zero or an immediate*/
+const char* random_operand(Generator* gen)
+{
+    int pick = random_range(gen, 0, DATA_REGISTER_COUNT + 2);
+    if (pick < DATA_REGISTER_COUNT)
+    {
+        return data_registers[pick];
+    }
+    return pick == DATA_REGISTER_COUNT ? "$zero" : (pick == DATA_REGISTER_COUNT + 1 ? "$imm1" : "$imm2");
+}
+
+
+/*Write one instruction and count it*/
+void emit(Generator* gen, const char* opcode, const char* rd, const char* rs, const char* rt, const char* rm, int imm1, int imm2)
+{
+    fprintf(gen->out, "%s %s, %s, %s, %s, %d, %d\n", opcode, rd, rs, rt, rm, imm1, imm2);
+    gen->emitted++;
+}
+
+
+/*Same as emit, with a label as the first immediate*/
+void emit_to_label(Generator* gen, const char* opcode, const char* rd, const char* rs, const char* rt, const char* prefix, int label)
+{
+    fprintf(gen->out, "%s %s, %s, %s, $imm1, %s%d, 0\n", opcode, rd, rs, rt, prefix, label);
+    gen->emitted++;
+}
+
+
+/*Arithmetic or logic instruction writing a data register. Shift amounts are immediates in 0..31*/
+void emit_alu(Generator* gen)
+{
+    int op = random_range(gen, 0, 8);
+    const char* rd = data_registers[random_range(gen, 0, DATA_REGISTER_COUNT - 1)];
+
+    if (op >= 6)
+    {
+        emit(gen, alu_names[op], rd, data_registers[random_range(gen, 0, DATA_REGISTER_COUNT - 1)], "$imm1", "$zero", random_range(gen, 0, 31), 0);
+        return;
+    }
+    emit(gen, alu_names[op], rd, random_operand(gen), random_operand(gen), random_operand(gen),
+        random_range(gen, IMM_MIN, IMM_MAX), random_range(gen, IMM_MIN, IMM_MAX));
+}
+
+
+/*lw or sw of a word of the data region*/
+void emit_mem(Generator* gen)
+{
+    const char* reg = data_registers[random_range(gen, 0, DATA_REGISTER_COUNT - 1)];
+    const char* rm = random_range(gen, 0, 3) == 0 ? data_registers[random_range(gen, 0, DATA_REGISTER_COUNT - 1)] : "$zero";
+    int offset = random_range(gen, 0, gen->options->footprint - 1);
+
+    emit(gen, random_range(gen, 0, 1) ? "lw" : "sw", reg, "$gp", "$imm1", rm, offset, 0);
+}
+
+
+/*in from any IO register, or out to the leds, the 7-segment display or one monitor pixel*/
+void emit_io(Generator* gen)
+{
+    const char* reg = data_registers[random_range(gen, 0, DATA_REGISTER_COUNT - 1)];
+
+    switch (random_range(gen, 0, 3))
+    {
+    case 0:
+        emit(gen, "in", reg, "$imm1", "$zero", "$zero", random_range(gen, 0, 23), 0);
+        break;
+    case 1:
+        emit(gen, "out", "$zero", "$imm1", "$zero", reg, 9, 0);
+        break;
+    case 2:
+        emit(gen, "out", "$zero", "$imm1", "$zero", reg, 10, 0);
+        break;
+    default:
+        emit(gen, "out", "$zero", "$imm1", "$zero", "$imm2", 20, random_range(gen, 0, IMM_MAX));
+        emit(gen, "out", "$zero", "$imm1", "$zero", reg, 21, 0);
+        emit(gen, "out", "$zero", "$imm1", "$zero", "$imm2", 22, 1);
+        break;
+    }
+}
+
+
+/*One instruction that does not change the control flow*/
+void emit_straight(Generator* gen, int class)
+{
+    if (class == CLASS_MEM)
+    {
+        emit_mem(gen);
+    }
+    else if (class == CLASS_IO)
+    {
+        emit_io(gen);
+    }
+    else
+    {
+        emit_alu(gen);
+    }
+}
+
+
+/*Pick a class by weight. Without calls allowed, a call becomes an alu instruction*/
+int pick_class(Generator* gen, int allow_calls)
+{
+    const int* weights = gen->options->weights;
+    int total = 0;
+    for (int i = 0; i < CLASS_COUNT; i++)
+    {
+        total += weights[i];
+    }
+    int pick = random_range(gen, 0, total - 1);
+    int class = 0;
+    while (pick >= weights[class])
+    {
+        pick -= weights[class];
+        class++;
+    }
+    return (class == CLASS_CALL && !allow_calls) ? CLASS_ALU : class;
+}
+
+
+/*Forward conditional branch over 1..MAX_SKIP straight instructions*/
+void emit_branch(Generator* gen)
+{
+    int label = gen->labels++;
+    int skip = random_range(gen, 1, MAX_SKIP);
+
+    emit_to_label(gen, branch_names[random_range(gen, 0, 5)], "$zero", random_operand(gen), random_operand(gen), "L", label);
+    for (int i = 0; i < skip; i++)
+    {
+        int class = pick_class(gen, 0);
+        emit_straight(gen, class == CLASS_BRANCH ? CLASS_ALU : class);
+    }
+    fprintf(gen->out, "L%d:\n", label);
+}
+
+
+/*Wait for the disk, then start one DMA read or write between a sector and the data region*/
+void emit_disk(Generator* gen)
+{
+    int wait = gen->labels++;
+    int last_buffer = gen->options->footprint > SECTOR_SIZE ? gen->options->footprint - SECTOR_SIZE : 0;
+
+    fprintf(gen->out, "W%d:\n", wait);
+    emit(gen, "in", "$sp", "$imm1", "$zero", "$zero", 17, 0); //diskstatus
+    emit_to_label(gen, "bne", "$zero", "$sp", "$zero", "W", wait);
+    emit(gen, "out", "$zero", "$imm1", "$zero", "$imm2", 15, random_range(gen, 0, NUMBER_OF_SECTORS - 1));
+    emit(gen, "add", "$sp", "$gp", "$imm1", "$zero", random_range(gen, 0, last_buffer), 0);
+    emit(gen, "out", "$zero", "$imm1", "$zero", "$sp", 16, 0);
+    emit(gen, "out", "$zero", "$imm1", "$zero", "$imm2", 14, random_range(gen, 1, 2));
+    gen->disk_left--;
+}
+
+
+/*Call a leaf function, sometimes a new one*/
+void emit_call(Generator* gen)
+{
+    int function;
+    if (gen->functions < MAX_FUNCTIONS && (gen->functions == 0 || random_range(gen, 0, 2) == 0))
+    {
+        function = gen->functions++;
+    }
+    else
+    {
+        function = random_range(gen, 0, gen->functions - 1);
+    }
+    emit_to_label(gen, "jal", "$ra", "$zero", "$zero", "F", function);
+}
+
+
+/*Write about budget instructions at loop nesting level depth. Loops count down their own counter register,
+  branches only jump forward and calls go to leaf functions, so every block terminates*/
+void generate_block(Generator* gen, int depth, int budget)
+{
+    int end = gen->emitted + budget;
+
+    while (gen->emitted < end)
+    {
+        int left = end - gen->emitted;
+
+        //spread the disk commands over the main body
+        if (gen->disk_left > 0 && random_range(gen, 0, gen->options->length / (gen->options->disk_commands + 1)) == 0)
+        {
+            emit_disk(gen);
+            continue;
+        }
+
+        //a loop needs its setup, at least one body instruction and the count down
+        if (depth < gen->options->loop_depth && left >= 4 && random_range(gen, 0, 7) == 0)
+        {
+            const char* counter = counter_registers[depth];
+            int label = gen->labels++;
+            int body = random_range(gen, 1, left - 3 > 2 ? (left - 3) / 2 : 1);
+
+            emit(gen, "add", counter, "$zero", "$imm1", "$zero", random_range(gen, 1, gen->options->loop_iterations), 0);
+            fprintf(gen->out, "L%d:\n", label);
+            generate_block(gen, depth + 1, body);
+            emit(gen, "sub", counter, counter, "$imm1", "$zero", 1, 0);
+            emit_to_label(gen, "bgt", "$zero", counter, "$zero", "L", label);
+            continue;
+        }
+
+        int class = pick_class(gen, 1);
+        if (class == CLASS_BRANCH)
+        {
+            emit_branch(gen);
+        }
+        else if (class == CLASS_CALL)
+        {
+            emit_call(gen);
+        }
+        else
+        {
+            emit_straight(gen, class);
+        }
+    }
+}
+
+
+/*Write one complete program: setup, main body, halt, the leaf functions and the interrupt handler*/
+void generate_program(const Generator_Options* options, FILE* out)
+{
+    Generator gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.options = options;
+    gen.out = out;
+    seed_random(&gen, options->seed);
+    gen.disk_left = options->disk_commands;
+
+    fprintf(out, "# simp-gen -seed %u -length %d -mix %d,%d,%d,%d,%d -loop-depth %d -loop-iterations %d -footprint %d -interrupts %d -disk %d\n",
+        options->seed, options->length, options->weights[0], options->weights[1], options->weights[2], options->weights[3], options->weights[4],
+        options->loop_depth, options->loop_iterations, options->footprint, options->timer_period, options->disk_commands);
+
+    for (int i = 0; i < INITIAL_WORDS && i < options->footprint; i++)
+    {
+        fprintf(out, ".word %d %d\n", DATA_BASE + random_range(&gen, 0, options->footprint - 1), (int)next_random(&gen));
+    }
+
+    emit(&gen, "sll", "$gp", "$imm1", "$imm2", "$zero", 1, 11); //$gp = DATA_BASE
+    for (int i = 0; i < DATA_REGISTER_COUNT; i++)
+    {
+        emit(&gen, "add", data_registers[i], "$imm1", "$zero", "$zero", random_range(&gen, IMM_MIN, IMM_MAX), 0);
+    }
+    if (options->timer_period > 0)
+    {
+        fprintf(out, "out $zero, $imm1, $zero, $imm2, 6, ISR\n");
+        gen.emitted++;
+        emit(&gen, "out", "$zero", "$imm1", "$zero", "$imm2", 13, options->timer_period);
+        emit(&gen, "out", "$zero", "$imm1", "$zero", "$imm2", 11, 1);
+        emit(&gen, "out", "$zero", "$imm1", "$zero", "$imm2", 0, 1);
+        if (options->disk_commands > 0)
+        {
+            emit(&gen, "out", "$zero", "$imm1", "$zero", "$imm2", 1, 1);
+        }
+    }
+
+    generate_block(&gen, 0, options->length);
+    while (gen.disk_left > 0)
+    {
+        emit_disk(&gen);
+    }
+    emit(&gen, "halt", "$zero", "$zero", "$zero", "$zero", 0, 0);
+
+    //leaf functions: straight code with forward branches, no calls, no loops
+    for (int f = 0; f < gen.functions; f++)
+    {
+        int body = random_range(&gen, 1, 8);
+        fprintf(out, "F%d:\n", f);
+        for (int i = 0; i < body; i++)
+        {
+            int class = pick_class(&gen, 0);
+            if (class == CLASS_BRANCH)
+            {
+                emit_branch(&gen);
+            }
+            else
+            {
+                emit_straight(&gen, class);
+            }
+        }
+        emit(&gen, "beq", "$zero", "$zero", "$zero", "$ra", 0, 0);
+    }
+
+    //a handler of a single reti can never be interrupted in the middle
+    if (options->timer_period > 0)
+    {
+        fprintf(out, "ISR:\n");
+        emit(&gen, "reti", "$zero", "$zero", "$zero", "$zero", 0, 0);
+    }
+}
+
+
+/*Write one program to a file*/
+int generate_file(const Generator_Options* options, const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        return 0;
+    }
+    generate_program(options, file);
+    fclose(file);
+    return 1;
+}
+
+
+/*Parse "-mix alu,branch,mem,io,call". Returns 0 if the weights are not 5 non-negative numbers with alu > 0*/
+int parse_mix(const char* text, int weights[CLASS_COUNT])
+{
+    char* end;
+    for (int i = 0; i < CLASS_COUNT; i++)
+    {
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 0 || value > 1000 || (i < CLASS_COUNT - 1 ? *end != ',' : *end != '\0'))
+        {
+            return 0;
+        }
+        weights[i] = (int)value;
+        text = end + 1;
+    }
+    return weights[CLASS_ALU] > 0; //straight code inside branches and functions falls back to alu
+}
+
+
+/*Parse the generator options at argv[first..last). Returns 0 on an unknown or invalid option*/
+int parse_generator_options(int first, int last, char* argv[], Generator_Options* options)
+{
+    for (int i = first; i < last; i++)
+    {
+        const char* name = argv[i];
+        if (i + 1 >= last)
+        {
+            fprintf(stderr, "Unknown option %s\n", name);
+            return 0;
+        }
+        const char* value = argv[++i];
+
+        if (strcmp(name, "-seed") == 0) {
+            options->seed = (unsigned int)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(name, "-length") == 0) {
+            options->length = atoi(value);
+        }
+        else if (strcmp(name, "-mix") == 0) {
+            if (!parse_mix(value, options->weights)) {
+                fprintf(stderr, "Invalid mix %s, expected alu,branch,mem,io,call weights with alu > 0\n", value);
+                return 0;
+            }
+            options->mix_given = 1;
+        }
+        else if (strcmp(name, "-loop-depth") == 0) {
+            options->loop_depth = atoi(value);
+        }
+        else if (strcmp(name, "-loop-iterations") == 0) {
+            options->loop_iterations = atoi(value);
+        }
+        else if (strcmp(name, "-footprint") == 0) {
+            options->footprint = atoi(value);
+        }
+        else if (strcmp(name, "-interrupts") == 0) {
+            options->timer_period = atoi(value);
+        }
+        else if (strcmp(name, "-disk") == 0) {
+            options->disk_commands = atoi(value);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", name);
+            return 0;
+        }
+    }
+
+    if (options->length < 1 || options->length > MAX_LENGTH) {
+        fprintf(stderr, "-length must be between 1 and %d\n", MAX_LENGTH);
+        return 0;
+    }
+    if (options->loop_depth < 0 || options->loop_depth > MAX_LOOP_DEPTH) {
+        fprintf(stderr, "-loop-depth must be between 0 and %d\n", MAX_LOOP_DEPTH);
+        return 0;
+    }
+    if (options->loop_iterations < 1 || options->loop_iterations > IMM_MAX) {
+        fprintf(stderr, "-loop-iterations must be between 1 and %d\n", IMM_MAX);
+        return 0;
+    }
+    if (options->footprint < 1 || options->footprint > MAX_FOOTPRINT) {
+        fprintf(stderr, "-footprint must be between 1 and %d words\n", MAX_FOOTPRINT);
+        return 0;
+    }
+    if (options->timer_period < 0 || options->timer_period > IMM_MAX) {
+        fprintf(stderr, "-interrupts must be a timer period between 0 (off) and %d\n", IMM_MAX);
+        return 0;
+    }
+    if (options->disk_commands < 0 || options->disk_commands > 64) {
+        fprintf(stderr, "-disk must be between 0 and 64 commands\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*Wall clock in seconds*/
+double now_seconds(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+
+/*Run a shell command, returns its exit status and adds its duration to seconds*/
+int run_command(const char* command, double* seconds)
+{
+    char line[COMMAND_SIZE + 2];
+#ifdef _WIN32
+    snprintf(line, sizeof(line), "\"%s\"", command); //cmd.exe drops the outer quotes
+#else
+    snprintf(line, sizeof(line), "%s", command);
+#endif
+    double start = now_seconds();
+    int status = system(line);
+    *seconds = now_seconds() - start;
+    return status;
+}
+
+
+/*Count the executed instructions of a trace by class. Returns 1 if the last one was halt*/
+int count_trace(const char* filename, unsigned long long counts[CLASS_COUNT])
+{
+    static const int opcode_class[] = { CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU, CLASS_ALU,
+        CLASS_BRANCH, CLASS_BRANCH, CLASS_BRANCH, CLASS_BRANCH, CLASS_BRANCH, CLASS_BRANCH, CLASS_CALL, CLASS_MEM, CLASS_MEM,
+        CLASS_IO, CLASS_IO, CLASS_IO };
+    char line[512];
+    int last = -1;
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        //"PPP IIIIIIIIIIII R0 ... R15": the opcode is the first two hex digits of the instruction
+        char* instruction = strchr(line, ' ');
+        if (instruction == NULL)
+        {
+            continue;
+        }
+        char opcode_text[3] = { instruction[1], instruction[2], '\0' };
+        last = (int)strtol(opcode_text, NULL, 16);
+        if (last >= 0 && last < OPCODE_HALT)
+        {
+            counts[opcode_class[last]]++;
+        }
+    }
+    fclose(file);
+    return last == OPCODE_HALT;
+}
+
+
+/*Checks if the simulator reported an error, which a correct program never causes*/
+int log_has_errors(const char* filename)
+{
+    char line[512];
+    int found = 0;
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+    {
+        return 1;
+    }
+    while (!found && fgets(line, sizeof(line), file) != NULL)
+    {
+        found = strstr(line, "Error") != NULL;
+    }
+    fclose(file);
+    return found;
+}
+
+
+/*Create an empty file*/
+int touch_file(const char* filename)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        return 0;
+    }
+    fclose(file);
+    return 1;
+}
+
+
+/*Generate one program, assemble it, simulate it and check the outputs*/
+void run_program(const Generator_Options* options, const char* asm_path, const char* sim_path, const char* dir,
+    char* sim_flags, Run_Result* result)
+{
+    char source[PATH_SIZE], trace[PATH_SIZE], log[PATH_SIZE], cycles[PATH_SIZE], command[COMMAND_SIZE];
+    const char* status = "ok";
+
+    memset(result, 0, sizeof(*result));
+    result->seed = options->seed;
+    snprintf(source, sizeof(source), "%s/gen.asm", dir);
+    snprintf(trace, sizeof(trace), "%s/trace.txt", dir);
+    snprintf(log, sizeof(log), "%s/sim.log", dir);
+    snprintf(cycles, sizeof(cycles), "%s/cycles.txt", dir);
+    remove(trace);
+    remove(cycles);
+
+    if (!generate_file(options, source)) {
+        status = "generate_failed";
+    }
+    else {
+        snprintf(command, sizeof(command), "\"%s\" \"%s/gen.asm\" \"%s/imemin.txt\" \"%s/dmemin.txt\" > \"%s/asm.log\" 2>&1",
+            asm_path, dir, dir, dir, dir);
+        if (run_command(command, &result->asm_seconds) != 0) {
+            status = "asm_failed";
+        }
+        else {
+            const char* d = dir;
+            snprintf(command, sizeof(command), "\"%s\" \"%s/imemin.txt\" \"%s/dmemin.txt\" \"%s/diskin.txt\" \"%s/irq2in.txt\" \"%s/dmemout.txt\" "
+                "\"%s/regout.txt\" \"%s/trace.txt\" \"%s/hwregtrace.txt\" \"%s/cycles.txt\" \"%s/leds.txt\" \"%s/display7seg.txt\" "
+                "\"%s/diskout.txt\" \"%s/monitor.txt\" \"%s/monitor.yuv\" %s > \"%s/sim.log\" 2>&1",
+                sim_path, d, d, d, d, d, d, d, d, d, d, d, d, d, d, sim_flags, d);
+            if (run_command(command, &result->sim_seconds) != 0) {
+                status = "sim_failed";
+            }
+            else if (log_has_errors(log)) {
+                status = "sim_error";
+            }
+            else if (!count_trace(trace, result->counts)) {
+                status = "no_halt";
+            }
+        }
+    }
+
+    FILE* file = fopen(cycles, "r");
+    if (file != NULL) {
+        if (fscanf(file, "%llu", &result->cycles) != 1) {
+            result->cycles = 0;
+        }
+        fclose(file);
+    }
+
+    result->ok = strcmp(status, "ok") == 0;
+    if (!result->ok) {
+        //keep the program so the failure can be reproduced
+        char kept[PATH_SIZE];
+        snprintf(kept, sizeof(kept), "%s/fail_%u.asm", dir, options->seed);
+        remove(kept);
+        rename(source, kept);
+    }
+
+    unsigned long long total = 0;
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        total += result->counts[c];
+    }
+    printf("%u,%d,%d,%d,%d,%d,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%s\n", options->seed, options->weights[0], options->weights[1],
+        options->weights[2], options->weights[3], options->weights[4], total, result->cycles, result->counts[CLASS_ALU],
+        result->counts[CLASS_BRANCH], result->counts[CLASS_MEM], result->counts[CLASS_IO], result->counts[CLASS_CALL],
+        result->asm_seconds * 1000, result->sim_seconds * 1000, status);
+    fflush(stdout);
+}
+
+
+/*Solve the n x n system a x = b in place by Gaussian elimination. Returns 0 if it is singular*/
+int solve(double a[FIT_UNKNOWNS][FIT_UNKNOWNS], double b[FIT_UNKNOWNS], int n)
+{
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+        for (int row = col + 1; row < n; row++)
+        {
+            if (fabs(a[row][col]) > fabs(a[pivot][col]))
+            {
+                pivot = row;
+            }
+        }
+        if (fabs(a[pivot][col]) < 1e-9)
+        {
+            return 0;
+        }
+        for (int k = 0; k < n; k++)
+        {
+            double swap = a[col][k];
+            a[col][k] = a[pivot][k];
+            a[pivot][k] = swap;
+        }
+        double swap = b[col];
+        b[col] = b[pivot];
+        b[pivot] = swap;
+
+        for (int row = 0; row < n; row++)
+        {
+            if (row == col)
+            {
+                continue;
+            }
+            double factor = a[row][col] / a[col][col];
+            for (int k = col; k < n; k++)
+            {
+                a[row][k] -= factor * a[col][k];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+    for (int i = 0; i < n; i++)
+    {
+        b[i] /= a[i][i];
+    }
+    return 1;
+}
+
+
+/*1-norm condition number of the normal equations scaled to a unit diagonal, HUGE_VAL if they are singular*/
+double condition_number(double a[FIT_UNKNOWNS][FIT_UNKNOWNS])
+{
+    double scale[FIT_UNKNOWNS];
+    for (int i = 0; i < FIT_UNKNOWNS; i++) {
+        if (a[i][i] <= 0) {
+            return HUGE_VAL; //a class no program executed
+        }
+        scale[i] = 1 / sqrt(a[i][i]);
+    }
+
+    double norm = 0, inverse_norm = 0;
+    for (int col = 0; col < FIT_UNKNOWNS; col++) {
+        double m[FIT_UNKNOWNS][FIT_UNKNOWNS], e[FIT_UNKNOWNS];
+        double sum = 0, inverse_sum = 0;
+        for (int r = 0; r < FIT_UNKNOWNS; r++) {
+            for (int c = 0; c < FIT_UNKNOWNS; c++) {
+                m[r][c] = a[r][c] * scale[r] * scale[c];
+            }
+            e[r] = r == col;
+            sum += fabs(m[r][col]);
+        }
+        if (!solve(m, e, FIT_UNKNOWNS)) {
+            return HUGE_VAL;
+        }
+        for (int r = 0; r < FIT_UNKNOWNS; r++) {
+            inverse_sum += fabs(e[r]); //column col of the inverse
+        }
+        norm = fmax(norm, sum);
+        inverse_norm = fmax(inverse_norm, inverse_sum);
+    }
+    return norm * inverse_norm;
+}
+
+
+/*Solve the normal equations a x = b restricted to the passive unknowns, the others are 0*/
+int solve_passive(double a[FIT_UNKNOWNS][FIT_UNKNOWNS], double b[FIT_UNKNOWNS], const int passive[FIT_UNKNOWNS], double x[FIT_UNKNOWNS])
+{
+    double m[FIT_UNKNOWNS][FIT_UNKNOWNS], v[FIT_UNKNOWNS];
+    int index[FIT_UNKNOWNS], n = 0;
+    for (int i = 0; i < FIT_UNKNOWNS; i++) {
+        if (passive[i]) {
+            index[n++] = i;
+        }
+    }
+    for (int r = 0; r < n; r++) {
+        for (int c = 0; c < n; c++) {
+            m[r][c] = a[index[r]][index[c]];
+        }
+        v[r] = b[index[r]];
+    }
+    if (!solve(m, v, n)) {
+        return 0;
+    }
+    for (int i = 0; i < FIT_UNKNOWNS; i++) {
+        x[i] = 0;
+    }
+    for (int r = 0; r < n; r++) {
+        x[index[r]] = v[r];
+    }
+    return 1;
+}
+
+
+/*Least squares with x >= 0 from the normal equations a x = b (Lawson-Hanson active set). Returns 0 if a subproblem is singular*/
+int solve_nonnegative(double a[FIT_UNKNOWNS][FIT_UNKNOWNS], double b[FIT_UNKNOWNS], double x[FIT_UNKNOWNS])
+{
+    int passive[FIT_UNKNOWNS] = { 0 };
+    for (int i = 0; i < FIT_UNKNOWNS; i++) {
+        x[i] = 0;
+    }
+
+    for (int iteration = 0; iteration < 3 * FIT_UNKNOWNS; iteration++) {
+        //the unknown held at 0 whose increase lowers the residual the most becomes free
+        int enter = -1;
+        double steepest = 0;
+        for (int i = 0; i < FIT_UNKNOWNS; i++) {
+            double gradient = b[i];
+            for (int j = 0; j < FIT_UNKNOWNS; j++) {
+                gradient -= a[i][j] * x[j];
+            }
+            if (!passive[i] && gradient > steepest) {
+                steepest = gradient;
+                enter = i;
+            }
+        }
+        if (enter < 0) {
+            return 1;
+        }
+        passive[enter] = 1;
+
+        for (;;) {
+            double z[FIT_UNKNOWNS];
+            if (!solve_passive(a, b, passive, z)) {
+                return 0;
+            }
+            //move towards the unconstrained solution, stopping where the first free unknown reaches 0
+            double step = 1;
+            for (int i = 0; i < FIT_UNKNOWNS; i++) {
+                if (passive[i] && z[i] <= 0) {
+                    step = fmin(step, x[i] / (x[i] - z[i]));
+                }
+            }
+            for (int i = 0; i < FIT_UNKNOWNS; i++) {
+                x[i] += step * (z[i] - x[i]);
+            }
+            if (step == 1) {
+                break;
+            }
+            for (int i = 0; i < FIT_UNKNOWNS; i++) {
+                if (passive[i] && x[i] <= 1e-15) {
+                    passive[i] = 0;
+                    x[i] = 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+
+/*Totals of the run and the simulator time per instruction class: a non-negative least-squares fit of
+  sim_seconds = startup + sum(count[class] * cost[class]) over the programs that passed, reported only when
+  there are enough programs, their mixes separate the classes and the fit explains the times*/
+void write_summary(Run_Result* results, int count)
+{
+    double a[FIT_UNKNOWNS][FIT_UNKNOWNS] = { { 0 } };
+    double b[FIT_UNKNOWNS] = { 0 };
+    unsigned long long instructions = 0;
+    double sim_seconds = 0;
+    int passed = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (!results[i].ok) {
+            continue;
+        }
+        double x[FIT_UNKNOWNS];
+        x[0] = 1; //startup
+        for (int c = 0; c < CLASS_COUNT; c++) {
+            x[c + 1] = (double)results[i].counts[c] / 1e6; //millions, keeps the normal equations well scaled
+            instructions += results[i].counts[c];
+        }
+        for (int r = 0; r < FIT_UNKNOWNS; r++) {
+            for (int c = 0; c < FIT_UNKNOWNS; c++) {
+                a[r][c] += x[r] * x[c];
+            }
+            b[r] += x[r] * results[i].sim_seconds;
+        }
+        sim_seconds += results[i].sim_seconds;
+        passed++;
+    }
+
+    fprintf(stderr, "%d programs, %d passed, %d failed\n", count, passed, count - passed);
+    if (passed == 0) {
+        return;
+    }
+    fprintf(stderr, "%llu instructions in %.3f s of simulation: %.2f MIPS\n", instructions, sim_seconds,
+        sim_seconds > 0 ? instructions / sim_seconds / 1e6 : 0.0);
+
+    if (passed < FIT_SAMPLES_PER_UNKNOWN * FIT_UNKNOWNS) {
+        fprintf(stderr, "Cost per class not fitted: %d programs passed, the fit needs %d\n", passed, FIT_SAMPLES_PER_UNKNOWN * FIT_UNKNOWNS);
+        return;
+    }
+    double condition = condition_number(a);
+    double cost[FIT_UNKNOWNS];
+    if (condition > FIT_MAX_CONDITION || !solve_nonnegative(a, b, cost)) {
+        fprintf(stderr, "Cost per class not fitted: the mixes do not separate the classes (condition number %.3g, limit %.0e)\n",
+            condition, FIT_MAX_CONDITION);
+        return;
+    }
+
+    //how much of the spread of the times the fit explains
+    double mean = sim_seconds / passed, residual = 0, spread = 0;
+    for (int i = 0; i < count; i++) {
+        if (!results[i].ok) {
+            continue;
+        }
+        double fitted = cost[0];
+        for (int c = 0; c < CLASS_COUNT; c++) {
+            fitted += (double)results[i].counts[c] / 1e6 * cost[c + 1];
+        }
+        residual += (results[i].sim_seconds - fitted) * (results[i].sim_seconds - fitted);
+        spread += (results[i].sim_seconds - mean) * (results[i].sim_seconds - mean);
+    }
+    double r2 = spread > 0 ? 1 - residual / spread : 0;
+    fprintf(stderr, "fit: R^2 %.4f, residual %.3f ms RMS, condition number %.3g\n", r2, sqrt(residual / passed) * 1000, condition);
+    if (r2 < FIT_MIN_R2) {
+        fprintf(stderr, "Cost per class not reported: R^2 below %.2f, the times are dominated by noise\n", FIT_MIN_R2);
+        return;
+    }
+    fprintf(stderr, "fitted startup: %.3f ms\n", cost[0] * 1000);
+    for (int c = 0; c < CLASS_COUNT; c++) {
+        fprintf(stderr, "fitted %-6s: %.2f ns per instruction\n", class_names[c], cost[c + 1] * 1000); //seconds per million = us, * 1000 = ns
+    }
+}
+
+
+/*Generate count programs from consecutive seeds and run each through the assembler and the simulator.
+  Without -mix every program draws its own mix, so the per-class cost can be fitted*/
+int run_mode(int argc, char* argv[], Generator_Options* options)
+{
+    int count = atoi(argv[2]);
+    const char* asm_path = argv[3];
+    const char* sim_path = argv[4];
+    const char* dir = argv[5];
+    char sim_flags[COMMAND_SIZE / 2] = "";
+    char path[PATH_SIZE];
+    int last = argc;
+
+    //everything after "--" goes to the simulator
+    for (int i = 6; i < argc; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            last = i;
+            for (int j = i + 1; j < argc; j++) {
+                strncat(sim_flags, argv[j], sizeof(sim_flags) - strlen(sim_flags) - 2);
+                strcat(sim_flags, " ");
+            }
+            break;
+        }
+    }
+    if (count < 1 || !parse_generator_options(6, last, argv, options)) {
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/diskin.txt", dir);
+    if (!touch_file(path)) {
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/irq2in.txt", dir);
+    if (!touch_file(path)) {
+        return 1;
+    }
+
+    Run_Result* results = (Run_Result*)calloc(count, sizeof(Run_Result));
+    if (results == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    Generator mixer;
+    memset(&mixer, 0, sizeof(mixer));
+    seed_random(&mixer, ~options->seed); //not the same sequence as the first program
+
+    printf("seed,w_alu,w_branch,w_mem,w_io,w_call,instructions,cycles,alu,branch,mem,io,call,asm_ms,sim_ms,status\n");
+    int failed = 0;
+    unsigned int first_seed = options->seed;
+    for (int i = 0; i < count; i++) {
+        Generator_Options program = *options;
+        program.seed = first_seed + i;
+        if (!options->mix_given) {
+            program.weights[CLASS_ALU] = random_range(&mixer, 1, 9);
+            for (int c = 1; c < CLASS_COUNT; c++) {
+                program.weights[c] = random_range(&mixer, 0, 9);
+            }
+        }
+        run_program(&program, asm_path, sim_path, dir, sim_flags, &results[i]);
+        failed += !results[i].ok;
+    }
+
+    write_summary(results, count);
+    free(results);
+    return failed != 0;
+}
+
+
+/*Generate random SIMP programs that always halt, to feed the assembler and the simulator with more paths than the
+  examples take, or run batches of them to measure the simulator per instruction class*/
+int main(int argc, char* argv[]){
+
+    Generator_Options options;
+    memset(&options, 0, sizeof(options));
+    options.seed = 1;
+    options.length = 200;
+    options.weights[CLASS_ALU] = 6;
+    options.weights[CLASS_BRANCH] = 2;
+    options.weights[CLASS_MEM] = 3;
+    options.weights[CLASS_IO] = 1;
+    options.weights[CLASS_CALL] = 1;
+    options.loop_depth = 2;
+    options.loop_iterations = 8;
+    options.footprint = 256;
+
+    if (argc >= 6 && strcmp(argv[1], "-run") == 0) {
+        return run_mode(argc, argv, &options);
+    }
+
+    if (argc < 2 || argv[1][0] == '-' || argc % 2 != 0) {
+        fprintf(stderr, "Usage: %s <output.asm> [options]\n", argv[0]);
+        fprintf(stderr, "       %s -run <count> <asm> <sim> <workdir> [options] [-- simulator options]\n", argv[0]);
+        fprintf(stderr, "Options: -seed N -length N -mix alu,branch,mem,io,call -loop-depth 0-%d -loop-iterations N\n", MAX_LOOP_DEPTH);
+        fprintf(stderr, "         -footprint WORDS -interrupts TIMER_PERIOD -disk COMMANDS\n");
+        return 1;
+    }
+
+    if (!parse_generator_options(2, argc, argv, &options)) {
+        return 1;
+    }
+    return generate_file(&options, argv[1]) ? 0 : 1;
+}
@@ -0,0 +1,439 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define CMD_MEM_LINES_SIZE 4096
+#define HEX_INSTRUCTION_LENGTH 12
+#define HEX_DATA_LENGTH 8
+#define IMM_LENGTH 3
+#define IMM_OFFSET 6 //first hex digit of immediate1 in an encoded command
+#define TABLE_MIN_CAPACITY 64
+
+
+/*One relocatable object written by "asm -c"*/
+typedef struct Object{
+    const char* filename;
+    char* text; //the whole file, names and code lines point into it
+    int base; //address of the first command after linking
+    char* code; //first encoded command
+    int code_count;
+    char* data; //first .word record
+    int data_count;
+    char* exports; //first EXPORT record
+    int export_count;
+    char* relocations; //first RELOC record
+    int relocation_count;
+}Object;
+
+/*An exported label of the linked program*/
+typedef struct Symbol{
+    const char* name; //NULL marks an empty slot
+    int len;
+    unsigned int hash;
+    int value; //final address
+    int object; //index of the defining object, for error messages
+}Symbol;
+
+typedef struct Symbol_Table{
+    Symbol* slots;
+    int capacity; //always a power of two
+    int count;
+}Symbol_Table;
+
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+
+/*FNV-1a hash of a name*/
+unsigned int hash_name(const char* name, int len)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < len; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+
+/*Create an empty table with room for at least expected entries*/
+void table_init(Symbol_Table* table, int expected)
+{
+    int capacity = TABLE_MIN_CAPACITY;
+    while (capacity < expected * 2)
+    {
+        capacity *= 2;
+    }
+    table->slots = (Symbol*)calloc(capacity, sizeof(Symbol));
+    if (table->slots == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    table->capacity = capacity;
+    table->count = 0;
+}
+
+
+/*Find the slot of a name: either the matching entry or the empty slot where it belongs*/
+Symbol* table_slot(Symbol_Table* table, const char* name, int len)
+{
+    unsigned int hash = hash_name(name, len);
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = hash & mask;
+    while (table->slots[i].name != NULL)
+    {
+        Symbol* slot = &table->slots[i];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->name, name, len) == 0)
+        {
+            return slot;
+        }
+        i = (i + 1) & mask; //linear probing
+    }
+    table->slots[i].hash = hash;
+    return &table->slots[i];
+}
+
+
+/*Length of the name at p, up to the next blank*/
+int name_length(const char* p)
+{
+    int len = 0;
+    while (p[len] != '\0' && p[len] != ' ' && p[len] != '\t' && p[len] != '\r' && p[len] != '\n')
+    {
+        len++;
+    }
+    return len;
+}
+
+
+/*Move to the start of the next line, returns NULL at the end of the text*/
+char* next_line(char* p)
+{
+    char* end = strchr(p, '\n');
+    return end != NULL ? end + 1 : NULL;
+}
+
+
+/*Read the "<keyword> <count>" header of a section and move past it. Returns 0 if the header is missing*/
+int read_section(char** p, const char* keyword, int* count)
+{
+    size_t len = strlen(keyword);
+    if (*p == NULL || strncmp(*p, keyword, len) != 0 || sscanf(*p + len, "%d", count) != 1 || *count < 0)
+    {
+        return 0;
+    }
+    *p = next_line(*p);
+    return 1;
+}
+
+
+/*Skip count lines, returns NULL if the text ends first*/
+char* skip_lines(char* p, int count)
+{
+    for (int i = 0; i < count && p != NULL; i++)
+    {
+        p = next_line(p);
+    }
+    return p;
+}
+
+
+/*Read an object file and find its sections. The records are parsed later, in place*/
+int load_object(Object* object, const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error openning file %s\n", filename);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    object->filename = filename;
+    object->text = (char*)malloc(length > 0 ? (size_t)length + 1 : 1);
+    if (object->text == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    size_t size = fread(object->text, 1, length > 0 ? (size_t)length : 0, file);
+    object->text[size] = '\0';
+    fclose(file);
+
+    char* p = object->text;
+    if (strncmp(p, "SIMPOBJ 1", 9) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a SIMP object file\n", filename);
+        return 0;
+    }
+    p = next_line(p);
+
+    int ok = read_section(&p, "CODE", &object->code_count);
+    object->code = p;
+    p = ok ? skip_lines(p, object->code_count) : NULL;
+    ok = ok && read_section(&p, "DATA", &object->data_count);
+    object->data = p;
+    p = ok ? skip_lines(p, object->data_count) : NULL;
+    ok = ok && read_section(&p, "EXPORT", &object->export_count);
+    object->exports = p;
+    p = ok ? skip_lines(p, object->export_count) : NULL;
+    ok = ok && read_section(&p, "RELOC", &object->relocation_count);
+    object->relocations = p;
+    if (!ok || (object->relocation_count > 0 && skip_lines(p, object->relocation_count - 1) == NULL))
+    {
+        fprintf(stderr, "Error: %s is truncated or damaged\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*Collect the exported labels of every object with their final addresses. Returns 0 on a duplicate*/
+int collect_exports(Object* objects, int count, Symbol_Table* table)
+{
+    int ok = 1;
+    for (int i = 0; i < count; i++)
+    {
+        char* p = objects[i].exports;
+        for (int j = 0; j < objects[i].export_count; j++, p = next_line(p))
+        {
+            int len = name_length(p);
+            int address;
+            if (sscanf(p + len, "%d", &address) != 1)
+            {
+                fprintf(stderr, "Error: Bad export record in %s\n", objects[i].filename);
+                return 0;
+            }
+            if ((table->count + 1) * 10 > table->capacity * 7) //keep the load factor under 70%
+            {
+                Symbol* old_slots = table->slots;
+                int old_capacity = table->capacity;
+                table_init(table, old_capacity);
+                for (int k = 0; k < old_capacity; k++)
+                {
+                    if (old_slots[k].name != NULL)
+                    {
+                        *table_slot(table, old_slots[k].name, old_slots[k].len) = old_slots[k];
+                        table->count++;
+                    }
+                }
+                free(old_slots);
+            }
+            Symbol* symbol = table_slot(table, p, len);
+            if (symbol->name != NULL)
+            {
+                fprintf(stderr, "Error: Symbol %.*s exported by %s and %s\n", len, p, objects[symbol->object].filename, objects[i].filename);
+                ok = 0;
+                continue;
+            }
+            symbol->name = p;
+            symbol->len = len;
+            symbol->value = objects[i].base + address;
+            symbol->object = i;
+            table->count++;
+        }
+    }
+    return ok;
+}
+
+
+/*Value of the 3 hex digits at p*/
+int read_immediate(const char* p)
+{
+    int value = 0;
+    for (int i = 0; i < IMM_LENGTH; i++)
+    {
+        char c = p[i];
+        value = value * 16 + (c >= 'A' ? c - 'A' + 10 : c - '0');
+    }
+    return value;
+}
+
+
+/*Write value as 3 hex digits*/
+void put_immediate(char* out, int value)
+{
+    for (int i = IMM_LENGTH - 1; i >= 0; i--)
+    {
+        out[i] = hex_digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+
+/*Copy the code of one object to its place in the output and apply its relocations*/
+int link_code(Object* object, Symbol_Table* table, char* imem)
+{
+    char* out = imem + (size_t)object->base * (HEX_INSTRUCTION_LENGTH + 1);
+    char* p = object->code;
+    for (int i = 0; i < object->code_count; i++, p = next_line(p))
+    {
+        memcpy(out + (size_t)i * (HEX_INSTRUCTION_LENGTH + 1), p, HEX_INSTRUCTION_LENGTH);
+        out[(size_t)i * (HEX_INSTRUCTION_LENGTH + 1) + HEX_INSTRUCTION_LENGTH] = '\n';
+    }
+
+    int ok = 1;
+    p = object->relocations;
+    for (int i = 0; i < object->relocation_count; i++, p = next_line(p))
+    {
+        int command, field, offset;
+        if (sscanf(p, "%d %d %n", &command, &field, &offset) != 2 || command < 0 || command >= object->code_count || field < 0 || field > 1)
+        {
+            fprintf(stderr, "Error: Bad relocation record in %s\n", object->filename);
+            return 0;
+        }
+        char* immediate = out + (size_t)command * (HEX_INSTRUCTION_LENGTH + 1) + IMM_OFFSET + field * IMM_LENGTH;
+        char* name = p + offset;
+        int len = name_length(name);
+
+        if (len == 1 && name[0] == '.') //a label of this object: move it by the object base
+        {
+            put_immediate(immediate, (read_immediate(immediate) + object->base) & 0xFFF);
+            continue;
+        }
+        Symbol* symbol = table_slot(table, name, len);
+        if (symbol->name == NULL)
+        {
+            fprintf(stderr, "Error: Undefined symbol %.*s (%s)\n", len, name, object->filename);
+            ok = 0;
+            continue;
+        }
+        put_immediate(immediate, symbol->value & 0xFFF);
+    }
+    return ok;
+}
+
+
+/*Place the .word records of every object in one data memory image. Returns the last relevant line*/
+int link_data(Object* objects, int count, int dmem[CMD_MEM_LINES_SIZE])
+{
+    static int owner[CMD_MEM_LINES_SIZE]; //object that wrote each word + 1, 0 if none
+    int last_line = 0;
+    memset(owner, 0, sizeof(owner));
+    for (int i = 0; i < count; i++)
+    {
+        char* p = objects[i].data;
+        for (int j = 0; j < objects[i].data_count; j++, p = next_line(p))
+        {
+            unsigned int address, value;
+            if (sscanf(p, "%x %x", &address, &value) != 2 || address >= CMD_MEM_LINES_SIZE)
+            {
+                fprintf(stderr, "Error: Bad data record in %s\n", objects[i].filename);
+                return -1;
+            }
+            if (owner[address] != 0 && owner[address] != i + 1 && dmem[address] != (int)value)
+            {
+                fprintf(stderr, "Warning: .word %u is set by %s and %s, the last one is kept\n",
+                    address, objects[owner[address] - 1].filename, objects[i].filename);
+            }
+            dmem[address] = (int)value;
+            owner[address] = i + 1;
+            if (last_line < (int)address)
+            {
+                last_line = (int)address;
+            }
+        }
+    }
+    return last_line;
+}
+
+
+/*Write a buffer to a file with a single write*/
+int write_output(const char* filename, const char* buffer, size_t size)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        printf("Error openning file %s", filename);
+        return 0;
+    }
+    fwrite(buffer, 1, size, file);
+    fclose(file);
+    return 1;
+}
+
+
+/*Link relocatable SIMP objects into imemin/dmemin. The objects are placed one after the other in the order
+  given, so the first one holds the entry point at address 0. Only the objects are read, modules that did not
+  change are not assembled again*/
+int main(int argc, char* argv[]){
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <output.imemin> <output.dmemin> <input.obj> [input.obj ...]\n", argv[0]);
+        return 1;
+    }
+
+    int count = argc - 3;
+    Object* objects = (Object*)calloc(count, sizeof(Object));
+    if (objects == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    int total = 0;
+    int exports = 0;
+    for (int i = 0; i < count; i++) {
+        if (!load_object(&objects[i], argv[3 + i])) {
+            return 1;
+        }
+        objects[i].base = total;
+        total += objects[i].code_count;
+        exports += objects[i].export_count;
+    }
+    if (total > CMD_MEM_LINES_SIZE) {
+        fprintf(stderr, "Warning: %d instructions do not fit in the %d-line instruction memory\n", total, CMD_MEM_LINES_SIZE);
+    }
+
+    Symbol_Table table;
+    table_init(&table, exports);
+    if (!collect_exports(objects, count, &table)) {
+        return 1;
+    }
+
+    char* imem = (char*)malloc((size_t)total * (HEX_INSTRUCTION_LENGTH + 1) + 1);
+    if (imem == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    int ok = 1;
+    for (int i = 0; i < count; i++) {
+        ok = link_code(&objects[i], &table, imem) && ok;
+    }
+    if (!ok) {
+        return 1;
+    }
+
+    static int dmem[CMD_MEM_LINES_SIZE];
+    int data_lines = link_data(objects, count, dmem) + 1;
+    if (data_lines == 0) {
+        return 1;
+    }
+    char* data = (char*)malloc((size_t)data_lines * (HEX_DATA_LENGTH + 1));
+    if (data == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < data_lines; i++) {
+        snprintf(data + (size_t)i * (HEX_DATA_LENGTH + 1), HEX_DATA_LENGTH + 1, "%08X", (unsigned int)dmem[i]);
+        data[(size_t)i * (HEX_DATA_LENGTH + 1) + HEX_DATA_LENGTH] = '\n';
+    }
+
+    //no newline after the last line, like the assembler
+    size_t imem_size = total ? (size_t)total * (HEX_INSTRUCTION_LENGTH + 1) - 1 : 0;
+    if (!write_output(argv[1], imem, imem_size) || !write_output(argv[2], data, (size_t)data_lines * (HEX_DATA_LENGTH + 1) - 1)) {
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(objects[i].text);
+    }
+    free(objects);
+    free(table.slots);
+    free(imem);
+    free(data);
+    return 0;
+}
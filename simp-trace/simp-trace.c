@@ -0,0 +1,239 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define REG_NUM 16
+#define HEX_INSTRUCTION_LENGTH 12
+#define IMM1_OFFSET 6 //first hex digit of immediate1 in an encoded command
+#define IMM2_OFFSET 9
+#define LINE_SIZE 512
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+
+/*
+    Decodes a trace written by "sim ... -trace_delta N" back into the trace.txt format:
+    "<PC> <instruction> " followed by the 16 registers as "%08X ", one line per cycle.
+
+    Input format (see trace_delta_open in sim/sim/output.c):
+    - "SMTD <interval>" header.
+    - "K <full trace line>" keyframe on lines 0, interval, 2 * interval, ...
+    - "<PC> <instruction> <r>=<value> ..." on the other lines, listing the registers
+      that changed since the previous line; $imm1/$imm2 default to the immediates
+      of the instruction.
+    With -from the decoder skips to the keyframe at or before the requested line
+    without parsing the lines in between, so a window of a long trace is cheap.
+*/
+
+
+/*Decoder position: the registers of the last decoded line*/
+typedef struct Trace_State{
+    int registers[REG_NUM];
+    int has_keyframe;
+}Trace_State;
+
+
+/*Value of a hex digit, -1 if it is not one*/
+int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*Sign-extended 12-bit immediate whose 3 hex digits start at offset*/
+int immediate_of(const char* instruction, int offset)
+{
+    int value = 0;
+    for (int i = offset; i < offset + 3; i++) {
+        value = value * 16 + hex_value(instruction[i]);
+    }
+    return value >= 0x800 ? value - 0x1000 : value;
+}
+
+/*Parses "<PC> <instruction>" at the start of a line. Returns a pointer past it, NULL if malformed.*/
+const char* parse_prefix(const char* line, unsigned int* pc, char instruction[HEX_INSTRUCTION_LENGTH + 1])
+{
+    char* end;
+    *pc = (unsigned int)strtoul(line, &end, 16);
+    if (end == line || *end != ' ') {
+        return NULL;
+    }
+    end++;
+    for (int i = 0; i < HEX_INSTRUCTION_LENGTH; i++) {
+        if (hex_value(end[i]) < 0) {
+            return NULL;
+        }
+        instruction[i] = end[i];
+    }
+    instruction[HEX_INSTRUCTION_LENGTH] = '\0';
+    return end + HEX_INSTRUCTION_LENGTH;
+}
+
+/*Decodes one keyframe or delta line into state. Returns 0 if it is malformed.*/
+int decode_line(const char* line, Trace_State* state, unsigned int* pc, char instruction[HEX_INSTRUCTION_LENGTH + 1])
+{
+    const char* rest;
+    char* end;
+
+    if (line[0] == 'K' && line[1] == ' ') {
+        rest = parse_prefix(line + 2, pc, instruction);
+        if (rest == NULL) {
+            return 0;
+        }
+        for (int i = 0; i < REG_NUM; i++) {
+            state->registers[i] = (int)strtoul(rest, &end, 16);
+            if (end == rest) {
+                return 0;
+            }
+            rest = end;
+        }
+        state->has_keyframe = 1;
+        return 1;
+    }
+
+    if (!state->has_keyframe) {
+        return 0;
+    }
+    rest = parse_prefix(line, pc, instruction);
+    if (rest == NULL) {
+        return 0;
+    }
+    state->registers[1] = immediate_of(instruction, IMM1_OFFSET);
+    state->registers[2] = immediate_of(instruction, IMM2_OFFSET);
+    while (*rest == ' ') {
+        int reg = hex_value(rest[1]);
+        if (reg < 0 || rest[2] != '=') {
+            return 0;
+        }
+        state->registers[reg] = (int)strtoul(rest + 3, &end, 16);
+        if (end == rest + 3) {
+            return 0;
+        }
+        rest = end;
+    }
+    return *rest == '\n' || *rest == '\r' || *rest == '\0';
+}
+
+/*Appends the trace.txt line of the decoded state to buffer. Returns its length.*/
+int format_line(char* buffer, unsigned int pc, const char* instruction, const int registers[REG_NUM])
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    int length = sprintf(buffer, "%03X %s ", pc, instruction);
+
+    for (int i = 0; i < REG_NUM; i++) {
+        unsigned int value = (unsigned int)registers[i];
+        for (int digit = 7; digit >= 0; digit--) {
+            buffer[length + 7 - digit] = hex_digits[(value >> (digit * 4)) & 0xF];
+        }
+        buffer[length + 8] = ' ';
+        length += 9;
+    }
+    buffer[length++] = '\n';
+    return length;
+}
+
+/*Decodes lines first .. first + count - 1 (count < 0: to the end) of input into output*/
+int decode_trace(FILE* input, FILE* output, unsigned long long first, long long count)
+{
+    char line[LINE_SIZE];
+    unsigned int interval;
+
+    if (!fgets(line, sizeof(line), input) || sscanf(line, "SMTD %u", &interval) != 1 || interval == 0) {
+        fprintf(stderr, "Error: not a delta trace (missing SMTD header)\n");
+        return 0;
+    }
+
+    // Skip to the keyframe at or before the first requested line
+    unsigned long long keyframe = first - first % interval;
+    unsigned long long index = 0;
+    for (; index < keyframe; index++) {
+        if (!fgets(line, sizeof(line), input)) {
+            fprintf(stderr, "Error: the trace has only %llu lines\n", index);
+            return 0;
+        }
+    }
+
+    char* buffer = (char*)malloc(OUTPUT_BUFFER_SIZE);
+    if (buffer == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+
+    Trace_State state;
+    memset(&state, 0, sizeof(state));
+    size_t used = 0;
+    int ok = 1;
+    for (; count != 0 && fgets(line, sizeof(line), input); index++) {
+        unsigned int pc;
+        char instruction[HEX_INSTRUCTION_LENGTH + 1];
+        if (!decode_line(line, &state, &pc, instruction)) {
+            fprintf(stderr, "Error: malformed delta trace line %llu: %s", index, line);
+            ok = 0;
+            break;
+        }
+        if (index < first) {
+            continue;
+        }
+        used += format_line(buffer + used, pc, instruction, state.registers);
+        if (used > OUTPUT_BUFFER_SIZE - LINE_SIZE) {
+            fwrite(buffer, 1, used, output);
+            used = 0;
+        }
+        if (count > 0) {
+            count--;
+        }
+    }
+    fwrite(buffer, 1, used, output);
+    free(buffer);
+    return ok;
+}
+
+
+int main(int argc, char* argv[]){
+
+    unsigned long long first = 0;
+    long long count = -1;
+
+    if (argc < 3 || argc % 2 == 0) {
+        fprintf(stderr, "Usage: %s <delta trace> <trace.txt> [-from LINE] [-count LINES]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 3; i < argc; i += 2) {
+        if (strcmp(argv[i], "-from") == 0) {
+            first = strtoull(argv[i + 1], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-count") == 0) {
+            count = strtoll(argv[i + 1], NULL, 10);
+        }
+        else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE* input = fopen(argv[1], "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error opening file %s\n", argv[1]);
+        return 1;
+    }
+    FILE* output = fopen(argv[2], "w");
+    if (output == NULL) {
+        fprintf(stderr, "Error opening file %s\n", argv[2]);
+        fclose(input);
+        return 1;
+    }
+
+    int ok = decode_trace(input, output, first, count);
+    fclose(input);
+    fclose(output);
+    return ok ? 0 : 1;
+}